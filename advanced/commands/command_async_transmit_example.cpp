@@ -0,0 +1,70 @@
+/**
+ * This file demonstrates sending commands from a separate transmitter thread,
+ * so that a fixed-rate control loop doesn't wait on command serialization and
+ * the network.  The loop fills in a command frame and hands it off; the
+ * transmitter sends the newest frame as soon as it can.
+ */
+
+#include <math.h>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "lookup.hpp"
+#include "util/command_transmitter.hpp"
+
+int main(int argc, char* argv[])
+{
+  // Try and get the requested group.
+  std::shared_ptr<hebi::Group> group;
+  {
+    hebi::Lookup lookup;
+    group = lookup.getGroupFromNames({"X5-4"}, {"X5-0000"});
+    if (!group)
+    {
+      std::cout << "No group found!" << std::endl;
+      return -1;
+    }
+  }
+
+  int num_modules = group->size();
+
+  // Pin the transmitter thread to the last CPU, away from the control loop.
+  hebi::util::CommandTransmitter transmitter(group, hebi::util::CommandTransmitter::lastCpu());
+  if (!transmitter.isPinned())
+    std::cout << "Could not pin the transmitter thread; continuing anyway." << std::endl;
+
+  // Fields left as NaN are not sent.
+  hebi::util::CommandFrame frame(num_modules);
+
+  // Run a 200 Hz control loop for 10 seconds.
+  auto period = std::chrono::milliseconds(5);
+  auto start = std::chrono::steady_clock::now();
+  auto next_tick = start;
+  for (int tick = 0; tick < 2000; ++tick)
+  {
+    double t = std::chrono::duration<double>(next_tick - start).count();
+    for (int module_index = 0; module_index < num_modules; module_index++)
+    {
+      // Offset each module with respect to the others.
+      frame.positions_[module_index] = sin(t * 0.5 + module_index * 0.25);
+      frame.velocities_[module_index] = 0.5 * cos(t * 0.5 + module_index * 0.25);
+    }
+
+    // Never blocks; if the previous frame hasn't been sent yet, it is replaced.
+    transmitter.submit(frame);
+
+    next_tick += period;
+    std::this_thread::sleep_until(next_tick);
+  }
+
+  auto stats = transmitter.getStatistics();
+  std::cout << "Submitted " << stats.submitted_ << " frames, sent " << stats.sent_
+            << " (" << stats.superseded_ << " superseded)." << std::endl;
+  std::cout << "Handoff to send (us): mean " << stats.mean_handoff_us_
+            << ", max " << stats.max_handoff_us_ << std::endl;
+  std::cout << "Send (us): mean " << stats.mean_send_us_
+            << ", max " << stats.max_send_us_ << std::endl;
+
+  return 0;
+}
@@ -1,5 +1,7 @@
 /**
- * This file demonstrates the ability to set the spring constants.
+ * This file demonstrates the ability to set the spring constants.  The current
+ * settings are read through an InfoCache, which keeps the group's info up to
+ * date in the background and answers queries without blocking.
  */
 
 #include <stdio.h>
@@ -10,11 +12,27 @@
 #include "command.hpp"
 #include "mac_address.hpp"
 #include "lookup_helpers.cpp"
+#include "util/info_cache.hpp"
+
+// Print the spring constants (and how old that information is) from the cache.
+static void printSpringConstants(const hebi::util::InfoCache& cache, int group_id, int num_modules)
+{
+  std::cout << "Spring constants:";
+  for (int module_index = 0; module_index < num_modules; module_index++)
+  {
+    auto cached = cache.get(group_id, module_index);
+    if (cached.valid_ && !std::isnan(cached.settings_.spring_constant_))
+      std::cout << " " << cached.settings_.spring_constant_ << " (" << cached.age_s_ << " s old)";
+    else
+      std::cout << " (no data)";
+  }
+  std::cout << std::endl;
+}
 
 int main(int argc, char* argv[])
 {
   // Try and get the requested group.
-  std::unique_ptr<hebi::Group> group = getGroupFromArgs(argc, argv);
+  std::shared_ptr<hebi::Group> group = getGroupFromArgs(argc, argv);
   if (!group)
   {
     std::cout << "No group found!" << std::endl;
@@ -27,22 +45,13 @@ int main(int argc, char* argv[])
   hebi::GroupCommand command(num_modules);
 
   long timeout_ms = 1000;
-  hebi::GroupInfo info_orig(num_modules);
+  hebi::util::InfoCache cache;
+  int group_id = cache.addGroup(group, std::chrono::milliseconds(1000), timeout_ms);
 
   std::cout << "Getting current spring constants." << std::endl;
-  if (group->requestInfo(info_orig, timeout_ms))
+  if (cache.waitForRefresh(group_id, timeout_ms))
   {
-    // Print out the spring constants
-    std::cout << "Spring constants:";
-    for (int module_index = 0; module_index < num_modules; module_index++)
-    {
-      auto& spring_constant = info_orig[module_index].settings().actuator().springConstant();
-      if (spring_constant.has())
-        std::cout << " " << spring_constant.get();
-      else
-        std::cout << " (no data)";
-    }
-    std::cout << std::endl;
+    printSpringConstants(cache, group_id, num_modules);
   }
   else
   {
@@ -50,6 +59,10 @@ int main(int argc, char* argv[])
     std::cout << "Get failed!" << std::endl << "Quitting early..." << std::endl;
     return -1;
   }
+  // Keep a copy of the original values so we can restore them later.
+  std::vector<hebi::util::CachedModuleSettings> settings_orig;
+  for (int module_index = 0; module_index < num_modules; module_index++)
+    settings_orig.push_back(cache.get(group_id, module_index));
 
   // Set the spring constants:
   printf("Setting spring constants to 1.\n");
@@ -62,7 +75,8 @@ int main(int argc, char* argv[])
     command[module_index].settings().actuator().springConstant().set(new_spring_constant);
   }
 
-  if (group->sendCommandWithAcknowledgement(command, timeout_ms))
+  // Sending through the cache invalidates the cached settings for this group
+  if (cache.sendCommandWithAcknowledgement(group_id, command, timeout_ms))
   {
     std::cout << "Got acknowledgement." << std::endl;
   }
@@ -71,27 +85,12 @@ int main(int argc, char* argv[])
     std::cout << "Did not receive acknowledgement!" << std::endl;
   }
 
-  // Checking spring constant (use new info message so we don't lose old values)
-  hebi::GroupInfo info_new(num_modules);
+  // Checking spring constant (wait for the cache to pick up the new values)
   std::cout << "Getting new spring constants:" << std::endl;
-  if (group->requestInfo(info_new, timeout_ms))
-  {
-    // Print out the spring constants
-    std::cout << "Spring constants:";
-    for (int module_index = 0; module_index < num_modules; module_index++)
-    {
-      auto& spring_constant = info_orig[module_index].settings().actuator().springConstant();
-      if (spring_constant.has())
-        std::cout << " " << spring_constant.get();
-      else
-        std::cout << " (no data)";
-    }
-    std::cout << std::endl;
-  }
+  if (cache.waitForRefresh(group_id, timeout_ms))
+    printSpringConstants(cache, group_id, num_modules);
   else
-  {
     std::cout << "Get failed!" << std::endl;
-  }
 
   // Reset the spring constants:
   std::cout << "Resetting spring constants to previous values." << std::endl;
@@ -100,10 +99,10 @@ int main(int argc, char* argv[])
     // Set the spring constant for this module to the previous value, or nothing
     // if we didn't get it back before (this is reading from the previously
     // received info packet)
-    auto& orig_spring_constant = info_orig[module_index].settings().actuator().springConstant();
-    if (orig_spring_constant.has())
+    const auto& orig = settings_orig[module_index];
+    if (orig.valid_ && !std::isnan(orig.settings_.spring_constant_))
     {
-      command[module_index].settings().actuator().springConstant().set(orig_spring_constant.get());
+      command[module_index].settings().actuator().springConstant().set(orig.settings_.spring_constant_);
     }
     else
     {
@@ -112,7 +111,7 @@ int main(int argc, char* argv[])
     }
   }
 
-  if (group->sendCommandWithAcknowledgement(command, timeout_ms))
+  if (cache.sendCommandWithAcknowledgement(group_id, command, timeout_ms))
   {
     std::cout << "Got acknowledgement." << std::endl;
   }
@@ -2,12 +2,18 @@
  * This file demonstrates master-slave control from one module to another, with
  * the feedback loop handled by the API. There must be two modules in the group;
  * the first one controls the second.
+ *
+ * The feedback is handled in "latest wins" mode: the API's feedback thread
+ * only stores the newest master positions, and a worker thread commands the
+ * slave from the latest ones.  If sending the command falls behind the
+ * feedback rate, stale packets are skipped instead of queueing up.
  */
 
 #include "lookup.hpp"
 #include "group.hpp"
 #include "group_command.hpp"
 #include "group_feedback.hpp"
+#include "util/conflating_feedback_handler.hpp"
 #include <chrono>
 #include <thread>
 
@@ -37,12 +43,18 @@ int main(int argc, char* argv[])
 
   // Add a feedback handler to send feedback from one module to control the
   // other
-  master->addFeedbackHandler(
-    [&master, &slave, &cmd](const hebi::GroupFeedback& feedback)->void
+  hebi::util::ConflatingFeedbackHandler<Eigen::VectorXd> handler(
+    [](const hebi::GroupFeedback& feedback, Eigen::VectorXd& positions)->void
       {
-        cmd.setPosition(feedback.getPosition());
+        feedback.getPosition(positions);
+      },
+    [&slave, &cmd](const Eigen::VectorXd& positions)->void
+      {
+        cmd.setPosition(positions);
         slave->sendCommand(cmd);
-      });
+      },
+    Eigen::VectorXd::Zero(master->size()));
+  handler.attach(*master);
 
   // Start feedback callbacks
   master->setFeedbackFrequencyHz(200);
@@ -52,6 +64,12 @@ int main(int argc, char* argv[])
   // Stop the async callback before returning and deleting objects.
   master->setFeedbackFrequencyHz(0);
   master->clearFeedbackHandlers();
+  handler.stop();
+
+  auto stats = handler.getStatistics();
+  std::cout << "Received " << stats.received_ << " feedback packets, sent "
+            << stats.processed_ << " commands (" << stats.skipped_
+            << " stale packets skipped)." << std::endl;
 
   // NOTE: destructors automatically clean up remaining objects
   return 0;
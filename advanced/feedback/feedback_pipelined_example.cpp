@@ -0,0 +1,63 @@
+/**
+ * This file demonstrates polling feedback from a group with several requests
+ * in flight at once, rather than waiting for each response before sending the
+ * next request.  This is useful for groups that can't be set to stream
+ * feedback at a fixed frequency.
+ */
+
+#include "lookup.hpp"
+#include "group_feedback.hpp"
+#include "util/feedback_poller.hpp"
+#include <chrono>
+#include <iostream>
+
+int main(int argc, char* argv[])
+{
+  // Try and get the requested group.
+  std::shared_ptr<hebi::Group> group;
+  {
+    hebi::Lookup lookup;
+    group = lookup.getGroupFromNames({"X5-4"}, {"X5-0000"});
+    if (!group)
+    {
+      std::cout << "No group found!" << std::endl;
+      return -1;
+    }
+  }
+
+  // Keep up to 4 feedback requests outstanding at once.  (This also turns off
+  // the group's feedback streaming, so only responses are received.)
+  size_t max_outstanding = 4;
+  hebi::util::PipelinedFeedbackPoller poller(group, max_outstanding);
+  poller.start();
+
+  // Print out the position of the first module for a few seconds, handling
+  // responses as quickly as they arrive.
+  long timeout_ms = 1000;
+  auto start = std::chrono::steady_clock::now();
+  size_t num_received = 0;
+  while (std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+  {
+    const hebi::GroupFeedback* feedback = poller.waitForFeedback(timeout_ms);
+    if (!feedback)
+    {
+      std::cout << "Received no feedback from group!" << std::endl;
+      continue;
+    }
+    if (num_received++ % 100 == 0)
+      std::cout << "Position: " << (*feedback)[0].actuator().position().get() << std::endl;
+    // Done with this feedback -- return the slot to the poller.
+    poller.release();
+  }
+  poller.stop();
+
+  auto stats = poller.getStatistics();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "Received " << stats.responses_ << " responses to " << stats.requests_
+            << " requests (" << stats.responses_ / elapsed.count() << " Hz); "
+            << stats.lost_ << " lost, " << stats.dropped_ << " dropped, mean round trip "
+            << stats.mean_rtt_s_ * 1000.0 << " ms." << std::endl;
+
+  // NOTE: destructors automatically clean up remaining objects
+  return 0;
+}
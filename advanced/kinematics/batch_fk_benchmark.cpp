@@ -0,0 +1,92 @@
+/**
+ * This file measures forward kinematics over many random joint configurations
+ * of an arm (as when checking its workspace), using:
+ *  - hebi::robot_model::RobotModel::getEndEffector, one configuration per call,
+ *  - util::BatchForwardKinematics on one thread, and
+ *  - util::BatchForwardKinematics on every core.
+ *
+ * It checks that the results agree, and prints the bounding box of the sampled
+ * workspace.  Build with -DHEBI_EXAMPLES_AVX2=ON to use the AVX2 code path.  No
+ * modules are needed.
+ *
+ * Usage: batch_fk_benchmark [hrdf file] [number of configurations]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "Eigen/Dense"
+#include "robot_model.hpp"
+#include "util/batch_fk.hpp"
+
+using clock_type = std::chrono::steady_clock;
+
+// Average time per configuration [ns]
+template<typename Function>
+double timePerConfiguration(Eigen::Index num_configs, Function function)
+{
+  auto start = clock_type::now();
+  function();
+  return std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / num_configs;
+}
+
+int main(int argc, char* argv[])
+{
+  std::string hrdf_file = argc > 1 ? argv[1] : "hrdf/6-DoF_arm_example.hrdf";
+  Eigen::Index num_configs = argc > 2 ? std::stol(argv[2]) : 100000;
+
+  auto model = hebi::robot_model::RobotModel::loadHRDF(hrdf_file);
+  if (!model)
+  {
+    std::cout << "Could not load HRDF " << hrdf_file << "!" << std::endl;
+    return -1;
+  }
+  auto batch_fk = hebi::util::BatchForwardKinematics::create(*model);
+  if (!batch_fk)
+  {
+    std::cout << "Batch FK only supports serial chains of actuators!" << std::endl;
+    return -1;
+  }
+
+  Eigen::MatrixXd positions = Eigen::MatrixXd::Random(model->getDoFCount(), num_configs) * M_PI;
+
+  // One configuration at a time
+  Eigen::MatrixXd reference(3, num_configs);
+  Eigen::VectorXd config(model->getDoFCount());
+  Eigen::Matrix4d transform;
+  double model_ns = timePerConfiguration(num_configs, [&]()
+  {
+    for (Eigen::Index k = 0; k < num_configs; ++k)
+    {
+      config = positions.col(k);
+      model->getEndEffector(config, transform);
+      reference.col(k) = transform.topRightCorner<3, 1>();
+    }
+  });
+
+  Eigen::MatrixXd poses;
+  double single_ns = timePerConfiguration(num_configs, [&]() { batch_fk->getEndEffector(positions, poses, 1); });
+  double threaded_ns = timePerConfiguration(num_configs, [&]() { batch_fk->getEndEffector(positions, poses); });
+
+  // Translation is in rows 9-11
+  Eigen::MatrixXd points = poses.bottomRows<3>();
+  double max_difference = (points - reference).cwiseAbs().maxCoeff();
+
+  std::cout << num_configs << " configurations of " << hrdf_file << " (" << model->getDoFCount() << " DoF):" << std::endl
+            << std::fixed << std::setprecision(1)
+            << "  RobotModel::getEndEffector:       " << model_ns << " ns/configuration" << std::endl
+            << "  batch FK, 1 thread:               " << single_ns << " ns/configuration" << std::endl
+            << "  batch FK, every core:             " << threaded_ns << " ns/configuration" << std::endl
+            << std::scientific << std::setprecision(1)
+            << "  max difference from RobotModel:   " << max_difference << " m" << std::endl
+            << std::fixed << std::setprecision(3)
+            << "  workspace x: [" << points.row(0).minCoeff() << ", " << points.row(0).maxCoeff() << "] m" << std::endl
+            << "            y: [" << points.row(1).minCoeff() << ", " << points.row(1).maxCoeff() << "] m" << std::endl
+            << "            z: [" << points.row(2).minCoeff() << ", " << points.row(2).maxCoeff() << "] m" << std::endl;
+
+  return max_difference < 1e-9 ? 0 : 1;
+}
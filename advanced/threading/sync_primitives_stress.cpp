@@ -0,0 +1,304 @@
+/**
+ * This file stress tests the thread handoff primitives in util/ (Seqlock,
+ * AtomicSnapshot, SpscRing, TripleBuffer and PiMutex), and shows the intended
+ * use of each.  Each test runs its threads flat out for a while, checks that
+ * no reader ever saw a torn, reordered or lost value, and reports how often
+ * the non-blocking calls had to retry or fail.  No modules are needed.
+ *
+ * To check the primitives for data races as well, build this with
+ * ThreadSanitizer, e.g. from projects/cmake:
+ *
+ *   cmake -DCMAKE_CXX_FLAGS=-fsanitize=thread -DCMAKE_EXE_LINKER_FLAGS=-fsanitize=thread .
+ *
+ * Returns non-zero if any check failed.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "util/atomic_snapshot.hpp"
+#include "util/pi_mutex.hpp"
+#include "util/seqlock.hpp"
+#include "util/spsc_ring.hpp"
+#include "util/trace.hpp"
+#include "util/triple_buffer.hpp"
+
+using namespace hebi::util;
+using clock_type = std::chrono::steady_clock;
+
+// A value whose fields must always agree; a reader seeing a mix of two
+// writes would notice.
+struct Sample
+{
+  uint64_t sequence_;
+  double values_[5];
+
+  void set(uint64_t sequence)
+  {
+    sequence_ = sequence;
+    for (int i = 0; i < 5; ++i)
+      values_[i] = static_cast<double>(sequence) * (i + 1);
+  }
+
+  bool isConsistent() const
+  {
+    for (int i = 0; i < 5; ++i)
+      if (values_[i] != static_cast<double>(sequence_) * (i + 1))
+        return false;
+    return true;
+  }
+};
+
+// Two counters that are always updated together.
+struct CounterPair
+{
+  uint32_t count_;
+  uint32_t twice_;
+};
+
+bool report(const std::string& name, bool ok, const std::string& details)
+{
+  std::cout << (ok ? "[ ok ] " : "[FAIL] ") << name << ": " << details << std::endl;
+  return ok;
+}
+
+// One writer, several readers polling the latest sample (e.g. a feedback
+// thread sharing the gravity estimate with a control thread).
+bool testSeqlock(std::chrono::milliseconds duration, int num_readers)
+{
+  Sample initial;
+  initial.set(0);
+  Seqlock<Sample> latest(initial);
+  std::atomic<bool> done{false};
+  std::atomic<uint64_t> torn{0}, backwards{0}, loads{0}, retries{0};
+
+  std::vector<std::thread> readers;
+  for (int r = 0; r < num_readers; ++r)
+  {
+    readers.emplace_back([&]
+    {
+      uint64_t last = 0, my_loads = 0, my_retries = 0;
+      Sample sample;
+      while (!done.load(std::memory_order_relaxed))
+      {
+        if (!latest.tryLoad(sample))
+        {
+          ++my_retries;
+          continue;
+        }
+        ++my_loads;
+        if (!sample.isConsistent())
+          torn.fetch_add(1);
+        if (sample.sequence_ < last)
+          backwards.fetch_add(1);
+        last = sample.sequence_;
+      }
+      loads.fetch_add(my_loads);
+      retries.fetch_add(my_retries);
+    });
+  }
+
+  uint64_t writes = 0;
+  auto end = clock_type::now() + duration;
+  Sample sample;
+  while (clock_type::now() < end)
+  {
+    sample.set(++writes);
+    latest.store(sample);
+  }
+  done = true;
+  for (auto& reader : readers)
+    reader.join();
+
+  bool ok = torn == 0 && backwards == 0 && latest.getVersion() == writes && latest.load().sequence_ == writes;
+  return report("Seqlock", ok, std::to_string(writes) + " writes, " + std::to_string(loads) + " loads, " +
+    std::to_string(retries) + " retries, " + std::to_string(torn) + " torn, " +
+    std::to_string(backwards) + " out of order");
+}
+
+// Several threads updating a small struct together (e.g. flags or a pair of
+// joystick axes).
+bool testAtomicSnapshot(int num_threads, int updates_per_thread)
+{
+  AtomicSnapshot<CounterPair> counters(CounterPair{0, 0});
+  std::atomic<uint64_t> mismatched{0};
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t)
+  {
+    threads.emplace_back([&]
+    {
+      for (int i = 0; i < updates_per_thread; ++i)
+      {
+        counters.update([] (CounterPair pair) { return CounterPair{pair.count_ + 1, pair.twice_ + 2}; });
+        CounterPair pair = counters.load();
+        if (pair.twice_ != 2 * pair.count_)
+          mismatched.fetch_add(1);
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  CounterPair final_pair = counters.load();
+  uint32_t expected = static_cast<uint32_t>(num_threads * updates_per_thread);
+  bool ok = mismatched == 0 && final_pair.count_ == expected && final_pair.twice_ == 2 * expected;
+  return report("AtomicSnapshot", ok, std::to_string(final_pair.count_) + " of " + std::to_string(expected) +
+    " updates, " + std::to_string(mismatched) + " inconsistent loads");
+}
+
+// Every item from one thread to another, in order (e.g. events or log
+// records); the producer drops items when the consumer falls behind.
+bool testSpscRing(std::chrono::milliseconds duration)
+{
+  SpscRing<Sample, 256> ring;
+  std::atomic<bool> done{false};
+  uint64_t popped = 0, torn = 0, gaps = 0, empty = 0;
+
+  std::thread consumer([&]
+  {
+    Sample sample;
+    uint64_t expected = 1;
+    while (true)
+    {
+      if (!ring.tryPop(sample))
+      {
+        if (done.load(std::memory_order_acquire) && ring.empty())
+          break;
+        ++empty;
+        continue;
+      }
+      ++popped;
+      if (!sample.isConsistent())
+        ++torn;
+      if (sample.sequence_ != expected)
+        ++gaps;
+      expected = sample.sequence_ + 1;
+    }
+  });
+
+  uint64_t pushed = 0, full = 0;
+  auto end = clock_type::now() + duration;
+  Sample sample;
+  while (clock_type::now() < end)
+  {
+    sample.set(pushed + 1);
+    if (ring.tryPush(sample))
+      ++pushed;
+    else
+      ++full;
+  }
+  done.store(true, std::memory_order_release);
+  consumer.join();
+
+  bool ok = torn == 0 && gaps == 0 && popped == pushed;
+  return report("SpscRing", ok, std::to_string(pushed) + " pushed, " + std::to_string(popped) + " popped, " +
+    std::to_string(full) + " full, " + std::to_string(empty) + " empty, " + std::to_string(torn) + " torn, " +
+    std::to_string(gaps) + " out of order");
+}
+
+// The latest value from one thread to another (e.g. commands to a
+// transmitter thread); intermediate values may be skipped.
+bool testTripleBuffer(std::chrono::milliseconds duration)
+{
+  Sample initial;
+  initial.set(0);
+  TripleBuffer<Sample> buffer(initial);
+  std::atomic<bool> done{false};
+  std::atomic<uint64_t> writes{0};
+  uint64_t reads = 0, torn = 0, backwards = 0, last = 0;
+
+  std::thread reader([&]
+  {
+    while (!done.load(std::memory_order_acquire))
+    {
+      if (!buffer.update())
+        continue;
+      const Sample& sample = buffer.getReadBuffer();
+      ++reads;
+      if (!sample.isConsistent())
+        ++torn;
+      if (sample.sequence_ <= last)
+        ++backwards;
+      last = sample.sequence_;
+    }
+    buffer.update();
+    last = buffer.getReadBuffer().sequence_;
+  });
+
+  uint64_t sequence = 0;
+  auto end = clock_type::now() + duration;
+  while (clock_type::now() < end)
+  {
+    buffer.getWriteBuffer().set(++sequence);
+    buffer.publish();
+  }
+  writes = sequence;
+  done.store(true, std::memory_order_release);
+  reader.join();
+
+  bool ok = torn == 0 && backwards == 0 && last == writes;
+  return report("TripleBuffer", ok, std::to_string(writes) + " writes, " + std::to_string(reads) + " reads, " +
+    std::to_string(torn) + " torn, " + std::to_string(backwards) + " out of order");
+}
+
+// Shared state edited under a lock by several threads (e.g. a UI thread and a
+// control thread).
+bool testPiMutex(int num_threads, int increments_per_thread)
+{
+  PiMutex mutex;
+  uint64_t counter = 0; // protected by 'mutex'
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t)
+  {
+    threads.emplace_back([&, t]
+    {
+      for (int i = 0; i < increments_per_thread; ++i)
+      {
+        // Mix the ways of locking it.
+        if (t % 2 == 0)
+        {
+          std::lock_guard<PiMutex> lock(mutex);
+          ++counter;
+        }
+        else
+        {
+          auto lock = tracedLock(mutex, "wait mutex");
+          ++counter;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  uint64_t expected = static_cast<uint64_t>(num_threads) * increments_per_thread;
+  bool ok = counter == expected;
+  return report("PiMutex", ok, std::to_string(counter) + " of " + std::to_string(expected) + " increments (" +
+    (mutex.hasPriorityInheritance() ? "with" : "without") + " priority inheritance)");
+}
+
+int main(int argc, char* argv[])
+{
+  std::chrono::milliseconds duration(1000);
+  if (argc > 1)
+    duration = std::chrono::milliseconds(static_cast<int>(std::stod(argv[1]) * 1000));
+  int num_threads = std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+
+  std::cout << "Running each test for " << duration.count() << " ms with up to " << num_threads << " threads..." << std::endl;
+  bool ok = true;
+  ok = testSeqlock(duration, num_threads - 1) && ok;
+  ok = testAtomicSnapshot(num_threads, 100000) && ok;
+  ok = testSpscRing(duration) && ok;
+  ok = testTripleBuffer(duration) && ok;
+  ok = testPiMutex(num_threads, 100000) && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+/**
+ * This file measures how long it takes to create the short, fixed-grid
+ * trajectories that legged robots plan over and over (a three-waypoint step,
+ * and a five-waypoint startup move), using:
+ *  - hebi::trajectory::Trajectory::createUnconstrainedQp,
+ *  - util::QuinticSplineBuilder, solving each system from scratch, and
+ *  - util::QuinticSplineBuilder, reusing the cached system for the grid.
+ *
+ * It also compares the resulting trajectories, which should be the same
+ * minimum-jerk splines.  No modules are needed.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "Eigen/Dense"
+#include "trajectory.hpp"
+#include "util/quintic_spline.hpp"
+
+using clock_type = std::chrono::steady_clock;
+
+struct Waypoints
+{
+  Eigen::VectorXd times;
+  Eigen::MatrixXd positions;
+  Eigen::MatrixXd velocities;
+  Eigen::MatrixXd accelerations;
+};
+
+// A leg step: lift off with a given velocity, free through the high point,
+// and touch down moving with the stance.
+Waypoints makeStep(int num_joints)
+{
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  Waypoints w;
+  w.times.resize(3);
+  w.times << 0, 0.35, 0.7;
+  w.positions = Eigen::MatrixXd::Random(num_joints, 3);
+  w.velocities = Eigen::MatrixXd::Random(num_joints, 3) * 0.2;
+  w.accelerations = Eigen::MatrixXd::Zero(num_joints, 3);
+  w.velocities.col(1).setConstant(nan);
+  w.accelerations.col(1).setConstant(nan);
+  return w;
+}
+
+// A startup move: stopped at the ends, free at the lift/place points.
+Waypoints makeStartup(int num_joints)
+{
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  Waypoints w;
+  w.times.resize(5);
+  w.times << 0, 0.75, 1.5, 2.25, 3.0;
+  w.positions = Eigen::MatrixXd::Random(num_joints, 5);
+  w.velocities = Eigen::MatrixXd::Zero(num_joints, 5);
+  w.accelerations = Eigen::MatrixXd::Zero(num_joints, 5);
+  for (int i : {1, 3})
+  {
+    w.velocities.col(i).setConstant(nan);
+    w.accelerations.col(i).setConstant(nan);
+  }
+  return w;
+}
+
+// Average time to create one trajectory from each set of waypoints [us]
+template<typename CreateFunction>
+double timeCreation(const std::vector<Waypoints>& waypoints, int repetitions, CreateFunction create)
+{
+  size_t created = 0;
+  auto start = clock_type::now();
+  for (int r = 0; r < repetitions; ++r)
+    for (auto& w : waypoints)
+      created += create(w) ? 1 : 0;
+  double elapsed = std::chrono::duration<double, std::micro>(clock_type::now() - start).count();
+  return elapsed / static_cast<double>(created);
+}
+
+// Largest position/velocity difference between the two trajectories
+template<typename TrajectoryA, typename TrajectoryB>
+double maxDifference(const TrajectoryA& a, const TrajectoryB& b, double start, double end)
+{
+  double max_difference = 0;
+  Eigen::VectorXd pa, va, aa, pb, vb, ab;
+  for (int i = 0; i <= 200; ++i)
+  {
+    double t = start + (end - start) * i / 200.0;
+    a.getState(t, &pa, &va, &aa);
+    b.getState(t, &pb, &vb, &ab);
+    max_difference = std::max(max_difference, (pa - pb).cwiseAbs().maxCoeff());
+    max_difference = std::max(max_difference, (va - vb).cwiseAbs().maxCoeff());
+  }
+  return max_difference;
+}
+
+void benchmark(const char* name, Waypoints (*make)(int))
+{
+  const int num_joints = 3;
+  const int num_sets = 100;
+  const int repetitions = 200;
+
+  std::vector<Waypoints> waypoints;
+  for (int i = 0; i < num_sets; ++i)
+    waypoints.push_back(make(num_joints));
+
+  hebi::util::QuinticSplineBuilder builder;
+  double hebi_us = timeCreation(waypoints, repetitions, [](const Waypoints& w) {
+    return static_cast<bool>(hebi::trajectory::Trajectory::createUnconstrainedQp(
+      w.times, w.positions, &w.velocities, &w.accelerations));
+  });
+  double uncached_us = timeCreation(waypoints, repetitions, [](const Waypoints& w) {
+    return static_cast<bool>(hebi::util::QuinticSplineBuilder::createUncached(
+      w.times, w.positions, &w.velocities, &w.accelerations));
+  });
+  double cached_us = timeCreation(waypoints, repetitions, [&builder](const Waypoints& w) {
+    return static_cast<bool>(builder.create(w.times, w.positions, &w.velocities, &w.accelerations));
+  });
+
+  double max_difference = 0;
+  for (auto& w : waypoints)
+  {
+    auto reference = hebi::trajectory::Trajectory::createUnconstrainedQp(
+      w.times, w.positions, &w.velocities, &w.accelerations);
+    auto spline = builder.create(w.times, w.positions, &w.velocities, &w.accelerations);
+    max_difference = std::max(max_difference,
+      maxDifference(*reference, *spline, w.times[0], w.times[w.times.size() - 1]));
+  }
+
+  auto stats = builder.getStatistics();
+  std::cout << name << " (" << waypoints[0].times.size() << " waypoints, " << num_joints << " joints):" << std::endl
+            << std::fixed << std::setprecision(2)
+            << "  createUnconstrainedQp:   " << hebi_us << " us/trajectory" << std::endl
+            << "  spline builder, solved:  " << uncached_us << " us/trajectory" << std::endl
+            << "  spline builder, cached:  " << cached_us << " us/trajectory ("
+            << stats.hits_ << " cache hits, " << stats.misses_ << " misses)" << std::endl
+            << std::scientific << std::setprecision(1)
+            << "  max difference from createUnconstrainedQp (position/velocity): " << max_difference << std::endl;
+}
+
+int main()
+{
+  benchmark("Step", makeStep);
+  benchmark("Startup", makeStartup);
+  return 0;
+}
@@ -6,6 +6,7 @@
 #include "group_command.hpp"
 #include "group_feedback.hpp"
 #include "robot_model.hpp"
+#include "util/command_keep_alive.hpp"
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
@@ -114,16 +115,16 @@ int main()
   //////////////////////////////////////
 
   // Move the arm (note -- could use the Hebi Trajectory API to do this smoothly)
-  GroupCommand group_cmd(group->size());
-  group_cmd.setPosition(ik_result_joint_angles);
-
-  // Note -- the arm will go limp after the 100 ms command lifetime, so we repeat
-  // the command in a loop here until we terminate after approximately 5 seconds.
-  for (int i = 0; i < 100; ++i)
-  {
-    group->sendCommand(group_cmd);
-    std::this_thread::sleep_for(std::chrono::milliseconds(50));
-  }
+  util::CommandFrame frame(group->size());
+  frame.positions_ = ik_result_joint_angles;
+
+  // Note -- the arm will go limp after the 100 ms command lifetime, so the
+  // keep alive thread repeats the command until we terminate after
+  // approximately 5 seconds.
+  util::CommandKeepAlive keep_alive;
+  int arm = keep_alive.addGroup(group, 100);
+  keep_alive.setCommand(arm, frame);
+  std::this_thread::sleep_for(std::chrono::seconds(5));
 
   return 0;
 }
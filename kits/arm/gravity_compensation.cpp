@@ -5,12 +5,18 @@
  * the torque sensing and modeled system can lead to "drift".  Also, the
  * particular choice of PID control gains can affect the performance of this
  * demo.
+ *
+ * Feedback is handled in "latest wins" mode: the API's feedback thread only
+ * stores the newest positions and base accelerometer reading, and a worker
+ * thread computes and sends efforts for the latest ones, so a slow computation
+ * skips stale packets rather than falling further and further behind.
  */
 
 #include "group.hpp"
 #include "group_command.hpp"
 #include "group_feedback.hpp"
 #include "util/grav_comp.hpp"
+#include "util/conflating_feedback_handler.hpp"
 #include "arm_container.hpp"
 #include <chrono>
 #include <thread>
@@ -25,24 +31,46 @@ int main(int argc, char* argv[])
     return -1;
 
   hebi::GroupCommand cmd(arm->getGroup().size());
-  Eigen::Vector3d gravity(0, 0, -1);
- 
-  // Respond to every feedback packet with an effort command to cancel the
+
+  // What the effort computation needs from each feedback packet
+  struct ArmState
+  {
+    Eigen::VectorXd positions_;
+    Eigen::Vector3d gravity_;
+  };
+  ArmState initial_state { Eigen::VectorXd::Zero(arm->getGroup().size()), Eigen::Vector3d(0, 0, -1) };
+
+  // Respond to the latest feedback packet with an effort command to cancel the
   // force due to gravity at this pose.
-  arm->getGroup().addFeedbackHandler(
-    [&arm, &gravity, &cmd](const hebi::GroupFeedback& feedback)->void
+  hebi::util::ConflatingFeedbackHandler<ArmState> handler(
+    [](const hebi::GroupFeedback& feedback, ArmState& state)->void
+      {
+        feedback.getPosition(state.positions_);
+        // Update gravity from base module:
+        auto base_accel = feedback[0].imu().accelerometer().get();
+        state.gravity_ = Eigen::Vector3d(-base_accel.getX(), -base_accel.getY(), -base_accel.getZ());
+      },
+    [&arm, &cmd](const ArmState& state)->void
       {
         Eigen::VectorXd effort = hebi::util::GravityCompensation::getEfforts(
           arm->getRobotModel(),
           arm->getMasses(),
-          feedback);
+          state.positions_,
+          state.gravity_);
         cmd.setEffort(effort);
         arm->getGroup().sendCommand(cmd);
-      });
+      },
+    initial_state);
+  handler.attach(arm->getGroup());
 
   // Run for 60 seconds
   std::this_thread::sleep_for(std::chrono::seconds(60));
   arm->getGroup().clearFeedbackHandlers();
+  handler.stop();
+
+  auto stats = handler.getStatistics();
+  std::cout << "Processed " << stats.processed_ << " of " << stats.received_
+            << " feedback packets (" << stats.skipped_ << " stale packets skipped)." << std::endl;
 
   return 0;
 }
@@ -1,6 +1,8 @@
 #include "util/input.hpp"
 #include "util/grav_comp.hpp"
+#include "util/pi_mutex.hpp"
 #include "util/trajectory_time_heuristic.hpp"
+#include "util/trace.hpp"
 #include "arm_container.hpp"
 #include "group_feedback.hpp"
 #include "group_command.hpp"
@@ -49,9 +51,11 @@ struct State
 };
 
 /**
- * Protects the "State" object across multiple control threads.
+ * Protects the "State" object across multiple control threads.  Uses priority
+ * inheritance, so the input thread can't hold up the command thread for long
+ * while holding it.
  */
-std::mutex state_mutex;
+hebi::util::PiMutex state_mutex;
 
 std::shared_ptr<hebi::trajectory::Trajectory> buildTrajectory(State& state)
 {
@@ -89,17 +93,25 @@ static void commandProc(State* state)
   Mode prev_mode = state->_mode;
   auto start_time = std::chrono::steady_clock::now();
   std::shared_ptr<hebi::trajectory::Trajectory> trajectory;
+  HEBI_TRACE_THREAD_NAME("command");
 
   while (true)
   {
-    if (!group.getNextFeedback(feedback))
+    bool got_feedback;
     {
+      HEBI_TRACE_SCOPE("wait for feedback");
+      got_feedback = group.getNextFeedback(feedback);
+    }
+    if (!got_feedback)
+    {
+      HEBI_TRACE_INSTANT("feedback timeout");
       std::cout << "Did not receive feedback\r\n";
       continue;
     }
 
+    HEBI_TRACE_SCOPE("command tick");
     // Acquire lock for duration of this iteration
-    std::lock_guard<std::mutex> state_lock(state_mutex);
+    auto state_lock = tracedLock(state_mutex, "wait state_mutex");
     if (state->_quit)
       break;
 
@@ -116,6 +128,7 @@ static void commandProc(State* state)
       // First time!
       if (prev_mode != Mode::Playback)
       {
+        HEBI_TRACE_SCOPE("build trajectory");
         trajectory = buildTrajectory(*state);
 
         // Reset time
@@ -180,6 +193,13 @@ static void clearWaypoints(State& state)
  */
 int main(int argc, char* argv[])
 {
+  // Optionally record a timeline trace: "teach_repeat -t <file>"
+  std::string trace_file;
+  if (argc == 3 && std::string(argv[1]) == "-t")
+    trace_file = argv[2];
+  Tracer::get().setEnabled(!trace_file.empty());
+  HEBI_TRACE_THREAD_NAME("input");
+
   // Loads the arm configuration -- modify this line to use your own
   // configuration (see kits/arm/arm_container.hpp).
   std::unique_ptr<hebi::ArmContainer> arm = hebi::ArmContainer::create3Dof();
@@ -198,8 +218,9 @@ int main(int argc, char* argv[])
   char res = '\0';
   while ((res = Input::getChar()) != 'q')
   {
+    HEBI_TRACE_SCOPE("input action");
     // Acquire lock for duration of action step
-    std::lock_guard<std::mutex> state_lock(state_mutex);
+    auto state_lock = tracedLock(state_mutex, "wait state_mutex");
     std::cout << "\r\n"; // Prettier console output on linux (if echo is enabled)
     if (state._mode == Mode::Training)
     {
@@ -236,9 +257,14 @@ int main(int argc, char* argv[])
       } 
     }
   }
-  state._quit = true;
+  {
+    auto state_lock = tracedLock(state_mutex, "wait state_mutex");
+    state._quit = true;
+  }
   std::cout << "\r\n";
 
   commandThread.join();
+  if (!trace_file.empty() && Tracer::get().writeChromeTrace(trace_file))
+    std::cout << "Wrote trace to " << trace_file << "\r\n";
   return 0;
 }
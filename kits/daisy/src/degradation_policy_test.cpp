@@ -0,0 +1,93 @@
+// Checks the control loop's DegradationPolicy against scripted tick times (no
+// robot needed): a lone overrun after a quiet stretch must shed one level and
+// hold it for the full restore period, and sustained overload must shed work
+// level by level and then restore it one level at a time.
+//
+// Returns 0 if every check passes.
+
+#include "robot/degradation_policy.hpp"
+
+#include <iostream>
+#include <string>
+
+using namespace hebi;
+
+namespace {
+
+const double period_s = 0.005;
+// restore_hold_s / period_s, with the default hold of 2 s
+const int restore_hold_ticks = 400;
+
+int num_failures = 0;
+
+void check(bool condition, const std::string& what)
+{
+  if (!condition)
+  {
+    std::cout << "FAILED: " << what << std::endl;
+    ++num_failures;
+  }
+}
+
+// Runs 'ticks' ticks that each work for 'utilization' of the period; returns
+// the number of level changes.
+int run(DegradationPolicy& policy, int ticks, double utilization)
+{
+  int changes = 0;
+  for (int i = 0; i < ticks; ++i)
+  {
+    DegradationPolicy::Level before = policy.getLevel();
+    if (policy.update(utilization * period_s) != before)
+      ++changes;
+  }
+  return changes;
+}
+
+void testOverrunAfterQuietPeriod()
+{
+  DegradationPolicy policy(period_s);
+  check(run(policy, 2 * restore_hold_ticks, 0.1) == 0, "quiet period changes nothing");
+
+  policy.update(1.5 * period_s);
+  check(policy.getLevel() == DegradationPolicy::Level::NoVisualization,
+        "an overrun after a quiet period sheds one level");
+
+  check(run(policy, restore_hold_ticks - 1, 0.1) == 0,
+        "the shed level is held for the whole restore period");
+  check(run(policy, 1, 0.1) == 1 && policy.getLevel() == DegradationPolicy::Level::Full,
+        "the level is restored once the restore period has passed");
+}
+
+void testSustainedOverload()
+{
+  DegradationPolicy policy(period_s);
+  run(policy, 2000, 0.95);
+  check(policy.getLevel() == DegradationPolicy::Level::ReducedPrecision,
+        "sustained overload sheds every level");
+
+  // The average takes a few ticks to fall below the restore threshold, and
+  // then each level is held for the restore period before the next is restored.
+  int num_levels = static_cast<int>(DegradationPolicy::Level::ReducedPrecision);
+  for (int level = num_levels - 1; level >= 0; --level)
+  {
+    run(policy, restore_hold_ticks + 20, 0.1);
+    check(static_cast<int>(policy.getLevel()) == level,
+          "work is restored one level per restore period (level " + std::to_string(level) + ")");
+  }
+}
+
+} // namespace
+
+int main()
+{
+  testOverrunAfterQuietPeriod();
+  testSustainedOverload();
+
+  if (num_failures > 0)
+  {
+    std::cout << num_failures << " check(s) failed." << std::endl;
+    return 1;
+  }
+  std::cout << "All checks passed." << std::endl;
+  return 0;
+}
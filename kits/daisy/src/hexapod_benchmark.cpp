@@ -0,0 +1,152 @@
+// Runs the hexapod control tick against a dummy robot as fast as possible,
+// with a scripted input profile standing in for the joystick, and reports the
+// sustained tick rate, tick latency percentiles and allocations per tick.
+//
+// The tick matches the walking part of the control loop in hexapod_control.cpp
+// (stance update, stepping, foot forces, IK/torques and command marshaling for
+// each leg); simulated time advances by one control period per tick.  As ticks
+// run faster than real time, the footstep planner thread sees fewer inputs per
+// step than on the robot, so fewer of its plans match; its allocations are
+// included in the counts.
+
+#include "robot/hexapod.hpp"
+#include "robot/footstep_planner.hpp"
+#include "util/tick_benchmark.hpp"
+
+#include <iostream>
+#include <string>
+
+HEBI_BENCHMARK_COUNT_ALLOCATIONS();
+
+using namespace hebi;
+
+namespace {
+
+// One segment of the scripted input profile: joystick commands held for a
+// duration, with mode toggles at its start.
+struct InputSegment
+{
+  double duration_;
+  Eigen::Vector3d translation_velocity_;
+  Eigen::Vector3d rotation_velocity_;
+  int mode_toggles_;
+};
+
+// Roughly what the Mobile IO joystick mapping produces (see
+// InputManagerMobileIO): up to 0.175 m/s translation and 0.4 rad/s rotation.
+const InputSegment input_profile[] = {
+  { 2.0, { 0.0, 0.0, 0.0 },      { 0.0, 0.0, 0.0 },  0 }, // stand
+  { 8.0, { 0.175, 0.0, 0.0 },    { 0.0, 0.0, 0.0 },  0 }, // walk forward
+  { 6.0, { 0.0, 0.0, 0.0 },      { 0.0, 0.0, 0.4 },  0 }, // turn in place
+  { 6.0, { 0.1, 0.1, 0.0 },      { 0.0, 0.0, -0.2 }, 0 }, // walk diagonally while turning
+  { 3.0, { 0.0, 0.0, 0.1 },      { 0.0, 0.0, 0.0 },  0 }, // raise the body
+  { 3.0, { 0.0, 0.0, -0.1 },     { 0.0, 0.0, 0.0 },  0 }, // lower the body
+  { 4.0, { 0.05, 0.0, 0.0 },     { 0.0, 0.3, 0.2 },  1 }, // stance mode: shift and tilt
+  { 4.0, { 0.0, -0.175, 0.0 },   { 0.0, 0.0, 0.0 },  1 }, // back to stepping: walk sideways
+};
+const int num_input_segments = sizeof(input_profile) / sizeof(input_profile[0]);
+
+bool parseParameters(int argc, char** argv, double& duration_s)
+{
+  for (int idx = 1; idx < argc; ++idx)
+  {
+    std::string arg(argv[idx]);
+    if (arg == "-s" && idx + 1 < argc)
+    {
+      duration_s = std::stod(argv[++idx]);
+      continue;
+    }
+    std::cout << "Hexapod benchmark usage:\n" <<
+    "    -s <seconds>\n" <<
+    "        Simulated time to run for (default " << duration_s << " s); the input profile repeats.\n\n" <<
+    "    -h\n" <<
+    "        Print this help and return." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  double duration_s = 120.0;
+  if (!parseParameters(argc, argv, duration_s))
+    return 1;
+
+  HexapodParameters params;
+  if (!params.loadFromFile("hex_config.xml"))
+    params.resetToDefaults();
+  std::unique_ptr<Hexapod> hexapod = Hexapod::createDummy(params);
+
+  const double period = Hexapod::getFeedbackPeriodMs() / 1000.0;
+  const size_t num_ticks = static_cast<size_t>(duration_s / period);
+  util::TickBenchmark benchmark(num_ticks);
+
+  // Controls to send to the robot
+  Eigen::VectorXd angles(Leg::getNumJoints());
+  Eigen::VectorXd vels(Leg::getNumJoints());
+  Eigen::VectorXd torques(Leg::getNumJoints());
+  Eigen::MatrixXd foot_forces(3,6); // 3 (xyz) by num legs
+  foot_forces.setZero();
+  Eigen::MatrixXd jacobian_ee;
+  robot_model::MatrixXdVector jacobian_com;
+
+  int segment = 0;
+  double segment_end = input_profile[0].duration_;
+  bool segment_started = false;
+  std::cout << "Running " << num_ticks << " ticks (" << duration_s << " s simulated)..." << std::endl;
+  for (size_t tick = 0; tick < num_ticks; ++tick)
+  {
+    double t = tick * period;
+    if (t >= segment_end)
+    {
+      segment = (segment + 1) % num_input_segments;
+      segment_end += input_profile[segment].duration_;
+      segment_started = false;
+    }
+    const InputSegment& input = input_profile[segment];
+
+    benchmark.beginTick();
+
+    if (!segment_started)
+    {
+      hexapod->updateMode(input.mode_toggles_);
+      segment_started = true;
+    }
+
+    hexapod->updateStance(input.translation_velocity_, input.rotation_velocity_, period);
+    if (hexapod->needToStep())
+      hexapod->startStep(t);
+    hexapod->updateSteps(t);
+
+    hexapod->computeFootForces(t, foot_forces);
+
+    for (int i = 0; i < 6; ++i)
+    {
+      hebi::Leg* curr_leg = hexapod->getLeg(i);
+      curr_leg->computeState(t, angles, vels, jacobian_ee, jacobian_com);
+
+      Eigen::Vector3d foot_force = foot_forces.block<3,1>(0,i);
+      Eigen::Vector3d gravity_vec = hexapod->getGravityDirection() * 9.8;
+      torques = curr_leg->computeTorques(jacobian_com, jacobian_ee, angles, vels, gravity_vec, foot_force);
+
+      hexapod->setCommand(i, &angles, &vels, &torques);
+    }
+    hexapod->sendCommand();
+
+    benchmark.endTick();
+  }
+
+  benchmark.report(std::cout, period);
+
+  if (auto planner = hexapod->getFootstepPlanner())
+  {
+    auto stats = planner->getStatistics();
+    std::cout << "Footstep planner: " << stats.plans_ << " plans from " << stats.inputs_ << " inputs ("
+              << stats.mean_plan_us_ << " us mean, " << stats.max_plan_us_ << " us max); steps started with "
+              << stats.adopted_ << " planned, " << stats.rejected_ << " rejected and "
+              << stats.unplanned_ << " missing plans" << std::endl;
+  }
+  return 0;
+}
@@ -2,6 +2,7 @@
 #include <QGraphicsScene>
 #include <QGraphicsView>
 #include <QMessageBox>
+#include <QTimer>
 
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QWidget>
@@ -11,9 +12,15 @@
 #include "display/hexapod_view_2d.hpp"
 
 #include "robot/hexapod.hpp"
+#include "robot/degradation_policy.hpp"
+#include "robot/checkpoint.hpp"
 #include "input/input_manager_mobile_io.hpp"
+#include "util/trace.hpp"
+#include "telemetry_sender.h"
 #include <atomic>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <unistd.h>
 #include <chrono>
 #include <thread>
@@ -22,7 +29,9 @@
 using namespace hebi;
 using namespace Eigen;
 
-bool parse_parameters(int argc, char** argv, bool& visualize, bool& dummy, bool& partial, bool& quiet, std::set<int>& partial_legs)
+bool parse_parameters(int argc, char** argv, bool& visualize, bool& dummy, bool& partial, bool& quiet, std::set<int>& partial_legs, std::string& trace_file,
+                      std::string& checkpoint_prefix, std::string& restore_file,
+                      std::string& telemetry_host, uint16_t& telemetry_port, double& telemetry_rate_hz)
 {
   visualize = false;
   dummy = false;
@@ -45,6 +54,20 @@ bool parse_parameters(int argc, char** argv, bool& visualize, bool& dummy, bool&
       "        Visualize -- show a simple rendering of the robot.\n\n" <<
       "    -q\n" <<
       "        Quiet mode (no dialog messages; waits and tries to continue on failure such as no modules on the network).\n\n" <<
+      "    -t <file>\n" <<
+      "        Record a timeline trace of the control, feedback, and GUI threads, and write it\n" <<
+      "        to the given file on exit (Chrome trace-event JSON; open in chrome://tracing or\n" <<
+      "        ui.perfetto.dev).\n\n" <<
+      "    -c <prefix>\n" <<
+      "        Checkpoint the controller state every 10 seconds, to \"<prefix>-<seconds>.hxck\".\n\n" <<
+      "    -r <file>\n" <<
+      "        Restore the controller state from the given checkpoint and continue from\n" <<
+      "        there (typically combined with \"-d\").\n\n" <<
+      "    -u <host>:<port>\n" <<
+      "        Stream compressed telemetry (joint positions, commanded efforts, gravity, input\n" <<
+      "        commands and loop load) over UDP to a base station running telemetry_monitor.\n\n" <<
+      "    -f <hz>\n" <<
+      "        Telemetry sample rate (default " << telemetry_rate_hz << " Hz).\n\n" <<
       "    -h\n" <<
       "        Print this help and return." << std::endl;
       return false;
@@ -82,6 +105,39 @@ bool parse_parameters(int argc, char** argv, bool& visualize, bool& dummy, bool&
       quiet = true;
       continue;
     }
+    else if (str_arg == "-t" && idx + 1 < argc)
+    {
+      trace_file = argv[++idx];
+      continue;
+    }
+    else if (str_arg == "-c" && idx + 1 < argc)
+    {
+      checkpoint_prefix = argv[++idx];
+      continue;
+    }
+    else if (str_arg == "-r" && idx + 1 < argc)
+    {
+      restore_file = argv[++idx];
+      continue;
+    }
+    else if (str_arg == "-u" && idx + 1 < argc)
+    {
+      std::string destination(argv[++idx]);
+      size_t colon = destination.rfind(':');
+      if (colon == std::string::npos || colon == 0)
+      {
+        valid = false;
+        break;
+      }
+      telemetry_host = destination.substr(0, colon);
+      telemetry_port = static_cast<uint16_t>(std::atoi(destination.c_str() + colon + 1));
+      continue;
+    }
+    else if (str_arg == "-f" && idx + 1 < argc)
+    {
+      telemetry_rate_hz = std::atof(argv[++idx]);
+      continue;
+    }
     else
     {
       valid = false;
@@ -91,7 +147,9 @@ bool parse_parameters(int argc, char** argv, bool& visualize, bool& dummy, bool&
   // Do all exclusive argument checks here
   if (!valid ||
       (dummy && partial) ||
-      (partial && partial_legs.size() == 0))
+      (partial && partial_legs.size() == 0) ||
+      (!telemetry_host.empty() && telemetry_port == 0) ||
+      telemetry_rate_hz <= 0)
   {
     std::cout << "Invalid combination of arguments! Use \"-h\" for usage." << std::endl;
     return false;
@@ -99,6 +157,120 @@ bool parse_parameters(int argc, char** argv, bool& visualize, bool& dummy, bool&
   return true;
 }
 
+// Creates a startup trajectory through the given waypoints, stopped at the
+// ends and free (NaN) at the intermediate lift/place points.  All legs share
+// the same time grid, so they share one builder.
+std::shared_ptr<util::TrajectoryBuilder::Trajectory> createStartupTrajectory(const Eigen::VectorXd& times, const Eigen::MatrixXd& positions)
+{
+  int num_joints = positions.rows();
+  int num_waypoints = positions.cols();
+  Eigen::MatrixXd velocities = Eigen::MatrixXd::Zero(num_joints, num_waypoints);
+  Eigen::MatrixXd accelerations = Eigen::MatrixXd::Zero(num_joints, num_waypoints);
+  Eigen::VectorXd nan_column = Eigen::VectorXd::Constant(num_joints, std::numeric_limits<double>::quiet_NaN());
+  velocities.col(1) = nan_column;
+  velocities.col(3) = nan_column;
+  accelerations.col(1) = nan_column;
+  accelerations.col(3) = nan_column;
+  static thread_local util::TrajectoryBuilder builder;
+  return builder.create(times, positions, &velocities, &accelerations);
+}
+
+// Checkpoint layout: header, control loop state (time, startup progress and
+// startup trajectory waypoints), then the hexapod state.
+void saveControllerState(CheckpointWriter& out, double elapsed, bool startup, bool first_run,
+  const std::vector<Eigen::VectorXd>& startup_times, const std::vector<Eigen::MatrixXd>& startup_positions, Hexapod& hexapod)
+{
+  out.writeHeader();
+  out.writeDouble(elapsed);
+  out.writeBool(startup);
+  out.writeBool(first_run);
+  out.writeUInt(static_cast<uint32_t>(startup_times.size()));
+  for (size_t i = 0; i < startup_times.size(); ++i)
+  {
+    out.writeMatrix(startup_times[i]);
+    out.writeMatrix(startup_positions[i]);
+  }
+  hexapod.saveState(out);
+}
+
+bool restoreControllerState(CheckpointReader& in, double& elapsed, bool& startup, bool& first_run,
+  std::vector<Eigen::VectorXd>& startup_times, std::vector<Eigen::MatrixXd>& startup_positions,
+  std::vector<std::shared_ptr<util::TrajectoryBuilder::Trajectory>>& startup_trajectories, Hexapod& hexapod)
+{
+  uint32_t num_startup_trajectories = 0;
+  in.readHeader();
+  in.readDouble(elapsed);
+  in.readBool(startup);
+  in.readBool(first_run);
+  in.readUInt(num_startup_trajectories);
+  if (!in.ok() || (num_startup_trajectories != 0 && num_startup_trajectories != 6))
+    return false;
+  startup_times.resize(num_startup_trajectories);
+  startup_positions.resize(num_startup_trajectories);
+  startup_trajectories.clear();
+  for (uint32_t i = 0; i < num_startup_trajectories; ++i)
+  {
+    in.readMatrix(startup_times[i]);
+    in.readMatrix(startup_positions[i]);
+    if (!in.ok() || startup_positions[i].rows() != Leg::getNumJoints() || startup_positions[i].cols() != 5 ||
+        startup_times[i].size() != 5)
+      return false;
+    startup_trajectories.push_back(createStartupTrajectory(startup_times[i], startup_positions[i]));
+  }
+  // Startup needs its trajectories, unless they are still to be planned.
+  if (startup && !first_run && startup_trajectories.empty())
+    return false;
+  return hexapod.restoreState(in) && in.atEnd();
+}
+
+// Telemetry layout: joint positions (from feedback) and commanded efforts
+// for each leg, then gravity direction, input commands, mode and loop load.
+const int telemetry_efforts_offset = 18;
+
+std::vector<util::TelemetryChannel> createTelemetryChannels()
+{
+  std::vector<util::TelemetryChannel> channels;
+  for (int leg = 0; leg < 6; ++leg)
+    for (int joint = 0; joint < Leg::getNumJoints(); ++joint)
+      channels.push_back({ "position_" + std::to_string(leg) + "_" + std::to_string(joint), 1e-3 });
+  for (int leg = 0; leg < 6; ++leg)
+    for (int joint = 0; joint < Leg::getNumJoints(); ++joint)
+      channels.push_back({ "effort_cmd_" + std::to_string(leg) + "_" + std::to_string(joint), 1e-2 });
+  for (const char* axis : { "x", "y", "z" })
+    channels.push_back({ std::string("gravity_") + axis, 1e-3 });
+  for (const char* axis : { "x", "y", "z" })
+    channels.push_back({ std::string("translation_cmd_") + axis, 1e-3 });
+  for (const char* axis : { "x", "y", "z" })
+    channels.push_back({ std::string("rotation_cmd_") + axis, 1e-3 });
+  channels.push_back({ "mode", 1.0 }); // -1 startup, 0 step, 1 stance
+  channels.push_back({ "utilization", 1e-3 });
+  channels.push_back({ "degradation_level", 1.0 });
+  return channels;
+}
+
+// Fills in everything but the commanded efforts (which the leg loops write
+// directly) and hands the values off to the telemetry thread.
+void publishTelemetry(util::TelemetrySender& telemetry, Eigen::VectorXd& values, Hexapod& hexapod,
+  const Eigen::Vector3f& translation_velocity_cmd, const Eigen::Vector3f& rotation_velocity_cmd,
+  bool startup, const DegradationPolicy& degradation)
+{
+  const util::FeedbackHistory& history = hexapod.getPositionHistory();
+  for (int i = 0; i < telemetry_efforts_offset; ++i)
+  {
+    double time;
+    if (!history.getSample(i, 0, values[i], time))
+      values[i] = std::numeric_limits<double>::quiet_NaN();
+  }
+  int offset = 2 * telemetry_efforts_offset;
+  values.segment<3>(offset) = hexapod.getGravityDirection();
+  values.segment<3>(offset + 3) = translation_velocity_cmd.cast<double>();
+  values.segment<3>(offset + 6) = rotation_velocity_cmd.cast<double>();
+  values[offset + 9] = startup ? -1 : (hexapod.getMode() == Hexapod::Mode::Step ? 0 : 1);
+  values[offset + 10] = degradation.getAverageUtilization();
+  values[offset + 11] = static_cast<int>(degradation.getLevel());
+  telemetry.publish(values.data());
+}
+
 // Get the hexapod, handling errors as appropriate
 std::unique_ptr<Hexapod> getHexapod(const HexapodParameters& params, bool is_dummy, bool is_partial, bool is_quiet, const std::set<int>& legs)
 {
@@ -196,9 +368,19 @@ int main(int argc, char** argv)
   bool is_partial{};
   bool is_quiet{};
   std::set<int> legs;
-  if (!parse_parameters(argc, argv, do_visualize, is_dummy, is_partial, is_quiet, legs))
+  std::string trace_file;
+  std::string checkpoint_prefix;
+  std::string restore_file;
+  std::string telemetry_host;
+  uint16_t telemetry_port = 0;
+  double telemetry_rate_hz = 50.0;
+  if (!parse_parameters(argc, argv, do_visualize, is_dummy, is_partial, is_quiet, legs, trace_file, checkpoint_prefix, restore_file,
+                        telemetry_host, telemetry_port, telemetry_rate_hz))
     return 1;
 
+  HEBI_TRACE_THREAD_NAME("Qt GUI");
+  util::Tracer::get().setEnabled(!trace_file.empty());
+
   HexapodParameters params;
   if (!params.loadFromFile("hex_config.xml"))
   {
@@ -369,6 +551,19 @@ int main(int argc, char** argv)
     vLayout->addLayout(hLayout3);
   }
 
+  // Periodically move trace events out of the per-thread buffers so they don't
+  // fill up during long runs.
+  QTimer trace_timer;
+  if (!trace_file.empty())
+  {
+    QObject::connect(&trace_timer, &QTimer::timeout, []()
+    {
+      HEBI_TRACE_SCOPE("collect trace");
+      util::Tracer::get().collect();
+    });
+    trace_timer.start(500);
+  }
+
   widget->setWindowTitle(QStringLiteral("heXapod Control"));
   widget->show();
   widget->resize(overall_width, overall_height);
@@ -392,33 +587,94 @@ int main(int argc, char** argv)
   Eigen::VectorXd torques(Leg::getNumJoints());
   Eigen::MatrixXd foot_forces(3,6); // 3 (xyz) by num legs
   foot_forces.setZero();
-  std::vector<std::shared_ptr<trajectory::Trajectory>> startup_trajectories;
+  std::vector<std::shared_ptr<util::TrajectoryBuilder::Trajectory>> startup_trajectories;
+  // Waypoints of the startup trajectories, for checkpoints
+  std::vector<Eigen::VectorXd> startup_times;
+  std::vector<Eigen::MatrixXd> startup_positions;
 
   auto start = std::chrono::steady_clock::now();
+
+  // Continue from a checkpoint?  The clock is shifted so the controller picks
+  // up at the time the checkpoint was taken.
+  if (!restore_file.empty())
+  {
+    CheckpointReader checkpoint;
+    double checkpoint_elapsed = 0;
+    if (!checkpoint.loadFile(restore_file) ||
+        !restoreControllerState(checkpoint, checkpoint_elapsed, startup, first_run,
+          startup_times, startup_positions, startup_trajectories, *hexapod))
+    {
+      std::cout << "Could not restore controller state from " << restore_file << std::endl;
+      return 1;
+    }
+    start -= std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(checkpoint_elapsed));
+    std::cout << "Restored controller state at t = " << checkpoint_elapsed << " s from " << restore_file << std::endl;
+  }
+
+  // The control thread serializes checkpoints into 'checkpoint', and the file
+  // writer's thread does the actual I/O.
+  const double checkpoint_interval_s = 10.0;
+  std::unique_ptr<CheckpointFileWriter> checkpoint_file_writer;
+  CheckpointWriter checkpoint;
+  double next_checkpoint_s = 0;
+  if (!checkpoint_prefix.empty())
+  {
+    checkpoint_file_writer.reset(new CheckpointFileWriter());
+    checkpoint.reserve(16 * 1024);
+  }
+
+  // The control thread only publishes telemetry values; the sender's thread
+  // samples, encodes and sends them.
+  std::unique_ptr<util::TelemetrySender> telemetry;
+  Eigen::VectorXd telemetry_values;
+  if (!telemetry_host.empty())
+  {
+    util::TelemetrySenderOptions telemetry_options;
+    telemetry_options.sample_rate_hz = telemetry_rate_hz;
+    telemetry.reset(new util::TelemetrySender(createTelemetryChannels(), telemetry_options));
+    if (!telemetry->start(telemetry_host, telemetry_port))
+    {
+      std::cout << "Could not send telemetry to " << telemetry_host << ":" << telemetry_port << std::endl;
+      return 1;
+    }
+    telemetry_values = Eigen::VectorXd::Constant(telemetry->channel_count(), std::numeric_limits<double>::quiet_NaN());
+  }
   long interval_ms = period;
   // http://stackoverflow.com/questions/30425772/c-11-calling-a-c-function-periodically
   std::atomic<bool> control_execute;
   control_execute.store(true, std::memory_order_release);
+  // Sheds optional work (rendering, labels, step replanning, ...) when ticks
+  // start taking too much of the control period.
+  DegradationPolicy degradation(period / 1000.0);
   std::thread control_thread([&]()
   {
+    HEBI_TRACE_THREAD_NAME("control");
     auto prev = std::chrono::steady_clock::now();
     // Get dt (in seconds)
     std::chrono::duration<double> dt = std::chrono::seconds(0);
+    bool first_tick = true;
     while (control_execute.load(std::memory_order_acquire))
     {
+      // 'prev' is the start of the last tick, so this is how long it worked for
+      auto now = std::chrono::steady_clock::now();
+      if (!first_tick)
+        degradation.update(std::chrono::duration<double>(now - prev).count());
+      first_tick = false;
 
       // Wait!
-      auto now = std::chrono::steady_clock::now();
       auto need_to_wait = std::max(0, (int)std::chrono::duration_cast<std::chrono::milliseconds>(prev + std::chrono::milliseconds(interval_ms) - now).count());
       std::this_thread::sleep_for(std::chrono::milliseconds(need_to_wait));
 
+      HEBI_TRACE_SCOPE("control tick");
+
       // Get dt (in seconds)
       now = std::chrono::steady_clock::now();
       dt = std::chrono::duration_cast<std::chrono::duration<double>>(now - prev);
       prev = now;
 
       // show connection status
-      if (!is_dummy)
+      if (!is_dummy && degradation.shouldUpdateStatusLabels())
       {
         // More than 2x the feedback period?
         if ((now - hexapod->getLastFeedbackTime()) > std::chrono::milliseconds((long)(hexapod->getFeedbackPeriodMs() * 2.0)))
@@ -448,8 +704,22 @@ int main(int argc, char** argv)
       // In seconds:
       std::chrono::duration<double> elapsed(now - start);
 
+      // Checkpoint the state at the start of this tick
+      if (checkpoint_file_writer && elapsed.count() >= next_checkpoint_s)
+      {
+        HEBI_TRACE_SCOPE("checkpoint");
+        next_checkpoint_s = (std::floor(elapsed.count() / checkpoint_interval_s) + 1) * checkpoint_interval_s;
+        saveControllerState(checkpoint, elapsed.count(), startup, first_run, startup_times, startup_positions, *hexapod);
+        std::string file = checkpoint_prefix + "-" + std::to_string(static_cast<long>(elapsed.count())) + ".hxck";
+        if (!checkpoint_file_writer->submit(checkpoint, file))
+          checkpoint.clear();
+      }
+
       // Get joystick update, and update any relevant variables.
-      input->update();
+      {
+        HEBI_TRACE_SCOPE("input update");
+        input->update();
+      }
       if (input->getQuitButtonPushed())
         app.exit();
 
@@ -457,8 +727,9 @@ int main(int argc, char** argv)
       rotation_velocity_cmd = input->getRotationVelocityCmd();
       hexapod->updateMode(input->getAndResetModeToggleCount());
 
-      // The first minute of every 30 minutes: record log?
-      if (fmod(elapsed.count(), 1800) < 60)
+      // The first minute of every 30 minutes: record log?  (Unless we are
+      // short on time)
+      if (fmod(elapsed.count(), 1800) < 60 && degradation.shouldLogAtHighFrequency())
       {
         if (!high_freq_logging)
         {
@@ -503,9 +774,6 @@ int main(int argc, char** argv)
             // Convert for trajectories
             int num_waypoints = 5;
             Eigen::MatrixXd positions(num_joints, num_waypoints);
-            Eigen::MatrixXd velocities = Eigen::MatrixXd::Zero(num_joints, num_waypoints);
-            Eigen::MatrixXd accelerations = Eigen::MatrixXd::Zero(num_joints, num_waypoints);
-            Eigen::VectorXd nan_column = Eigen::VectorXd::Constant(num_joints, std::numeric_limits<double>::quiet_NaN());
             // Is this one of the legs that takes a step first?
             bool step_first = (i == 0 || i == 3 || i == 4);
 
@@ -516,11 +784,6 @@ int main(int argc, char** argv)
             positions.col(3) = step_first ? leg_end : leg_mid;
             positions.col(4) = leg_end;
 
-            velocities.col(1) = nan_column;
-            velocities.col(3) = nan_column;
-            accelerations.col(1) = nan_column;
-            accelerations.col(3) = nan_column;
-
             Eigen::VectorXd times(num_waypoints);
             double local_start = elapsed.count();
             double total = startup_seconds - local_start;
@@ -529,8 +792,9 @@ int main(int argc, char** argv)
                     local_start + total * 0.5,
                     local_start + total * 0.75,
                     local_start + total;
-            startup_trajectories.push_back(trajectory::Trajectory::createUnconstrainedQp(
-              times, positions, &velocities, &accelerations));
+            startup_trajectories.push_back(createStartupTrajectory(times, positions));
+            startup_times.push_back(times);
+            startup_positions.push_back(positions);
 
           }
 
@@ -538,7 +802,8 @@ int main(int argc, char** argv)
           // we don't need 'first_run'?
           first_run = false;
         }
-        mode->setText("Startup");
+        if (degradation.shouldUpdateStatusLabels())
+          mode->setText("Startup");
       
         // Follow t_l:
         for (int i = 0; i < 6; ++i)
@@ -559,13 +824,17 @@ int main(int argc, char** argv)
           Eigen::Vector3d gravity_vec = hexapod->getGravityDirection() * 9.8;
           torques = curr_leg->computeTorques(jacobian_com, jacobian_ee, angles, vels, gravity_vec, /* dynamic_comp_torque,*/ foot_force); // TODO: add dynamic compensation
           // For rendering:
-          if (hexapod_display)
+          if (hexapod_display && degradation.shouldVisualize())
             hexapod_display->updateLeg(curr_leg, i, angles);
           // TODO: add actual foot torque for startup?
           // TODO: add vel, torque; test each one!
           hexapod->setCommand(i, &angles, &vels, &torques);
+          if (telemetry)
+            telemetry_values.segment(telemetry_efforts_offset + i * Leg::getNumJoints(), Leg::getNumJoints()) = torques;
         }
         hexapod->sendCommand();
+        if (telemetry)
+          publishTelemetry(*telemetry, telemetry_values, *hexapod, translation_velocity_cmd, rotation_velocity_cmd, startup, degradation);
         if (elapsed.count() >= startup_seconds)
         {
           mode->setText("");
@@ -577,28 +846,37 @@ int main(int argc, char** argv)
       // Optionally slowly ramp up commands over the first few seconds
       double ramp_up_scale = std::min(1.0, (elapsed.count() - startup_seconds) / 2.0);
 
-      mode->setText(hexapod->getMode() == hebi::Hexapod::Mode::Step ? "Step" : "Stance");
+      if (degradation.shouldUpdateStatusLabels())
+        mode->setText(hexapod->getMode() == hebi::Hexapod::Mode::Step ? "Step" : "Stance");
 
-      hexapod->updateStance(
-        translation_velocity_cmd.cast<double>(),
-        rotation_velocity_cmd.cast<double>(),
-        dt.count());
-
-      if (hexapod->needToStep())
       {
-        hexapod->startStep(elapsed.count());
-      }
+        HEBI_TRACE_SCOPE("plan steps");
+        hexapod->updateStance(
+          translation_velocity_cmd.cast<double>(),
+          rotation_velocity_cmd.cast<double>(),
+          dt.count());
 
-      hexapod->updateSteps(elapsed.count());
+        if (hexapod->needToStep())
+        {
+          hexapod->startStep(elapsed.count());
+        }
 
-      // Calculate how the weight is distributed
-      hexapod->computeFootForces(elapsed.count(), foot_forces);
+        hexapod->updateSteps(elapsed.count(), degradation.shouldReplanSteps());
+      }
 
-      foot_forces *= ramp_up_scale;
+      // Calculate how the weight is distributed (when short on time, this is
+      // only refreshed every other tick)
+      if (degradation.shouldComputeSecondary())
+      {
+        HEBI_TRACE_SCOPE("foot forces");
+        hexapod->computeFootForces(elapsed.count(), foot_forces);
+        foot_forces *= ramp_up_scale;
+      }
 
       Eigen::MatrixXd jacobian_ee;
       robot_model::MatrixXdVector jacobian_com;
       Eigen::VectorXd angles_plus_dt;
+      HEBI_TRACE_SCOPE("leg commands");
       for (int i = 0; i < 6; ++i)
       {
         hebi::Leg* curr_leg = hexapod->getLeg(i);
@@ -606,7 +884,7 @@ int main(int argc, char** argv)
         curr_leg->computeState(elapsed.count(), angles, vels, jacobian_ee, jacobian_com);
 
         // For rendering:
-        if (hexapod_display)
+        if (hexapod_display && degradation.shouldVisualize())
           hexapod_display->updateLeg(curr_leg, i, angles);
         
         // Get torques
@@ -615,12 +893,30 @@ int main(int argc, char** argv)
         torques = hexapod->getLeg(i)->computeTorques(jacobian_com, jacobian_ee, angles, vels, gravity_vec, /*dynamic_comp_torque,*/ foot_force); // TODO:
 
         hexapod->setCommand(i, &angles, &vels, &torques);
+        if (telemetry)
+          telemetry_values.segment(telemetry_efforts_offset + i * Leg::getNumJoints(), Leg::getNumJoints()) = torques;
       }
       hexapod->sendCommand();
+      if (telemetry)
+        publishTelemetry(*telemetry, telemetry_values, *hexapod, translation_velocity_cmd, rotation_velocity_cmd, startup, degradation);
     }
   });
   bool res = app.exec();
   control_execute.store(false, std::memory_order_release);
   control_thread.join();
+  if (telemetry)
+  {
+    telemetry->stop();
+    auto stats = telemetry->statistics();
+    std::cout << "Sent " << stats.frames << " telemetry frames in " << stats.packets << " packets ("
+              << stats.bytes << " bytes, " << stats.send_errors << " send errors)" << std::endl;
+  }
+  if (!trace_file.empty())
+  {
+    if (util::Tracer::get().writeChromeTrace(trace_file))
+      std::cout << "Wrote trace to " << trace_file << std::endl;
+    else
+      std::cout << "Could not write trace to " << trace_file << std::endl;
+  }
   return res;
 }
@@ -29,20 +29,20 @@ bool InputManagerMobileIO::reset()
 
   group_->addFeedbackHandler([this] (const GroupFeedback& fbk)
   {
-    // TODO: use 'std::atomic' variables for state here? Add mutex?  Does this
-    // slow things down due to lock contention?
     const auto& analog = fbk[0].io().a();
     const auto& digital = fbk[0].io().b();
     if (analog.hasFloat(1) && analog.hasFloat(2) && analog.hasFloat(3) &&
         digital.hasInt(1))
     {
-      left_horz_raw_ = analog.getFloat(1);
-      left_vert_raw_ = analog.getFloat(2);
+      Axes axes;
+      axes.left_horz_raw_ = analog.getFloat(1);
+      axes.left_vert_raw_ = analog.getFloat(2);
 
-      slider_1_raw_ = analog.getFloat(3);
+      axes.slider_1_raw_ = analog.getFloat(3);
 
-      right_horz_raw_ = analog.getFloat(7);
-      right_vert_raw_ = analog.getFloat(8);
+      axes.right_horz_raw_ = analog.getFloat(7);
+      axes.right_vert_raw_ = analog.getFloat(8);
+      axes_.store(axes);
 
       // Note: only care about edge triggers down here
       bool new_mode_button_state = (digital.getInt(7) == 1);
@@ -62,13 +62,14 @@ bool InputManagerMobileIO::reset()
 
 void InputManagerMobileIO::printState() const
 {
-  std::cout << "Rotation (z)" << rot_scale_ * left_horz_raw_ << "\n";
-  std::cout << "Rotation (y)" << rot_scale_ * left_vert_raw_ << "\n";
+  Axes axes = axes_.load();
+  std::cout << "Rotation (z)" << rot_scale_ * axes.left_horz_raw_ << "\n";
+  std::cout << "Rotation (y)" << rot_scale_ * axes.left_vert_raw_ << "\n";
 
-  std::cout << "Translation (z)" << xyz_scale_ * left_horz_raw_ << "\n";
-  std::cout << "Translation (y)" << xyz_scale_ * right_vert_raw_ << "\n";
+  std::cout << "Translation (z)" << xyz_scale_ * axes.left_horz_raw_ << "\n";
+  std::cout << "Translation (y)" << xyz_scale_ * axes.right_vert_raw_ << "\n";
 
-  std::cout << "Height " << xyz_scale_ * getVerticalVelocity() << "\n";
+  std::cout << "Height " << xyz_scale_ * getVerticalVelocity(axes) << "\n";
 
   std::cout << "quit state: " << has_quit_been_pushed_ << "\n";
   std::cout << "number of mode changes: " << num_mode_toggles_ << "\n";
@@ -79,10 +80,11 @@ Eigen::Vector3f InputManagerMobileIO::getTranslationVelocityCmd() const
   Eigen::Vector3f translation_velocity_cmd;
   if (isConnected())
   {
+    Axes axes = axes_.load();
     translation_velocity_cmd <<
-      -xyz_scale_ * right_vert_raw_,
-      xyz_scale_ * right_horz_raw_,
-      xyz_scale_ * getVerticalVelocity();
+      -xyz_scale_ * axes.right_vert_raw_,
+      xyz_scale_ * axes.right_horz_raw_,
+      xyz_scale_ * getVerticalVelocity(axes);
   }
   else
   {
@@ -96,10 +98,11 @@ Eigen::Vector3f InputManagerMobileIO::getRotationVelocityCmd() const
   Eigen::Vector3f rotation_velocity_cmd;
   if (isConnected())
   {
+    Axes axes = axes_.load();
     rotation_velocity_cmd <<
       0,
-      -rot_scale_ * left_vert_raw_,
-      rot_scale_ * left_horz_raw_;
+      -rot_scale_ * axes.left_vert_raw_,
+      rot_scale_ * axes.left_horz_raw_;
   }
   else
   {
@@ -118,16 +121,16 @@ size_t InputManagerMobileIO::getAndResetModeToggleCount()
   return num_mode_toggles_.exchange(0);
 }
   
-float InputManagerMobileIO::getVerticalVelocity() const
+float InputManagerMobileIO::getVerticalVelocity(const Axes& axes)
 {
   // Slider dead zone: 0.25
   const float slider_dead_zone_ = 0.25; 
-  if (std::abs(slider_1_raw_) < slider_dead_zone_)
+  if (std::abs(axes.slider_1_raw_) < slider_dead_zone_)
     return 0;
   // Scale from [dead_zone, 1] to [0, 1] (and same for [-1, -dead_zone]
-  if (slider_1_raw_ > 0)
-    return -(slider_1_raw_ - slider_dead_zone_) / (1 - slider_dead_zone_);
-  return -(slider_1_raw_ + slider_dead_zone_) / (1 - slider_dead_zone_);
+  if (axes.slider_1_raw_ > 0)
+    return -(axes.slider_1_raw_ - slider_dead_zone_) / (1 - slider_dead_zone_);
+  return -(axes.slider_1_raw_ + slider_dead_zone_) / (1 - slider_dead_zone_);
 }
 
 } // namespace input
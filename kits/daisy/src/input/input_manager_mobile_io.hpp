@@ -3,6 +3,7 @@
 #include "input_manager.hpp"
 #include <Eigen/Dense>
 #include "group.hpp"
+#include "util/seqlock.hpp"
 #include <memory>
 #include <atomic>
 
@@ -47,7 +48,19 @@ public:
 
 private:
 
-  float getVerticalVelocity() const;
+  // The raw joystick values, written together by the feedback handler.
+  struct Axes
+  {
+    float left_horz_raw_{0}; // Rotation
+    float left_vert_raw_{0}; // Chassis tilt
+
+    float slider_1_raw_{0}; // Height
+
+    float right_horz_raw_{0}; // Translation (l/r)
+    float right_vert_raw_{0}; // Translation (f/b)
+  };
+
+  static float getVerticalVelocity(const Axes& axes);
 
   // The Mobile IO app that serves as a joystick
   std::shared_ptr<hebi::Group> group_;
@@ -57,18 +70,12 @@ private:
   static constexpr float xyz_scale_{0.175};
   static constexpr float rot_scale_{0.4};
 
-  float left_horz_raw_{0}; // Rotation
-  float left_vert_raw_{0}; // Chassis tilt
-
-  float slider_1_raw_{0}; // Height
-
-  float right_horz_raw_{0}; // Translation (l/r)
-  float right_vert_raw_{0}; // Translation (f/b)
+  util::Seqlock<Axes> axes_;
 
   bool prev_mode_button_state_{false};      // Mode
   std::atomic<size_t> num_mode_toggles_{0}; //
 
-  bool has_quit_been_pushed_ = false; // Quit
+  std::atomic<bool> has_quit_been_pushed_{false}; // Quit
 };
 
 } // namespace input
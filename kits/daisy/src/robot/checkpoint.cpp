@@ -0,0 +1,102 @@
+#include "checkpoint.hpp"
+
+#include "util/trace.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+namespace hebi {
+
+constexpr uint32_t CheckpointWriter::magic_;
+constexpr uint32_t CheckpointWriter::version_;
+
+bool CheckpointReader::loadFile(const std::string& file)
+{
+  std::ifstream in(file, std::ios::binary);
+  if (!in)
+    return false;
+  data_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  offset_ = 0;
+  ok_ = !in.bad();
+  return ok_;
+}
+
+bool CheckpointReader::readHeader()
+{
+  uint32_t magic, version;
+  if (!readUInt(magic) || !readUInt(version))
+    return false;
+  if (magic != CheckpointWriter::magic_ || version != CheckpointWriter::version_)
+    return fail();
+  return true;
+}
+
+CheckpointFileWriter::CheckpointFileWriter()
+  : thread_(&CheckpointFileWriter::run, this)
+{
+}
+
+CheckpointFileWriter::~CheckpointFileWriter()
+{
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    quit_ = true;
+  }
+  pending_cv_.notify_one();
+  thread_.join();
+}
+
+bool CheckpointFileWriter::submit(CheckpointWriter& checkpoint, const std::string& file)
+{
+  std::unique_lock<std::mutex> lock(lock_, std::try_to_lock);
+  if (!lock.owns_lock() || has_pending_)
+  {
+    ++num_failed_;
+    return false;
+  }
+  // Swap rather than copy; the I/O thread hands back its previous buffer.
+  pending_.swap(checkpoint.getData());
+  checkpoint.clear();
+  pending_file_ = file;
+  has_pending_ = true;
+  lock.unlock();
+  pending_cv_.notify_one();
+  return true;
+}
+
+void CheckpointFileWriter::run()
+{
+  HEBI_TRACE_THREAD_NAME("checkpoint writer");
+  std::string file;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(lock_);
+      pending_cv_.wait(lock, [this] { return has_pending_ || quit_; });
+      // Finish writing anything that is pending before quitting.
+      if (!has_pending_)
+        return;
+      writing_.swap(pending_);
+      file.swap(pending_file_);
+      has_pending_ = false;
+    }
+
+    HEBI_TRACE_SCOPE("write checkpoint");
+    // Write to a temporary file first, so a reader never sees a partial
+    // checkpoint.
+    std::string tmp_file = file + ".tmp";
+    bool success;
+    {
+      std::ofstream out(tmp_file, std::ios::binary | std::ios::trunc);
+      out.write(writing_.data(), writing_.size());
+      success = static_cast<bool>(out);
+    }
+    success = success && std::rename(tmp_file.c_str(), file.c_str()) == 0;
+    if (!success)
+      ++num_failed_;
+    writing_.clear();
+  }
+}
+
+} // namespace hebi
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <Eigen/Dense>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace hebi {
+
+// Compact binary encoding of controller state, for checkpointing a running
+// controller and restoring it later (e.g., to replay the lead-up to an issue on
+// a simulated robot without re-running the whole session).
+//
+// Values are written back to back in native byte order with no padding or
+// per-field tags; the reader must read fields in the order they were written.
+// A checkpoint starts with a magic number and format version (see
+// 'writeHeader'/'readHeader'); bump the version whenever the layout changes.
+class CheckpointWriter
+{
+public:
+  static constexpr uint32_t magic_ = 0x4b435848; // "HXCK"
+  static constexpr uint32_t version_ = 1;
+
+  // Discards the contents, but keeps the allocated storage, so a writer that is
+  // reused every checkpoint stops allocating once it has grown large enough.
+  void clear() { data_.clear(); }
+  void reserve(size_t bytes) { data_.reserve(bytes); }
+
+  void writeHeader() { writeUInt(magic_); writeUInt(version_); }
+
+  void writeUInt(uint32_t value) { writeRaw(&value, sizeof(value)); }
+  void writeInt(int32_t value) { writeRaw(&value, sizeof(value)); }
+  void writeBool(bool value) { uint8_t byte = value ? 1 : 0; writeRaw(&byte, sizeof(byte)); }
+  void writeDouble(double value) { writeRaw(&value, sizeof(value)); }
+
+  // Dimensions followed by the (column major) coefficients.
+  template <typename Derived>
+  void writeMatrix(const Eigen::MatrixBase<Derived>& matrix)
+  {
+    writeUInt(static_cast<uint32_t>(matrix.rows()));
+    writeUInt(static_cast<uint32_t>(matrix.cols()));
+    for (int col = 0; col < matrix.cols(); ++col)
+      for (int row = 0; row < matrix.rows(); ++row)
+        writeDouble(matrix(row, col));
+  }
+
+  const std::vector<char>& getData() const { return data_; }
+  std::vector<char>& getData() { return data_; }
+
+private:
+  void writeRaw(const void* value, size_t size)
+  {
+    const char* bytes = static_cast<const char*>(value);
+    data_.insert(data_.end(), bytes, bytes + size);
+  }
+
+  std::vector<char> data_;
+};
+
+// Reads back what a CheckpointWriter wrote.  Every read returns false once the
+// data runs out or doesn't match what was expected, and all later reads fail
+// too, so callers can read a whole section and check the result once.
+class CheckpointReader
+{
+public:
+  CheckpointReader() = default;
+  explicit CheckpointReader(std::vector<char> data) : data_(std::move(data)) {}
+
+  // Replaces the contents with those of a checkpoint file.  Returns false if
+  // the file could not be read.
+  bool loadFile(const std::string& file);
+
+  // Returns false if the data isn't a checkpoint of the current version.
+  bool readHeader();
+
+  bool readUInt(uint32_t& value) { return readRaw(&value, sizeof(value)); }
+  bool readInt(int32_t& value) { return readRaw(&value, sizeof(value)); }
+  bool readBool(bool& value)
+  {
+    uint8_t byte = 0;
+    if (!readRaw(&byte, sizeof(byte)))
+      return false;
+    value = (byte != 0);
+    return true;
+  }
+  bool readDouble(double& value) { return readRaw(&value, sizeof(value)); }
+
+  // Resizes dynamic matrices as needed; fails if a fixed size matrix has
+  // different dimensions than the stored one.
+  template <typename Derived>
+  bool readMatrix(Eigen::PlainObjectBase<Derived>& matrix)
+  {
+    uint32_t rows, cols;
+    if (!readUInt(rows) || !readUInt(cols))
+      return false;
+    if ((Derived::RowsAtCompileTime != Eigen::Dynamic && Derived::RowsAtCompileTime != static_cast<int>(rows)) ||
+        (Derived::ColsAtCompileTime != Eigen::Dynamic && Derived::ColsAtCompileTime != static_cast<int>(cols)) ||
+        static_cast<size_t>(rows) * cols * sizeof(double) > data_.size() - offset_)
+      return fail();
+    matrix.resize(rows, cols);
+    for (uint32_t col = 0; col < cols; ++col)
+      for (uint32_t row = 0; row < rows; ++row)
+        readDouble(matrix(row, col));
+    return ok_;
+  }
+
+  bool ok() const { return ok_; }
+  bool atEnd() const { return offset_ == data_.size(); }
+
+private:
+  bool fail() { ok_ = false; return false; }
+
+  bool readRaw(void* value, size_t size)
+  {
+    if (!ok_ || data_.size() - offset_ < size)
+      return fail();
+    std::memcpy(value, data_.data() + offset_, size);
+    offset_ += size;
+    return true;
+  }
+
+  std::vector<char> data_;
+  size_t offset_ = 0;
+  bool ok_ = true;
+};
+
+// Writes checkpoints to disk on a background thread, so that the control
+// thread only pays for serializing its state into memory.
+//
+// At most one checkpoint is pending at a time; if the previous one is still
+// being written (or the I/O thread is momentarily holding the lock), a new one
+// is dropped rather than waiting.
+class CheckpointFileWriter
+{
+public:
+  CheckpointFileWriter();
+  ~CheckpointFileWriter();
+
+  CheckpointFileWriter(const CheckpointFileWriter&) = delete;
+  CheckpointFileWriter& operator=(const CheckpointFileWriter&) = delete;
+
+  // Hands the contents of 'checkpoint' to the I/O thread to be written to
+  // 'file'.  Never blocks.  On success, 'checkpoint' is left empty (but with
+  // storage that can be reused for the next checkpoint); returns false if the
+  // checkpoint was dropped.
+  bool submit(CheckpointWriter& checkpoint, const std::string& file);
+
+  // Number of checkpoints that were dropped, or could not be written.
+  int getNumFailed() const { return num_failed_; }
+
+private:
+  void run();
+
+  std::mutex lock_;
+  std::condition_variable pending_cv_;
+  bool has_pending_ = false;
+  bool quit_ = false;
+  std::vector<char> pending_;
+  std::string pending_file_;
+  std::vector<char> writing_;
+  std::atomic<int> num_failed_{0};
+
+  std::thread thread_;
+};
+
+} // namespace hebi
@@ -0,0 +1,93 @@
+#include "degradation_policy.hpp"
+
+#include "util/trace.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+namespace hebi {
+
+DegradationPolicy::DegradationPolicy(double period_s,
+                                     double degrade_utilization,
+                                     double restore_utilization,
+                                     double restore_hold_s)
+  : period_s_(period_s),
+    degrade_utilization_(degrade_utilization),
+    restore_utilization_(restore_utilization),
+    restore_hold_ticks_(static_cast<int>(std::ceil(restore_hold_s / period_s)))
+{
+}
+
+DegradationPolicy::Level DegradationPolicy::update(double tick_work_s)
+{
+  ++tick_count_;
+  double utilization = tick_work_s / period_s_;
+  avg_utilization_ = ewma_alpha_ * utilization + (1.0 - ewma_alpha_) * avg_utilization_;
+
+  bool can_degrade = level_ < Level::ReducedPrecision;
+  long ticks_since_change = tick_count_ - last_change_tick_;
+
+  Level before = level_;
+
+  // A tick that misses the deadline sheds work right away (but only once per
+  // couple of ticks, so a single long tick doesn't drop everything); otherwise,
+  // wait for the average to rise.
+  if (can_degrade && utilization > 1.0 && ticks_since_change > 2)
+  {
+    std::ostringstream reason;
+    reason << "tick overran (" << tick_work_s * 1000.0 << " ms of " << period_s_ * 1000.0 << " ms period)";
+    setLevel(static_cast<Level>(static_cast<int>(level_) + 1), reason.str());
+  }
+  else if (can_degrade && avg_utilization_ > degrade_utilization_ && ticks_since_change >= min_ticks_between_degrades_)
+  {
+    std::ostringstream reason;
+    reason << "average utilization " << avg_utilization_ * 100.0 << "% above " << degrade_utilization_ * 100.0 << "%";
+    setLevel(static_cast<Level>(static_cast<int>(level_) + 1), reason.str());
+  }
+
+  // Restore only after a sustained period of headroom.  A single overrun
+  // doesn't move the average much, so the headroom is counted from the last
+  // change (and not at all on a tick that just shed work).
+  if (level_ != before)
+    return level_;
+  if (avg_utilization_ < restore_utilization_)
+    ++ticks_below_restore_;
+  else
+    ticks_below_restore_ = 0;
+  if (level_ != Level::Full && ticks_below_restore_ >= restore_hold_ticks_)
+  {
+    std::ostringstream reason;
+    reason << "average utilization " << avg_utilization_ * 100.0 << "% below " << restore_utilization_ * 100.0 << "%";
+    setLevel(static_cast<Level>(static_cast<int>(level_) - 1), reason.str());
+  }
+
+  return level_;
+}
+
+const char* DegradationPolicy::getLevelName(Level level)
+{
+  switch (level)
+  {
+    case Level::Full: return "full";
+    case Level::NoVisualization: return "no visualization";
+    case Level::NoStatusLabels: return "no status labels";
+    case Level::ReuseStepTrajectories: return "reuse step trajectories";
+    case Level::ReducedLogging: return "reduced logging";
+    case Level::ReducedPrecision: return "reduced precision";
+    default: return "unknown";
+  }
+}
+
+void DegradationPolicy::setLevel(Level level, const std::string& reason)
+{
+  bool degrading = level > level_;
+  std::cout << "Control loop " << (degrading ? "degraded" : "restored") << " to level "
+            << static_cast<int>(level) << " (" << getLevelName(level) << "): " << reason << std::endl;
+  HEBI_TRACE_VALUE("degradation level", static_cast<int>(level));
+  level_ = level;
+  last_change_tick_ = tick_count_;
+  ticks_below_restore_ = 0;
+}
+
+} // namespace hebi
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+
+namespace hebi {
+
+// Decides which optional work the control loop should skip, based on how long
+// the loop's ticks are taking compared to the control period.
+//
+// The loop reports the time each tick spent working (excluding the sleep until
+// the next tick).  The policy keeps an exponentially weighted average of the
+// resulting utilization; if it gets too high (or a tick overruns the period),
+// the next level of optional work is shed.  When the average has stayed low for
+// a while, work is restored again one level at a time.  Every change is logged.
+class DegradationPolicy
+{
+public:
+  // Levels, in the order work is shed.  Each level includes all of the
+  // degradations of the levels before it.
+  enum class Level
+  {
+    Full = 0,
+    NoVisualization,       // skip rendering updates
+    NoStatusLabels,        // skip GUI status label updates
+    ReuseStepTrajectories, // don't replan in-flight steps; follow the existing trajectory
+    ReducedLogging,        // keep the module logs at the low frequency
+    ReducedPrecision,      // recompute secondary quantities (foot forces) less often
+    NumLevels
+  };
+
+  // period_s: the control period the loop is trying to hold.
+  // degrade_utilization: shed work when the averaged utilization exceeds this.
+  // restore_utilization: restore work when the averaged utilization has stayed
+  //   below this for 'restore_hold_s'.
+  DegradationPolicy(double period_s,
+                    double degrade_utilization = 0.8,
+                    double restore_utilization = 0.5,
+                    double restore_hold_s = 2.0);
+
+  // Call once per tick with the time spent working in the previous tick;
+  // returns the level to use for this tick.
+  Level update(double tick_work_s);
+
+  Level getLevel() const { return level_; }
+  double getAverageUtilization() const { return avg_utilization_; }
+
+  bool shouldVisualize() const { return level_ < Level::NoVisualization; }
+  bool shouldUpdateStatusLabels() const { return level_ < Level::NoStatusLabels; }
+  bool shouldReplanSteps() const { return level_ < Level::ReuseStepTrajectories; }
+  bool shouldLogAtHighFrequency() const { return level_ < Level::ReducedLogging; }
+  // At reduced precision, secondary computations only run every other tick.
+  bool shouldComputeSecondary() const { return level_ < Level::ReducedPrecision || (tick_count_ % 2) == 0; }
+
+  static const char* getLevelName(Level level);
+
+private:
+  void setLevel(Level level, const std::string& reason);
+
+  const double period_s_;
+  const double degrade_utilization_;
+  const double restore_utilization_;
+  const int restore_hold_ticks_;
+  // Don't shed more work until a change has had a few ticks to take effect
+  // (overruns excepted).
+  const int min_ticks_between_degrades_ = 20;
+  // Weight of each new sample in the average
+  const double ewma_alpha_ = 0.1;
+
+  Level level_ = Level::Full;
+  double avg_utilization_ = 0;
+  long tick_count_ = 0;
+  long last_change_tick_ = 0;
+  int ticks_below_restore_ = 0;
+};
+
+} // namespace hebi
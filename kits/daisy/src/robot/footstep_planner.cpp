@@ -0,0 +1,209 @@
+#include "footstep_planner.hpp"
+#include "hexapod.hpp"
+
+#include <cmath>
+#include <limits>
+
+namespace hebi {
+
+constexpr int FootstepPlanner::num_legs_;
+constexpr int FootstepPlanner::max_steps_;
+constexpr double FootstepPlanner::horizon_;
+constexpr double FootstepPlanner::position_tolerance_;
+constexpr double FootstepPlanner::velocity_tolerance_;
+
+namespace {
+
+FootstepPlanner::Plan emptyPlan()
+{
+  FootstepPlanner::Plan plan;
+  plan.input_sequence_ = 0;
+  plan.num_steps_ = 0;
+  return plan;
+}
+
+} // namespace
+
+FootstepPlanner::FootstepPlanner(const HexapodParameters& params,
+                                 std::vector<std::unique_ptr<robot_model::RobotModel>> kinematics,
+                                 std::vector<Eigen::VectorXd> seed_angles)
+  : params_(params), kinematics_(std::move(kinematics)), seed_angles_(std::move(seed_angles)),
+    inputs_(InputSlot{Input(), 0}), plans_(emptyPlan())
+{
+  planner_ = std::thread(&FootstepPlanner::run, this);
+}
+
+FootstepPlanner::~FootstepPlanner()
+{
+  {
+    std::lock_guard<std::mutex> lock(wake_lock_);
+    quit_ = true;
+  }
+  wake_cv_.notify_one();
+  planner_.join();
+}
+
+void FootstepPlanner::submit(const Input& input)
+{
+  InputSlot& slot = inputs_.getWriteBuffer();
+  slot.input_ = input;
+  slot.sequence_ = ++submit_sequence_;
+  inputs_.publish();
+  submitted_.store(submit_sequence_, std::memory_order_release);
+  // As in util::CommandTransmitter, don't wait for the lock if the planner
+  // holds it; the wait timeout covers the rare missed wakeup.
+  if (wake_lock_.try_lock())
+    wake_lock_.unlock();
+  wake_cv_.notify_one();
+}
+
+const FootstepPlanner::PlannedStep* FootstepPlanner::matchStep(unsigned legs,
+  const std::array<Eigen::Vector3d, num_legs_>& stance,
+  const std::array<Eigen::Vector3d, num_legs_>& stance_vel,
+  const std::array<Eigen::Vector3d, num_legs_>& home_stance)
+{
+  plans_.update();
+  const Plan& plan = plans_.getReadBuffer();
+  const PlannedStep* step = nullptr;
+  for (int i = 0; i < plan.num_steps_; ++i)
+  {
+    if (plan.steps_[i].legs_ == legs)
+    {
+      step = &plan.steps_[i];
+      break;
+    }
+  }
+  if (!step)
+  {
+    unplanned_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  for (int i = 0; i < num_legs_; ++i)
+  {
+    if ((legs & (1u << i)) == 0)
+      continue;
+    const StepPlan& leg_plan = step->plans_[i];
+    Eigen::Vector3d touch_down = home_stance[i] - (Step::overshoot_ * Step::period_ * stance_vel[i]);
+    if ((leg_plan.lift_up_ - stance[i]).norm() > position_tolerance_ ||
+        (leg_plan.lift_off_vel_ - stance_vel[i]).norm() > velocity_tolerance_ ||
+        (leg_plan.touch_down_ - touch_down).norm() > position_tolerance_)
+    {
+      rejected_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+  }
+  adopted_.fetch_add(1, std::memory_order_relaxed);
+  return step;
+}
+
+FootstepPlanner::Statistics FootstepPlanner::getStatistics() const
+{
+  uint64_t planned = planned_.load(std::memory_order_relaxed);
+  double count = planned > 0 ? static_cast<double>(planned) : 1.0;
+  return Statistics{ submitted_.load(std::memory_order_relaxed), planned,
+                     adopted_.load(std::memory_order_relaxed),
+                     rejected_.load(std::memory_order_relaxed),
+                     unplanned_.load(std::memory_order_relaxed),
+                     total_plan_ns_.load(std::memory_order_relaxed) * 1e-3 / count,
+                     max_plan_ns_.load(std::memory_order_relaxed) * 1e-3 };
+}
+
+void FootstepPlanner::run()
+{
+  uint64_t last_sequence = 0;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(wake_lock_);
+      wake_cv_.wait_for(lock, std::chrono::milliseconds(1), [this, last_sequence]
+        { return quit_ || submitted_.load(std::memory_order_acquire) != last_sequence; });
+      if (quit_)
+        return;
+    }
+    if (!inputs_.update())
+      continue;
+    const InputSlot& slot = inputs_.getReadBuffer();
+    last_sequence = slot.sequence_;
+
+    auto start = clock::now();
+    Plan& plan = plans_.getWriteBuffer();
+    makePlan(slot.input_, plan);
+    plan.input_sequence_ = slot.sequence_;
+    plans_.publish();
+    uint64_t ns = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+
+    // Only this thread writes these
+    total_plan_ns_.store(total_plan_ns_.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    if (ns > max_plan_ns_.load(std::memory_order_relaxed))
+      max_plan_ns_.store(ns, std::memory_order_relaxed);
+    planned_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void FootstepPlanner::makePlan(const Input& input, Plan& plan)
+{
+  plan.num_steps_ = 0;
+  if (!input.walking_ || !(input.dt_ > 0))
+    return;
+
+  // Predicted state at each tick, as in Hexapod::updateStance (which is
+  // followed by Hexapod::needToStep)
+  std::array<Eigen::Vector3d, num_legs_> stance = input.stance_;
+  std::array<Eigen::Vector3d, num_legs_> stance_vel;
+  std::array<Eigen::Vector3d, num_legs_> level_home_stance = input.level_home_stance_;
+  Eigen::MatrixXd feet_xyz(3, num_legs_);
+  Eigen::MatrixXd base_xyz(3, num_legs_);
+
+  const unsigned all_legs = (1u << num_legs_) - 1;
+  double step_start_time = input.step_start_time_;
+  unsigned flight_legs = std::isnan(step_start_time) ? 0 : (~input.next_legs_ & all_legs);
+  unsigned next_legs = input.next_legs_;
+  int num_ticks = static_cast<int>(horizon_ / input.dt_);
+  for (int tick = 1; tick <= num_ticks && plan.num_steps_ < max_steps_; ++tick)
+  {
+    double prev_t = input.time_ + (tick - 1) * input.dt_;
+    double t = input.time_ + tick * input.dt_;
+    // The active step finished on the last tick (see Step::update); its legs
+    // are now in stance from their touch down points
+    if (flight_legs != 0 && prev_t - step_start_time > Step::period_)
+      flight_legs = 0;
+
+    Eigen::Vector3d trans_vel = Hexapod::limitTranslationVelocity(
+      input.trans_vel_, level_home_stance[0](2), input.dt_, params_);
+    for (int i = 0; i < num_legs_; ++i)
+    {
+      // Legs in flight stay at their touch down points
+      Eigen::Vector3d touch_down = stance[i];
+      Leg::integrateStance(trans_vel, input.rot_vel_, input.dt_, stance[i], stance_vel[i], level_home_stance[i]);
+      if (flight_legs & (1u << i))
+        stance[i] = touch_down;
+      feet_xyz.col(i) = stance[i];
+      base_xyz.col(i) = Leg::computeHomeStance(level_home_stance[i], trans_vel);
+    }
+    if (flight_legs != 0)
+      continue;
+    if (!Hexapod::shouldStep(Hexapod::computeBodyPose(feet_xyz, base_xyz), trans_vel, params_))
+      continue;
+
+    // A step starts on this tick: plan it from the predicted stance
+    PlannedStep& step = plan.steps_[plan.num_steps_];
+    step.start_time_ = t;
+    step.legs_ = next_legs;
+    for (int i = 0; i < num_legs_; ++i)
+    {
+      if ((next_legs & (1u << i)) == 0)
+        continue;
+      if (!Step::planInitial(*kinematics_[i], seed_angles_[i], stance[i], base_xyz.col(i), stance_vel[i], step.plans_[i]))
+        return;
+      stance[i] = step.plans_[i].touch_down_;
+    }
+    ++plan.num_steps_;
+    flight_legs = next_legs;
+    step_start_time = t;
+    next_legs = ~next_legs & all_legs;
+  }
+}
+
+} // namespace hebi
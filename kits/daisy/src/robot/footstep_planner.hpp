@@ -0,0 +1,167 @@
+#pragma once
+
+#include "robot_model.hpp"
+#include "step.hpp"
+#include "hexapod_parameters.hpp"
+#include "util/triple_buffer.hpp"
+
+#include <Eigen/Dense>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hebi {
+
+// Plans the next steps of the alternating tripod gait ahead of time.
+//
+// After each control tick, the hexapod submits its stance and velocity
+// command.  A background thread predicts the stance forward at the same
+// velocity, finds when the next steps will be triggered and where each
+// stepping foot lifts off and touches down, and solves the IK and trajectory
+// for each; the newest plan is published through a lock-free buffer.  When a
+// step starts, the control thread only has to check that the planned lift off
+// and touch down points match the actual ones (see 'matchStep'), and then
+// adopts the plan instead of planning the step itself.
+//
+// The prediction assumes the velocity command and control period stay the
+// same, so plans made well ahead are refined with every tick; if a step
+// starts earlier than predicted, or the command changed, its plan won't
+// match and the step is planned as before.
+class FootstepPlanner
+{
+public:
+  static constexpr int num_legs_ = 6;
+  // The number of steps planned ahead
+  static constexpr int max_steps_ = 2;
+  // How far ahead to look for steps [s]
+  static constexpr double horizon_ = 2.0;
+  // How closely a plan must match the actual step to be used [m], [m/s]
+  static constexpr double position_tolerance_ = 0.001;
+  static constexpr double velocity_tolerance_ = 0.005;
+
+  // The state of the hexapod at the end of a control tick.
+  struct Input
+  {
+    double time_;
+    // The last control period; assumed to continue
+    double dt_;
+    // Commanded (but not yet limited) translational velocity, and the limited
+    // rotational velocity
+    Eigen::Vector3d trans_vel_;
+    Eigen::Vector3d rot_vel_;
+    // Where each foot is next in stance (see Leg::getNextStanceXYZ)
+    std::array<Eigen::Vector3d, num_legs_> stance_;
+    std::array<Eigen::Vector3d, num_legs_> level_home_stance_;
+    // False in stance mode, where no steps are taken
+    bool walking_;
+    // The start of the active step, or NaN if no legs are stepping
+    double step_start_time_;
+    // Bitmask of the legs that take the next step
+    unsigned next_legs_;
+  };
+
+  // A step predicted to start at 'start_time_', with a plan for each leg in
+  // the 'legs_' bitmask.
+  struct PlannedStep
+  {
+    double start_time_;
+    unsigned legs_;
+    std::array<StepPlan, num_legs_> plans_;
+  };
+
+  struct Plan
+  {
+    // Which input this was planned from (0 if none)
+    uint64_t input_sequence_;
+    int num_steps_;
+    std::array<PlannedStep, max_steps_> steps_;
+  };
+
+  struct Statistics
+  {
+    // Inputs submitted by the control thread
+    uint64_t inputs_;
+    // Plans published by the planner thread
+    uint64_t plans_;
+    // Steps started with a planned step, with one that didn't match, or with
+    // no plan for that step
+    uint64_t adopted_;
+    uint64_t rejected_;
+    uint64_t unplanned_;
+    // Time taken to make each plan [us]
+    double mean_plan_us_;
+    double max_plan_us_;
+  };
+
+  // Starts the planner thread.  'kinematics' and 'seed_angles' are for each
+  // leg; the kinematics are only used by the planner thread.
+  FootstepPlanner(const HexapodParameters& params,
+                  std::vector<std::unique_ptr<robot_model::RobotModel>> kinematics,
+                  std::vector<Eigen::VectorXd> seed_angles);
+  ~FootstepPlanner();
+
+  FootstepPlanner(const FootstepPlanner&) = delete;
+  FootstepPlanner& operator=(const FootstepPlanner&) = delete;
+
+  // Hands off the state at the end of a control tick, and wakes the planner.
+  // Call from the control thread; does not block or allocate.
+  void submit(const Input& input);
+
+  // Finds the planned step for 'legs' in the newest plan, and checks that each
+  // leg's plan starts from the given stance and stance velocity, and touches
+  // down relative to the given home stance (all indexed by leg).  Returns null
+  // if there is no such step or it doesn't match.  Call from the control
+  // thread; the result is valid until the next call.
+  const PlannedStep* matchStep(unsigned legs,
+                               const std::array<Eigen::Vector3d, num_legs_>& stance,
+                               const std::array<Eigen::Vector3d, num_legs_>& stance_vel,
+                               const std::array<Eigen::Vector3d, num_legs_>& home_stance);
+
+  Statistics getStatistics() const;
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  struct InputSlot
+  {
+    Input input_;
+    uint64_t sequence_;
+  };
+
+  void run();
+  // Fills in 'plan' from 'input'; only called from the planner thread.
+  void makePlan(const Input& input, Plan& plan);
+
+  const HexapodParameters params_;
+  // Only touched by the planner thread
+  std::vector<std::unique_ptr<robot_model::RobotModel>> kinematics_;
+  const std::vector<Eigen::VectorXd> seed_angles_;
+
+  util::TripleBuffer<InputSlot> inputs_;
+  util::TripleBuffer<Plan> plans_;
+
+  // Only touched by the submitting thread
+  uint64_t submit_sequence_{0};
+
+  std::atomic<uint64_t> submitted_{0};
+  std::atomic<uint64_t> planned_{0};
+  std::atomic<uint64_t> adopted_{0};
+  std::atomic<uint64_t> rejected_{0};
+  std::atomic<uint64_t> unplanned_{0};
+  std::atomic<uint64_t> total_plan_ns_{0};
+  std::atomic<uint64_t> max_plan_ns_{0};
+
+  std::mutex wake_lock_;
+  std::condition_variable wake_cv_;
+  bool quit_{false};
+  std::thread planner_;
+};
+
+} // namespace hebi
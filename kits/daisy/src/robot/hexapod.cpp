@@ -6,11 +6,16 @@
 #include "step.hpp"
 
 #include "hexapod.hpp"
+#include "checkpoint.hpp"
+#include "footstep_planner.hpp"
+
+#include "util/trace.hpp"
 
 #include <chrono>
 #include <thread>
 #include <ctime>
 #include <fstream>
+#include <limits>
 
 namespace hebi {
 
@@ -66,35 +71,44 @@ std::unique_ptr<Hexapod> Hexapod::createDummy(const HexapodParameters& params)
 // function retrieves it from the hexapod)
 void Hexapod::updateStance(const Eigen::Vector3d& translation_velocity, const Eigen::Vector3d& rotation_velocity, double dt)
 {
-  Eigen::Vector3d trans_vel_limited = translation_velocity;
-  // Cap Z velocity if we are too high
-  double cur_z = legs_[0]->getLevelHomeStanceZ();
-  double dz = trans_vel_limited(2) * dt;
-  if (cur_z + dz > params_.max_z_)
-    trans_vel_limited(2) = (params_.max_z_ - cur_z) / dt;
-  if (cur_z + dz < params_.min_z_)
-    trans_vel_limited(2) = (params_.min_z_ - cur_z) / dt;
+  Eigen::Vector3d trans_vel_limited = limitTranslationVelocity(
+    translation_velocity, legs_[0]->getLevelHomeStanceZ(), dt, params_);
 
   Eigen::Vector3d rot_vel_limited = rotation_velocity;
   // Don't tilt in step!
   if (mode_ == Mode::Step)
     rot_vel_limited(1) = 0;
 
-  Eigen::VectorXd all_angles(num_angles_);
   {
-    std::lock_guard<std::mutex> guard(fbk_lock_);
-    all_angles = positions_;
+    auto guard = util::tracedLock(fbk_lock_, "wait fbk_lock_");
+    control_positions_ = positions_;
   }
   int num_joints = Leg::getNumJoints();
   Eigen::VectorXd current_leg_angles(num_joints);
   for (int i = 0; i < num_legs_; ++i)
   {
     // subsample from full vector
-    current_leg_angles = all_angles.segment(num_joints * i, num_joints);
+    current_leg_angles = control_positions_.segment(num_joints * i, num_joints);
     // Update stance of leg
     legs_[i]->updateStance(trans_vel_limited, rot_vel_limited, current_leg_angles, dt);
   }
   vel_xyz_ = trans_vel_limited;
+  cmd_vel_xyz_ = translation_velocity;
+  rot_vel_ = rot_vel_limited;
+  dt_ = dt;
+}
+
+Eigen::Vector3d Hexapod::limitTranslationVelocity(const Eigen::Vector3d& trans_vel, double level_home_z, double dt, const HexapodParameters& params)
+{
+  Eigen::Vector3d trans_vel_limited = trans_vel;
+  // Cap Z velocity if we are too high
+  double cur_z = level_home_z;
+  double dz = trans_vel_limited(2) * dt;
+  if (cur_z + dz > params.max_z_)
+    trans_vel_limited(2) = (params.max_z_ - cur_z) / dt;
+  if (cur_z + dz < params.min_z_)
+    trans_vel_limited(2) = (params.min_z_ - cur_z) / dt;
+  return trans_vel_limited;
 }
 
 void Hexapod::setCommand(int leg_index, const VectorXd* angles, const VectorXd* vels, const VectorXd* torques)
@@ -107,40 +121,45 @@ void Hexapod::setCommand(int leg_index, const VectorXd* angles, const VectorXd*
     if (angles != nullptr)
     {
       int leg_offset = leg_index * num_joints;
-      std::lock_guard<std::mutex> guard(fbk_lock_);
+      control_positions_.segment(leg_offset, num_joints) = *angles;
+      auto guard = util::tracedLock(fbk_lock_, "wait fbk_lock_");
       positions_.segment(leg_offset, num_joints) = *angles;
     }
-    return;
+    // A dummy hexapod still fills in a (never sent) command for every leg, so
+    // that it does the same work as a real one (e.g., for benchmarking).
+    if (group_)
+      return;
   }
   // Get leg offset, taking into account all legs may not be present. First,
   // count the number of legs before this one:
-  int legs_prev = std::count_if(real_legs_.begin(), real_legs_.end(),
+  int legs_prev = !group_ ? leg_index : std::count_if(real_legs_.begin(), real_legs_.end(),
     [leg_index](int real_leg_idx) {return real_leg_idx < leg_index; });
   int leg_offset = legs_prev * num_joints;
   if (angles != nullptr)
   {
     assert(angles->size() == num_joints);
     for (int i = 0; i < num_joints; ++i)
-      cmd_[leg_offset + i].actuator().position().set((*angles)[i]);
+      cmd_.positions_(leg_offset + i) = (*angles)[i];
   }
   if (vels != nullptr)
   {
     assert(vels->size() == num_joints);
     for (int i = 0; i < num_joints; ++i)
-      cmd_[leg_offset + i].actuator().velocity().set((*vels)[i]);
+      cmd_.velocities_(leg_offset + i) = (*vels)[i];
   }
   if (torques != nullptr)
   {
     assert(torques->size() == num_joints);
     for (int i = 0; i < num_joints; ++i)
-      cmd_[leg_offset + i].actuator().effort().set((*torques)[i]);
+      cmd_.efforts_(leg_offset + i) = (*torques)[i];
   }
 }
 
 void Hexapod::sendCommand()
 {
-  if (group_)
-    group_->sendCommand(cmd_);
+  HEBI_TRACE_SCOPE("send command");
+  if (transmitter_)
+    transmitter_->submit(cmd_);
 }
 
 bool Hexapod::setGains()
@@ -148,11 +167,25 @@ bool Hexapod::setGains()
   if (!group_)
     return true;
 
-  hebi::GroupCommand gains(group_->size());
-  std::string gains_file = std::string("gains") + std::to_string(group_->size()) + ".xml";
-  std::cout << "Loading gains from: " << gains_file << std::endl;
-  bool success = gains.readGains(gains_file);
-  return success && group_->sendCommandWithAcknowledgement(gains, 4000);
+  int profile = gain_profiles_->find("default");
+  if (profile < 0)
+    return false;
+  gain_switcher_->select(profile);
+
+  // Nothing else is sent before the control loop starts, so the gains go out
+  // with empty commands (resent as needed) until the modules report them.
+  util::CommandFrame empty(group_->size());
+  while (true)
+  {
+    util::GainProfileSwitcher::Status status = gain_switcher_->update();
+    if (status == util::GainProfileSwitcher::Status::Confirmed)
+      return true;
+    if (status == util::GainProfileSwitcher::Status::Failed)
+      return false;
+    if (gain_switcher_->isSendPending())
+      transmitter_->submit(empty);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
 }
 
 void Hexapod::updateMode(int num_toggles)
@@ -171,7 +204,6 @@ void Hexapod::updateMode(int num_toggles)
 Eigen::Matrix4d Hexapod::getBodyPoseFromFeet()
 {
   int num_legs = legs_.size();
-  // Create zero-meaned COM values for feet and base
   MatrixXd feet_xyz(3, num_legs);
   MatrixXd base_xyz(3, num_legs);
   for (unsigned int i = 0; i < legs_.size(); ++i)
@@ -182,14 +214,18 @@ Eigen::Matrix4d Hexapod::getBodyPoseFromFeet()
       feet_xyz.block<3,1>(0,i) = legs_[i]->getFbkStanceXYZ();
     base_xyz.block<3,1>(0,i) = legs_[i]->getHomeStanceXYZ();
   }
-  auto& feet_xyz_com_tmp = feet_xyz.rowwise().mean();
-  auto& base_xyz_com_tmp = base_xyz.rowwise().mean();
-  Eigen::Vector3d feet_xyz_com = feet_xyz_com_tmp;
-  Eigen::Vector3d base_xyz_com = base_xyz_com_tmp;
+  return computeBodyPose(feet_xyz, base_xyz);
+}
+
+Eigen::Matrix4d Hexapod::computeBodyPose(const Eigen::MatrixXd& feet, const Eigen::MatrixXd& base)
+{
+  // Create zero-meaned COM values for feet and base
+  Eigen::Vector3d feet_xyz_com = feet.rowwise().mean();
+  Eigen::Vector3d base_xyz_com = base.rowwise().mean();
   // NOTE: I don't think these "eval" expressions are necessary to prevent
   // Eigen aliasing, but better safe than sorry while debugging.
-  feet_xyz = (feet_xyz.colwise() - feet_xyz_com).eval();
-  base_xyz = (base_xyz.colwise() - base_xyz_com).eval();
+  MatrixXd feet_xyz = (feet.colwise() - feet_xyz_com).eval();
+  MatrixXd base_xyz = (base.colwise() - base_xyz_com).eval();
 
   // SVN of weighted corrolation matrix:
   Matrix3d xyz_corr = base_xyz * (feet_xyz.transpose());
@@ -215,18 +251,22 @@ bool Hexapod::needToStep()
   if (mode_ == Stance || isStepping())
     return false;
 
-  Eigen::Matrix4d shift_pose = getBodyPoseFromFeet();
+  return shouldStep(getBodyPoseFromFeet(), vel_xyz_, params_);
+}
+
+bool Hexapod::shouldStep(const Eigen::Matrix4d& shift_pose, const Eigen::Vector3d& trans_vel, const HexapodParameters& params)
+{
   auto stance_shift = shift_pose.topRightCorner<3,1>();
 
   // Rotated too much
   float yaw = std::abs(std::atan2(shift_pose(1,0), shift_pose(0,0)));
-  if (yaw > params_.step_threshold_rotate_)
+  if (yaw > params.step_threshold_rotate_)
     return true;
 
   // Shifted too much in translation
   float sq_pos_norm = stance_shift(0) * stance_shift(0) + stance_shift(1) * stance_shift(1);
-  float sq_vel_norm = vel_xyz_(0) * vel_xyz_(0) + vel_xyz_(1) * vel_xyz_(1);
-  if ((std::sqrt(sq_pos_norm) + std::sqrt(sq_vel_norm) * Step::period_) > params_.step_threshold_shift_)
+  float sq_vel_norm = trans_vel(0) * trans_vel(0) + trans_vel(1) * trans_vel(1);
+  if ((std::sqrt(sq_pos_norm) + std::sqrt(sq_vel_norm) * Step::period_) > params.step_threshold_shift_)
     return true;
 
   return false;
@@ -252,27 +292,66 @@ void Hexapod::startStep(double t)
 
   // Update which legs should be active
   std::set<int> this_step_legs;
+  unsigned step_legs = 0;
   for (int i = 0; i < num_legs_; ++i)
   {
     if (last_step_legs_.count(i) == 0)
     {
       this_step_legs.insert(i);
-      legs_[i]->startStep(t);
+      step_legs |= 1u << i;
+    }
+  }
+
+  // Use the planned step if it starts from where we are now
+  const FootstepPlanner::PlannedStep* planned = nullptr;
+  if (footstep_planner_)
+  {
+    std::array<Eigen::Vector3d, FootstepPlanner::num_legs_> stance, stance_vel, home_stance;
+    for (int i = 0; i < num_legs_; ++i)
+    {
+      stance[i] = legs_[i]->getCmdStanceXYZ();
+      stance_vel[i] = legs_[i]->getStanceVelXYZ();
+      home_stance[i] = legs_[i]->getHomeStanceXYZ();
     }
+    planned = footstep_planner_->matchStep(step_legs, stance, stance_vel, home_stance);
   }
 
+  for (int i : this_step_legs)
+    legs_[i]->startStep(t, planned ? &planned->plans_[i] : nullptr);
+
   // Save the new starting step state 
   last_step_legs_ = this_step_legs;
 }
 
-void Hexapod::updateSteps(double t)
+void Hexapod::updateSteps(double t, bool replan)
 {
   for (auto& leg : legs_)
   {
     // Replan trajectory every timestep for legs in flight
     if (leg->getMode() == Leg::Mode::Flight)
-      leg->updateStep(t);
+      leg->updateStep(t, replan);
   }
+
+  if (!footstep_planner_)
+    return;
+  FootstepPlanner::Input input;
+  input.time_ = t;
+  input.dt_ = dt_;
+  input.trans_vel_ = cmd_vel_xyz_;
+  input.rot_vel_ = rot_vel_;
+  input.walking_ = mode_ == Mode::Step;
+  input.step_start_time_ = std::numeric_limits<double>::quiet_NaN();
+  input.next_legs_ = 0;
+  for (int i = 0; i < num_legs_; ++i)
+  {
+    input.stance_[i] = legs_[i]->getNextStanceXYZ();
+    input.level_home_stance_[i] = legs_[i]->getLevelHomeStanceXYZ();
+    if (legs_[i]->getMode() == Leg::Mode::Flight)
+      input.step_start_time_ = t - legs_[i]->getStepTime(t);
+    if (last_step_legs_.count(i) == 0)
+      input.next_legs_ |= 1u << i;
+  }
+  footstep_planner_->submit(input);
 }
 
 Eigen::VectorXd Hexapod::getLegFeedback(int leg_index)
@@ -281,7 +360,7 @@ Eigen::VectorXd Hexapod::getLegFeedback(int leg_index)
   int num_joints = Leg::getNumJoints();
   int leg_offset = leg_index * num_joints;
 
-  std::lock_guard<std::mutex> guard(fbk_lock_);
+  auto guard = util::tracedLock(fbk_lock_, "wait fbk_lock_");
 
   for (int i = 0; i < num_joints; ++i)
     leg_angles[i] = positions_[leg_offset + i];
@@ -293,7 +372,7 @@ void Hexapod::computeFootForces(double t, Eigen::MatrixXd& foot_forces)
 {
   Eigen::VectorXd factors(6);
   Eigen::VectorXd blend_factors(6);
-  Eigen::Vector3d grav = -gravity_direction_;
+  Eigen::Vector3d grav = -getGravityDirection();
   // Get the dot product of gravity with each leg, and then subtract a scaled
   // gravity from the foot stance position.
   // NOTE: Matt is skeptical about this overall approach; but it worked before so we are keeping
@@ -417,7 +496,7 @@ bool getMStopPressed(const hebi::GroupFeedback& fbk)
 
 std::chrono::time_point<std::chrono::steady_clock> Hexapod::getLastFeedbackTime()
 {
-  std::lock_guard<std::mutex> guard(fbk_lock_);
+  auto guard = util::tracedLock(fbk_lock_, "wait fbk_lock_");
   return last_fbk;
 }
 
@@ -425,17 +504,17 @@ void Hexapod::clearLegColors()
 {
   if (!group_)
     return;
-  GroupCommand cmd(group_->size());
+  util::LedFrame leds(group_->size());
   for (int i = 0; i < group_->size(); ++i)
-    cmd[i].led().set(hebi::Color(0,0,0,0));
-  group_->sendCommand(cmd);
+    leds.set(i, hebi::Color(0,0,0,0));
+  sendLeds(leds);
 }
 
 void Hexapod::setLegColor(int leg_index, uint8_t r, uint8_t g, uint8_t b)
 {
   if (!group_)
     return;
-  GroupCommand cmd(group_->size());
+  util::LedFrame leds(group_->size());
 
   // Fancy mapping to allow for partial sets of legs...
   int leg_count = 6;
@@ -448,34 +527,49 @@ void Hexapod::setLegColor(int leg_index, uint8_t r, uint8_t g, uint8_t b)
       // This is the leg we want to set:
       if (leg_index == i)
       {
-        cmd[leg_module_start].led().set(hebi::Color(r, g, b));
-        cmd[leg_module_start + 1].led().set(hebi::Color(r, g, b));
-        cmd[leg_module_start + 2].led().set(hebi::Color(r, g, b));
+        leds.set(leg_module_start, hebi::Color(r, g, b));
+        leds.set(leg_module_start + 1, hebi::Color(r, g, b));
+        leds.set(leg_module_start + 2, hebi::Color(r, g, b));
         break;
       }
       leg_module_start += 3;
     }
   }
 
-  group_->sendCommand(cmd);
+  sendLeds(leds);
+}
+
+void Hexapod::sendLeds(const util::LedFrame& leds)
+{
+  // Through the transmitter, so that it is ordered with the other commands;
+  // nothing else is being sent outside of the control loop, so it goes out
+  // with an empty command.
+  transmitter_->requestLeds(leds);
+  transmitter_->submit(util::CommandFrame(group_->size()));
 }
 
 Eigen::Vector3d Hexapod::getGravityDirection()
 {
-  std::lock_guard<std::mutex> lg(grav_lock_);
-  return gravity_direction_;
+  std::array<double, 3> gravity_direction = gravity_direction_.load();
+  return Eigen::Vector3d::Map(gravity_direction.data());
 }
 
-// Note -- because the "cmd_" object is a class member, we have to provide some constructor
-// here, and so we just give it a size '1' if there is no group.  This could become a smart
-// pointer instead?
+void Hexapod::setGravityDirection(const Eigen::Vector3d& gravity_direction)
+{
+  std::array<double, 3> value;
+  Eigen::Vector3d::Map(value.data()) = gravity_direction;
+  gravity_direction_.store(value);
+}
+
+// Note -- "cmd_" is sized for the group; if there is no group, it is sized for
+// all legs of a dummy hexapod.
 Hexapod::Hexapod(std::shared_ptr<Group> group,
                  std::shared_ptr<Group> log_group_input,
                  std::shared_ptr<Group> log_group_modules,
                  const HexapodParameters& params,
                  const std::set<int>& real_legs,
                  HexapodErrors& hex_errors)
- : real_legs_(real_legs), group_(group), log_group_input_(log_group_input), log_group_modules_(log_group_modules), cmd_(group_ ? group_->size() : 1),
+ : real_legs_(real_legs), group_(group), log_group_input_(log_group_input), log_group_modules_(log_group_modules), cmd_(group_ ? group_->size() : 6 * Leg::getNumJoints()),
    params_(params), mode_(Mode::Step)
 {
   // TODO: What should the initial dummy position be?
@@ -496,6 +590,7 @@ Hexapod::Hexapod(std::shared_ptr<Group> group,
     hex_errors.first_out_of_range_leg = getFirstOutOfRange(positions_);
     hex_errors.m_stop_pressed = getMStopPressed(fbk);
   }
+  control_positions_ = positions_;
 
   // TODO: generalize!
   legs_.emplace_back(new Leg(30.0 * M_PI / 180.0, 0.2375, getLegFeedback(0), params, real_legs_.count(0)>0, 0, Leg::LegConfiguration::Left));
@@ -505,81 +600,201 @@ Hexapod::Hexapod(std::shared_ptr<Group> group,
   legs_.emplace_back(new Leg(150.0 * M_PI / 180.0, 0.2375, getLegFeedback(4), params, real_legs_.count(4)>0, 4, Leg::LegConfiguration::Left));
   legs_.emplace_back(new Leg(-150.0 * M_PI / 180.0, 0.2375, getLegFeedback(5), params, real_legs_.count(5)>0, 5, Leg::LegConfiguration::Right));
 
+  // The planner gets its own copy of the kinematics for each leg
+  std::vector<std::unique_ptr<robot_model::RobotModel>> planner_kinematics;
+  std::vector<Eigen::VectorXd> planner_seed_angles;
+  for (auto& leg : legs_)
+  {
+    auto kin = leg->cloneKinematics();
+    if (!kin)
+      break;
+    planner_kinematics.push_back(std::move(kin));
+    planner_seed_angles.push_back(leg->getSeedAngles());
+  }
+  if (static_cast<int>(planner_kinematics.size()) == num_legs_)
+    footstep_planner_.reset(new FootstepPlanner(params_, std::move(planner_kinematics), std::move(planner_seed_angles)));
+
   // Initialize step information
   last_step_legs_.insert(0);
   last_step_legs_.insert(3);
   last_step_legs_.insert(4);
 
   // Default to straight down w/ a level chassis
-  gravity_direction_ = -Eigen::Vector3d::UnitZ();
+  setGravityDirection(-Eigen::Vector3d::UnitZ());
+
+  // Commands are sent from a separate thread, so that the control loop doesn't
+  // wait on serialization and the network.  Gains are parsed once here, and
+  // sent along with a command when 'setGains' selects them.
+  if (group_)
+  {
+    gain_profiles_ = std::make_shared<util::GainProfiles>(group_->size());
+    std::string gains_file = std::string("gains") + std::to_string(group_->size()) + ".xml";
+    std::cout << "Loading gains from: " << gains_file << std::endl;
+    if (gain_profiles_->load("default", gains_file) < 0)
+      std::cerr << "Could not load gains from " << gains_file << std::endl;
+    transmitter_.reset(new util::CommandTransmitter(group_, util::CommandTransmitter::lastCpu(), gain_profiles_));
+    gain_switcher_.reset(new util::GainProfileSwitcher(group_, gain_profiles_, *transmitter_));
+  }
 
   last_fbk = std::chrono::steady_clock::now();
-  // Start a background feedback handler
+  // Start a background feedback handler.  The API's feedback thread only
+  // copies out what we need from each packet; the rest is done on a worker
+  // thread from the newest packet, so if it falls behind, stale packets are
+  // skipped rather than queued.
   if (group_)
   {
+    FeedbackSnapshot initial_snapshot;
+    initial_snapshot.positions_ = positions_;
+    initial_snapshot.orientations_ = Eigen::MatrixXd::Constant(4, num_legs_, std::numeric_limits<double>::quiet_NaN());
+    feedback_handler_.reset(new util::ConflatingFeedbackHandler<FeedbackSnapshot>(
+      [this] (const GroupFeedback& fbk, FeedbackSnapshot& snapshot) { extractFeedback(fbk, snapshot); },
+      [this] (const FeedbackSnapshot& snapshot) { processFeedback(snapshot); },
+      initial_snapshot));
     // group group_   bug, but does not affert performance 
-    group->addFeedbackHandler([this] (const GroupFeedback& fbk)
-    {
-      // A -z vector in a local frame.
-      Eigen::Vector3d down(0, 0, -1);
-      Eigen::Vector3d avg_grav;
-      avg_grav.setZero();
-
-      std::lock_guard<std::mutex> guard(fbk_lock_);
-      last_fbk = std::chrono::steady_clock::now();
-      assert(fbk.size() == Leg::getNumJoints() * real_legs_.size());
-
-      // Copy data into an array
-      copyIntoPositions(positions_, &fbk, real_legs_);
-
-      // Get averaged body-frame IMU data for each leg
-      // TODO: For each, CHECK THIS IS VALID/HAS FEEDBACK!
-      int num_leg_joints = Leg::getNumJoints();
-      int num_legs_used = std::max((int)real_legs_.size(), 1);
-      int leg_count = 0;
-      for (int i = 0; i < 6 && leg_count < num_legs_used; ++i)
-      {
-        if (real_legs_.count(i) == 0)
-        {
-          continue;
-        }
-        leg_count++;
-        // Get from base of each leg
-        int num_prev_legs = std::count_if(real_legs_.begin(), real_legs_.end(), [i](int other_leg) { return other_leg < i; });
-
-        // HEBI Quaternion
-        auto mod_orientation = fbk[num_prev_legs * num_leg_joints]
-          .imu().orientation().get();
-        // Eigen Quaternion
-        Eigen::Quaterniond mod_orientation_eig(
-          mod_orientation.getW(),
-          mod_orientation.getX(),
-          mod_orientation.getY(),
-          mod_orientation.getZ());
-        Eigen::Matrix3d mod_orientation_mat = mod_orientation_eig.toRotationMatrix();
-
-        // Transform
-        Eigen::Matrix4d trans = legs_[i]->getKinematics().getBaseFrame();
-        Eigen::Vector3d my_grav = trans.topLeftCorner<3,3>() * mod_orientation_mat.transpose() * down;
-        // If one of the modules isn't reporting valid feedback, ignore this:
-        if (!std::isnan(my_grav[0]) && !std::isnan(my_grav[1]) && !std::isnan(my_grav[2]))
-          avg_grav += my_grav;
-      }
-      // Average the feedback from various modules and normalize.
-      avg_grav.normalize();
-      {
-        std::lock_guard<std::mutex> lg(grav_lock_);
-        gravity_direction_ = avg_grav;
-      }
-
-      std::chrono::duration<double, std::ratio<1>> dt =
-        (std::chrono::steady_clock::now() - this->pose_start_time_);
-      this->pose_last_time_ = dt.count();
-    });
+    feedback_handler_->attach(*group);
     group->setFeedbackFrequencyHz(1000.0 / getFeedbackPeriodMs());
   }
 }
 
+void Hexapod::extractFeedback(const GroupFeedback& fbk, FeedbackSnapshot& snapshot)
+{
+  HEBI_TRACE_THREAD_NAME("hexapod feedback");
+  HEBI_TRACE_SCOPE("hexapod feedback");
+  snapshot.time_ = std::chrono::steady_clock::now();
+  assert(fbk.size() == Leg::getNumJoints() * real_legs_.size());
+
+  // Copy data into an array
+  copyIntoPositions(snapshot.positions_, &fbk, real_legs_);
+
+  // Orientation of the base module of each real leg
+  // TODO: For each, CHECK THIS IS VALID/HAS FEEDBACK!
+  int num_leg_joints = Leg::getNumJoints();
+  int num_prev_legs = 0;
+  for (int i = 0; i < num_legs_; ++i)
+  {
+    if (real_legs_.count(i) == 0)
+      continue;
+    // HEBI Quaternion
+    auto mod_orientation = fbk[num_prev_legs * num_leg_joints]
+      .imu().orientation().get();
+    snapshot.orientations_.col(i) << mod_orientation.getW(), mod_orientation.getX(),
+      mod_orientation.getY(), mod_orientation.getZ();
+    ++num_prev_legs;
+  }
+}
+
+void Hexapod::processFeedback(const FeedbackSnapshot& snapshot)
+{
+  HEBI_TRACE_THREAD_NAME("hexapod feedback worker");
+  HEBI_TRACE_SCOPE("hexapod feedback worker");
+  // A -z vector in a local frame.
+  Eigen::Vector3d down(0, 0, -1);
+  Eigen::Vector3d avg_grav;
+  avg_grav.setZero();
+
+  auto guard = util::tracedLock(fbk_lock_, "wait fbk_lock_");
+  // Mark feedback that arrives more than 2x the feedback period after the last packet
+  // that was processed (including time spent waiting for the worker)
+  auto now = std::chrono::steady_clock::now();
+  auto gap_us = std::chrono::duration_cast<std::chrono::microseconds>(now - last_fbk).count();
+  if (gap_us > getFeedbackPeriodMs() * 2000.0)
+    HEBI_TRACE_VALUE("late feedback (us)", gap_us);
+  last_fbk = now;
+
+  // Only the real legs are updated from feedback
+  int num_leg_joints = Leg::getNumJoints();
+  for (int leg : real_legs_)
+    positions_.segment(leg * num_leg_joints, num_leg_joints) = snapshot.positions_.segment(leg * num_leg_joints, num_leg_joints);
+  position_history_.push(std::chrono::duration<double>(snapshot.time_ - history_epoch_).count(), positions_);
+
+  // Get averaged body-frame IMU data for each leg
+  for (int i : real_legs_)
+  {
+    // Eigen Quaternion
+    Eigen::Quaterniond mod_orientation_eig(
+      snapshot.orientations_(0, i),
+      snapshot.orientations_(1, i),
+      snapshot.orientations_(2, i),
+      snapshot.orientations_(3, i));
+    Eigen::Matrix3d mod_orientation_mat = mod_orientation_eig.toRotationMatrix();
+
+    // Transform
+    Eigen::Matrix4d trans = legs_[i]->getKinematics().getBaseFrame();
+    Eigen::Vector3d my_grav = trans.topLeftCorner<3,3>() * mod_orientation_mat.transpose() * down;
+    // If one of the modules isn't reporting valid feedback, ignore this:
+    if (!std::isnan(my_grav[0]) && !std::isnan(my_grav[1]) && !std::isnan(my_grav[2]))
+      avg_grav += my_grav;
+  }
+  // Average the feedback from various modules and normalize.
+  avg_grav.normalize();
+  setGravityDirection(avg_grav);
+
+  std::chrono::duration<double, std::ratio<1>> dt =
+    (std::chrono::steady_clock::now() - this->pose_start_time_);
+  this->pose_last_time_ = dt.count();
+}
+
+void Hexapod::saveState(CheckpointWriter& out)
+{
+  out.writeInt(static_cast<int32_t>(mode_));
+  out.writeUInt(static_cast<uint32_t>(last_step_legs_.size()));
+  for (int leg : last_step_legs_)
+    out.writeInt(leg);
+  out.writeMatrix(vel_xyz_);
+  out.writeMatrix(getGravityDirection());
+  out.writeMatrix(control_positions_);
+  out.writeUInt(static_cast<uint32_t>(legs_.size()));
+  for (const auto& leg : legs_)
+    leg->saveState(out);
+}
+
+bool Hexapod::restoreState(CheckpointReader& in)
+{
+  int32_t mode = 0;
+  uint32_t num_step_legs = 0;
+  in.readInt(mode);
+  in.readUInt(num_step_legs);
+  if (!in.ok() || (mode != Mode::Step && mode != Mode::Stance) || num_step_legs > legs_.size())
+    return false;
+  // Each leg index is later used to index 'legs_', so check them all (and
+  // that none repeats) before changing anything.
+  std::set<int> step_legs;
+  for (uint32_t i = 0; i < num_step_legs; ++i)
+  {
+    int32_t leg = -1;
+    if (!in.readInt(leg) || leg < 0 || leg >= static_cast<int32_t>(legs_.size()) ||
+        !step_legs.insert(leg).second)
+      return false;
+  }
+  Eigen::Vector3d vel_xyz;
+  Eigen::Vector3d gravity_direction;
+  Eigen::VectorXd positions;
+  in.readMatrix(vel_xyz);
+  in.readMatrix(gravity_direction);
+  in.readMatrix(positions);
+  if (!in.ok() || positions.size() != num_angles_)
+    return false;
+  mode_ = static_cast<Mode>(mode);
+  last_step_legs_ = std::move(step_legs);
+  vel_xyz_ = vel_xyz;
+  setGravityDirection(gravity_direction);
+  {
+    // With real modules, this is overwritten by the next feedback packet.
+    std::lock_guard<std::mutex> lg(fbk_lock_);
+    positions_ = positions;
+  }
+  control_positions_ = positions;
+  uint32_t num_legs = 0;
+  if (!in.readUInt(num_legs) || num_legs != legs_.size())
+    return false;
+  for (auto& leg : legs_)
+  {
+    if (!leg->restoreState(in))
+      return false;
+  }
+  return true;
+}
+
 void Hexapod::startLogging()
 {
   // Set up logging if enabled:
@@ -612,10 +827,14 @@ void Hexapod::startLogging()
 
 Hexapod::~Hexapod()
 {
+  footstep_planner_.reset();
+  gain_switcher_.reset();
+  transmitter_.reset();
   if (group_)
   {
     group_->setFeedbackFrequencyHz(0);
     group_->clearFeedbackHandlers();
+    feedback_handler_.reset();
   }
   if (log_group_input_)
   {
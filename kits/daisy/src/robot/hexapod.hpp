@@ -5,8 +5,15 @@
 
 #include "leg.hpp"
 #include "hexapod_parameters.hpp"
+#include "util/feedback_history.hpp"
+#include "util/conflating_feedback_handler.hpp"
+#include "util/command_transmitter.hpp"
+#include "util/gain_profile_switcher.hpp"
+#include "util/gain_profiles.hpp"
+#include "util/seqlock.hpp"
 
 #include <Eigen/Dense>
+#include <array>
 #include <memory>
 #include <set>
 #include <chrono>
@@ -26,6 +33,8 @@ using namespace Eigen;
 
 namespace hebi {
 
+class FootstepPlanner;
+
 struct HexapodErrors {
   bool has_valid_initial_feedback;
   bool m_stop_pressed;
@@ -56,6 +65,10 @@ public:
   // Actually send the command to the robot.
   void sendCommand();
 
+  // Sends the gains for this group size (loaded at startup), and waits until
+  // the modules report them.  Returns false if the gains file could not be
+  // loaded, or the modules didn't report the gains within 4 seconds.  Call
+  // before the control loop starts sending commands.
   bool setGains();
 
   // toggle the mode a specified number of times
@@ -65,11 +78,27 @@ public:
 
   bool needToStep();
 
+  // The pieces of 'getBodyPoseFromFeet', 'needToStep' and 'updateStance' that
+  // the footstep planner also uses to predict steps.  'feet_xyz' and
+  // 'base_xyz' hold the foot and home stance positions of each leg as columns.
+  static Eigen::Matrix4d computeBodyPose(const Eigen::MatrixXd& feet_xyz, const Eigen::MatrixXd& base_xyz);
+  static bool shouldStep(const Eigen::Matrix4d& shift_pose, const Eigen::Vector3d& trans_vel, const HexapodParameters& params);
+  static Eigen::Vector3d limitTranslationVelocity(const Eigen::Vector3d& trans_vel, double level_home_z, double dt, const HexapodParameters& params);
+
   bool isStepping();
 
+  // Uses the footstep planner's plan for the step, if there is one that
+  // matches the current stance.
   void startStep(double t);
 
-  void updateSteps(double t);
+  // If 'replan' is false, legs in flight keep following their current step
+  // trajectories instead of replanning them.  Call once per control tick, after
+  // 'updateStance' and any 'startStep'; hands the resulting state off to the
+  // footstep planner.
+  void updateSteps(double t, bool replan = true);
+
+  // Null if the leg kinematics could not be loaded.
+  const FootstepPlanner* getFootstepPlanner() const { return footstep_planner_.get(); }
 
   Mode getMode() { return mode_; }
 
@@ -88,11 +117,26 @@ public:
   }
   bool hasLogGroup() { if (log_group_input_ || log_group_modules_) return true; return false; }
 
+  // Sent through the transmitter with an empty command; like 'setGains', call
+  // these while the control loop isn't sending commands.
   void clearLegColors();
   void setLegColor(int leg_index, uint8_t r, uint8_t g, uint8_t b);
 
   Eigen::Vector3d getGravityDirection();
 
+  // Recent joint position feedback, indexed like 'getLegFeedback' (dummy legs
+  // hold their initial value); times are in seconds since construction.  Safe
+  // to read from any thread.
+  const util::FeedbackHistory& getPositionHistory() const { return position_history_; }
+
+  // Checkpointing of the controller state (mode, stepping state, each leg's
+  // stance and active step, the gravity estimate and the joint positions the
+  // control thread last used).  Call from the control thread; saving doesn't
+  // wait on the feedback worker.  'restoreState' returns false if the data
+  // was invalid, in which case the state may be partly restored.
+  void saveState(CheckpointWriter& out);
+  bool restoreState(CheckpointReader& in);
+
 private:
 
   std::chrono::time_point<std::chrono::steady_clock> last_fbk;
@@ -105,10 +149,23 @@ private:
   std::shared_ptr<Group> group_;
   std::shared_ptr<Group> log_group_input_;
   std::shared_ptr<Group> log_group_modules_;
-  hebi::GroupCommand cmd_;
+  // Filled in by 'setCommand' on the control thread; 'sendCommand' hands it
+  // off to the transmitter thread (if there is a group).
+  util::CommandFrame cmd_;
+  std::unique_ptr<util::CommandTransmitter> transmitter_;
+  void sendLeds(const util::LedFrame& leds);
+  // Gains are parsed once, and switched through the transmitter.
+  std::shared_ptr<util::GainProfiles> gain_profiles_;
+  std::unique_ptr<util::GainProfileSwitcher> gain_switcher_;
   Eigen::VectorXd positions_;
   std::mutex fbk_lock_;
+  // The joint positions as the control thread last saw them: feedback as of
+  // the last 'updateStance', and the latest commands to dummy legs.  Only
+  // touched by the control thread, so checkpoints don't need 'fbk_lock_'.
+  Eigen::VectorXd control_positions_;
   std::vector<std::unique_ptr<Leg> > legs_;
+  // Plans steps ahead of time on a background thread; see 'updateSteps'.
+  std::unique_ptr<FootstepPlanner> footstep_planner_;
 
   std::chrono::time_point<std::chrono::steady_clock> pose_start_time_;
   double pose_last_time_;
@@ -116,16 +173,43 @@ private:
   const int num_legs_ = 6;
   const int num_angles_ = num_legs_ * Leg::getNumJoints();
 
+  // What the feedback worker needs from each packet: positions (indexed like
+  // 'positions_'; dummy legs are left untouched), the orientation of the base
+  // module of each real leg as (w, x, y, z) columns, and when it arrived.
+  struct FeedbackSnapshot
+  {
+    Eigen::VectorXd positions_;
+    Eigen::MatrixXd orientations_;
+    std::chrono::steady_clock::time_point time_;
+  };
+  // Called from the API's feedback thread; keep this quick.
+  void extractFeedback(const GroupFeedback& fbk, FeedbackSnapshot& snapshot);
+  // Called from the feedback worker thread, with the newest snapshot.
+  void processFeedback(const FeedbackSnapshot& snapshot);
+  std::unique_ptr<util::ConflatingFeedbackHandler<FeedbackSnapshot>> feedback_handler_;
+
+  // Written only by the feedback handler.  Keeps 320 ms of feedback at the
+  // default rate, with window statistics over the last 80 ms.
+  util::FeedbackHistory position_history_{static_cast<size_t>(num_angles_), 64, 16};
+  const std::chrono::steady_clock::time_point history_epoch_ = std::chrono::steady_clock::now();
+
   // TODO: abstract into "step" class? At least parameter data structure?
   // TODO: LOAD FROM XML!
   HexapodParameters params_;
   static constexpr float weight_ = 9.8f * 21.0f; // mass = 21 kg
 
-  Eigen::Vector3d vel_xyz_;
+  Eigen::Vector3d vel_xyz_{Eigen::Vector3d::Zero()};
+  // The last velocity command (before limiting the translation) and period
+  // given to 'updateStance'; zero until it is first called, as the footstep
+  // planner may read them before then (e.g. if a step starts early).
+  Eigen::Vector3d cmd_vel_xyz_{Eigen::Vector3d::Zero()};
+  Eigen::Vector3d rot_vel_{Eigen::Vector3d::Zero()};
+  double dt_{0};
 
   // The orientation of gravity, as a unit vector, w.r.t. the chassis.
-  Eigen::Vector3d gravity_direction_;
-  std::mutex grav_lock_;
+  // Written by the feedback worker, read by the control thread.
+  util::Seqlock<std::array<double, 3>> gravity_direction_;
+  void setGravityDirection(const Eigen::Vector3d& gravity_direction);
 
   Mode mode_;
 
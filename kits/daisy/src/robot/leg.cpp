@@ -1,4 +1,5 @@
 #include "leg.hpp"
+#include "checkpoint.hpp"
 #include <iostream>
 
 namespace hebi {
@@ -7,7 +8,8 @@ using ActuatorType = hebi::robot_model::RobotModel::ActuatorType;
 using LinkType = hebi::robot_model::RobotModel::LinkType;
 
 Leg::Leg(double angle_rad, double distance, const Eigen::VectorXd& current_angles, const HexapodParameters& params, bool is_dummy, int index, LegConfiguration configuration)
-  : index_(index), stance_radius_(params.stance_radius_), body_height_(params.default_body_height_), spring_shift_(configuration == LegConfiguration::Right ? 3.75 : -3.75) // Nm
+  : index_(index), stance_radius_(params.stance_radius_), body_height_(params.default_body_height_), spring_shift_(configuration == LegConfiguration::Right ? 3.75 : -3.75), // Nm
+    configuration_(configuration)
 {
   kin_ = configuration == LegConfiguration::Left ?
     hebi::robot_model::RobotModel::loadHRDF("left.hrdf") :
@@ -112,44 +114,69 @@ Eigen::VectorXd Leg::computeTorques(const robot_model::MatrixXdVector& jacobian_
 
 void Leg::updateStance(const Eigen::Vector3d& trans_vel, const Eigen::Vector3d& rotate_vel, const Eigen::VectorXd& current_angles, double dt)
 {
-  // Get linear velocities of stance legs based on rotational/translational
-  // velocities
-  stance_vel_xyz_ = trans_vel + rotate_vel.cross(cmd_stance_xyz_);
-
-  // Update position
-  cmd_stance_xyz_ += trans_vel * dt;
-  cmd_stance_xyz_ = (AngleAxisd(rotate_vel(2) * dt, Eigen::Vector3d::UnitZ()) *
-                     AngleAxisd(rotate_vel(1) * dt, Eigen::Vector3d::UnitY()) *
-                     AngleAxisd(rotate_vel(0) * dt, Eigen::Vector3d::UnitX()) *
-                     cmd_stance_xyz_).eval();
+  integrateStance(trans_vel, rotate_vel, dt, cmd_stance_xyz_, stance_vel_xyz_, level_home_stance_xyz_);
 
   // Update from feedback
   Matrix4d end_point_frame;
   kin_->getEndEffector(current_angles, end_point_frame);
   fbk_stance_xyz_ = end_point_frame.topRightCorner<3,1>();
 
+  home_stance_xyz_ = computeHomeStance(level_home_stance_xyz_, trans_vel);
+}
+
+void Leg::integrateStance(const Eigen::Vector3d& trans_vel, const Eigen::Vector3d& rotate_vel, double dt,
+  Eigen::Vector3d& stance, Eigen::Vector3d& stance_vel, Eigen::Vector3d& level_home_stance)
+{
+  // Get linear velocities of stance legs based on rotational/translational
+  // velocities
+  stance_vel = trans_vel + rotate_vel.cross(stance);
+
+  // Update position
+  stance += trans_vel * dt;
+  stance = (AngleAxisd(rotate_vel(2) * dt, Eigen::Vector3d::UnitZ()) *
+            AngleAxisd(rotate_vel(1) * dt, Eigen::Vector3d::UnitY()) *
+            AngleAxisd(rotate_vel(0) * dt, Eigen::Vector3d::UnitX()) *
+            stance).eval();
+
   // Update home stance to match the current z height
-  level_home_stance_xyz_(2) += trans_vel(2) * dt;
-  home_stance_xyz_ = AngleAxisd(0.2 * trans_vel(1), Eigen::Vector3d::UnitX()) *
-                     AngleAxisd(-0.2 * trans_vel(0), Eigen::Vector3d::UnitY()) *
-                     level_home_stance_xyz_;
+  level_home_stance(2) += trans_vel(2) * dt;
+}
+
+Eigen::Vector3d Leg::computeHomeStance(const Eigen::Vector3d& level_home_stance, const Eigen::Vector3d& trans_vel)
+{
+  return AngleAxisd(0.2 * trans_vel(1), Eigen::Vector3d::UnitX()) *
+         AngleAxisd(-0.2 * trans_vel(0), Eigen::Vector3d::UnitY()) *
+         level_home_stance;
+}
+
+std::unique_ptr<hebi::robot_model::RobotModel> Leg::cloneKinematics() const
+{
+  auto kin = configuration_ == LegConfiguration::Left ?
+    hebi::robot_model::RobotModel::loadHRDF("left.hrdf") :
+    hebi::robot_model::RobotModel::loadHRDF("right.hrdf");
+  if (kin)
+    kin->setBaseFrame(kin_->getBaseFrame());
+  return kin;
 }
 
-void Leg::startStep(double t)
+void Leg::startStep(double t, const StepPlan* plan)
 {
-  step_.reset(new Step(t, this)); // TODO: why not use fbk stance here?
+  if (plan)
+    step_.reset(new Step(t, *plan));
+  else
+    step_.reset(new Step(t, this)); // TODO: why not use fbk stance here?
 }
 
-void Leg::updateStep(double t)
+void Leg::updateStep(double t, bool replan)
 {
   assert(step_);
   if (!step_)
     return;
   // Update, marking as complete if we finish the step.
-  if (step_->update(t, this))
+  if (step_->update(t, this, replan))
   {
     cmd_stance_xyz_ = step_->getTouchDown();
-    step_.reset(nullptr);
+    endStep();
   }
 }
 
@@ -169,4 +196,50 @@ double Leg::getStepPeriod() const
   return step_->period_;
 }
 
+void Leg::saveState(CheckpointWriter& out) const
+{
+  out.writeMatrix(home_stance_xyz_);
+  out.writeMatrix(level_home_stance_xyz_);
+  out.writeMatrix(fbk_stance_xyz_);
+  out.writeMatrix(cmd_stance_xyz_);
+  out.writeMatrix(stance_vel_xyz_);
+  out.writeBool(static_cast<bool>(step_));
+  if (step_)
+    step_->saveState(out);
+}
+
+bool Leg::restoreState(CheckpointReader& in)
+{
+  bool stepping = false;
+  in.readMatrix(home_stance_xyz_);
+  in.readMatrix(level_home_stance_xyz_);
+  in.readMatrix(fbk_stance_xyz_);
+  in.readMatrix(cmd_stance_xyz_);
+  in.readMatrix(stance_vel_xyz_);
+  in.readBool(stepping);
+  if (!in.ok() || !stepping)
+  {
+    endStep();
+    return in.ok();
+  }
+  // Every field of the step is restored, so reuse the current (or last
+  // finished) step rather than allocating one.
+  if (!step_)
+    step_ = std::move(finished_step_);
+  if (!step_)
+    step_.reset(new Step(0, this));
+  if (!step_->restoreState(in))
+  {
+    endStep();
+    return false;
+  }
+  return true;
+}
+
+void Leg::endStep()
+{
+  if (step_)
+    finished_step_ = std::move(step_);
+}
+
 } // namespace hebi
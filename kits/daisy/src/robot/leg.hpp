@@ -32,8 +32,17 @@ public:
 
   void updateStance(const Eigen::Vector3d& trans_vel, const Eigen::Vector3d& rotate_vel, const Eigen::VectorXd& current_angles, double dt);
 
+  // The stance motion done by 'updateStance', for predicting ahead: moves
+  // 'stance' and 'level_home_stance' over 'dt', and sets 'stance_vel' to the
+  // stance velocity at the start of the interval.
+  static void integrateStance(const Eigen::Vector3d& trans_vel, const Eigen::Vector3d& rotate_vel, double dt,
+    Eigen::Vector3d& stance, Eigen::Vector3d& stance_vel, Eigen::Vector3d& level_home_stance);
+  // The home stance for a given level home stance and translational velocity
+  static Eigen::Vector3d computeHomeStance(const Eigen::Vector3d& level_home_stance, const Eigen::Vector3d& trans_vel);
+
   const double getLevelHomeStanceZ() const { return level_home_stance_xyz_(2); }
   const Eigen::Vector3d& getHomeStanceXYZ() const { return home_stance_xyz_; }
+  const Eigen::Vector3d& getLevelHomeStanceXYZ() const { return level_home_stance_xyz_; }
   const Eigen::Vector3d& getCmdStanceXYZ() const { return cmd_stance_xyz_; }
   const Eigen::Vector3d& getFbkStanceXYZ() const { return fbk_stance_xyz_; }
   const Eigen::Vector3d& getStanceVelXYZ() const { return stance_vel_xyz_; }
@@ -49,24 +58,41 @@ public:
   // getting info from inside
   hebi::robot_model::RobotModel& getKinematics() { return *kin_; }
   const hebi::robot_model::RobotModel& getKinematics() const { return *kin_; }
+  // A separate copy of the kinematics (e.g., for use from another thread);
+  // null if the HRDF could not be loaded.
+  std::unique_ptr<hebi::robot_model::RobotModel> cloneKinematics() const;
 
   // Am I actively stepping?
   Mode getMode() { return (step_) ? Mode::Flight : Mode::Stance; }
-
-  void startStep(double t);
-  void updateStep(double t);
+  // Where the foot will be when it is next in stance: the touch down point of
+  // the active step, or the current stance.
+  const Eigen::Vector3d& getNextStanceXYZ() const { return step_ ? step_->getTouchDown() : cmd_stance_xyz_; }
+
+  // Starts a step from the current stance; if given, 'plan' is the initial
+  // plan for the step, made ahead of time from this stance.
+  void startStep(double t, const StepPlan* plan = nullptr);
+  void updateStep(double t, bool replan = true);
   double getStepTime(double t) const;
   double getStepPeriod() const;
 
+  // Checkpointing of the stance and any active step.  Returns false if the
+  // data was invalid.
+  void saveState(CheckpointWriter& out) const;
+  bool restoreState(CheckpointReader& in);
+
 private:
 
   static constexpr int num_joints_ = 3;
   float stance_radius_; // [m]
   float body_height_; // [m]
   const float spring_shift_; // [N*m] compensate for the spring torques
+  const LegConfiguration configuration_;
   Eigen::VectorXd seed_angles_;
 
   std::unique_ptr<Step> step_;
+  // The last step to end, kept so that 'restoreState' can reuse it.
+  std::unique_ptr<Step> finished_step_;
+  void endStep();
 
   Eigen::Vector3d home_stance_xyz_;
   Eigen::Vector3d level_home_stance_xyz_;
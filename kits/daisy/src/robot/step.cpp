@@ -1,8 +1,19 @@
 #include "step.hpp"
 #include "leg.hpp"
+#include "checkpoint.hpp"
 
 namespace hebi {
 
+constexpr double Step::phase_[];
+
+// Shared by all legs and steps planned on a thread (the control thread, and
+// the footstep planner's): every step is first planned on the same phase grid.
+static util::TrajectoryBuilder& initialStepBuilder()
+{
+  static thread_local util::TrajectoryBuilder builder;
+  return builder;
+}
+
 Step::Step(double start_time, Leg* leg)
   : start_time_(start_time), lift_up_(leg->getCmdStanceXYZ())
 {
@@ -12,27 +23,127 @@ Step::Step(double start_time, Leg* leg)
 //  update(start_time, leg); // NOTE: I probably don't actually need to call this here, because it gets called from main before accessing the legs.  TODO: try removing?
 }
 
-// Note: returns 'true' if complete
-bool Step::update(double t, Leg* leg)
+Step::Step(double start_time, const StepPlan& plan)
+  : start_time_(start_time)
 {
-  lift_off_vel_ = leg->getStanceVelXYZ();
+  for (int i = 0; i < num_phase_pts_; ++i)
+    time_.push_back(phase_[i] * period_);
+  adoptPlan(plan);
+}
+
+bool Step::planInitial(const robot_model::RobotModel& kin, const Eigen::VectorXd& seed_angles,
+  const Eigen::Vector3d& lift_up, const Eigen::Vector3d& home_stance, const Eigen::Vector3d& stance_vel,
+  StepPlan& plan)
+{
+  plan.lift_up_ = lift_up;
+  plan.lift_off_vel_ = stance_vel;
 
   // Set touch down point to overshoot the stance error; only do this at the beginning to prevent
   // large changes in foot touch down location and corresponding weird trajectories.  TODO: fix to
   // allow small incremental updates to touch down location!
-//  std::cout << leg->getHomeStanceXYZ() << std::endl;
-  if (t == start_time_)
-    touch_down_ = leg->getHomeStanceXYZ() - (overshoot_ * period_ * lift_off_vel_);
+  plan.touch_down_ = home_stance - (overshoot_ * period_ * stance_vel);
 
   // Linearly interpolate along ground
 //  mid_step_1_ = 0.9 * lift_up_ + 0.1 * touch_down_;
 //  mid_step_2_ = 0.25 * lift_up_ + 0.75 * touch_down_;
-  mid_step_1_ = 0.5 * lift_up_ + 0.5 * touch_down_;
+  plan.mid_step_1_ = 0.5 * plan.lift_up_ + 0.5 * plan.touch_down_;
 
   // Set z position
 //  mid_step_1_(2) += 0.75 * height_;
 //  mid_step_2_(2) += height_;
-  mid_step_1_(2) += height_;
+  plan.mid_step_1_(2) += height_;
+
+  int num_joints = Leg::getNumJoints();
+  int num_pts = num_phase_pts_;
+  plan.times_.resize(num_pts);
+  plan.positions_.resize(num_joints, num_pts);
+  plan.velocities_.resize(num_joints, num_pts);
+  plan.accelerations_.resize(num_joints, num_pts);
+  MatrixXd jacobian_ee;
+  VectorXd ik_output;
+
+  // Lift off, with the stance velocity
+  kin.solveIK(
+    seed_angles,
+    ik_output,
+    robot_model::EndEffectorPositionObjective(plan.lift_up_));
+  if (ik_output.size() == 0)
+    return false;
+  // J(1:3, :) \ lift_off_vel;
+  kin.getJEndEffector(ik_output, jacobian_ee);
+  MatrixXd jacobian_part = jacobian_ee.topLeftCorner(3,jacobian_ee.cols());
+  plan.positions_.col(0) = ik_output;
+  plan.velocities_.col(0) = jacobian_part.colPivHouseholderQr().solve(plan.lift_off_vel_);
+  plan.accelerations_.col(0).setZero();
+
+  // High point, free velocity and acceleration
+  kin.solveIK(
+    seed_angles,
+    ik_output,
+    robot_model::EndEffectorPositionObjective(plan.mid_step_1_));
+  if (ik_output.size() == 0)
+    return false;
+  plan.positions_.col(1) = ik_output;
+  plan.velocities_.col(1).setConstant(std::numeric_limits<double>::quiet_NaN());
+  plan.accelerations_.col(1).setConstant(std::numeric_limits<double>::quiet_NaN());
+
+  // Touch down, moving with the stance
+  kin.solveIK(
+    seed_angles,
+    ik_output,
+    robot_model::EndEffectorPositionObjective(plan.touch_down_));
+  if (ik_output.size() == 0)
+    return false;
+  // J(1:3, :) \ stance_vel;
+  kin.getJEndEffector(ik_output, jacobian_ee);
+  jacobian_part = jacobian_ee.topLeftCorner(3,jacobian_ee.cols());
+  plan.positions_.col(2) = ik_output;
+  plan.velocities_.col(2) = jacobian_part.colPivHouseholderQr().solve(stance_vel);
+  plan.accelerations_.col(2).setZero();
+
+  for (int i = 0; i < num_pts; ++i)
+    plan.times_[i] = phase_[i] * period_;
+  plan.trajectory_ = initialStepBuilder().create(
+    plan.times_,
+    plan.positions_,
+    &plan.velocities_,
+    &plan.accelerations_);
+  return static_cast<bool>(plan.trajectory_);
+}
+
+void Step::adoptPlan(const StepPlan& plan)
+{
+  lift_up_ = plan.lift_up_;
+  lift_off_vel_ = plan.lift_off_vel_;
+  mid_step_1_ = plan.mid_step_1_;
+  touch_down_ = plan.touch_down_;
+  plan_times_ = plan.times_;
+  plan_positions_ = plan.positions_;
+  plan_velocities_ = plan.velocities_;
+  plan_accelerations_ = plan.accelerations_;
+  trajectory_ = plan.trajectory_;
+}
+
+// Note: returns 'true' if complete
+bool Step::update(double t, Leg* leg, bool replan)
+{
+  lift_off_vel_ = leg->getStanceVelXYZ();
+
+  // The initial trajectory is planned once, when the step starts (unless it
+  // was already planned ahead of time).
+  if (t == start_time_)
+  {
+    if (!trajectory_)
+    {
+      StepPlan plan;
+      bool planned = planInitial(leg->getKinematics(), leg->getSeedAngles(), lift_up_,
+        leg->getHomeStanceXYZ(), lift_off_vel_, plan);
+      assert(planned);
+      adoptPlan(plan);
+    }
+    return false;
+  }
+
   double elapsed = t - start_time_;
   // We are done with this step!
   if (elapsed > period_)
@@ -40,6 +151,9 @@ bool Step::update(double t, Leg* leg)
   // Close enough to the end; don't replan
   else if ((period_ - elapsed) < ignore_waypoint_threshold_)
     return false;
+  // Asked to keep following the existing trajectory
+  else if (!replan && trajectory_)
+    return false;
 
   // Replan based on current waypoints; create new trajectory objects
   // TODO: make this all more modular! (put waypoints in a vector so we can refer to them more easily here?)
@@ -54,30 +168,8 @@ bool Step::update(double t, Leg* leg)
   MatrixXd jacobian_ee;
   VectorXd ik_output;
 
-  // Add initial waypoint
+  // Add our current point:
   int next_pt = 0;
-  if (t == start_time_)// For initial time, add special velocity for lift off:
-  {
-    kin.solveIK(
-      leg->getSeedAngles(),
-      ik_output,
-      robot_model::EndEffectorPositionObjective(lift_up_));
-    if (ik_output.size() == 0)
-      assert(false);
-
-    // J(1:3, :) \ lift_off_vel;
-    kin.getJEndEffector(ik_output, jacobian_ee);
-    MatrixXd jacobian_part = jacobian_ee.topLeftCorner(3,jacobian_ee.cols());
-    leg_waypoint_vels.block(0, next_pt, num_joints, 1) =
-      jacobian_part.colPivHouseholderQr().solve(lift_off_vel_).eval().cast<double>();
-
-    leg_waypoints.col(next_pt) = ik_output;
-    leg_waypoint_accels.col(next_pt).setZero();
-    
-    leg_times[next_pt] = time_[0];
-    next_pt++;
-  }
-  else // If not initial time, add our current point:
   {
     Eigen::VectorXd p(num_joints), v(num_joints), a(num_joints);
     trajectory_->getState(elapsed, &p, &v, &a);
@@ -141,11 +233,16 @@ bool Step::update(double t, Leg* leg)
   leg_waypoint_vels.conservativeResize(num_joints, num_pts);
   leg_waypoint_accels.conservativeResize(num_joints, num_pts);
 
-  trajectory_ = trajectory::Trajectory::createUnconstrainedQp(
-    leg_times.head(num_pts),
-    leg_waypoints.topLeftCorner(num_joints, num_pts),
-    &leg_waypoint_vels,
-    &leg_waypoint_accels);
+  plan_times_ = leg_times.head(num_pts);
+  plan_positions_ = leg_waypoints.topLeftCorner(num_joints, num_pts);
+  plan_velocities_.swap(leg_waypoint_vels);
+  plan_accelerations_.swap(leg_waypoint_accels);
+  // Replans start from the current time, so their grid is rarely seen twice
+  trajectory_ = util::TrajectoryBuilder::createUncached(
+    plan_times_,
+    plan_positions_,
+    &plan_velocities_,
+    &plan_accelerations_);
 
   assert(trajectory_);
   return false; // Not done with the step
@@ -165,4 +262,54 @@ void Step::computeState(double t, Eigen::VectorXd& angles, Eigen::VectorXd& vels
 //    vels = v.cast<float>();
 }
 
+void Step::saveState(CheckpointWriter& out) const
+{
+  out.writeDouble(start_time_);
+  out.writeMatrix(lift_off_vel_);
+  out.writeMatrix(lift_up_);
+  out.writeMatrix(mid_step_1_);
+  out.writeMatrix(mid_step_2_);
+  out.writeMatrix(touch_down_);
+  out.writeBool(static_cast<bool>(trajectory_));
+  if (trajectory_)
+  {
+    out.writeMatrix(plan_times_);
+    out.writeMatrix(plan_positions_);
+    out.writeMatrix(plan_velocities_);
+    out.writeMatrix(plan_accelerations_);
+  }
+}
+
+bool Step::restoreState(CheckpointReader& in)
+{
+  bool has_trajectory = false;
+  in.readDouble(start_time_);
+  in.readMatrix(lift_off_vel_);
+  in.readMatrix(lift_up_);
+  in.readMatrix(mid_step_1_);
+  in.readMatrix(mid_step_2_);
+  in.readMatrix(touch_down_);
+  in.readBool(has_trajectory);
+  trajectory_.reset();
+  if (!in.ok() || !has_trajectory)
+    return in.ok();
+
+  in.readMatrix(plan_times_);
+  in.readMatrix(plan_positions_);
+  in.readMatrix(plan_velocities_);
+  in.readMatrix(plan_accelerations_);
+  int num_joints = Leg::getNumJoints();
+  if (!in.ok() || plan_times_.size() < 2 ||
+      plan_positions_.rows() != num_joints || plan_positions_.cols() != plan_times_.size() ||
+      plan_velocities_.rows() != num_joints || plan_velocities_.cols() != plan_times_.size() ||
+      plan_accelerations_.rows() != num_joints || plan_accelerations_.cols() != plan_times_.size())
+    return false;
+  trajectory_ = util::TrajectoryBuilder::createUncached(
+    plan_times_,
+    plan_positions_,
+    &plan_velocities_,
+    &plan_accelerations_);
+  return static_cast<bool>(trajectory_);
+}
+
 } // namespace hebi
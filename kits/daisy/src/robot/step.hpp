@@ -1,11 +1,32 @@
 #pragma once
 
-#include "trajectory.hpp"
+#include "util/trajectory_builder.hpp"
 #include <Eigen/Dense>
 
 namespace hebi {
 
 class Leg;
+class CheckpointWriter;
+class CheckpointReader;
+namespace robot_model {
+class RobotModel;
+}
+
+// The initial plan for a step: its waypoints in the workspace, and the joint
+// trajectory (in time since the start of the step) through them.
+struct StepPlan
+{
+  Eigen::Vector3d lift_up_;
+  Eigen::Vector3d lift_off_vel_;
+  Eigen::Vector3d mid_step_1_;
+  Eigen::Vector3d touch_down_;
+
+  Eigen::VectorXd times_;
+  Eigen::MatrixXd positions_;
+  Eigen::MatrixXd velocities_;
+  Eigen::MatrixXd accelerations_;
+  std::shared_ptr<util::TrajectoryBuilder::Trajectory> trajectory_;
+};
 
 // Represents a single step being actively taken by a leg.
 class Step
@@ -13,9 +34,21 @@ class Step
 public:
   Step(double start_time, Leg* leg); // NOTE: I don't like this circular dependency on Leg here...
   // TODO: don't call update from constructor?
+  // Starts from a plan made ahead of time, rather than planning on the first
+  // update.
+  Step(double start_time, const StepPlan& plan);
+
+  // Makes the initial plan for a step lifting off at 'lift_up' while the
+  // stance moves at 'stance_vel'; this is what the first update does.  Only
+  // uses const kinematics calls, so it can run off the control thread with its
+  // own copy of the leg kinematics.  Returns false if the IK gave no result.
+  static bool planInitial(const robot_model::RobotModel& kin, const Eigen::VectorXd& seed_angles,
+    const Eigen::Vector3d& lift_up, const Eigen::Vector3d& home_stance, const Eigen::Vector3d& stance_vel,
+    StepPlan& plan);
 
-  // Note: returns 'true' if complete
-  bool update(double t, Leg* leg); // NOTE: I don't like this circular dependency on Leg here...
+  // Note: returns 'true' if complete.  If 'replan' is false, the trajectory
+  // planned so far is reused rather than replanned from the current waypoints.
+  bool update(double t, Leg* leg, bool replan = true); // NOTE: I don't like this circular dependency on Leg here...
 
   const Eigen::Vector3d& getTouchDown() const { return touch_down_; }
   void computeState(double t, Eigen::VectorXd& angles, Eigen::VectorXd& vels, Eigen::VectorXd& accels) const;
@@ -26,10 +59,18 @@ public:
   // When creating trajectories, don't use waypoints that are too close together
   static constexpr float ignore_waypoint_threshold_ = 0.01; // 10 ms (in seconds)
   double getStartTime() const { return start_time_; }
+  const Eigen::Vector3d& getLiftUp() const { return lift_up_; }
+
+  // Checkpointing; the trajectory is stored as the waypoints it was planned
+  // from, and replanned on restore.  Returns false if the data was invalid.
+  void saveState(CheckpointWriter& out) const;
+  bool restoreState(CheckpointReader& in);
 private:
+  void adoptPlan(const StepPlan& plan);
+
   // TODO: read from XML -- the phase points of the leg
   static const int num_phase_pts_ = 3;
-  const double phase_[num_phase_pts_] = {0, 0.5, 1};
+  static constexpr double phase_[num_phase_pts_] = {0, 0.5, 1};
   double start_time_;
   // Time to hit each waypoint
   std::vector<double> time_;
@@ -42,7 +83,13 @@ private:
   Eigen::Vector3d mid_step_2_;
   Eigen::Vector3d touch_down_;
 
-  std::shared_ptr<trajectory::Trajectory> trajectory_;
+  // Waypoints the current trajectory was planned from.
+  Eigen::VectorXd plan_times_;
+  Eigen::MatrixXd plan_positions_;
+  Eigen::MatrixXd plan_velocities_;
+  Eigen::MatrixXd plan_accelerations_;
+
+  std::shared_ptr<util::TrajectoryBuilder::Trajectory> trajectory_;
   
   // Allow Eigen member variables:
 public:
@@ -0,0 +1,157 @@
+// Runs the quadruped control state machine against a dummy robot as fast as
+// possible, with a scripted profile in place of the joystick, and reports the
+// sustained tick rate, tick latency percentiles and allocations per tick.
+//
+// The profile goes through the stand up sequence, then alternates between
+// walking (swing/stance trajectories for both virtual leg pairs) and
+// re-orienting the body to scripted roll/pitch targets, just as
+// quadruped_control.cpp would; simulated time advances by one control period
+// per tick.
+
+#include "robot/quadruped_parameters.hpp"
+#include "robot/quadruped.hpp"
+#include "util/tick_benchmark.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <string>
+
+HEBI_BENCHMARK_COUNT_ALLOCATIONS();
+
+using namespace hebi;
+
+namespace {
+
+enum class BenchmarkState { StandUp1, StandUp2, StandUp3, WalkLeft, WalkRight, Orient };
+
+const double startup_seconds = 1.9;
+const double leg_swing_time = 0.5;
+// Time spent in each phase of the repeating walk / re-orient cycle
+const double walk_seconds = 10.0;
+const double orient_seconds = 5.0;
+
+bool parseParameters(int argc, char** argv, double& duration_s)
+{
+  for (int idx = 1; idx < argc; ++idx)
+  {
+    std::string arg(argv[idx]);
+    if (arg == "-s" && idx + 1 < argc)
+    {
+      duration_s = std::stod(argv[++idx]);
+      continue;
+    }
+    std::cout << "Quadruped benchmark usage:\n" <<
+    "    -s <seconds>\n" <<
+    "        Simulated time to run for (default " << duration_s << " s).\n\n" <<
+    "    -h\n" <<
+    "        Print this help and return." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  double duration_s = 120.0;
+  if (!parseParameters(argc, argv, duration_s))
+    return 1;
+
+  QuadrupedParameters params;
+  params.resetToDefaults();
+  std::unique_ptr<Quadruped> quadruped = Quadruped::createDummy(params);
+  // the walking debug prints would dominate the measured ticks
+  quadruped->setVerbose(false);
+
+  const double period = 0.005; // 200 Hz, as in quadruped_control
+  const size_t num_ticks = static_cast<size_t>(duration_s / period);
+  util::TickBenchmark benchmark(num_ticks);
+
+  BenchmarkState state = BenchmarkState::StandUp1;
+  double state_enter_time = 0;
+  double cycle_start_time = 0;
+  std::cout << "Running " << num_ticks << " ticks (" << duration_s << " s simulated)..." << std::endl;
+  for (size_t tick = 0; tick < num_ticks; ++tick)
+  {
+    double t = tick * period;
+    double state_run_time = t - state_enter_time;
+
+    benchmark.beginTick();
+
+    switch (state)
+    {
+      case BenchmarkState::StandUp1:
+        quadruped->spreadAllLegs();
+        if (state_run_time >= startup_seconds)
+        {
+          state = BenchmarkState::StandUp2;
+          state_enter_time = t;
+        }
+        break;
+      case BenchmarkState::StandUp2:
+        quadruped->pushAllLegs(state_run_time, startup_seconds);
+        if (state_run_time >= startup_seconds)
+        {
+          quadruped->startBodyRUpdate();
+          state = BenchmarkState::StandUp3;
+          state_enter_time = t;
+        }
+        break;
+      case BenchmarkState::StandUp3:
+        quadruped->prepareQuadMode();
+        if (state_run_time >= startup_seconds)
+        {
+          quadruped->prepareTrajectories(Quadruped::SwingMode::swing_mode_virtualLeg1, leg_swing_time);
+          state = BenchmarkState::WalkLeft;
+          state_enter_time = t;
+          cycle_start_time = t;
+        }
+        break;
+      case BenchmarkState::WalkLeft:
+      case BenchmarkState::WalkRight:
+      {
+        bool left = (state == BenchmarkState::WalkLeft);
+        quadruped->runTest(left ? Quadruped::SwingMode::swing_mode_virtualLeg1 : Quadruped::SwingMode::swing_mode_virtualLeg2,
+          state_run_time, leg_swing_time);
+        if (state_run_time >= leg_swing_time)
+        {
+          state_enter_time = t;
+          if (t - cycle_start_time >= walk_seconds)
+          {
+            state = BenchmarkState::Orient;
+          }
+          else
+          {
+            state = left ? BenchmarkState::WalkRight : BenchmarkState::WalkLeft;
+            quadruped->prepareTrajectories(left ? Quadruped::SwingMode::swing_mode_virtualLeg2 : Quadruped::SwingMode::swing_mode_virtualLeg1,
+              leg_swing_time);
+          }
+        }
+        break;
+      }
+      case BenchmarkState::Orient:
+      {
+        // Slowly sweep roll and pitch, like moving the joystick around
+        double phase = 2.0 * M_PI * state_run_time / orient_seconds;
+        Eigen::Matrix3d target_body_R;
+        target_body_R = Eigen::AngleAxisd(std::sin(phase) * 16.0 / 180.0 * M_PI, Eigen::Vector3d::UnitY()) *
+                        Eigen::AngleAxisd(std::sin(2.0 * phase) * 16.0 / 180.0 * M_PI, Eigen::Vector3d::UnitX());
+        quadruped->reOrient(target_body_R);
+        if (state_run_time >= orient_seconds)
+        {
+          quadruped->prepareTrajectories(Quadruped::SwingMode::swing_mode_virtualLeg1, leg_swing_time);
+          state = BenchmarkState::WalkLeft;
+          state_enter_time = t;
+          cycle_start_time = t;
+        }
+        break;
+      }
+    }
+
+    benchmark.endTick();
+  }
+
+  benchmark.report(std::cout, period);
+  return 0;
+}
@@ -60,7 +60,8 @@ int main(int argc, char** argv)
   std::cout << "Found input joystick -- starting control program.\n";
   // INIT STEP 3: init robot planner
   std::unique_ptr<Quadruped> quadruped = Quadruped::create(params);
-  quadruped -> setGains();
+  if (!quadruped -> setGains())
+    std::cout << "Could not load gains -- modules keep their current gains." << std::endl;
 
   // INIT STEP FINAL: start control state machine
   // input command from joystick (hebi's input manager use vector3f, i think use vector3d would be better)
@@ -103,6 +104,7 @@ int main(int argc, char** argv)
     Eigen::AngleAxisd tmp_aa;
     double new_angle;
     Eigen::Vector3d axis_aa;
+    bool gains_reported = false;
     while (control_execute.load(std::memory_order_acquire))
     {    
       // Wait!
@@ -126,6 +128,27 @@ int main(int argc, char** argv)
       translation_velocity_cmd = input->getTranslationVelocityCmd();
       rotation_velocity_cmd = input->getRotationVelocityCmd();
       Eigen::Matrix3d target_body_R;
+
+      // gains change on the first tick of a new state, along with its first command
+      Quadruped::GainProfile gain_profile = cur_ctrl_state <= QUAD_CTRL_STAND_UP3 ?
+        Quadruped::GainProfile::stand_up : Quadruped::GainProfile::quad;
+      if (gain_profile != quadruped -> getGainProfile())
+      {
+        quadruped -> setGainProfile(gain_profile);
+        gains_reported = false;
+      }
+      util::GainProfileSwitcher::Status gain_status = quadruped -> getGainStatus();
+      const char* profile_name = gain_profile == Quadruped::GainProfile::stand_up ? "stand up" : "quad";
+      if (!gains_reported && gain_status == util::GainProfileSwitcher::Status::Confirmed)
+      {
+        gains_reported = true;
+        std::cout << "Modules report the " << profile_name << " gains." << std::endl;
+      }
+      else if (!gains_reported && gain_status == util::GainProfileSwitcher::Status::Failed)
+      {
+        gains_reported = true;
+        std::cerr << "Modules did not report the " << profile_name << " gains -- this could indicate an intermittent network connection with the modules." << std::endl;
+      }
       
       // control state machine 
       // std::cout << "|Time: " << elapsed_time.count() <<  "| my current state is: " << cur_ctrl_state <<std::endl;
@@ -0,0 +1,185 @@
+#include "body_velocity_estimator.hpp"
+
+#include <cmath>
+#include <vector>
+
+namespace hebi {
+
+  namespace {
+    Eigen::Matrix4d rotationZ(double angle)
+    {
+      Eigen::Matrix4d rotation = Eigen::Matrix4d::Identity();
+      rotation.topLeftCorner<2,2>() << std::cos(angle), -std::sin(angle),
+                                       std::sin(angle), std::cos(angle);
+      return rotation;
+    }
+  }
+
+  BodyVelocityEstimator::BodyVelocityEstimator(double filter_time_constant_s)
+  : filter_time_constant_s_(filter_time_constant_s)
+  {
+    filtered_linear_.setZero();
+    filtered_angular_.setZero();
+    Estimate& initial = estimate_.getWriteBuffer();
+    initial.linear_velocity_.setZero();
+    initial.linear_velocity_world_.setZero();
+    initial.angular_velocity_.setZero();
+    initial.num_stance_legs_ = 0;
+    estimate_.publish();
+  }
+
+  bool BodyVelocityEstimator::addLeg(const std::string& hrdf_file, const Eigen::Matrix4d& base_frame)
+  {
+    if (num_legs_ >= max_legs_)
+      return false;
+    Leg& leg = legs_[num_legs_];
+    auto model = robot_model::RobotModel::loadHRDF(hrdf_file);
+    if (!model)
+      return false;
+    model->setBaseFrame(base_frame);
+    if (!extractChain(*model, leg))
+      return false;
+    leg.R_cb_ = base_frame.topLeftCorner<3,3>();
+    ++num_legs_;
+    return true;
+  }
+
+  // As util::BatchForwardKinematics::create, for a single short chain.
+  bool BodyVelocityEstimator::extractChain(const robot_model::RobotModel& model, Leg& leg)
+  {
+    if (model.getDoFCount() != num_joints_per_leg_)
+      return false;
+    size_t num_frames = model.getFrameCount(HebiFrameTypeOutput);
+    const double test_angle = 1.0;
+    const double tolerance = 1e-9;
+
+    Eigen::VectorXd zero = Eigen::VectorXd::Zero(num_joints_per_leg_);
+    robot_model::Matrix4dVector zero_frames;
+    model.getFK(HebiFrameTypeOutput, zero, zero_frames);
+    Eigen::Matrix4d zero_foot;
+    model.getEndEffector(zero, zero_foot);
+
+    // Each joint's output frame is the first frame that moves when only that
+    // joint does, and it rotates about its own z axis.
+    std::vector<size_t> joint_frames(num_joints_per_leg_);
+    robot_model::Matrix4dVector moved_frames;
+    for (int j = 0; j < num_joints_per_leg_; ++j)
+    {
+      Eigen::VectorXd positions = zero;
+      positions[j] = test_angle;
+      model.getFK(HebiFrameTypeOutput, positions, moved_frames);
+      size_t first = num_frames;
+      for (size_t f = 0; f < num_frames && first == num_frames; ++f)
+        if (!moved_frames[f].isApprox(zero_frames[f], tolerance))
+          first = f;
+      if (first == num_frames || (j > 0 && first <= joint_frames[j - 1]))
+        return false;
+      if (!(zero_frames[first].inverse() * moved_frames[first]).isApprox(rotationZ(test_angle), tolerance))
+        return false;
+      joint_frames[j] = first;
+    }
+
+    Eigen::Matrix4d previous = Eigen::Matrix4d::Identity();
+    for (int j = 0; j < num_joints_per_leg_; ++j)
+    {
+      leg.joint_offsets_[j] = previous.inverse() * zero_frames[joint_frames[j]];
+      previous = zero_frames[joint_frames[j]];
+    }
+    leg.foot_offset_ = previous.inverse() * zero_foot;
+
+    // Check the chain against the model at a few configurations.
+    Eigen::Matrix<double, num_joints_per_leg_, 8> positions =
+      Eigen::Matrix<double, num_joints_per_leg_, 8>::Random() * M_PI;
+    Eigen::Matrix4d model_foot;
+    Eigen::MatrixXd model_J;
+    Eigen::Vector3d foot;
+    LegJacobian J;
+    for (int k = 0; k < positions.cols(); ++k)
+    {
+      model.getEndEffector(positions.col(k), model_foot);
+      model.getJEndEffector(positions.col(k), model_J);
+      legKinematics(leg, positions.col(k), foot, J);
+      if (!foot.isApprox(model_foot.topRightCorner<3,1>(), tolerance) ||
+          !J.isApprox(model_J.topRows<3>(), tolerance))
+        return false;
+    }
+    return true;
+  }
+
+  void BodyVelocityEstimator::legKinematics(const Leg& leg, const LegVector& q, Eigen::Vector3d& foot, LegJacobian& J)
+  {
+    // Each joint rotates about the z axis of its output frame, so the axis and
+    // origin of joint j are those of its output frame.
+    Eigen::Matrix4d frame = Eigen::Matrix4d::Identity();
+    Eigen::Matrix<double, 3, num_joints_per_leg_> axes;
+    Eigen::Matrix<double, 3, num_joints_per_leg_> origins;
+    for (int j = 0; j < num_joints_per_leg_; ++j)
+    {
+      frame = frame * leg.joint_offsets_[j] * rotationZ(q[j]);
+      axes.col(j) = frame.block<3,1>(0,2);
+      origins.col(j) = frame.topRightCorner<3,1>();
+    }
+    foot = (frame * leg.foot_offset_).topRightCorner<3,1>();
+    for (int j = 0; j < num_joints_per_leg_; ++j)
+      J.col(j) = axes.col(j).cross(foot - origins.col(j));
+  }
+
+  void BodyVelocityEstimator::update(const JointVector& positions, const JointVector& velocities,
+    const GyroMatrix& gyros, const Eigen::Matrix3d& body_R, double dt)
+  {
+    // Angular velocity: all base modules are rigidly attached to the chassis.
+    Eigen::Vector3d angular = Eigen::Vector3d::Zero();
+    int num_gyros = 0;
+    for (int i = 0; i < num_legs_; ++i)
+    {
+      Eigen::Vector3d gyro = gyros.col(i);
+      if (std::isnan(gyro.x()) || std::isnan(gyro.y()) || std::isnan(gyro.z()))
+        continue;
+      angular += legs_[i].R_cb_ * gyro;
+      ++num_gyros;
+    }
+    if (num_gyros > 0)
+      angular /= num_gyros;
+
+    // Linear velocity from the legs on the ground.
+    uint32_t stance_mask = stance_mask_.load(std::memory_order_relaxed);
+    Eigen::Vector3d linear = Eigen::Vector3d::Zero();
+    int num_stance = 0;
+    for (int i = 0; i < num_legs_; ++i)
+    {
+      if ((stance_mask & (1u << i)) == 0)
+        continue;
+      LegVector q = positions.segment<num_joints_per_leg_>(i * num_joints_per_leg_);
+      LegVector qdot = velocities.segment<num_joints_per_leg_>(i * num_joints_per_leg_);
+      if (q.hasNaN() || qdot.hasNaN())
+        continue;
+
+      Eigen::Vector3d foot_pos;
+      LegJacobian J;
+      legKinematics(legs_[i], q, foot_pos, J);
+      Eigen::Vector3d foot_vel = J * qdot;
+      linear -= foot_vel + angular.cross(foot_pos);
+      ++num_stance;
+    }
+    if (num_stance > 0)
+      linear /= num_stance;
+
+    // First order low pass; with no legs on the ground there is no information
+    // about the linear velocity, so let it decay to zero.
+    double alpha = 1.0;
+    if (has_estimate_ && filter_time_constant_s_ > 0 && dt > 0)
+      alpha = dt / (filter_time_constant_s_ + dt);
+    filtered_linear_ += alpha * (linear - filtered_linear_);
+    if (num_gyros > 0)
+      filtered_angular_ += alpha * (angular - filtered_angular_);
+    has_estimate_ = true;
+
+    Estimate& estimate = estimate_.getWriteBuffer();
+    estimate.linear_velocity_ = filtered_linear_;
+    estimate.linear_velocity_world_ = body_R * filtered_linear_;
+    estimate.angular_velocity_ = filtered_angular_;
+    estimate.num_stance_legs_ = num_stance;
+    estimate_.publish();
+  }
+
+} // namespace hebi
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <Eigen/Dense>
+
+#include "robot_model.hpp"
+#include "util/triple_buffer.hpp"
+
+namespace hebi {
+
+/*
+  Leg odometry for the quadruped: estimates the linear and angular velocity of
+  the body from the feedback of the legs that are currently on the ground.
+
+  Angular velocity is the average of the base module gyros, rotated into the
+  chassis frame.  For each stance leg, the foot is assumed to be fixed on the
+  ground, so the body velocity is the negative of the foot velocity relative to
+  the body:
+      v = -(J(q) * qdot + w x p(q))
+  and the estimate is the average over the stance legs, low pass filtered.  The
+  IMU orientation is then used to express it in the (gravity aligned) world
+  frame as well.
+
+  `update` is meant to be called from the feedback handler, so it doesn't
+  allocate: RobotModel's FK and Jacobian calls do, so each leg's chain (the
+  fixed transform before each joint, and from the last joint to the foot) is
+  extracted from its model once, in `addLeg`, and `update` evaluates it with
+  fixed-size matrices.  The estimate is handed to the planner (a single reader
+  thread) through a lock-free triple buffer.
+*/
+class BodyVelocityEstimator
+{
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW // Allow Eigen member variables
+
+    static constexpr int max_legs_ = 6;
+    static constexpr int num_joints_per_leg_ = 3;
+    using JointVector = Eigen::Matrix<double, max_legs_ * num_joints_per_leg_, 1>;
+    using GyroMatrix = Eigen::Matrix<double, 3, max_legs_>;
+
+    struct Estimate
+    {
+      // Body velocity expressed in the chassis frame [m/s]
+      Eigen::Vector3d linear_velocity_;
+      // Body velocity expressed in the world frame given by the IMU orientation [m/s]
+      Eigen::Vector3d linear_velocity_world_;
+      // Body angular velocity expressed in the chassis frame [rad/s]
+      Eigen::Vector3d angular_velocity_;
+      // Number of stance legs the linear velocity was computed from
+      int num_stance_legs_;
+    };
+
+    // filter_time_constant_s: time constant of the first order low pass filter
+    // applied to the raw estimates; 0 disables filtering.
+    explicit BodyVelocityEstimator(double filter_time_constant_s = 0.03);
+
+    // Setup; must be called for each leg (in feedback order) before the first
+    // update.  Returns false if the HRDF file can't be loaded, or isn't a chain
+    // of num_joints_per_leg_ joints that each rotate about the z axis of their
+    // output frame (checked against the model's FK and Jacobian).
+    bool addLeg(const std::string& hrdf_file, const Eigen::Matrix4d& base_frame);
+
+    // Sets which legs are on the ground (bit i for leg i).  Can be called from
+    // any thread.
+    void setStanceLegs(uint32_t stance_mask) { stance_mask_.store(stance_mask, std::memory_order_relaxed); }
+    uint32_t getStanceLegs() const { return stance_mask_.load(std::memory_order_relaxed); }
+
+    // Called from the feedback thread.  NaN joint feedback removes that leg
+    // from this update; NaN gyro feedback removes that module from the angular
+    // velocity average.
+    void update(const JointVector& positions, const JointVector& velocities,
+      const GyroMatrix& gyros, const Eigen::Matrix3d& body_R, double dt);
+
+    // Returns the latest estimate; only one thread may call this.
+    const Estimate& getEstimate() { return estimate_.read(); }
+
+  private:
+    using LegVector = Eigen::Matrix<double, num_joints_per_leg_, 1>;
+    using LegJacobian = Eigen::Matrix<double, 3, num_joints_per_leg_>;
+
+    struct Leg
+    {
+      // Rotation from the base module frame to the chassis frame
+      Eigen::Matrix3d R_cb_;
+      // Transform from the previous joint's output (or the chassis) to each
+      // joint's output at zero angle, and from the last joint to the foot
+      std::array<Eigen::Matrix4d, num_joints_per_leg_> joint_offsets_;
+      Eigen::Matrix4d foot_offset_;
+    };
+
+    // Extracts the chain of 'model' into 'leg'; false if it isn't supported.
+    static bool extractChain(const robot_model::RobotModel& model, Leg& leg);
+    // Foot position, and the Jacobian of the foot position, in the chassis frame
+    static void legKinematics(const Leg& leg, const LegVector& q, Eigen::Vector3d& foot, LegJacobian& J);
+
+    std::array<Leg, max_legs_> legs_;
+    int num_legs_ = 0;
+
+    const double filter_time_constant_s_;
+    std::atomic<uint32_t> stance_mask_{0};
+
+    // Filter state, only touched by the feedback thread
+    Eigen::Vector3d filtered_linear_;
+    Eigen::Vector3d filtered_angular_;
+    bool has_estimate_ = false;
+
+    util::TripleBuffer<Estimate> estimate_;
+};
+
+} // namespace hebi
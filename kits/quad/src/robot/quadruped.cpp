@@ -33,8 +33,15 @@ namespace hebi {
     return std::unique_ptr<Quadruped>(new Quadruped(group, params));
   }
 
+  std::unique_ptr<Quadruped> Quadruped::createDummy(const QuadrupedParameters& params)
+  {
+    return std::unique_ptr<Quadruped>(new Quadruped(std::shared_ptr<Group>(), params));
+  }
+
   Quadruped::Quadruped(std::shared_ptr<Group> group, const QuadrupedParameters& params)
-  : group_(group), params_(params), cmd_(group_ ? group_->size() : 1)
+  : group_(group), params_(params), cmd_(group_ ? group_->size() : num_legs_ * 3), // dummy: 3 joints per leg
+    leg_angles_(num_joints_per_leg_), leg_vels_(num_joints_per_leg_), leg_accs_(num_joints_per_leg_), leg_torques_(num_joints_per_leg_),
+    dummy_angles_(num_joints_per_leg_)
   {
     Eigen::Vector3d zero_vec = Eigen::Vector3d::Zero();
     legs_.emplace_back(new QuadLeg(30.0 * M_PI / 180.0, 0.2375, zero_vec, params, 0, QuadLeg::LegConfiguration::Left));
@@ -46,176 +53,257 @@ namespace hebi {
 
 
     base_stance_ee_xyz = Eigen::Vector4d(0.36f, 0.0f, -0.31f, 0); // expressed in base motor's frame
+    body_R.setIdentity();
+    {
+      std::array<double, 9> identity;
+      Eigen::Matrix3d::Map(identity.data()) = body_R;
+      shared_body_R_.store(identity);
+    }
+    // until feedback arrives (or forever, for a dummy), straight down w/ a level chassis
+    setGravityDirection(-Eigen::Vector3d::UnitZ());
+
+    // the estimator extracts its own copy of each leg's kinematics, as it runs on the feedback thread
+    for (int i = 0; i < num_legs_; ++i)
+    {
+      bool left = legs_[i]->getConfiguration() == QuadLeg::LegConfiguration::Left;
+      if (!velocity_estimator_.addLeg(left ? "left.hrdf" : "right.hrdf", legs_[i]->getBaseFrame()))
+        std::cerr << "Could not load leg kinematics for velocity estimator!" << std::endl;
+    }
+    // until the state machine says otherwise, the robot is lying on its belly
+    velocity_estimator_.setStanceLegs(0);
+
+    // commands are sent from a separate thread, so that the control loop
+    // doesn't wait on serialization and the network
+    // every gain file is parsed here, once; setGainProfile picks between them
+    if (group_)
+    {
+      gain_profiles_ = std::make_shared<util::GainProfiles>(group_->size());
+      std::string size = std::to_string(group_->size());
+      const std::array<std::string, 2> gains_files{{"gains" + size + ".xml", "quad_gains" + size + ".xml"}};
+      const std::array<std::string, 2> names{{"stand_up", "quad"}};
+      for (size_t i = 0; i < gains_files.size(); ++i)
+      {
+        std::cout << "Loading gains from: " << gains_files[i] << std::endl;
+        gain_profile_ids_[i] = gain_profiles_->load(names[i], gains_files[i]);
+        if (gain_profile_ids_[i] < 0)
+          std::cerr << "Could not load gains from " << gains_files[i] << std::endl;
+      }
+      transmitter_.reset(new util::CommandTransmitter(group_, util::CommandTransmitter::lastCpu(), gain_profiles_));
+      gain_switcher_.reset(new util::GainProfileSwitcher(group_, gain_profiles_, *transmitter_));
+    }
 
     // This looks like black magic to me
     if (group_)
     {
-      group_->addFeedbackHandler([this] (const GroupFeedback& fbk)
+      feedback_handler_.reset(new util::ConflatingFeedbackHandler<FeedbackSnapshot>(
+        [this] (const GroupFeedback& fbk, FeedbackSnapshot& snapshot) { extractFeedback(fbk, snapshot); },
+        [this] (const FeedbackSnapshot& snapshot) { processFeedback(snapshot); }));
+      feedback_handler_->attach(*group_);
+      group_->setFeedbackFrequencyHz(fbk_frq_hz_); 
+    }
+  }
+
+  // Runs on the API's feedback thread: only copies out what processFeedback
+  // needs, so that the worker can skip stale packets if it falls behind.
+  void Quadruped::extractFeedback(const GroupFeedback& fbk, FeedbackSnapshot& snapshot)
+  {
+    snapshot.time_ = std::chrono::steady_clock::now();
+    assert(fbk.size() == num_joints_);
+    for (int i = 0; i < num_joints_; ++i)
+    {
+      auto& pos = fbk[i].actuator().position();
+      auto& vel = fbk[i].actuator().velocity();
+      snapshot.positions_(i) = pos ? pos.get() : std::numeric_limits<double>::quiet_NaN();
+      snapshot.velocities_(i) = vel ? vel.get() : std::numeric_limits<double>::quiet_NaN();
+    }
+    for (int i = 0; i < num_legs_; ++i)
+    {
+      auto& imu = fbk[i * num_joints_per_leg_].imu();   // 0  3  6 9 12 15
+      auto mod_orientation = imu.orientation().get();
+      snapshot.orientations_.col(i) << mod_orientation.getW(), mod_orientation.getX(),
+        mod_orientation.getY(), mod_orientation.getZ();
+      auto& gyro = imu.gyro();
+      if (gyro)
       {
-        static bool first_rotation = false;
-        static std::vector<Eigen::Matrix3d> init_rotation;
-        // FBK 1: get gravity direction
-        // Some assistant variables calcuate needed physical quantities
-        // A -z vector in a local frame.
-        Eigen::Vector3d down(0, 0, -1);
-        Eigen::Vector3d avg_grav;
-        avg_grav.setZero();
-
-        std::lock_guard<std::mutex> guard(fbk_lock_);
-        latest_fbk_time = std::chrono::steady_clock::now();
-        assert(fbk.size() == num_joints_);
-        
-        // average all euler angle from 6 IMUs to get a better estimation
-        Eigen::Vector3d single_euler;
-        Eigen::Vector3d average_euler;
-        std::vector<Eigen::Quaterniond> q_list;
-        // std::cout << "angles ";
-        // for (int i = 0; i < num_legs_*num_joints_per_leg_; ++i)
-        // {
-        //     std::cout << fbk[i].actuator().position().get() << " ";
-        // }
-        // std::cout << std::endl;
-        if (updateBodyR) // this only be activated when system goes to third state, so the outside planner will 
-                         // call startUpdateBodyR to enable this flag to let the system start to update body R estimation
+        auto gyro_vec = gyro.get();
+        snapshot.gyros_.col(i) << gyro_vec.getX(), gyro_vec.getY(), gyro_vec.getZ();
+      }
+      else
+        snapshot.gyros_.col(i).setConstant(std::numeric_limits<double>::quiet_NaN());
+    }
+  }
+
+  // Runs on the feedback worker thread, with the newest snapshot.
+  void Quadruped::processFeedback(const FeedbackSnapshot& fbk)
+  {
+    static bool first_rotation = false;
+    static std::vector<Eigen::Matrix3d> init_rotation;
+    // FBK 1: get gravity direction
+    // Some assistant variables calcuate needed physical quantities
+    // A -z vector in a local frame.
+    Eigen::Vector3d down(0, 0, -1);
+    Eigen::Vector3d avg_grav;
+    avg_grav.setZero();
+
+    std::lock_guard<std::mutex> guard(fbk_lock_);
+    auto fbk_time = fbk.time_;
+    double fbk_dt = 0;
+    if (latest_fbk_time.time_since_epoch().count() != 0)
+      fbk_dt = std::chrono::duration<double>(fbk_time - latest_fbk_time).count();
+    latest_fbk_time = fbk_time;
+    
+    // average all euler angle from 6 IMUs to get a better estimation
+    Eigen::Vector3d single_euler;
+    Eigen::Vector3d average_euler;
+    std::vector<Eigen::Quaterniond> q_list;
+    // std::cout << "angles ";
+    // for (int i = 0; i < num_legs_*num_joints_per_leg_; ++i)
+    // {
+    //     std::cout << fbk[i].actuator().position().get() << " ";
+    // }
+    // std::cout << std::endl;
+    if (updateBodyR) // this only be activated when system goes to third state, so the outside planner will 
+                     // call startUpdateBodyR to enable this flag to let the system start to update body R estimation
+    {
+      // record initial rotations, so later we only calculate relation rotations as body rotation
+      if (!first_rotation)
+      {
+        for (int i = 0; i < num_legs_; ++i)
         {
-          // record initial rotations, so later we only calculate relation rotations as body rotation
-          if (!first_rotation)
-          {
-            for (int i = 0; i < num_legs_; ++i)
-            {
-              Eigen::Matrix4d trans = legs_[i]->getKinematics().getBaseFrame();
-              Eigen::Matrix3d trans_mat = trans.topLeftCorner<3,3>();
-              auto mod_orientation = fbk[i * num_joints_per_leg_]   // 0  3  6 9 12 15
-              .imu().orientation().get();
-              Eigen::Quaterniond mod_orientation_eig(
-                mod_orientation.getW(),
-                mod_orientation.getX(),
-                mod_orientation.getY(),
-                mod_orientation.getZ());
-              Eigen::Matrix3d mod_orientation_mat = mod_orientation_eig.toRotationMatrix();
-              
-              init_rotation.push_back(mod_orientation_mat);
-            }
-            
-            first_rotation = true;
-          }
-          else
-          {
-            int valid_fbk = 0;
-            for (int i = 0; i < num_legs_; ++i)
-            {
-              Eigen::Matrix4d trans = legs_[i]->getKinematics().getBaseFrame();
-              Eigen::Matrix3d trans_mat = trans.topLeftCorner<3,3>();
-              // HEBI Quaternion
-              auto mod_orientation = fbk[i * num_joints_per_leg_]   // 0  3  6 9 12 15
-                .imu().orientation().get();
-              // Eigen Quaternion
-              Eigen::Quaterniond mod_orientation_eig(
-                mod_orientation.getW(),
-                mod_orientation.getX(),
-                mod_orientation.getY(),
-                mod_orientation.getZ());
-                
-              Eigen::Matrix3d mod_orientation_mat = init_rotation[i].transpose() * mod_orientation_eig.toRotationMatrix();
-              // transform rotation axis to com of the robot
-              Eigen::AngleAxisd tmp_aa = Eigen::AngleAxisd(mod_orientation_mat);
-              double new_angle = tmp_aa.angle();
-              Eigen::Vector3d axis_aa = tmp_aa.axis();
-              axis_aa = trans_mat*axis_aa;
-              
-
-              // std::cout << "mod_orientation_mat aa  " << tmp_aa.angle() << " "
-              //                                       << axis_aa(0) << " "
-              //                                       << axis_aa(1) << " "
-              //                                       << axis_aa(2) << " "
-              //                                       << std::endl;
-              Eigen::AngleAxisd tmp_aa_after = Eigen::AngleAxisd(new_angle, axis_aa);
-              mod_orientation_mat = tmp_aa_after.toRotationMatrix();
-              
-              single_euler = mod_orientation_mat.eulerAngles(2,1,0);
-              
-              body_R = mod_orientation_mat; // comment this, then uncomment  168-170 to get average rotation
-              
-              //std::cout << "mod_orientation_mat" << mod_orientation_mat << std::endl;
-              // std::cout << "single _euler: " << single_euler(0) << " "
-              //                          << single_euler(1) << " "
-              //                          << single_euler(2) << 
-              //                          std::endl;
-              if (!std::isnan(single_euler(0)) && !std::isnan(single_euler(1)) && !std::isnan(single_euler(2)))
-              {
-                average_euler = average_euler + single_euler;
-                valid_fbk += 1;
-              }
-                
-
-              // Transform
-              Eigen::Vector3d my_grav = trans.topLeftCorner<3,3>() * mod_orientation_mat.transpose() * down;
-              // If one of the modules isn't reporting valid feedback, ignore this:
-              if (!std::isnan(my_grav[0]) && !std::isnan(my_grav[1]) && !std::isnan(my_grav[2]))
-                avg_grav += my_grav;
-            } 
-            // std::cout << "average_euler: " << average_euler(0) << " "
-            //                            << average_euler(1) << " "
-            //                            << average_euler(2) << std::endl;
-
-            average_euler(0) = average_euler(0)/valid_fbk;
-            average_euler(1) = average_euler(1)/valid_fbk;
-            average_euler(2) = average_euler(2)/valid_fbk;
-            // std::cout << "average_euler: " << average_euler(0) << " "
-            //                           << average_euler(1) << " "
-            //                           << average_euler(2) <<  std::endl;
-
-            // body_R = Eigen::AngleAxisd(average_euler(0), Eigen::Vector3d::UnitZ()) *
-            //         Eigen::AngleAxisd(average_euler(1), Eigen::Vector3d::UnitY()) *
-            //         Eigen::AngleAxisd(average_euler(2), Eigen::Vector3d::UnitX());
-
-            // Average the feedback from various modules and normalize.
-            avg_grav.normalize();
-            {
-              std::lock_guard<std::mutex> lg(grav_lock_);
-              gravity_direction_ = avg_grav;
-            }
-          }
+          Eigen::Matrix4d trans = legs_[i]->getKinematics().getBaseFrame();
+          Eigen::Matrix3d trans_mat = trans.topLeftCorner<3,3>();
+          Eigen::Quaterniond mod_orientation_eig(
+            fbk.orientations_(0, i),
+            fbk.orientations_(1, i),
+            fbk.orientations_(2, i),
+            fbk.orientations_(3, i));
+          Eigen::Matrix3d mod_orientation_mat = mod_orientation_eig.toRotationMatrix();
+          
+          init_rotation.push_back(mod_orientation_mat);
         }
         
-
-        // FBK 2 read fbk positions to legs
+        first_rotation = true;
+      }
+      else
+      {
+        int valid_fbk = 0;
         for (int i = 0; i < num_legs_; ++i)
         {
-          Eigen::VectorXd pos_vec = Eigen::VectorXd::Zero(num_joints_per_leg_);
-          for (int j = 0; j < num_joints_per_leg_; ++j)
+          Eigen::Matrix4d trans = legs_[i]->getKinematics().getBaseFrame();
+          Eigen::Matrix3d trans_mat = trans.topLeftCorner<3,3>();
+          // HEBI Quaternion
+          // Eigen Quaternion
+          Eigen::Quaterniond mod_orientation_eig(
+            fbk.orientations_(0, i),
+            fbk.orientations_(1, i),
+            fbk.orientations_(2, i),
+            fbk.orientations_(3, i));
+            
+          Eigen::Matrix3d mod_orientation_mat = init_rotation[i].transpose() * mod_orientation_eig.toRotationMatrix();
+          // transform rotation axis to com of the robot
+          Eigen::AngleAxisd tmp_aa = Eigen::AngleAxisd(mod_orientation_mat);
+          double new_angle = tmp_aa.angle();
+          Eigen::Vector3d axis_aa = tmp_aa.axis();
+          axis_aa = trans_mat*axis_aa;
+          
+
+          // std::cout << "mod_orientation_mat aa  " << tmp_aa.angle() << " "
+          //                                       << axis_aa(0) << " "
+          //                                       << axis_aa(1) << " "
+          //                                       << axis_aa(2) << " "
+          //                                       << std::endl;
+          Eigen::AngleAxisd tmp_aa_after = Eigen::AngleAxisd(new_angle, axis_aa);
+          mod_orientation_mat = tmp_aa_after.toRotationMatrix();
+          
+          single_euler = mod_orientation_mat.eulerAngles(2,1,0);
+          
+          body_R = mod_orientation_mat; // comment this, then uncomment  168-170 to get average rotation
+          
+          //std::cout << "mod_orientation_mat" << mod_orientation_mat << std::endl;
+          // std::cout << "single _euler: " << single_euler(0) << " "
+          //                          << single_euler(1) << " "
+          //                          << single_euler(2) << 
+          //                          std::endl;
+          if (!std::isnan(single_euler(0)) && !std::isnan(single_euler(1)) && !std::isnan(single_euler(2)))
           {
-            auto& pos = fbk[i*num_joints_per_leg_+j].actuator().position();
-            if (pos)
-            {
-              pos_vec(j) = pos.get();
-            }
-            else
-            {
-              pos_vec(j) = std::numeric_limits<double>::quiet_NaN();
-            }
+            average_euler = average_euler + single_euler;
+            valid_fbk += 1;
           }
-          legs_[i]->setJointAngles(pos_vec);
-        }
+            
 
-      });
-      group_->setFeedbackFrequencyHz(fbk_frq_hz_); 
+          // Transform
+          Eigen::Vector3d my_grav = trans.topLeftCorner<3,3>() * mod_orientation_mat.transpose() * down;
+          // If one of the modules isn't reporting valid feedback, ignore this:
+          if (!std::isnan(my_grav[0]) && !std::isnan(my_grav[1]) && !std::isnan(my_grav[2]))
+            avg_grav += my_grav;
+        } 
+        // std::cout << "average_euler: " << average_euler(0) << " "
+        //                            << average_euler(1) << " "
+        //                            << average_euler(2) << std::endl;
+
+        average_euler(0) = average_euler(0)/valid_fbk;
+        average_euler(1) = average_euler(1)/valid_fbk;
+        average_euler(2) = average_euler(2)/valid_fbk;
+        // std::cout << "average_euler: " << average_euler(0) << " "
+        //                           << average_euler(1) << " "
+        //                           << average_euler(2) <<  std::endl;
+
+        // body_R = Eigen::AngleAxisd(average_euler(0), Eigen::Vector3d::UnitZ()) *
+        //         Eigen::AngleAxisd(average_euler(1), Eigen::Vector3d::UnitY()) *
+        //         Eigen::AngleAxisd(average_euler(2), Eigen::Vector3d::UnitX());
+
+        // Average the feedback from various modules and normalize.
+        avg_grav.normalize();
+        setGravityDirection(avg_grav);
+
+        std::array<double, 9> shared_body_R;
+        Eigen::Matrix3d::Map(shared_body_R.data()) = body_R;
+        shared_body_R_.store(shared_body_R);
+      }
+    }
+    
+
+    // FBK 2 read fbk positions to legs
+    for (int i = 0; i < num_legs_; ++i)
+    {
+      Eigen::VectorXd pos_vec = fbk.positions_.segment(i * num_joints_per_leg_, num_joints_per_leg_);
+      legs_[i]->setJointAngles(pos_vec);
     }
+
+    // FBK 3 leg odometry
+    velocity_estimator_.update(fbk.positions_, fbk.velocities_, fbk.gyros_, body_R, fbk_dt);
+    position_history_.push(std::chrono::duration<double>(fbk_time - history_epoch_).count(), fbk.positions_);
   }
 
   Quadruped::~Quadruped()
   {
+    gain_switcher_.reset();
+    transmitter_.reset();
     if (group_)
     {
       group_->setFeedbackFrequencyHz(0);
       group_->clearFeedbackHandlers();
+      feedback_handler_.reset();
     }
   }
 
   Eigen::Vector3d Quadruped::getGravityDirection()
   {
-    std::lock_guard<std::mutex> lg(grav_lock_);
-    return gravity_direction_;
+    std::array<double, 3> gravity_direction = gravity_direction_.load();
+    return Eigen::Vector3d::Map(gravity_direction.data());
+  }
+
+  void Quadruped::setGravityDirection(const Eigen::Vector3d& gravity_direction)
+  {
+    std::array<double, 3> value;
+    Eigen::Vector3d::Map(value.data()) = gravity_direction;
+    gravity_direction_.store(value);
+  }
+
+  Eigen::Matrix3d Quadruped::getBodyR()
+  {
+    std::array<double, 9> body_R_value = shared_body_R_.load();
+    return Eigen::Matrix3d::Map(body_R_value.data());
   }
 
   Eigen::VectorXd Quadruped::getLegJointAngles(int index)
@@ -267,21 +355,22 @@ namespace hebi {
               0 + duration_time * 0.5,
               0 + duration_time * 0.75,
               0 + duration_time;
-      startup_trajectories.push_back(trajectory::Trajectory::createUnconstrainedQp(
+      startup_trajectories.push_back(spline_builder_.create(
         times, positions, &velocities, &accelerations));
     }
+    return true;
   }
 
   bool Quadruped::execStandUpTraj(double curr_time)
   {
-    // Controls to send to the robot
-    Eigen::VectorXd angles(num_joints_per_leg_);
-    Eigen::VectorXd vels(num_joints_per_leg_);
-    Eigen::VectorXd torques(num_joints_per_leg_); 
+    velocity_estimator_.setStanceLegs(legMask({0, 1, 2, 3, 4, 5}));
+    // Controls to send to the robot (preallocated, as this runs every tick)
+    Eigen::VectorXd& angles = leg_angles_;
+    Eigen::VectorXd& vels = leg_vels_;
+    Eigen::VectorXd& torques = leg_torques_;
     for (int i = 0; i < num_legs_; ++i)
     {
-      Eigen::VectorXd a(num_joints_per_leg_); // do not use acceleration
-      startup_trajectories[i]->getState(curr_time, &angles, &vels, &a);
+      startup_trajectories[i]->getState(curr_time, &angles, &vels, &leg_accs_); // do not use acceleration
 
       Eigen::Vector3d gravity_vec = getGravityDirection() * 9.8f;
 
@@ -296,6 +385,7 @@ namespace hebi {
       setCommand(i, &angles, &vels, &torques);
     }
     sendCommand();
+    return true;
   }
   
   // this is the hexapod original computation, i need another one for quadruped 
@@ -303,7 +393,7 @@ namespace hebi {
   {
     Eigen::VectorXd factors(6);
     Eigen::VectorXd blend_factors(6);
-    Eigen::Vector3d grav = -gravity_direction_;
+    Eigen::Vector3d grav = -getGravityDirection();
     // Get the dot product of gravity with each leg, and then subtract a scaled
     // gravity from the foot stance position.
     // NOTE: Matt is skeptical about this overall approach; but it worked before so we are keeping
@@ -351,24 +441,25 @@ namespace hebi {
     {
       assert(angles->size() == num_joints_per_leg_);
       for (int i = 0; i < num_joints_per_leg_; ++i)
-        cmd_[leg_offset + i].actuator().position().set((*angles)[i]);
+        cmd_.positions_(leg_offset + i) = (*angles)[i];
     }
     if (vels != nullptr)
     {
       assert(vels->size() == num_joints_per_leg_);
       for (int i = 0; i < num_joints_per_leg_; ++i)
-        cmd_[leg_offset + i].actuator().velocity().set((*vels)[i]);
+        cmd_.velocities_(leg_offset + i) = (*vels)[i];
     }
     if (torques != nullptr)
     {
       assert(torques->size() == num_joints_per_leg_);
       for (int i = 0; i < num_joints_per_leg_; ++i)
-        cmd_[leg_offset + i].actuator().effort().set((*torques)[i]);
+        cmd_.efforts_(leg_offset + i) = (*torques)[i];
     }
   }
 
   bool Quadruped::spreadAllLegs()
   {
+    velocity_estimator_.setStanceLegs(0); // lying on the belly
     bool isReaching = true;
     is_exec_traj = true;
     Eigen::VectorXd goal;
@@ -382,9 +473,9 @@ namespace hebi {
       
       legs_[i]->computeIK(goal, home_stance_xyz);
       int leg_offset = i * num_joints_per_leg_;
-      cmd_[leg_offset + 0].actuator().position().set(goal(0));
-      cmd_[leg_offset + 1].actuator().position().set(goal(1));
-      cmd_[leg_offset + 2].actuator().position().set(goal(2));
+      cmd_.positions_(leg_offset + 0) = goal(0);
+      cmd_.positions_(leg_offset + 1) = goal(1);
+      cmd_.positions_(leg_offset + 2) = goal(2);
     }
 
     // check if legs reach command angle
@@ -404,6 +495,7 @@ namespace hebi {
 
   bool Quadruped::pushAllLegs(double curr_time, double total_time)
   {
+    velocity_estimator_.setStanceLegs(legMask({0, 1, 2, 3, 4, 5}));
     bool isReaching = true;
     is_exec_traj = true;
     Eigen::VectorXd goal;
@@ -416,18 +508,18 @@ namespace hebi {
       Eigen::VectorXd home_stance_xyz = (base_frame * base_stance_ee_xyz).topLeftCorner<3,1>();
       legs_[i]->computeIK(goal, home_stance_xyz);
       int leg_offset = i * num_joints_per_leg_;
-      cmd_[leg_offset + 0].actuator().position().set(goal(0));
-      cmd_[leg_offset + 1].actuator().position().set(goal(1));
-      cmd_[leg_offset + 2].actuator().position().set(goal(2));
+      cmd_.positions_(leg_offset + 0) = goal(0);
+      cmd_.positions_(leg_offset + 1) = goal(1);
+      cmd_.positions_(leg_offset + 2) = goal(2);
    
       Eigen::Vector3d vels(0,0,0);
       // locally compensate foot force, need a dedicated function later
-      Eigen::Vector3d foot_force = curr_time/total_time* 1.0f / 6.0f * -gravity_direction_ * weight_;
+      Eigen::Vector3d foot_force = curr_time/total_time* 1.0f / 6.0f * -getGravityDirection() * weight_;
       Eigen::Vector3d torques = legs_[i]-> computeCompensateTorques(goal, vels, gravity_vec, foot_force); 
 
-      cmd_[leg_offset + 0].actuator().effort().set(torques(0));
-      cmd_[leg_offset + 1].actuator().effort().set(torques(1));
-      cmd_[leg_offset + 2].actuator().effort().set(torques(2));
+      cmd_.efforts_(leg_offset + 0) = torques(0);
+      cmd_.efforts_(leg_offset + 1) = torques(1);
+      cmd_.efforts_(leg_offset + 2) = torques(2);
 
     }
 
@@ -437,6 +529,7 @@ namespace hebi {
 
   bool Quadruped::prepareQuadMode()
   {
+    velocity_estimator_.setStanceLegs(legMask({0, 1, 4, 5}));
     bool isReaching = true;
     is_exec_traj = true;
     Eigen::VectorXd goal;
@@ -453,18 +546,18 @@ namespace hebi {
       Eigen::VectorXd home_stance_xyz = (base_frame * base_stance_ee_xyz).topLeftCorner<3,1>();
       legs_[i]->computeIK(goal, home_stance_xyz);
       int leg_offset = i * num_joints_per_leg_;
-      cmd_[leg_offset + 0].actuator().position().set(goal(0));
-      cmd_[leg_offset + 1].actuator().position().set(goal(1));
-      cmd_[leg_offset + 2].actuator().position().set(goal(2));
+      cmd_.positions_(leg_offset + 0) = goal(0);
+      cmd_.positions_(leg_offset + 1) = goal(1);
+      cmd_.positions_(leg_offset + 2) = goal(2);
 
       Eigen::Vector3d vels(0,0,0);
       // locally compensate foot force, need a dedicated function later
-      Eigen::Vector3d foot_force = 0.25* -gravity_direction_ * weight_;
+      Eigen::Vector3d foot_force = 0.25* -getGravityDirection() * weight_;
       Eigen::Vector3d torques = legs_[i]-> computeCompensateTorques(goal, vels, gravity_vec, foot_force); 
 
-      cmd_[leg_offset + 0].actuator().effort().set(torques(0));
-      cmd_[leg_offset + 1].actuator().effort().set(torques(1));
-      cmd_[leg_offset + 2].actuator().effort().set(torques(2));
+      cmd_.efforts_(leg_offset + 0) = torques(0);
+      cmd_.efforts_(leg_offset + 1) = torques(1);
+      cmd_.efforts_(leg_offset + 2) = torques(2);
     }
     for (int i = 2; i < 4; i++)
     {
@@ -475,9 +568,9 @@ namespace hebi {
       home_stance_xyz = home_stance_xyz + tmp3;
       legs_[i]->computeIK(goal, home_stance_xyz);
       int leg_offset = i * num_joints_per_leg_;
-      cmd_[leg_offset + 0].actuator().position().set(goal(0));
-      cmd_[leg_offset + 1].actuator().position().set(goal(1));
-      cmd_[leg_offset + 2].actuator().position().set(goal(2));
+      cmd_.positions_(leg_offset + 0) = goal(0);
+      cmd_.positions_(leg_offset + 1) = goal(1);
+      cmd_.positions_(leg_offset + 2) = goal(2);
     }
     sendCommand();
     return isReaching;   
@@ -501,8 +594,8 @@ namespace hebi {
     in this function, legs execute trajectories
 
 
-    here the function does not actually use virtual leg placement strategy yet because we not yet have 
-    body velocity measurement, let me work out a open loop gait first
+    The body velocity comes from leg odometry (BodyVelocityEstimator); prepareTrajectories uses it
+    to place the swing feet (Raibert style), so the gait no longer runs fully open loop.
   */
   void Quadruped::runTest(SwingMode mode, double curr_time, double total_time)
   {
@@ -518,9 +611,9 @@ namespace hebi {
       home_stance_xyz = home_stance_xyz + tmp3;
       legs_[i]->computeIK(goal, home_stance_xyz);
       int leg_offset = i * num_joints_per_leg_;
-      cmd_[leg_offset + 0].actuator().position().set(goal(0));
-      cmd_[leg_offset + 1].actuator().position().set(goal(1));
-      cmd_[leg_offset + 2].actuator().position().set(goal(2));
+      cmd_.positions_(leg_offset + 0) = goal(0);
+      cmd_.positions_(leg_offset + 1) = goal(1);
+      cmd_.positions_(leg_offset + 2) = goal(2);
     }
 
     // id of legs
@@ -539,16 +632,18 @@ namespace hebi {
       stance_vleg[0] = 0;
       stance_vleg[1] = 5;
     }
+    velocity_estimator_.setStanceLegs(legMask({stance_vleg[0], stance_vleg[1]}));
     // for swing leg
     for (int i = 0; i<2;i++)
     {
       Eigen::VectorXd traj_angles(3);
       Eigen::VectorXd traj_vels(3);
       Eigen::VectorXd traj_accs(3);
-      Eigen::Vector3d foot_force = 0* -gravity_direction_ * weight_;
+      Eigen::Vector3d foot_force = 0* -getGravityDirection() * weight_;
       // if (i == 0 && swing_vleg[0] == 0)
       // {
         swing_trajectories[i]->getState(curr_time, &traj_angles, &traj_vels, &traj_accs);
+        if (verbose_)
               std::cout << "traj_angles is " << traj_angles(0) << " " 
                                          << traj_angles(1) << " "
                                          << traj_angles(2) <<std::endl; 
@@ -561,23 +656,23 @@ namespace hebi {
       //   legs_[swing_vleg[i]]->computeIK(traj_angles, home_stance_xyz);
       // }      
       int leg_offset = swing_vleg[i] * num_joints_per_leg_;
-      cmd_[leg_offset + 0].actuator().position().set(traj_angles(0));
-      cmd_[leg_offset + 1].actuator().position().set(traj_angles(1));
-      cmd_[leg_offset + 2].actuator().position().set(traj_angles(2));
+      cmd_.positions_(leg_offset + 0) = traj_angles(0);
+      cmd_.positions_(leg_offset + 1) = traj_angles(1);
+      cmd_.positions_(leg_offset + 2) = traj_angles(2);
 
       // swing leg does not compensate foot force
       // if (i == 0 && swing_vleg[0] == 0)
       // {
       double normed_time = curr_time/total_time;
       double coefficient = -2*normed_time*normed_time + 2* normed_time +0.5;
-      foot_force = (-0.25*0 + 0.2)* -gravity_direction_ * weight_;
+      foot_force = (-0.25*0 + 0.2)* -getGravityDirection() * weight_;
       // }
       //Eigen::Vector3d vels(0,0,0);
       Eigen::Vector3d torques = legs_[swing_vleg[i]]-> computeCompensateTorques(traj_angles, traj_vels, gravity_vec, foot_force); 
 
-      cmd_[leg_offset + 0].actuator().effort().set(torques(0));
-      cmd_[leg_offset + 1].actuator().effort().set(torques(1));
-      cmd_[leg_offset + 2].actuator().effort().set(torques(2));
+      cmd_.efforts_(leg_offset + 0) = torques(0);
+      cmd_.efforts_(leg_offset + 1) = torques(1);
+      cmd_.efforts_(leg_offset + 2) = torques(2);
     }
     // for stance leg
     // first calcuate foot force distribution
@@ -597,20 +692,20 @@ namespace hebi {
       // legs_[stance_vleg[i]]->computeIK(traj_angles, home_stance_xyz);
       
       int leg_offset = stance_vleg[i] * num_joints_per_leg_;
-      cmd_[leg_offset + 0].actuator().position().set(traj_angles(0));
-      cmd_[leg_offset + 1].actuator().position().set(traj_angles(1));
-      cmd_[leg_offset + 2].actuator().position().set(traj_angles(2));
+      cmd_.positions_(leg_offset + 0) = traj_angles(0);
+      cmd_.positions_(leg_offset + 1) = traj_angles(1);
+      cmd_.positions_(leg_offset + 2) = traj_angles(2);
 
       
       // during a swing, change foot force distribution and ratio for stance leg
       double normed_time = curr_time/total_time;
       double coefficient = -2*normed_time*normed_time + 2* normed_time +0.5;
-      Eigen::Vector3d foot_force = 0.0* -gravity_direction_ * weight_;
+      Eigen::Vector3d foot_force = 0.0* -getGravityDirection() * weight_;
       Eigen::Vector3d torques = legs_[stance_vleg[i]]-> computeCompensateTorques(traj_angles, traj_vels, gravity_vec, foot_force); 
 
-      cmd_[leg_offset + 0].actuator().effort().set(torques(0));
-      cmd_[leg_offset + 1].actuator().effort().set(torques(1));
-      cmd_[leg_offset + 2].actuator().effort().set(torques(2));
+      cmd_.efforts_(leg_offset + 0) = torques(0);
+      cmd_.efforts_(leg_offset + 1) = torques(1);
+      cmd_.efforts_(leg_offset + 2) = torques(2);
     }
 
     sendCommand();
@@ -635,6 +730,17 @@ namespace hebi {
       stance_vleg[0] = 0;
       stance_vleg[1] = 5;
     }
+    // Raibert-style foot placement: each half cycle, the stance legs push the body forward by one
+    // step length, so the nominal body velocity is step_length / leg_swing_time.  If the body is
+    // moving faster (or slower, or sideways) than that, land the swing foot further in that direction.
+    const double step_length = 0.10;
+    Eigen::Vector3d nominal_velocity(step_length / leg_swing_time, 0, 0);
+    Eigen::Vector3d foot_correction = params_.velocity_feedback_gain_ *
+      (getBodyVelocity().linear_velocity_ - nominal_velocity);
+    foot_correction(2) = 0;
+    if (foot_correction.norm() > params_.max_foot_correction_)
+      foot_correction *= params_.max_foot_correction_ / foot_correction.norm();
+
     // first swing legs
     swing_trajectories.clear();
     for (int i = 0; i<2;i++)
@@ -652,33 +758,35 @@ namespace hebi {
       legs_[swing_vleg[i]] -> getKinematics().getFK(HebiFrameTypeEndEffector, start_leg_angles, frames); // I assume this is in the frame of base frame
       Eigen::Vector3d start_leg_ee_xyz = frames[0].topRightCorner<3,1>();  // make sure this is in com frame
       int numFrame = legs_[swing_vleg[i]] -> getKinematics().getFrameCount(HebiFrameTypeEndEffector);
-      std::cout << "prepare trajectories for leg " << swing_vleg[i] << " (frame " << numFrame << " )" << std::endl;
-      std::cout << "start_leg_ee_xyz is " << start_leg_ee_xyz(0) << " " 
-                                         << start_leg_ee_xyz(1) << " "
-                                         << start_leg_ee_xyz(2) <<std::endl; 
-      Eigen::VectorXd mid_leg_ee_xyz = start_leg_ee_xyz + Eigen::Vector3d(0.05,0.0,0.08);
-
-      std::cout << "mid_leg_ee_xyz is " << mid_leg_ee_xyz(0) << " " 
-                                         << mid_leg_ee_xyz(1) << " "
-                                         << mid_leg_ee_xyz(2) <<std::endl; 
-      Eigen::VectorXd end_leg_ee_xyz = start_leg_ee_xyz + Eigen::Vector3d(0.10,0.0,0.0);
-      std::cout << "end_leg_ee_xyz is " << end_leg_ee_xyz(0) << " " 
-                                         << end_leg_ee_xyz(1) << " "
-                                         << end_leg_ee_xyz(2) <<std::endl; 
-
-      std::cout << "start_leg_angle is " << start_leg_angles(0) << " " 
-                                         << start_leg_angles(1) << " "
-                                         << start_leg_angles(2) <<std::endl; 
+      Eigen::VectorXd mid_leg_ee_xyz = start_leg_ee_xyz + Eigen::Vector3d(0.5*step_length,0.0,0.08) + 0.5*foot_correction;
+      Eigen::VectorXd end_leg_ee_xyz = start_leg_ee_xyz + Eigen::Vector3d(step_length,0.0,0.0) + foot_correction;
       Eigen::VectorXd mid_leg_angles;
       Eigen::VectorXd end_leg_angles;
       legs_[swing_vleg[i]] -> computeIK(mid_leg_angles, mid_leg_ee_xyz);
-      std::cout << "mid_leg_angles is " << mid_leg_angles(0) << " " 
-                                         << mid_leg_angles(1) << " "
-                                         << mid_leg_angles(2) <<std::endl; 
       legs_[swing_vleg[i]] -> computeIK(end_leg_angles, end_leg_ee_xyz);
-      std::cout << "end_leg_angles is " << end_leg_angles(0) << " " 
-                                         << end_leg_angles(1) << " "
-                                         << end_leg_angles(2) <<std::endl; 
+
+      if (verbose_)
+      {
+        std::cout << "prepare trajectories for leg " << swing_vleg[i] << " (frame " << numFrame << " )" << std::endl;
+        std::cout << "start_leg_ee_xyz is " << start_leg_ee_xyz(0) << " " 
+                                           << start_leg_ee_xyz(1) << " "
+                                           << start_leg_ee_xyz(2) <<std::endl; 
+        std::cout << "mid_leg_ee_xyz is " << mid_leg_ee_xyz(0) << " " 
+                                           << mid_leg_ee_xyz(1) << " "
+                                           << mid_leg_ee_xyz(2) <<std::endl; 
+        std::cout << "end_leg_ee_xyz is " << end_leg_ee_xyz(0) << " " 
+                                           << end_leg_ee_xyz(1) << " "
+                                           << end_leg_ee_xyz(2) <<std::endl; 
+        std::cout << "start_leg_angle is " << start_leg_angles(0) << " " 
+                                           << start_leg_angles(1) << " "
+                                           << start_leg_angles(2) <<std::endl; 
+        std::cout << "mid_leg_angles is " << mid_leg_angles(0) << " " 
+                                           << mid_leg_angles(1) << " "
+                                           << mid_leg_angles(2) <<std::endl; 
+        std::cout << "end_leg_angles is " << end_leg_angles(0) << " " 
+                                           << end_leg_angles(1) << " "
+                                           << end_leg_angles(2) <<std::endl; 
+      }
 
       // std::cout << "leg fk" << i << std:endl;
       // Convert for trajectories
@@ -702,7 +810,7 @@ namespace hebi {
       times << local_start,
               local_start + total * 0.5,
               local_start + total;
-      swing_trajectories.push_back(trajectory::Trajectory::createUnconstrainedQp(
+      swing_trajectories.push_back(spline_builder_.create(
         times, positions, &velocities, &accelerations));
     }
 
@@ -756,7 +864,7 @@ namespace hebi {
       times << local_start,
               local_start + total * 0.5,
               local_start + total;
-      stance_trajectories.push_back(trajectory::Trajectory::createUnconstrainedQp(
+      stance_trajectories.push_back(spline_builder_.create(
         times, positions, &velocities, &accelerations));
     }
 
@@ -764,6 +872,7 @@ namespace hebi {
 
   bool Quadruped::reOrient(Eigen::Matrix3d target_body_R)
   {
+    velocity_estimator_.setStanceLegs(legMask({0, 1, 4, 5}));
     Eigen::VectorXd goal;
     Eigen::Vector3d gravity_vec = getGravityDirection() * 9.8f;
     // won't use these manipulate legs for a while so just hold them up
@@ -776,9 +885,9 @@ namespace hebi {
       home_stance_xyz = home_stance_xyz + tmp3;
       legs_[i]->computeIK(goal, home_stance_xyz);
       int leg_offset = i * num_joints_per_leg_;
-      cmd_[leg_offset + 0].actuator().position().set(goal(0));
-      cmd_[leg_offset + 1].actuator().position().set(goal(1));
-      cmd_[leg_offset + 2].actuator().position().set(goal(2));
+      cmd_.positions_(leg_offset + 0) = goal(0);
+      cmd_.positions_(leg_offset + 1) = goal(1);
+      cmd_.positions_(leg_offset + 2) = goal(2);
     }
     // std::cout << "ready to get leg angles" << std::endl;
 
@@ -826,29 +935,43 @@ namespace hebi {
       //                           << p_e(1) << " "
       //                           << p_e(2) <<  std::endl;
 
-      cmd_[leg_offset + 0].actuator().position().set(goal(0));
-      cmd_[leg_offset + 1].actuator().position().set(goal(1));
-      cmd_[leg_offset + 2].actuator().position().set(goal(2));
+      cmd_.positions_(leg_offset + 0) = goal(0);
+      cmd_.positions_(leg_offset + 1) = goal(1);
+      cmd_.positions_(leg_offset + 2) = goal(2);
       
 
       // constant footforce compensation
       Eigen::Vector3d traj_vels(0,0,0);
-      Eigen::Vector3d foot_force = 0.25* -gravity_direction_ * weight_;
+      Eigen::Vector3d foot_force = 0.25* -getGravityDirection() * weight_;
       Eigen::Vector3d torques = legs_[support_vleg[i]]-> computeCompensateTorques(goal, traj_vels, gravity_vec, foot_force); 
 
-      cmd_[leg_offset + 0].actuator().effort().set(torques(0));
-      cmd_[leg_offset + 1].actuator().effort().set(torques(1));
-      cmd_[leg_offset + 2].actuator().effort().set(torques(2));
+      cmd_.efforts_(leg_offset + 0) = torques(0);
+      cmd_.efforts_(leg_offset + 1) = torques(1);
+      cmd_.efforts_(leg_offset + 2) = torques(2);
     }
 
     sendCommand();
-
+    return true;
   }
 
   void Quadruped::sendCommand()
   {
-    if (group_)
-      group_->sendCommand(cmd_);
+    if (transmitter_)
+    {
+      transmitter_->submit(cmd_);
+      return;
+    }
+    // dummy: the joints go straight to their commanded positions
+    std::lock_guard<std::mutex> guard(fbk_lock_);
+    for (int i = 0; i < num_legs_; ++i)
+    {
+      for (int j = 0; j < num_joints_per_leg_; ++j)
+      {
+        double pos = cmd_.positions_(i * num_joints_per_leg_ + j);
+        dummy_angles_(j) = std::isnan(pos) ? legs_[i]->getJointAngle()(j) : pos;
+      }
+      legs_[i]->setJointAngles(dummy_angles_);
+    }
   }
 
   bool Quadruped::setGains()
@@ -856,11 +979,27 @@ namespace hebi {
     if (!group_)
       return true;
 
-    hebi::GroupCommand gains(group_->size());
-    std::string gains_file = std::string("quad_gains") + std::to_string(group_->size()) + ".xml";
-    std::cout << "Loading gains from: " << gains_file << std::endl;
-    bool success = gains.readGains(gains_file);
-    return success && group_->sendCommandWithAcknowledgement(gains, 4000);
+    gain_profile_ = GainProfile::stand_up;
+    int profile = gain_profile_ids_[static_cast<int>(gain_profile_)];
+    if (profile < 0)
+      return false;
+    gain_switcher_->select(profile);
+    return true;
+  }
+
+  void Quadruped::setGainProfile(GainProfile profile)
+  {
+    gain_profile_ = profile;
+    int id = gain_profile_ids_[static_cast<int>(profile)];
+    if (gain_switcher_ && id >= 0)
+      gain_switcher_->select(id);
+  }
+
+  util::GainProfileSwitcher::Status Quadruped::getGainStatus()
+  {
+    if (!gain_switcher_)
+      return util::GainProfileSwitcher::Status::Confirmed;
+    return gain_switcher_->update();
   }
 
   // private individual function, calcuate average of quaternions, but not correct yet
@@ -895,6 +1034,14 @@ namespace hebi {
 
   }
 
+  uint32_t Quadruped::legMask(std::initializer_list<int> legs)
+  {
+    uint32_t mask = 0;
+    for (int leg : legs)
+      mask |= 1u << leg;
+    return mask;
+  }
+
   Eigen::Vector3d Quadruped::quat_log(Eigen::Quaterniond q)
   {
     Eigen::Vector3d qv = q.vec();
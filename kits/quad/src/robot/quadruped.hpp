@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <memory>
 #include <set>
 #include <chrono>
@@ -8,13 +10,20 @@
 
 #include "lookup.hpp"
 #include "group.hpp"
-#include "trajectory.hpp"
 #include "group_command.hpp"
 #include "group_feedback.hpp"
 #include "group_info.hpp"
 
 #include "quadruped_parameters.hpp"
 #include "quadruped_leg.hpp"
+#include "body_velocity_estimator.hpp"
+#include "util/feedback_history.hpp"
+#include "util/conflating_feedback_handler.hpp"
+#include "util/command_transmitter.hpp"
+#include "util/gain_profile_switcher.hpp"
+#include "util/gain_profiles.hpp"
+#include "util/trajectory_builder.hpp"
+#include "util/seqlock.hpp"
 
 /* 
   This class defines a quadruped robot using Hebi's daisy robot (or Mat6)
@@ -41,10 +50,16 @@ class Quadruped
     // 1 2 5 6 are locomote legs, 3 4 are manipulate legs
     enum struct CtrlLegType { all, locomote, manipulate };
     enum struct SwingMode {swing_mode_virtualLeg1, swing_mode_virtualLeg2};
+    // stand_up: softer gains (gains18.xml) while spreading and pushing the legs
+    // quad: the four legged gains (quad_gains18.xml) for everything after that
+    enum struct GainProfile {stand_up, quad};
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW // Allow Eigen member variables
 
     // learn from hebi source code to do this fancy construction method
     static std::unique_ptr<Quadruped> create(const QuadrupedParameters& params);
+    // a simulated robot with no modules; commands are built as usual, and the
+    // joints are assumed to track them perfectly
+    static std::unique_ptr<Quadruped> createDummy(const QuadrupedParameters& params);
     virtual ~Quadruped() noexcept;
 
     Eigen::Vector3d getGravityDirection();
@@ -69,14 +84,32 @@ class Quadruped
     void prepareTrajectories(SwingMode mode, double leg_swing_time);
     bool reOrient(Matrix3d target_body_R);
 
-    Eigen::Matrix3d getBodyR() {return body_R;}
+    // Safe to call from any thread.
+    Eigen::Matrix3d getBodyR();
     void startBodyRUpdate() {updateBodyR = true;}
+    // Latest leg odometry estimate; call only from the planner thread.
+    const BodyVelocityEstimator::Estimate& getBodyVelocity() {return velocity_estimator_.getEstimate();}
+    // Recent joint position feedback (NaN where a module did not report);
+    // times are in seconds since construction.  Safe to read from any thread.
+    const util::FeedbackHistory& getPositionHistory() const {return position_history_;}
 
     bool isExecution() {return is_exec_traj;}
+    // prints trajectory debugging info while walking (on by default)
+    void setVerbose(bool verbose) {verbose_ = verbose;}
 
     void setCommand(int index, const VectorXd* angles, const VectorXd* vels, const VectorXd* torques);
     void sendCommand();
+    // selects the stand up gains; all gain files are loaded at construction,
+    // and gains are sent along with the next command, so this never blocks.
+    // returns false if the gain files could not be loaded
     bool setGains();
+    // switches gains with the next command; call from the control thread
+    void setGainProfile(GainProfile profile);
+    GainProfile getGainProfile() {return gain_profile_;}
+    // whether the modules report the selected gains (confirmed if there are no
+    // modules); resends them if they seem lost, and fails after 4 seconds.
+    // does not block; poll it every tick from the control thread
+    util::GainProfileSwitcher::Status getGainStatus();
 
   private:
     // private constructor, it make sense because before construct must make sure group is successfully created
@@ -86,10 +119,20 @@ class Quadruped
     Eigen::Quaterniond average_quat(Eigen::Quaterniond average_q_, std::vector<Eigen::Quaterniond> q_list_);
     Eigen::Vector3d quat_log(Eigen::Quaterniond q);
     Eigen::Quaterniond quat_exp(Eigen::Vector3d qv);
+    static uint32_t legMask(std::initializer_list<int> legs);
 
     // hebi middleware to communicate with real hardware
     std::shared_ptr<Group> group_;
-    GroupCommand cmd_;
+    // filled in on the control thread; sendCommand hands it off to the
+    // transmitter thread (if there is a group)
+    util::CommandFrame cmd_;
+    std::unique_ptr<util::CommandTransmitter> transmitter_;
+    // every gain file is parsed once; profiles are switched through the transmitter
+    std::shared_ptr<util::GainProfiles> gain_profiles_;
+    std::unique_ptr<util::GainProfileSwitcher> gain_switcher_;
+    // indices into 'gain_profiles_' (-1 if not loaded), by GainProfile
+    std::array<int, 2> gain_profile_ids_{{-1, -1}};
+    GainProfile gain_profile_{GainProfile::stand_up};
 
     // leg info
     std::vector<std::unique_ptr<QuadLeg> > legs_;
@@ -98,21 +141,30 @@ class Quadruped
     std::chrono::time_point<std::chrono::steady_clock> latest_fbk_time;
     QuadrupedParameters params_;
 
-    // feedback physical quantities
-    Eigen::Vector3d gravity_direction_;
+    // feedback physical quantities; 'body_R' is only touched by the feedback
+    // worker, which shares it (and the gravity direction) through seqlocks.
+    util::Seqlock<std::array<double, 3>> gravity_direction_;
     Eigen::Matrix3d body_R;
+    util::Seqlock<std::array<double, 9>> shared_body_R_;
+    void setGravityDirection(const Eigen::Vector3d& gravity_direction);
 
-    bool updateBodyR = false;
+    std::atomic<bool> updateBodyR{false};
 
-    // two locks to get feedback
+    // leg odometry, updated at the feedback rate
+    BodyVelocityEstimator velocity_estimator_;
+
+    // lock to get feedback
     std::mutex fbk_lock_;
-    std::mutex grav_lock_;
 
     // planner trajectories
-    std::vector<std::shared_ptr<trajectory::Trajectory>> startup_trajectories;
-    std::vector<std::shared_ptr<trajectory::Trajectory>> stance_trajectories;  // used in runTest
-    std::vector<std::shared_ptr<trajectory::Trajectory>> swing_trajectories;   // used in runTest
+    std::vector<std::shared_ptr<util::TrajectoryBuilder::Trajectory>> startup_trajectories;
+    std::vector<std::shared_ptr<util::TrajectoryBuilder::Trajectory>> stance_trajectories;  // used in runTest
+    std::vector<std::shared_ptr<util::TrajectoryBuilder::Trajectory>> swing_trajectories;   // used in runTest
     bool is_exec_traj; // flag to show that it is still running trajectories 
+    bool verbose_{true};
+    // the startup, swing and stance grids are the same every time; only used
+    // from the control thread
+    util::TrajectoryBuilder spline_builder_;
 
     // control constants
     const float fbk_frq_hz_ = 200.0f;
@@ -126,6 +178,26 @@ class Quadruped
     const int num_joints_ = num_legs_ * num_joints_per_leg_;
     const int num_locomote_joints_ = num_locomote_legs_ * num_joints_per_leg_;
     const int num_manipulate_joints_ = num_manipulate_legs_ * num_joints_per_leg_;
+
+    // written only by the feedback handler; 320 ms of feedback, with window
+    // statistics over the last 80 ms
+    util::FeedbackHistory position_history_{static_cast<size_t>(num_joints_), 64, 16};
+    const std::chrono::steady_clock::time_point history_epoch_ = std::chrono::steady_clock::now();
+
+    // what the feedback worker needs from each packet (fixed size, so the
+    // API's feedback thread never allocates); orientations are the base module
+    // of each leg as (w, x, y, z) columns
+    struct FeedbackSnapshot
+    {
+      BodyVelocityEstimator::JointVector positions_;
+      BodyVelocityEstimator::JointVector velocities_;
+      BodyVelocityEstimator::GyroMatrix gyros_;
+      Eigen::Matrix<double, 4, num_legs_> orientations_;
+      std::chrono::steady_clock::time_point time_;
+    };
+    void extractFeedback(const GroupFeedback& fbk, FeedbackSnapshot& snapshot);
+    void processFeedback(const FeedbackSnapshot& fbk);
+    std::unique_ptr<util::ConflatingFeedbackHandler<FeedbackSnapshot>> feedback_handler_;
     static constexpr double weight_ = 9.8f * 21.0f; // mass = 21 kg
 
     // structural and stance constants to make system stand
@@ -139,6 +211,14 @@ class Quadruped
 
     Eigen::Vector4d base_stance_ee_xyz; // expressed in base motor's frame
     Eigen::Vector3d com_stance_ee_xyz;  // expressed in com of the robot's frame
+
+    // per leg scratch space, so the control tick doesn't allocate
+    Eigen::VectorXd leg_angles_;
+    Eigen::VectorXd leg_vels_;
+    Eigen::VectorXd leg_accs_;
+    Eigen::VectorXd leg_torques_;
+    // joint angles a dummy robot moves to in sendCommand
+    Eigen::VectorXd dummy_angles_;
 };
 
 } // namespace hebi
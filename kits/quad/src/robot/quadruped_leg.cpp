@@ -11,7 +11,7 @@ namespace hebi {
                    const Eigen::VectorXd& current_angles, 
                    const QuadrupedParameters& params, 
                    int index, LegConfiguration configuration)
-  : index_(index), spring_shift_(configuration == LegConfiguration::Right ? 3.75 : -3.75) //so hardcode
+  : index_(index), configuration_(configuration), spring_shift_(configuration == LegConfiguration::Right ? 3.75 : -3.75) //so hardcode
   {
     // deep copy?
     current_angles_ = current_angles;
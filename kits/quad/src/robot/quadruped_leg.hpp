@@ -21,6 +21,7 @@ class QuadLeg
 
     static constexpr int getNumJoints() { return num_joints_; }
     int getIndex() { return index_; }
+    LegConfiguration getConfiguration() const { return configuration_; }
 
     void setJointAngles(Eigen::VectorXd& current_angles);
     Eigen::VectorXd getJointAngle();
@@ -39,6 +40,7 @@ class QuadLeg
     // to calcuate IK
     Eigen::VectorXd seed_angles_;
     int index_;  
+    LegConfiguration configuration_;
     static constexpr int num_joints_ = 3;
     std::unique_ptr<hebi::robot_model::RobotModel> kin_;
 
@@ -8,6 +8,8 @@ namespace hebi {
 void QuadrupedParameters::resetToDefaults()
 {
     leg_swing_time_ = 0.25f;
+    velocity_feedback_gain_ = 0.05;
+    max_foot_correction_ = 0.05;
 }
 
 } // namespace hebi
@@ -7,6 +7,11 @@ namespace hebi {
 struct QuadrupedParameters
 {
     double leg_swing_time_;
+    // Raibert-style foot placement: the swing foot lands this much further
+    // ahead per m/s the body is faster than the nominal gait speed [s]
+    double velocity_feedback_gain_;
+    // Limit on the foot placement correction [m]
+    double max_foot_correction_;
 
     void resetToDefaults();
 };
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace hebi {
+namespace util {
+
+/**
+ * An atomic value for small, trivially copyable structs (up to 8 bytes, e.g. a
+ * pair of floats or a few flags), shared between any number of threads.
+ *
+ * Unlike std::atomic<T>, this never falls back on a hidden lock: the value is
+ * packed into a single lock-free 64 bit word (which fails to compile if that
+ * isn't possible).  `update` applies a function to the value atomically,
+ * retrying if another thread changed it meanwhile.  For larger values, see
+ * util::Seqlock.
+ */
+template <typename T>
+class AtomicSnapshot
+{
+  static_assert(std::is_trivially_copyable<T>::value, "AtomicSnapshot values must be trivially copyable");
+  static_assert(sizeof(T) <= sizeof(uint64_t), "AtomicSnapshot values must fit in 8 bytes; use Seqlock instead");
+  static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "AtomicSnapshot requires lock-free 64 bit atomics");
+
+public:
+  AtomicSnapshot() : AtomicSnapshot(T()) {}
+
+  explicit AtomicSnapshot(const T& initial) : word_(pack(initial)) {}
+
+  AtomicSnapshot(const AtomicSnapshot&) = delete;
+  AtomicSnapshot& operator=(const AtomicSnapshot&) = delete;
+
+  T load() const
+  {
+    return unpack(word_.load(std::memory_order_acquire));
+  }
+
+  void store(const T& value)
+  {
+    word_.store(pack(value), std::memory_order_release);
+  }
+
+  /**
+   * Replaces the value, and returns the previous one.
+   */
+  T exchange(const T& value)
+  {
+    return unpack(word_.exchange(pack(value), std::memory_order_acq_rel));
+  }
+
+  /**
+   * Replaces the value with 'function(value)', and returns the new value.
+   * 'function' may be called more than once if other threads write
+   * concurrently, so it should not have side effects.
+   */
+  template <typename Function>
+  T update(Function function)
+  {
+    uint64_t expected = word_.load(std::memory_order_relaxed);
+    T updated;
+    do
+    {
+      updated = function(unpack(expected));
+    } while (!word_.compare_exchange_weak(expected, pack(updated), std::memory_order_acq_rel, std::memory_order_relaxed));
+    return updated;
+  }
+
+private:
+  static uint64_t pack(const T& value)
+  {
+    uint64_t word = 0;
+    std::memcpy(&word, &value, sizeof(T));
+    return word;
+  }
+
+  static T unpack(uint64_t word)
+  {
+    T value;
+    std::memcpy(&value, &word, sizeof(T));
+    return value;
+  }
+
+  std::atomic<uint64_t> word_;
+};
+
+} // namespace util
+} // namespace hebi
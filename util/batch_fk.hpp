@@ -0,0 +1,416 @@
+#pragma once
+
+#include "robot_model.hpp"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace hebi {
+namespace util {
+
+/**
+ * Forward kinematics for many joint configurations of the same serial chain at
+ * once, e.g. to check a workspace, score IK seeds or draw a reachability map.
+ *
+ * RobotModel::getFK and getEndEffector compute one configuration per call, with
+ * dynamically sized matrices.  This instead extracts the chain from a
+ * RobotModel once (the fixed transform before each joint, and from each joint
+ * to each frame after it), and then evaluates blocks of configurations
+ * together: each block is transposed so that the same quantity for every
+ * configuration is contiguous, and the transforms are composed across the
+ * block with AVX2 (4 configurations per instruction) when the examples are
+ * built with HEBI_EXAMPLES_AVX2, and with scalar code otherwise.  Large batches
+ * are split across threads.
+ *
+ * Poses are returned as the columns of a 12 x K matrix: rows 0-8 are the
+ * rotation (column major), and rows 9-11 the translation; see `getPose`.
+ */
+class BatchForwardKinematics
+{
+public:
+  /**
+   * Extracts the chain from 'model' (including its base frame).  Returns null
+   * if the model is not a serial chain whose joints each rotate about the z
+   * axis of their output frame, as HEBI actuators do; the extracted chain is
+   * checked against RobotModel::getFK before it is used.
+   */
+  static std::unique_ptr<BatchForwardKinematics> create(const robot_model::RobotModel& model)
+  {
+    size_t num_dof = model.getDoFCount();
+    size_t num_frames = model.getFrameCount(HebiFrameTypeOutput);
+    if (num_dof == 0)
+      return nullptr;
+    const double test_angle = 1.0;
+    const double tolerance = 1e-9;
+
+    Eigen::VectorXd zero = Eigen::VectorXd::Zero(num_dof);
+    robot_model::Matrix4dVector zero_frames;
+    model.getFK(HebiFrameTypeOutput, zero, zero_frames);
+    Eigen::Matrix4d zero_end_effector;
+    model.getEndEffector(zero, zero_end_effector);
+
+    // Each joint's output frame is the first frame that moves when only that
+    // joint does; in a serial chain, every later frame moves too.
+    std::unique_ptr<BatchForwardKinematics> fk(new BatchForwardKinematics());
+    std::vector<size_t> joint_frames(num_dof);
+    robot_model::Matrix4dVector moved_frames;
+    for (size_t j = 0; j < num_dof; ++j)
+    {
+      Eigen::VectorXd positions = zero;
+      positions[j] = test_angle;
+      model.getFK(HebiFrameTypeOutput, positions, moved_frames);
+      size_t first = num_frames;
+      for (size_t f = 0; f < num_frames; ++f)
+      {
+        bool moved = !moved_frames[f].isApprox(zero_frames[f], tolerance);
+        if (moved && first == num_frames)
+          first = f;
+        if (!moved && first != num_frames)
+          return nullptr;
+      }
+      if (first == num_frames || (j > 0 && first <= joint_frames[j - 1]))
+        return nullptr;
+      // ...and it rotates about its own z axis.
+      Eigen::Matrix4d rotation = zero_frames[first].inverse() * moved_frames[first];
+      if (!rotation.isApprox(rotationZ(test_angle), tolerance))
+        return nullptr;
+      joint_frames[j] = first;
+    }
+
+    // The joint chain, and each frame relative to the joint before it
+    Eigen::Matrix4d previous = Eigen::Matrix4d::Identity();
+    for (size_t j = 0; j < num_dof; ++j)
+    {
+      fk->joint_offsets_.push_back(toPose(previous.inverse() * zero_frames[joint_frames[j]]));
+      previous = zero_frames[joint_frames[j]];
+    }
+    for (size_t f = 0; f < num_frames; ++f)
+    {
+      int joint = -1;
+      while (joint + 1 < static_cast<int>(num_dof) && joint_frames[joint + 1] <= f)
+        ++joint;
+      Eigen::Matrix4d joint_frame = joint < 0 ? Eigen::Matrix4d::Identity() : zero_frames[joint_frames[joint]];
+      fk->frames_.push_back(FrameOffset{joint, toPose(joint_frame.inverse() * zero_frames[f])});
+    }
+    fk->end_effector_ = FrameOffset{static_cast<int>(num_dof) - 1,
+      toPose(zero_frames[joint_frames[num_dof - 1]].inverse() * zero_end_effector)};
+
+    // Check the whole chain against the model at a few configurations.
+    Eigen::MatrixXd positions = Eigen::MatrixXd::Random(num_dof, 8) * M_PI;
+    std::vector<Eigen::MatrixXd> batch_frames;
+    Eigen::MatrixXd batch_end_effector;
+    fk->getFK(positions, batch_frames, 1);
+    fk->getEndEffector(positions, batch_end_effector, 1);
+    Eigen::Matrix4d end_effector;
+    for (int k = 0; k < positions.cols(); ++k)
+    {
+      model.getFK(HebiFrameTypeOutput, positions.col(k), moved_frames);
+      for (size_t f = 0; f < num_frames; ++f)
+        if (!getPose(batch_frames[f], k).isApprox(moved_frames[f], tolerance))
+          return nullptr;
+      model.getEndEffector(positions.col(k), end_effector);
+      if (!getPose(batch_end_effector, k).isApprox(end_effector, tolerance))
+        return nullptr;
+    }
+    return fk;
+  }
+
+  size_t getDoFCount() const { return joint_offsets_.size(); }
+  // The number of output frames, as for RobotModel::getFrameCount(HebiFrameTypeOutput).
+  size_t getFrameCount() const { return frames_.size(); }
+
+  /**
+   * Computes the end effector pose for each column of 'positions' (DoF x K)
+   * into the columns of 'poses' (12 x K).
+   *
+   * @param num_threads The most threads to use; 0 uses one per core, but only
+   * for batches large enough to make that worthwhile.
+   */
+  void getEndEffector(const Eigen::MatrixXd& positions, Eigen::MatrixXd& poses, size_t num_threads = 0) const
+  {
+    poses.resize(pose_size_, positions.cols());
+    compute(positions, nullptr, &poses, num_threads);
+  }
+
+  /**
+   * As above, but computes every output frame: 'frames[f]' holds the poses of
+   * frame f (12 x K), in RobotModel::getFK order.
+   */
+  void getFK(const Eigen::MatrixXd& positions, std::vector<Eigen::MatrixXd>& frames, size_t num_threads = 0) const
+  {
+    frames.resize(frames_.size());
+    for (auto& frame : frames)
+      frame.resize(pose_size_, positions.cols());
+    compute(positions, &frames, nullptr, num_threads);
+  }
+
+  /**
+   * Returns the k'th pose from a 12 x K result as a homogeneous transform.
+   */
+  static Eigen::Matrix4d getPose(const Eigen::MatrixXd& poses, Eigen::Index k)
+  {
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    for (int c = 0; c < 3; ++c)
+      for (int r = 0; r < 3; ++r)
+        pose(r, c) = poses(c * 3 + r, k);
+    for (int r = 0; r < 3; ++r)
+      pose(r, 3) = poses(9 + r, k);
+    return pose;
+  }
+
+private:
+  // Configurations per block; a multiple of the widest lane count.
+  static constexpr size_t block_size_ = 64;
+  static constexpr int pose_size_ = 12;
+  // Batches smaller than this many configurations per thread aren't split.
+  static constexpr Eigen::Index min_per_thread_ = 2048;
+
+  // A rigid transform, stored like a column of a result.
+  using Pose = std::array<double, pose_size_>;
+
+  // A frame fixed relative to the output of a joint (-1: to the base).
+  struct FrameOffset
+  {
+    int joint_;
+    Pose offset_;
+  };
+
+#if defined(__AVX2__)
+  struct Lanes
+  {
+    using Type = __m256d;
+    static constexpr size_t size = 4;
+    static Type load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, Type v) { _mm256_storeu_pd(p, v); }
+    static Type broadcast(double x) { return _mm256_set1_pd(x); }
+    static Type mul(Type a, Type b) { return _mm256_mul_pd(a, b); }
+    static Type sub(Type a, Type b) { return _mm256_sub_pd(a, b); }
+#if defined(__FMA__)
+    static Type mulAdd(Type a, Type b, Type c) { return _mm256_fmadd_pd(a, b, c); }
+#else
+    static Type mulAdd(Type a, Type b, Type c) { return _mm256_add_pd(_mm256_mul_pd(a, b), c); }
+#endif
+
+    // Cephes' sin/cos polynomials on [-pi/4, pi/4], after reducing x by the
+    // nearest multiple of pi/2 (in three parts, so this stays accurate for
+    // any reasonable joint angle).
+    static void sinCos(Type x, Type& sin_x, Type& cos_x)
+    {
+      Type n = _mm256_round_pd(mul(x, broadcast(2.0 / M_PI)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+      Type r = mulAdd(n, broadcast(-1.57079625129699707031), x);
+      r = mulAdd(n, broadcast(-7.54978941586159635336e-8), r);
+      r = mulAdd(n, broadcast(-5.39030285815811905290e-15), r);
+      Type z = mul(r, r);
+
+      Type p = broadcast(1.58962301576546568060e-10);
+      p = mulAdd(p, z, broadcast(-2.50507477628578072866e-8));
+      p = mulAdd(p, z, broadcast(2.75573136213857245213e-6));
+      p = mulAdd(p, z, broadcast(-1.98412698295895385996e-4));
+      p = mulAdd(p, z, broadcast(8.33333333332211858878e-3));
+      p = mulAdd(p, z, broadcast(-1.66666666666666307295e-1));
+      Type sin_r = mulAdd(mul(r, z), p, r);
+
+      Type q = broadcast(-1.13585365213876817300e-11);
+      q = mulAdd(q, z, broadcast(2.08757008419747316778e-9));
+      q = mulAdd(q, z, broadcast(-2.75573141792967388112e-7));
+      q = mulAdd(q, z, broadcast(2.48015872888517045348e-5));
+      q = mulAdd(q, z, broadcast(-1.38888888888730564116e-3));
+      q = mulAdd(q, z, broadcast(4.16666666666665929218e-2));
+      Type cos_r = mulAdd(mul(z, z), q, mulAdd(z, broadcast(-0.5), broadcast(1.0)));
+
+      // Quadrant (n mod 4): swap sin and cos in odd quadrants, negate sin in
+      // quadrants 2 and 3, and cos in quadrants 1 and 2.
+      Type quadrant = sub(n, mul(broadcast(4.0), _mm256_floor_pd(mul(n, broadcast(0.25)))));
+      Type odd = _mm256_cmp_pd(sub(quadrant, mul(broadcast(2.0), _mm256_floor_pd(mul(quadrant, broadcast(0.5))))),
+        broadcast(1.0), _CMP_EQ_OQ);
+      Type sign = broadcast(-0.0);
+      Type negate_sin = _mm256_and_pd(_mm256_cmp_pd(quadrant, broadcast(2.0), _CMP_GE_OQ), sign);
+      Type negate_cos = _mm256_and_pd(_mm256_cmp_pd(
+        _mm256_andnot_pd(sign, sub(quadrant, broadcast(1.5))), broadcast(1.0), _CMP_LT_OQ), sign);
+      sin_x = _mm256_xor_pd(_mm256_blendv_pd(sin_r, cos_r, odd), negate_sin);
+      cos_x = _mm256_xor_pd(_mm256_blendv_pd(cos_r, sin_r, odd), negate_cos);
+    }
+  };
+#else
+  struct Lanes
+  {
+    using Type = double;
+    static constexpr size_t size = 1;
+    static Type load(const double* p) { return *p; }
+    static void store(double* p, Type v) { *p = v; }
+    static Type broadcast(double x) { return x; }
+    static Type mul(Type a, Type b) { return a * b; }
+    static Type sub(Type a, Type b) { return a - b; }
+    static Type mulAdd(Type a, Type b, Type c) { return a * b + c; }
+    static void sinCos(Type x, Type& sin_x, Type& cos_x) { sin_x = std::sin(x); cos_x = std::cos(x); }
+  };
+#endif
+
+  // A block of poses, one array per element, each 'block_size_' long.
+  using PoseBlock = std::array<double, pose_size_ * block_size_>;
+
+  BatchForwardKinematics() = default;
+
+  static Eigen::Matrix4d rotationZ(double angle)
+  {
+    Eigen::Matrix4d res = Eigen::Matrix4d::Identity();
+    res.topLeftCorner<3, 3>() = Eigen::AngleAxisd(angle, Eigen::Vector3d::UnitZ()).toRotationMatrix();
+    return res;
+  }
+
+  static Pose toPose(const Eigen::Matrix4d& transform)
+  {
+    Pose pose;
+    for (int c = 0; c < 3; ++c)
+      for (int r = 0; r < 3; ++r)
+        pose[c * 3 + r] = transform(r, c);
+    for (int r = 0; r < 3; ++r)
+      pose[9 + r] = transform(r, 3);
+    return pose;
+  }
+
+  // dst = src * offset, for the first 'count' configurations of the block.
+  static void composeOffset(const PoseBlock& src, const Pose& offset, PoseBlock& dst, size_t count)
+  {
+    Lanes::Type offsets[pose_size_];
+    for (int i = 0; i < pose_size_; ++i)
+      offsets[i] = Lanes::broadcast(offset[i]);
+    for (size_t b = 0; b < count; b += Lanes::size)
+    {
+      Lanes::Type rot[9];
+      for (int i = 0; i < 9; ++i)
+        rot[i] = Lanes::load(&src[i * block_size_ + b]);
+      // Rotation columns, then translation
+      for (int c = 0; c < 4; ++c)
+      {
+        for (int r = 0; r < 3; ++r)
+        {
+          Lanes::Type sum = c < 3 ? Lanes::broadcast(0.0) : Lanes::load(&src[(9 + r) * block_size_ + b]);
+          for (int k = 0; k < 3; ++k)
+            sum = Lanes::mulAdd(rot[k * 3 + r], offsets[c * 3 + k], sum);
+          Lanes::store(&dst[(c * 3 + r) * block_size_ + b], sum);
+        }
+      }
+    }
+  }
+
+  // pose = pose * Rz(q), given cos(q) and sin(q) for each configuration.
+  static void rotateZ(PoseBlock& pose, const double* cos_q, const double* sin_q, size_t count)
+  {
+    for (size_t b = 0; b < count; b += Lanes::size)
+    {
+      Lanes::Type c = Lanes::load(cos_q + b);
+      Lanes::Type s = Lanes::load(sin_q + b);
+      for (int r = 0; r < 3; ++r)
+      {
+        Lanes::Type x = Lanes::load(&pose[r * block_size_ + b]);
+        Lanes::Type y = Lanes::load(&pose[(3 + r) * block_size_ + b]);
+        Lanes::store(&pose[r * block_size_ + b], Lanes::mulAdd(x, c, Lanes::mul(y, s)));
+        Lanes::store(&pose[(3 + r) * block_size_ + b], Lanes::sub(Lanes::mul(y, c), Lanes::mul(x, s)));
+      }
+    }
+  }
+
+  static void storeBlock(const PoseBlock& pose, Eigen::MatrixXd& out, Eigen::Index start, size_t count)
+  {
+    for (size_t b = 0; b < count; ++b)
+      for (int e = 0; e < pose_size_; ++e)
+        out(e, start + b) = pose[e * block_size_ + b];
+  }
+
+  // Computes configurations [start, end) one block at a time.
+  void computeRange(const Eigen::MatrixXd& positions, std::vector<Eigen::MatrixXd>* frames,
+    Eigen::MatrixXd* end_effector, Eigen::Index start, Eigen::Index end) const
+  {
+    size_t num_dof = joint_offsets_.size();
+    std::vector<double> angles(num_dof * block_size_), cos_q(angles), sin_q(angles);
+    // joints[j + 1] is the output frame of joint j; joints[0] is the base.
+    std::vector<PoseBlock> joints(num_dof + 1);
+    PoseBlock identity{};
+    for (int i = 0; i < 3; ++i)
+      std::fill_n(identity.begin() + (i * 4) * block_size_, block_size_, 1.0);
+    joints[0] = identity;
+    PoseBlock frame;
+
+    for (Eigen::Index block_start = start; block_start < end; block_start += block_size_)
+    {
+      size_t count = static_cast<size_t>(std::min<Eigen::Index>(static_cast<Eigen::Index>(block_size_), end - block_start));
+      // Transposed into one array per joint; the rest of the last block is
+      // left over from before, and its results are ignored.
+      for (size_t b = 0; b < count; ++b)
+        for (size_t j = 0; j < num_dof; ++j)
+          angles[j * block_size_ + b] = positions(j, block_start + b);
+      size_t padded = (count + Lanes::size - 1) / Lanes::size * Lanes::size;
+
+      for (size_t j = 0; j < num_dof; ++j)
+      {
+        for (size_t b = j * block_size_; b < j * block_size_ + padded; b += Lanes::size)
+        {
+          Lanes::Type sin_q_b, cos_q_b;
+          Lanes::sinCos(Lanes::load(&angles[b]), sin_q_b, cos_q_b);
+          Lanes::store(&sin_q[b], sin_q_b);
+          Lanes::store(&cos_q[b], cos_q_b);
+        }
+        composeOffset(joints[j], joint_offsets_[j], joints[j + 1], padded);
+        rotateZ(joints[j + 1], &cos_q[j * block_size_], &sin_q[j * block_size_], padded);
+      }
+
+      if (frames)
+      {
+        for (size_t f = 0; f < frames_.size(); ++f)
+        {
+          composeOffset(joints[frames_[f].joint_ + 1], frames_[f].offset_, frame, padded);
+          storeBlock(frame, (*frames)[f], block_start, count);
+        }
+      }
+      if (end_effector)
+      {
+        composeOffset(joints[end_effector_.joint_ + 1], end_effector_.offset_, frame, padded);
+        storeBlock(frame, *end_effector, block_start, count);
+      }
+    }
+  }
+
+  void compute(const Eigen::MatrixXd& positions, std::vector<Eigen::MatrixXd>* frames,
+    Eigen::MatrixXd* end_effector, size_t num_threads) const
+  {
+    assert(static_cast<size_t>(positions.rows()) == joint_offsets_.size());
+    Eigen::Index num_configs = positions.cols();
+    Eigen::Index num_blocks = (num_configs + block_size_ - 1) / block_size_;
+    Eigen::Index threads = static_cast<Eigen::Index>(num_threads);
+    if (threads == 0)
+      threads = std::min<Eigen::Index>(std::thread::hardware_concurrency(), num_configs / min_per_thread_);
+    threads = std::max<Eigen::Index>(1, std::min(threads, num_blocks));
+
+    // Whole blocks per thread; this thread computes the first share.
+    auto shareEnd = [=] (Eigen::Index t)
+      { return std::min(num_configs, num_blocks * (t + 1) / threads * static_cast<Eigen::Index>(block_size_)); };
+    std::vector<std::thread> workers;
+    for (Eigen::Index t = 1; t < threads; ++t)
+      workers.emplace_back(&BatchForwardKinematics::computeRange, this,
+        std::cref(positions), frames, end_effector, shareEnd(t - 1), shareEnd(t));
+    computeRange(positions, frames, end_effector, 0, shareEnd(0));
+    for (auto& worker : workers)
+      worker.join();
+  }
+
+  std::vector<Pose> joint_offsets_;
+  std::vector<FrameOffset> frames_;
+  FrameOffset end_effector_;
+};
+
+} // namespace util
+} // namespace hebi
@@ -0,0 +1,219 @@
+#pragma once
+
+#include "command_transmitter.hpp"
+#include "group.hpp"
+#include "group_command.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hebi {
+namespace util {
+
+/**
+ * Holds the last command for each registered group, so that the modules keep
+ * it (e.g. hold a pose) without the application resending it in a loop.
+ *
+ * Modules stop acting on a command once its lifetime (set with
+ * Group::setCommandLifetimeMs) has passed.  A single background thread resends
+ * each group's command three times per lifetime, so that one lost packet plus
+ * some scheduling delay doesn't let the command expire, no matter how many
+ * groups are held.  Lifetimes of 1 ms or less are too short to keep alive this
+ * way (and 0 means the command doesn't expire), so those commands are only
+ * sent once.
+ *
+ * `setCommand` replaces a group's command as a whole; the new command is sent
+ * right away, and resent from then on.  `release` stops resending, and the
+ * modules stop acting on the last command once its lifetime expires.
+ */
+class CommandKeepAlive
+{
+public:
+  struct Statistics
+  {
+    // Calls to setCommand
+    uint64_t commands_;
+    // Packets sent, including the first send of each command
+    uint64_t sent_;
+    // The most that any resend was late by [us]
+    double max_late_us_;
+  };
+
+  CommandKeepAlive()
+  {
+    keep_alive_thread_ = std::thread(&CommandKeepAlive::run, this);
+  }
+
+  ~CommandKeepAlive()
+  {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      quit_ = true;
+    }
+    wake_cv_.notify_all();
+    keep_alive_thread_.join();
+  }
+
+  CommandKeepAlive(const CommandKeepAlive&) = delete;
+  CommandKeepAlive& operator=(const CommandKeepAlive&) = delete;
+
+  /**
+   * Registers a group, sets its command lifetime, and returns the id used to
+   * set its command.  Nothing is sent until `setCommand` is called.
+   */
+  int addGroup(std::shared_ptr<Group> group, int32_t command_lifetime_ms = 100)
+  {
+    group->setCommandLifetimeMs(command_lifetime_ms);
+    // A zero period means "send once".
+    clock::duration period = clock::duration::zero();
+    if (command_lifetime_ms > 1)
+      period = std::chrono::microseconds(std::chrono::milliseconds(command_lifetime_ms)) / 3;
+    std::unique_ptr<Entry> entry(new Entry(group, period));
+    std::lock_guard<std::mutex> lock(lock_);
+    entries_.push_back(std::move(entry));
+    return static_cast<int>(entries_.size()) - 1;
+  }
+
+  /**
+   * Replaces the command held for a group (a frame sized for the group; NaN
+   * fields are not sent).  Doesn't wait for it to be sent.
+   */
+  void setCommand(int group_id, const CommandFrame& frame)
+  {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      Entry& entry = *entries_[group_id];
+      entry.frame_.positions_ = frame.positions_;
+      entry.frame_.velocities_ = frame.velocities_;
+      entry.frame_.efforts_ = frame.efforts_;
+      entry.hold_ = true;
+      entry.changed_ = true;
+      changed_ = true;
+      ++commands_;
+    }
+    wake_cv_.notify_one();
+  }
+
+  /**
+   * Stops resending the command for a group.
+   */
+  void release(int group_id)
+  {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      Entry& entry = *entries_[group_id];
+      entry.hold_ = false;
+      entry.changed_ = true;
+      changed_ = true;
+    }
+    wake_cv_.notify_one();
+  }
+
+  Statistics getStatistics() const
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    return Statistics{ commands_, sent_, std::chrono::duration<double, std::micro>(max_late_).count() };
+  }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  struct Entry
+  {
+    Entry(std::shared_ptr<Group> group, clock::duration period)
+      : group_(group), period_(period), frame_(group->size()), cmd_(group->size())
+    {}
+
+    std::shared_ptr<Group> group_;
+    const clock::duration period_;
+
+    // Protected by the keep alive's 'lock_'.
+    CommandFrame frame_;
+    bool hold_{false};
+    bool changed_{false};
+
+    // Only touched by the keep alive thread.
+    GroupCommand cmd_;
+    bool active_{false};
+    // True until the first send of a new command
+    bool fresh_{false};
+    clock::time_point next_send_;
+  };
+
+  void run()
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    while (!quit_)
+    {
+      changed_ = false;
+      bool any_active = false;
+      clock::time_point next_send = clock::time_point::max();
+      // Entries are only ever added, and are not moved when they are, so
+      // they can be sent to with the lock released.
+      for (size_t i = 0; i < entries_.size(); ++i)
+      {
+        Entry& entry = *entries_[i];
+        clock::time_point now = clock::now();
+        if (entry.changed_)
+        {
+          entry.changed_ = false;
+          entry.active_ = entry.hold_;
+          if (entry.active_)
+            entry.frame_.applyTo(entry.cmd_);
+          entry.fresh_ = true;
+          entry.next_send_ = now;
+        }
+        if (!entry.active_)
+          continue;
+        if (entry.next_send_ <= now)
+        {
+          if (!entry.fresh_)
+            max_late_ = std::max(max_late_, now - entry.next_send_);
+          entry.fresh_ = false;
+          lock.unlock();
+          entry.group_->sendCommand(entry.cmd_);
+          lock.lock();
+          ++sent_;
+          if (entry.period_ == clock::duration::zero())
+          {
+            entry.active_ = false;
+            continue;
+          }
+          // If this fell behind, don't try to catch up with a burst of sends.
+          entry.next_send_ += entry.period_;
+          if (entry.next_send_ <= now)
+            entry.next_send_ = now + entry.period_;
+        }
+        any_active = true;
+        next_send = std::min(next_send, entry.next_send_);
+      }
+
+      if (any_active)
+        wake_cv_.wait_until(lock, next_send, [this] { return quit_ || changed_; });
+      else
+        wake_cv_.wait(lock, [this] { return quit_ || changed_; });
+    }
+  }
+
+  mutable std::mutex lock_;
+  std::condition_variable wake_cv_;
+  std::vector<std::unique_ptr<Entry>> entries_;
+  // Set whenever an entry changes, so the thread knows to look again.
+  bool changed_{false};
+  bool quit_{false};
+
+  uint64_t commands_{0};
+  uint64_t sent_{0};
+  clock::duration max_late_{0};
+
+  std::thread keep_alive_thread_;
+};
+
+} // namespace util
+} // namespace hebi
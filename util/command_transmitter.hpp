@@ -0,0 +1,390 @@
+#pragma once
+
+#include "group.hpp"
+#include "group_command.hpp"
+#include "atomic_snapshot.hpp"
+#include "gain_profiles.hpp"
+#include "pi_mutex.hpp"
+#include "triple_buffer.hpp"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace hebi {
+namespace util {
+
+/**
+ * The actuator command for every module in a group, as plain vectors that can
+ * be handed between threads (unlike a GroupCommand).  A NaN entry means the
+ * field is not set for that module.
+ */
+struct CommandFrame
+{
+  CommandFrame() = default;
+  explicit CommandFrame(size_t num_modules)
+    : positions_(Eigen::VectorXd::Constant(num_modules, std::numeric_limits<double>::quiet_NaN())),
+      velocities_(positions_),
+      efforts_(positions_)
+  {}
+
+  size_t size() const { return static_cast<size_t>(positions_.size()); }
+
+  // Marks every field of every module as not set.
+  void clear()
+  {
+    positions_.setConstant(std::numeric_limits<double>::quiet_NaN());
+    velocities_.setConstant(std::numeric_limits<double>::quiet_NaN());
+    efforts_.setConstant(std::numeric_limits<double>::quiet_NaN());
+  }
+
+  // Sets (or clears) the actuator fields of the given command from this frame.
+  void applyTo(GroupCommand& cmd) const
+  {
+    for (size_t i = 0; i < size(); ++i)
+    {
+      auto& actuator = cmd[i].actuator();
+      applyField(actuator.position(), positions_[i]);
+      applyField(actuator.velocity(), velocities_[i]);
+      applyField(actuator.effort(), efforts_[i]);
+    }
+  }
+
+  Eigen::VectorXd positions_;
+  Eigen::VectorXd velocities_;
+  Eigen::VectorXd efforts_;
+
+private:
+  template <typename Field>
+  static void applyField(Field& field, double value)
+  {
+    if (std::isnan(value))
+      field.clear();
+    else
+      field.set(value);
+  }
+};
+
+/**
+ * An LED color for each module in a group, for CommandTransmitter::requestLeds.
+ * Modules whose color is not set keep whatever their LED is showing.
+ */
+struct LedFrame
+{
+  LedFrame() = default;
+  explicit LedFrame(size_t num_modules)
+    : colors_(num_modules, Color(0, 0, 0, 0)), set_(num_modules, false)
+  {}
+
+  size_t size() const { return colors_.size(); }
+
+  // Sets the color of one module; an alpha of 0 gives the module control of
+  // its LED again.
+  void set(size_t module, const Color& color)
+  {
+    colors_[module] = color;
+    set_[module] = true;
+  }
+
+  std::vector<Color> colors_;
+  std::vector<bool> set_;
+};
+
+/**
+ * Moves command serialization and sending off of a real time control thread.
+ *
+ * The control thread fills in a CommandFrame and calls `submit`, which copies
+ * it into a lock-free slot and wakes a dedicated transmitter thread (pinned to
+ * one CPU, if requested); that thread converts the newest frame into a
+ * GroupCommand and sends it.  `submit` never waits for a send: if a frame is
+ * submitted before the previous one was sent, the older one is dropped (and
+ * counted), as only the newest command matters.  The transmitter thread sleeps
+ * until a frame is submitted.
+ *
+ * The time from `submit` until the transmitter starts sending each frame is
+ * measured, as is the time the send itself takes.
+ *
+ * If the transmitter is given a set of gain profiles, `requestGains` switches
+ * between them without an extra packet: the profile is merged into the next
+ * frame that is sent, and `getGainsSent` reports when that has happened.
+ * `requestLeds` sends LED colors the same way, so that every packet to the
+ * group goes out from the transmitter thread, in order.
+ */
+class CommandTransmitter
+{
+public:
+  struct Statistics
+  {
+    // Frames handed off by the control thread
+    uint64_t submitted_;
+    // Frames sent to the group
+    uint64_t sent_;
+    // Frames replaced by a newer one before they could be sent
+    uint64_t superseded_;
+    // Frames that also carried a gain profile
+    uint64_t gain_switches_;
+    // Time from submit until the send started [us]
+    double mean_handoff_us_;
+    double max_handoff_us_;
+    // Time spent in Group::sendCommand [us]
+    double mean_send_us_;
+    double max_send_us_;
+  };
+
+  /**
+   * Starts the transmitter thread.
+   * @param cpu The CPU to pin the transmitter thread to, or -1 to not pin it
+   * (pinning is only supported on Linux).
+   * @param gain_profiles The profiles that `requestGains` can select from, if
+   * any.
+   */
+  CommandTransmitter(std::shared_ptr<Group> group, int cpu = -1,
+    std::shared_ptr<const GainProfiles> gain_profiles = nullptr)
+    : group_(group), gain_profiles_(gain_profiles), cmd_(group->size()),
+      buffer_(Slot{CommandFrame(group->size()), {}, 0}),
+      leds_(LedFrame(group->size()))
+  {
+    transmitter_ = std::thread(&CommandTransmitter::run, this);
+#ifdef __linux__
+    if (cpu >= 0)
+    {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(cpu, &cpus);
+      pinned_ = pthread_setaffinity_np(transmitter_.native_handle(), sizeof(cpus), &cpus) == 0;
+    }
+#else
+    (void)cpu;
+#endif
+  }
+
+  ~CommandTransmitter()
+  {
+    {
+      std::lock_guard<PiMutex> lock(wake_lock_);
+      quit_ = true;
+    }
+    wake_cv_.notify_one();
+    transmitter_.join();
+  }
+
+  CommandTransmitter(const CommandTransmitter&) = delete;
+  CommandTransmitter& operator=(const CommandTransmitter&) = delete;
+
+  /**
+   * The last CPU on this machine, which is less likely to be busy with other
+   * work; -1 if unknown.
+   */
+  static int lastCpu()
+  {
+    return static_cast<int>(std::thread::hardware_concurrency()) - 1;
+  }
+
+  /**
+   * Hands off a frame (sized for the group) to be sent.  Call from one thread
+   * at a time; does not allocate, and only waits (briefly) if the transmitter
+   * is checking for new frames at that moment.
+   */
+  void submit(const CommandFrame& frame)
+  {
+    Slot& slot = buffer_.getWriteBuffer();
+    slot.frame_.positions_ = frame.positions_;
+    slot.frame_.velocities_ = frame.velocities_;
+    slot.frame_.efforts_ = frame.efforts_;
+    slot.submit_time_ = clock::now();
+    slot.sequence_ = ++submit_sequence_;
+    buffer_.publish();
+    submitted_.store(submit_sequence_, std::memory_order_release);
+    // The transmitter only holds the lock while checking for new frames, so
+    // this never waits for a send; taking it (briefly) guarantees the
+    // transmitter can't miss the notification between its check and its wait.
+    // It is a PiMutex, so a real time caller isn't held up by a preempted
+    // transmitter.
+    {
+      std::lock_guard<PiMutex> lock(wake_lock_);
+    }
+    wake_cv_.notify_one();
+  }
+
+  /**
+   * Merges a gain profile into the next frame that is sent after this call,
+   * and returns a number that `getGainsSent` will reach once it has been sent.
+   * If another profile is requested before then, only the newer one is sent.
+   * Call from the same thread as `submit`; does not block or allocate.
+   */
+  uint32_t requestGains(int profile)
+  {
+    ++gain_request_sequence_;
+    gain_request_.store(GainRequest{static_cast<int32_t>(profile), gain_request_sequence_});
+    return gain_request_sequence_;
+  }
+
+  /**
+   * Merges LED colors (a frame sized for the group) into the next frame that
+   * is sent after this call; if other colors are requested before then, only
+   * the newer ones are sent.  Call from the same thread as `submit`; does not
+   * block or allocate.
+   */
+  void requestLeds(const LedFrame& leds)
+  {
+    LedFrame& slot = leds_.getWriteBuffer();
+    std::copy(leds.colors_.begin(), leds.colors_.end(), slot.colors_.begin());
+    std::copy(leds.set_.begin(), leds.set_.end(), slot.set_.begin());
+    leds_.publish();
+  }
+
+  /**
+   * The number returned by the last `requestGains` call whose profile has been
+   * sent (0 if none).  The modules only acknowledge the profile through their
+   * reported info, e.g. via util::InfoCache.
+   */
+  uint32_t getGainsSent() const { return gains_sent_.load(std::memory_order_acquire); }
+
+  // True if the transmitter thread was pinned to the requested CPU.
+  bool isPinned() const { return pinned_; }
+
+  Statistics getStatistics() const
+  {
+    uint64_t sent = sent_.load(std::memory_order_relaxed);
+    double count = sent > 0 ? static_cast<double>(sent) : 1.0;
+    return Statistics{ submitted_.load(std::memory_order_relaxed), sent,
+                       superseded_.load(std::memory_order_relaxed),
+                       gain_switches_.load(std::memory_order_relaxed),
+                       total_handoff_ns_.load(std::memory_order_relaxed) * 1e-3 / count,
+                       max_handoff_ns_.load(std::memory_order_relaxed) * 1e-3,
+                       total_send_ns_.load(std::memory_order_relaxed) * 1e-3 / count,
+                       max_send_ns_.load(std::memory_order_relaxed) * 1e-3 };
+  }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  struct Slot
+  {
+    CommandFrame frame_;
+    clock::time_point submit_time_;
+    uint64_t sequence_;
+  };
+
+  struct GainRequest
+  {
+    int32_t profile_;
+    uint32_t sequence_;
+  };
+
+  void run()
+  {
+    uint64_t last_sequence = 0;
+    while (true)
+    {
+      {
+        std::unique_lock<PiMutex> lock(wake_lock_);
+        wake_cv_.wait(lock, [this, last_sequence]
+          { return quit_ || submitted_.load(std::memory_order_acquire) != last_sequence; });
+        if (quit_)
+          return;
+      }
+      if (!buffer_.update())
+        continue;
+      const Slot& slot = buffer_.getReadBuffer();
+      auto start = clock::now();
+      slot.frame_.applyTo(cmd_);
+      GainRequest gains = gain_request_.load();
+      bool send_gains = gain_profiles_ && gains.sequence_ != gains_sent_.load(std::memory_order_relaxed);
+      if (send_gains)
+        GainProfiles::mergeGains(gain_profiles_->getGains(gains.profile_), cmd_);
+      bool send_leds = leds_.update();
+      if (send_leds)
+        applyLeds(leds_.getReadBuffer(), true);
+      group_->sendCommand(cmd_);
+      auto end = clock::now();
+      if (send_gains)
+      {
+        // Only send the profile once.
+        GainProfiles::clearGains(cmd_);
+        gains_sent_.store(gains.sequence_, std::memory_order_release);
+        gain_switches_.fetch_add(1, std::memory_order_relaxed);
+      }
+      // Only send the colors once, too.
+      if (send_leds)
+        applyLeds(leds_.getReadBuffer(), false);
+
+      if (slot.sequence_ > last_sequence + 1)
+        superseded_.fetch_add(slot.sequence_ - last_sequence - 1, std::memory_order_relaxed);
+      last_sequence = slot.sequence_;
+      record(total_handoff_ns_, max_handoff_ns_, start - slot.submit_time_);
+      record(total_send_ns_, max_send_ns_, end - start);
+      sent_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Sets (or clears) the LED field of each module that 'leds' sets.
+  void applyLeds(const LedFrame& leds, bool set)
+  {
+    for (size_t i = 0; i < leds.size(); ++i)
+    {
+      if (!leds.set_[i])
+        continue;
+      if (set)
+        cmd_[i].led().set(leds.colors_[i]);
+      else
+        cmd_[i].led().clear();
+    }
+  }
+
+  // Only called from the transmitter thread, so there is a single writer.
+  static void record(std::atomic<uint64_t>& total, std::atomic<uint64_t>& max, clock::duration duration)
+  {
+    uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    total.store(total.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    if (ns > max.load(std::memory_order_relaxed))
+      max.store(ns, std::memory_order_relaxed);
+  }
+
+  std::shared_ptr<Group> group_;
+  std::shared_ptr<const GainProfiles> gain_profiles_;
+  // Only touched by the transmitter thread
+  GroupCommand cmd_;
+  TripleBuffer<Slot> buffer_;
+  TripleBuffer<LedFrame> leds_;
+
+  // Only touched by the submitting thread
+  uint64_t submit_sequence_{0};
+  uint32_t gain_request_sequence_{0};
+
+  AtomicSnapshot<GainRequest> gain_request_{GainRequest{-1, 0}};
+  std::atomic<uint32_t> gains_sent_{0};
+
+  std::atomic<uint64_t> submitted_{0};
+  std::atomic<uint64_t> sent_{0};
+  std::atomic<uint64_t> superseded_{0};
+  std::atomic<uint64_t> gain_switches_{0};
+  std::atomic<uint64_t> total_handoff_ns_{0};
+  std::atomic<uint64_t> max_handoff_ns_{0};
+  std::atomic<uint64_t> total_send_ns_{0};
+  std::atomic<uint64_t> max_send_ns_{0};
+
+  PiMutex wake_lock_;
+  std::condition_variable_any wake_cv_;
+  bool quit_{false};
+  bool pinned_{false};
+  std::thread transmitter_;
+};
+
+} // namespace util
+} // namespace hebi
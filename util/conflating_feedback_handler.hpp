@@ -0,0 +1,188 @@
+#pragma once
+
+#include "group.hpp"
+#include "group_feedback.hpp"
+#include "triple_buffer.hpp"
+
+#include <Eigen/Core>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace hebi {
+namespace util {
+
+/**
+ * A "latest wins" alternative to processing feedback directly in a group's
+ * feedback handler.
+ *
+ * A normal feedback handler processes every packet in order, so if it takes
+ * longer than the feedback period, packets queue up and the data it acts on
+ * gets older and older.  With this class, the handler on the library's thread
+ * only extracts what is needed from the packet into a lock-free slot (which
+ * should be quick, and must not allocate for the slot to stay preallocated);
+ * a worker thread then processes the newest available snapshot.  If packets
+ * arrive faster than they can be processed, the older ones are skipped (and
+ * counted), so processing always acts on the freshest data.
+ *
+ * The snapshot type is chosen by the user and should hold only the data the
+ * processing step needs (e.g., positions, or positions and IMU data).  The
+ * slots are copies of `initial`, so size any dynamic members there.  They are
+ * held by value, so fixed-size Eigen members are fine as long as the handler
+ * is created with `new` (which is aligned for them) or on the stack.
+ *
+ * Usage:
+ *   ConflatingFeedbackHandler<Eigen::VectorXd> handler(
+ *     [](const GroupFeedback& fbk, Eigen::VectorXd& positions) { fbk.getPosition(positions); },
+ *     [&](const Eigen::VectorXd& positions) { ... },
+ *     Eigen::VectorXd::Zero(group->size()));
+ *   handler.attach(*group);
+ *   ...
+ *   group->clearFeedbackHandlers(); // before the handler is destroyed
+ */
+template <typename Snapshot>
+class ConflatingFeedbackHandler
+{
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW // The slots may hold fixed-size Eigen members
+
+  using ExtractFunction = std::function<void(const GroupFeedback&, Snapshot&)>;
+  using ProcessFunction = std::function<void(const Snapshot&)>;
+
+  struct Statistics
+  {
+    // Packets received from the library
+    uint64_t received_;
+    // Snapshots processed by the worker
+    uint64_t processed_;
+    // Packets that were superseded by a newer one before they were processed
+    uint64_t skipped_;
+  };
+
+  /**
+   * Starts the worker thread.
+   * @param extract Called on the library's feedback thread for each packet, to
+   * fill in a snapshot.
+   * @param process Called on the worker thread with the latest snapshot.
+   */
+  ConflatingFeedbackHandler(ExtractFunction extract, ProcessFunction process,
+    const Snapshot& initial = Snapshot())
+    : extract_(extract), process_(process), buffer_(Slot{initial, 0})
+  {
+    worker_ = std::thread(&ConflatingFeedbackHandler::run, this);
+  }
+
+  /**
+   * Stops the worker thread.  Make sure no more feedback will be delivered
+   * (e.g., clear the group's feedback handlers) first.
+   */
+  ~ConflatingFeedbackHandler()
+  {
+    stop();
+  }
+
+  ConflatingFeedbackHandler(const ConflatingFeedbackHandler&) = delete;
+  ConflatingFeedbackHandler& operator=(const ConflatingFeedbackHandler&) = delete;
+
+  /**
+   * Adds this as a feedback handler of the given group.
+   */
+  void attach(Group& group)
+  {
+    group.addFeedbackHandler([this](const GroupFeedback& fbk) { onFeedback(fbk); });
+  }
+
+  /**
+   * The feedback handler itself; only call from one thread at a time (the
+   * library calls each group's handlers from a single thread).
+   */
+  void onFeedback(const GroupFeedback& fbk)
+  {
+    Slot& slot = buffer_.getWriteBuffer();
+    extract_(fbk, slot.snapshot_);
+    slot.sequence_ = ++write_sequence_;
+    buffer_.publish();
+    received_.store(write_sequence_, std::memory_order_release);
+    // The worker only holds the lock while checking for new data, so this
+    // never waits for processing to finish; taking it (briefly) guarantees the
+    // worker can't miss the notification between its check and its wait.
+    {
+      std::lock_guard<std::mutex> lock(wake_lock_);
+    }
+    wake_cv_.notify_one();
+  }
+
+  /**
+   * Stops the worker thread after it finishes the snapshot it is processing.
+   */
+  void stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(wake_lock_);
+      quit_ = true;
+    }
+    wake_cv_.notify_one();
+    if (worker_.joinable())
+      worker_.join();
+  }
+
+  Statistics getStatistics() const
+  {
+    return Statistics{ received_.load(std::memory_order_relaxed),
+                       processed_.load(std::memory_order_relaxed),
+                       skipped_.load(std::memory_order_relaxed) };
+  }
+
+private:
+  struct Slot
+  {
+    Snapshot snapshot_;
+    uint64_t sequence_;
+  };
+
+  void run()
+  {
+    uint64_t last_sequence = 0;
+    while (true)
+    {
+      {
+        std::unique_lock<std::mutex> lock(wake_lock_);
+        wake_cv_.wait(lock, [this, last_sequence]
+          { return quit_ || received_.load(std::memory_order_acquire) != last_sequence; });
+        if (quit_)
+          return;
+      }
+      if (!buffer_.update())
+        continue;
+      const Slot& slot = buffer_.getReadBuffer();
+      if (slot.sequence_ > last_sequence + 1)
+        skipped_.fetch_add(slot.sequence_ - last_sequence - 1, std::memory_order_relaxed);
+      last_sequence = slot.sequence_;
+      process_(slot.snapshot_);
+      processed_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  ExtractFunction extract_;
+  ProcessFunction process_;
+  TripleBuffer<Slot> buffer_;
+
+  // Only touched by the feedback thread
+  uint64_t write_sequence_{0};
+
+  std::atomic<uint64_t> received_{0};
+  std::atomic<uint64_t> processed_{0};
+  std::atomic<uint64_t> skipped_{0};
+
+  std::mutex wake_lock_;
+  std::condition_variable wake_cv_;
+  bool quit_{false};
+  std::thread worker_;
+};
+
+} // namespace util
+} // namespace hebi
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace hebi {
+namespace util {
+
+/**
+ * A fixed-capacity history of the last N samples of a set of feedback signals
+ * (e.g., the position of each joint in a group), with timestamps.
+ *
+ * Storage is preallocated at construction and laid out as structure-of-arrays:
+ * each signal's samples are contiguous and start on their own cache line.
+ * Running sums over a sliding window of the most recent W samples are kept up
+ * to date on every push, so windowed mean and variance queries are O(1), as are
+ * finite differences between any two stored samples.  NaN samples (missing
+ * feedback) are stored, but left out of the window statistics.
+ *
+ * Safe for one writer (typically the feedback handler) and any number of
+ * concurrent readers; readers never block the writer, and retry if the writer
+ * updated the history while they were reading.
+ */
+class FeedbackHistory
+{
+public:
+  struct WindowStats
+  {
+    double mean_;
+    // Sample variance (n - 1 normalization); zero with fewer than two samples.
+    double variance_;
+    // Number of non-NaN samples in the window.
+    size_t count_;
+  };
+
+  /**
+   * @param num_signals Number of values in each sample.
+   * @param capacity Number of samples kept (N).
+   * @param window Number of most recent samples the window statistics are
+   * computed over (W); clamped to [1, capacity].
+   */
+  FeedbackHistory(size_t num_signals, size_t capacity, size_t window)
+    : num_signals_(num_signals),
+      capacity_(std::max<size_t>(capacity, 1)),
+      window_(std::min(std::max<size_t>(window, 1), capacity_)),
+      row_stride_((capacity_ + doubles_per_line_ - 1) / doubles_per_line_ * doubles_per_line_),
+      values_(num_signals_ * row_stride_),
+      times_(row_stride_),
+      sum_(num_signals_),
+      sum_sq_(num_signals_),
+      count_(num_signals_),
+      reference_(num_signals_, std::numeric_limits<double>::quiet_NaN()),
+      writer_sum_(num_signals_, 0.0),
+      writer_sum_sq_(num_signals_, 0.0),
+      writer_count_(num_signals_, 0)
+  {
+  }
+
+  FeedbackHistory(const FeedbackHistory&) = delete;
+  FeedbackHistory& operator=(const FeedbackHistory&) = delete;
+
+  size_t getNumSignals() const { return num_signals_; }
+  size_t getCapacity() const { return capacity_; }
+  size_t getWindow() const { return window_; }
+
+  ////////////////////////////////////////////////////////////////////////////
+  // Writer
+
+  /**
+   * Adds a sample; 'sample' must point to getNumSignals() values.  O(number of
+   * signals), amortized.
+   */
+  void push(double time, const double* sample)
+  {
+    uint64_t count = total_.load(std::memory_order_relaxed);
+    size_t slot = count % capacity_;
+    // The sample that drops out of the window, if the window is full.
+    bool evict = count >= window_;
+    size_t evict_slot = (count + capacity_ - window_) % capacity_;
+
+    for (size_t i = 0; i < num_signals_; ++i)
+    {
+      double value = sample[i];
+      if (std::isnan(reference_[i].load(std::memory_order_relaxed)) && !std::isnan(value))
+        reference_[i].store(value, std::memory_order_relaxed);
+      if (evict)
+        removeFromSums(i, values_[i * row_stride_ + evict_slot].load(std::memory_order_relaxed));
+      addToSums(i, value);
+    }
+    // Periodically recompute the sums from scratch so that rounding errors
+    // from adding and removing samples can't accumulate.
+    bool resync = (++pushes_since_resync_ >= capacity_);
+
+    beginWrite();
+    for (size_t i = 0; i < num_signals_; ++i)
+      values_[i * row_stride_ + slot].store(sample[i], std::memory_order_relaxed);
+    times_[slot].store(time, std::memory_order_relaxed);
+    if (resync)
+    {
+      recomputeSums(count + 1);
+      pushes_since_resync_ = 0;
+    }
+    for (size_t i = 0; i < num_signals_; ++i)
+    {
+      sum_[i].store(writer_sum_[i], std::memory_order_relaxed);
+      sum_sq_[i].store(writer_sum_sq_[i], std::memory_order_relaxed);
+      count_[i].store(writer_count_[i], std::memory_order_relaxed);
+    }
+    total_.store(count + 1, std::memory_order_relaxed);
+    endWrite();
+  }
+
+  template <typename Derived>
+  void push(double time, const Eigen::MatrixBase<Derived>& sample)
+  {
+    // Evaluate into contiguous storage if necessary.
+    const Eigen::Ref<const Eigen::VectorXd> contiguous(sample);
+    push(time, contiguous.data());
+  }
+
+  ////////////////////////////////////////////////////////////////////////////
+  // Readers
+
+  /**
+   * Number of samples currently stored (at most the capacity).
+   */
+  size_t size() const
+  {
+    return static_cast<size_t>(std::min<uint64_t>(total_.load(std::memory_order_relaxed), capacity_));
+  }
+
+  /**
+   * Gets a stored sample of one signal; age 0 is the most recent.  Returns
+   * false if there is no such sample.
+   */
+  bool getSample(size_t signal, size_t age, double& value, double& time) const
+  {
+    uint64_t seq;
+    bool valid;
+    do
+    {
+      seq = beginRead();
+      uint64_t count = total_.load(std::memory_order_relaxed);
+      valid = signal < num_signals_ && age < capacity_ && age < count;
+      if (valid)
+      {
+        size_t slot = (count - 1 - age) % capacity_;
+        value = values_[signal * row_stride_ + slot].load(std::memory_order_relaxed);
+        time = times_[slot].load(std::memory_order_relaxed);
+      }
+    } while (!endRead(seq));
+    return valid;
+  }
+
+  /**
+   * Mean, variance, and number of valid samples for one signal over the most
+   * recent window.  Returns false if the window has no valid samples.
+   */
+  bool getWindowStats(size_t signal, WindowStats& stats) const
+  {
+    if (signal >= num_signals_)
+      return false;
+    uint64_t seq;
+    double sum, sum_sq, reference;
+    do
+    {
+      seq = beginRead();
+      sum = sum_[signal].load(std::memory_order_relaxed);
+      sum_sq = sum_sq_[signal].load(std::memory_order_relaxed);
+      stats.count_ = count_[signal].load(std::memory_order_relaxed);
+      reference = reference_[signal].load(std::memory_order_relaxed);
+    } while (!endRead(seq));
+    if (stats.count_ == 0)
+      return false;
+    // Sums are kept relative to a reference value to limit cancellation error.
+    double n = static_cast<double>(stats.count_);
+    double shifted_mean = sum / n;
+    stats.mean_ = shifted_mean + reference;
+    stats.variance_ = stats.count_ > 1 ? std::max(0.0, (sum_sq - sum * shifted_mean) / (n - 1)) : 0.0;
+    return true;
+  }
+
+  bool getWindowMean(size_t signal, double& mean) const
+  {
+    WindowStats stats;
+    if (!getWindowStats(signal, stats))
+      return false;
+    mean = stats.mean_;
+    return true;
+  }
+
+  bool getWindowVariance(size_t signal, double& variance) const
+  {
+    WindowStats stats;
+    if (!getWindowStats(signal, stats))
+      return false;
+    variance = stats.variance_;
+    return true;
+  }
+
+  /**
+   * Window mean and variance of all signals (NaN where a signal has no valid
+   * samples in the window).  The vectors are resized if necessary.
+   */
+  void getWindowStats(Eigen::VectorXd& mean, Eigen::VectorXd& variance) const
+  {
+    mean.resize(num_signals_);
+    variance.resize(num_signals_);
+    for (size_t i = 0; i < num_signals_; ++i)
+    {
+      WindowStats stats;
+      if (getWindowStats(i, stats))
+      {
+        mean[i] = stats.mean_;
+        variance[i] = stats.variance_;
+      }
+      else
+      {
+        mean[i] = variance[i] = std::numeric_limits<double>::quiet_NaN();
+      }
+    }
+  }
+
+  /**
+   * Backward finite difference between the latest sample and the sample 'lag'
+   * samples before it: (x[0] - x[lag]) / (t[0] - t[lag]).  Returns false if
+   * there are not enough samples, or either sample is NaN.
+   */
+  bool getDerivative(size_t signal, size_t lag, double& derivative) const
+  {
+    if (signal >= num_signals_ || lag == 0 || lag >= capacity_)
+      return false;
+    uint64_t seq;
+    bool valid;
+    double x0 = 0, x1 = 0, t0 = 0, t1 = 0;
+    do
+    {
+      seq = beginRead();
+      uint64_t count = total_.load(std::memory_order_relaxed);
+      valid = lag < count;
+      if (valid)
+      {
+        size_t slot0 = (count - 1) % capacity_;
+        size_t slot1 = (count - 1 - lag) % capacity_;
+        x0 = values_[signal * row_stride_ + slot0].load(std::memory_order_relaxed);
+        x1 = values_[signal * row_stride_ + slot1].load(std::memory_order_relaxed);
+        t0 = times_[slot0].load(std::memory_order_relaxed);
+        t1 = times_[slot1].load(std::memory_order_relaxed);
+      }
+    } while (!endRead(seq));
+    if (!valid || std::isnan(x0) || std::isnan(x1) || t0 <= t1)
+      return false;
+    derivative = (x0 - x1) / (t0 - t1);
+    return true;
+  }
+
+  /**
+   * Average time between samples over the window (e.g., for link
+   * diagnostics).  Returns false with fewer than two samples.
+   */
+  bool getWindowPeriod(double& period) const
+  {
+    uint64_t seq;
+    bool valid;
+    double t0 = 0, t1 = 0;
+    size_t span;
+    do
+    {
+      seq = beginRead();
+      uint64_t count = total_.load(std::memory_order_relaxed);
+      span = static_cast<size_t>(std::min<uint64_t>(count, window_));
+      valid = span >= 2;
+      if (valid)
+      {
+        t0 = times_[(count - 1) % capacity_].load(std::memory_order_relaxed);
+        t1 = times_[(count - span) % capacity_].load(std::memory_order_relaxed);
+      }
+    } while (!endRead(seq));
+    if (!valid)
+      return false;
+    period = (t0 - t1) / (span - 1);
+    return true;
+  }
+
+private:
+  static constexpr size_t doubles_per_line_ = 64 / sizeof(double);
+
+  // Fixed-size array of atomics whose first element starts on a cache line.
+  template <typename T>
+  class AlignedArray
+  {
+  public:
+    explicit AlignedArray(size_t size, double initial = 0)
+      : storage_(new unsigned char[size * sizeof(T) + 64]), size_(size)
+    {
+      void* raw = storage_.get();
+      uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) + 63) & ~static_cast<uintptr_t>(63);
+      data_ = reinterpret_cast<T*>(aligned);
+      for (size_t i = 0; i < size_; ++i)
+        new (&data_[i]) T(initial);
+    }
+    ~AlignedArray()
+    {
+      for (size_t i = 0; i < size_; ++i)
+        data_[i].~T();
+    }
+    T& operator[](size_t i) { return data_[i]; }
+    const T& operator[](size_t i) const { return data_[i]; }
+
+  private:
+    std::unique_ptr<unsigned char[]> storage_;
+    size_t size_;
+    T* data_;
+  };
+
+  void addToSums(size_t signal, double value)
+  {
+    if (std::isnan(value))
+      return;
+    double shifted = value - reference_[signal].load(std::memory_order_relaxed);
+    writer_sum_[signal] += shifted;
+    writer_sum_sq_[signal] += shifted * shifted;
+    ++writer_count_[signal];
+  }
+
+  void removeFromSums(size_t signal, double value)
+  {
+    if (std::isnan(value))
+      return;
+    double shifted = value - reference_[signal].load(std::memory_order_relaxed);
+    writer_sum_[signal] -= shifted;
+    writer_sum_sq_[signal] -= shifted * shifted;
+    --writer_count_[signal];
+  }
+
+  // Recomputes the window sums given the total sample count after the push.
+  void recomputeSums(uint64_t count)
+  {
+    size_t span = static_cast<size_t>(std::min<uint64_t>(count, window_));
+    std::fill(writer_sum_.begin(), writer_sum_.end(), 0.0);
+    std::fill(writer_sum_sq_.begin(), writer_sum_sq_.end(), 0.0);
+    std::fill(writer_count_.begin(), writer_count_.end(), 0);
+    for (size_t i = 0; i < num_signals_; ++i)
+    {
+      for (size_t age = 0; age < span; ++age)
+      {
+        size_t slot = (count - 1 - age) % capacity_;
+        addToSums(i, values_[i * row_stride_ + slot].load(std::memory_order_relaxed));
+      }
+    }
+  }
+
+  // Sequence lock: odd while the writer is updating.
+  void beginWrite()
+  {
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+  void endWrite()
+  {
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+  uint64_t beginRead() const
+  {
+    uint64_t seq;
+    while ((seq = seq_.load(std::memory_order_acquire)) & 1)
+      ;
+    return seq;
+  }
+  bool endRead(uint64_t seq) const
+  {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return seq_.load(std::memory_order_relaxed) == seq;
+  }
+
+  const size_t num_signals_;
+  const size_t capacity_;
+  const size_t window_;
+  // Distance between the starts of consecutive signals' rows, in doubles
+  // (capacity rounded up to a whole number of cache lines).
+  const size_t row_stride_;
+
+  // Shared with readers; protected by 'seq_'.
+  std::atomic<uint64_t> seq_{0};
+  std::atomic<uint64_t> total_{0};
+  AlignedArray<std::atomic<double>> values_;
+  AlignedArray<std::atomic<double>> times_;
+  AlignedArray<std::atomic<double>> sum_;
+  AlignedArray<std::atomic<double>> sum_sq_;
+  AlignedArray<std::atomic<size_t>> count_;
+  // Window sums are kept relative to the first valid sample of each signal.
+  AlignedArray<std::atomic<double>> reference_;
+
+  // Only touched by the writer.
+  std::vector<double> writer_sum_;
+  std::vector<double> writer_sum_sq_;
+  std::vector<size_t> writer_count_;
+  size_t pushes_since_resync_ = 0;
+};
+
+} // namespace util
+} // namespace hebi
@@ -0,0 +1,245 @@
+#pragma once
+
+#include "group.hpp"
+#include "group_feedback.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hebi {
+namespace util {
+
+/**
+ * Polls a group with request/response feedback (`sendFeedbackRequest` +
+ * `getNextFeedback`), keeping up to K requests in flight at once instead of
+ * waiting for each response before sending the next request.  This lets the
+ * poll rate approach the link rate rather than being limited by the round trip
+ * time, for groups which can't be switched to streaming feedback.
+ *
+ * Responses are matched to the oldest outstanding request, and written
+ * directly into a preallocated ring of GroupFeedback objects; they are handed
+ * to the (single) consumer in the order they arrived.  If the consumer falls
+ * behind and the ring fills up, new responses are dropped and counted.
+ *
+ * Streamed feedback would be mistaken for responses, so the constructor turns
+ * off the group's feedback frequency (groups stream at 100 Hz by default); do
+ * not set it again while polling.
+ */
+class PipelinedFeedbackPoller
+{
+public:
+  struct Statistics
+  {
+    uint64_t requests_;
+    uint64_t responses_;
+    // Requests which timed out without a response.
+    uint64_t lost_;
+    // Responses dropped because the consumer didn't keep up.
+    uint64_t dropped_;
+    // Round trip time, from request to response, averaged over all responses.
+    double mean_rtt_s_;
+  };
+
+  /**
+   * @param max_outstanding The maximum number of requests in flight at once (K).
+   * @param ring_size Number of preallocated feedback slots available to hold
+   * responses not yet retrieved by the consumer.
+   * @param timeout_ms How long to wait for a response before considering a
+   * request lost.
+   */
+  PipelinedFeedbackPoller(std::shared_ptr<Group> group, size_t max_outstanding,
+    size_t ring_size = 64, long timeout_ms = 100)
+    : group_(group), max_outstanding_(std::max<size_t>(max_outstanding, 1)),
+      timeout_ms_(timeout_ms), scratch_(group->size())
+  {
+    // One slot is always left empty to distinguish "full" from "empty".
+    ring_size = std::max<size_t>(ring_size, 2);
+    for (size_t i = 0; i < ring_size; ++i)
+      ring_.emplace_back(new GroupFeedback(group->size()));
+    group_->setFeedbackFrequencyHz(0);
+  }
+
+  ~PipelinedFeedbackPoller()
+  {
+    stop();
+  }
+
+  PipelinedFeedbackPoller(const PipelinedFeedbackPoller&) = delete;
+  PipelinedFeedbackPoller& operator=(const PipelinedFeedbackPoller&) = delete;
+
+  /**
+   * Starts the polling thread.
+   */
+  void start()
+  {
+    if (poll_thread_.joinable())
+      return;
+    quit_.store(false, std::memory_order_release);
+    poll_thread_ = std::thread(&PipelinedFeedbackPoller::pollProc, this);
+  }
+
+  /**
+   * Stops the polling thread; any responses to outstanding requests are
+   * discarded.
+   */
+  void stop()
+  {
+    if (!poll_thread_.joinable())
+      return;
+    quit_.store(true, std::memory_order_release);
+    poll_thread_.join();
+  }
+
+  /**
+   * Waits for the next response, and returns a pointer to it (or nullptr if
+   * none arrived before the timeout).  The feedback remains valid until
+   * `release` is called; `release` must be called before requesting the next
+   * response.
+   */
+  const GroupFeedback* waitForFeedback(long timeout_ms)
+  {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (head_.load(std::memory_order_acquire) == tail)
+    {
+      std::unique_lock<std::mutex> lock(wait_lock_);
+      bool ready = wait_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+        [this, tail]() { return head_.load(std::memory_order_acquire) != tail; });
+      if (!ready)
+        return nullptr;
+    }
+    return ring_[tail].get();
+  }
+
+  /**
+   * Releases the feedback slot returned from `waitForFeedback` back to the
+   * poller.
+   */
+  void release()
+  {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    tail_.store((tail + 1) % ring_.size(), std::memory_order_release);
+  }
+
+  Statistics getStatistics() const
+  {
+    Statistics stats;
+    stats.requests_ = requests_.load(std::memory_order_relaxed);
+    stats.responses_ = responses_.load(std::memory_order_relaxed);
+    stats.lost_ = lost_.load(std::memory_order_relaxed);
+    stats.dropped_ = dropped_.load(std::memory_order_relaxed);
+    stats.mean_rtt_s_ = stats.responses_ == 0 ? 0 :
+      total_rtt_s_.load(std::memory_order_relaxed) / stats.responses_;
+    return stats;
+  }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  void sendRequest(std::deque<clock::time_point>& outstanding)
+  {
+    if (group_->sendFeedbackRequest())
+    {
+      outstanding.push_back(clock::now());
+      requests_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Retires every outstanding request that has waited longer than the timeout
+  // as lost, so a late response isn't matched to it.
+  void retireExpired(std::deque<clock::time_point>& outstanding)
+  {
+    clock::time_point deadline = clock::now() - std::chrono::milliseconds(timeout_ms_);
+    while (!outstanding.empty() && outstanding.front() <= deadline)
+    {
+      outstanding.pop_front();
+      lost_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void pollProc()
+  {
+    // Send times of outstanding requests, oldest first.  Responses arrive in
+    // the order the requests were sent, so each one belongs to the front.
+    std::deque<clock::time_point> outstanding;
+    double total_rtt_s = 0;
+
+    while (!quit_.load(std::memory_order_acquire))
+    {
+      while (outstanding.size() < max_outstanding_)
+      {
+        size_t before = outstanding.size();
+        sendRequest(outstanding);
+        if (outstanding.size() == before)
+          break; // Could not send; try again after waiting on a response.
+      }
+
+      // Receive straight into the next free ring slot if there is one.
+      size_t head = head_.load(std::memory_order_relaxed);
+      size_t next_head = (head + 1) % ring_.size();
+      bool has_space = (next_head != tail_.load(std::memory_order_acquire));
+      GroupFeedback& dest = has_space ? *ring_[head] : scratch_;
+
+      bool received = group_->getNextFeedback(dest, timeout_ms_);
+      retireExpired(outstanding);
+      if (!received)
+        continue;
+
+      if (!outstanding.empty())
+      {
+        std::chrono::duration<double> rtt = clock::now() - outstanding.front();
+        outstanding.pop_front();
+        total_rtt_s += rtt.count();
+        total_rtt_s_.store(total_rtt_s, std::memory_order_relaxed);
+      }
+      responses_.fetch_add(1, std::memory_order_relaxed);
+
+      if (!has_space)
+      {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+
+      {
+        // The lock is only held so the consumer can't miss the notification
+        // between checking the ring and waiting.
+        std::lock_guard<std::mutex> lock(wait_lock_);
+        head_.store(next_head, std::memory_order_release);
+      }
+      wait_cv_.notify_one();
+    }
+  }
+
+  std::shared_ptr<Group> group_;
+  const size_t max_outstanding_;
+  const long timeout_ms_;
+
+  // Ring of responses; written by the poll thread at 'head_', read by the
+  // consumer at 'tail_'.
+  std::vector<std::unique_ptr<GroupFeedback>> ring_;
+  std::atomic<size_t> head_{0};
+  std::atomic<size_t> tail_{0};
+  // Received into when the ring is full.
+  GroupFeedback scratch_;
+
+  std::mutex wait_lock_;
+  std::condition_variable wait_cv_;
+
+  std::atomic<uint64_t> requests_{0};
+  std::atomic<uint64_t> responses_{0};
+  std::atomic<uint64_t> lost_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<double> total_rtt_s_{0};
+
+  std::atomic<bool> quit_{false};
+  std::thread poll_thread_;
+};
+
+} // namespace util
+} // namespace hebi
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "command_transmitter.hpp"
+#include "gain_profiles.hpp"
+#include "group.hpp"
+#include "info_cache.hpp"
+
+#include <chrono>
+#include <memory>
+
+namespace hebi {
+namespace util {
+
+/**
+ * Switches a group between gain profiles from a control loop, e.g. when it
+ * goes from standing up to walking, without a blocking round trip.
+ *
+ * `select` only hands the profile to the group's util::CommandTransmitter,
+ * which merges it into the next motion command it sends.  Whether the modules
+ * have applied it is checked afterwards, from their info as kept by an
+ * internal util::InfoCache: once the profile has been sent, the cache is
+ * refreshed, and `update` compares the reported gains to the profile.
+ *
+ * Commands aren't acknowledged, so the profile is sent again whenever the
+ * modules haven't reported it a while after the last send; if they still
+ * haven't by the deadline, the switch has failed.  `update` must be polled
+ * (e.g. once per control tick) for this to happen.
+ */
+class GainProfileSwitcher
+{
+public:
+  enum class Status
+  {
+    // Nothing selected yet
+    None,
+    // Selected, but not yet reported by every module
+    Pending,
+    Confirmed,
+    // Not reported by every module before the deadline; `select` the profile
+    // again to retry.
+    Failed
+  };
+
+  /**
+   * @param transmitter Must have been given the same 'profiles', and outlive
+   * this object.
+   * @param timeout How long after `select` the modules have to report the
+   * profile.
+   * @param resend_interval How long after sending the profile to wait for the
+   * modules to report it before sending it again.
+   */
+  GainProfileSwitcher(std::shared_ptr<Group> group, std::shared_ptr<const GainProfiles> profiles,
+    CommandTransmitter& transmitter,
+    std::chrono::milliseconds timeout = std::chrono::milliseconds(4000),
+    std::chrono::milliseconds resend_interval = std::chrono::milliseconds(250))
+    : profiles_(profiles), transmitter_(transmitter),
+      group_id_(info_cache_.addGroup(group, std::chrono::milliseconds(2000))),
+      num_modules_(static_cast<size_t>(group->size())),
+      timeout_(timeout), resend_interval_(resend_interval)
+  {}
+
+  GainProfileSwitcher(const GainProfileSwitcher&) = delete;
+  GainProfileSwitcher& operator=(const GainProfileSwitcher&) = delete;
+
+  /**
+   * Switches to the given profile with the next command that is submitted to
+   * the transmitter; does nothing if it is already selected (unless that
+   * switch failed).  Call from the thread that submits commands; does not
+   * block.
+   */
+  void select(int profile)
+  {
+    if (profile == selected_ && status_ != Status::Failed)
+      return;
+    selected_ = profile;
+    status_ = Status::Pending;
+    deadline_ = clock::now() + timeout_;
+    request();
+  }
+
+  // The selected profile, or -1 if none has been selected yet.
+  int getSelected() const { return selected_; }
+
+  /**
+   * Checks whether every module reports the selected profile, sends it again
+   * if it seems to have been lost, and fails the switch once the deadline has
+   * passed.  Never blocks on the network; call from the same thread as
+   * `select`.
+   */
+  Status update()
+  {
+    if (status_ != Status::Pending)
+      return status_;
+    clock::time_point now = clock::now();
+    if (!sent_)
+    {
+      if (transmitter_.getGainsSent() == sequence_)
+      {
+        // Anything cached so far predates this send.
+        sent_ = true;
+        sent_time_ = now;
+        info_cache_.invalidate(group_id_);
+      }
+    }
+    else if (modulesReportSelected())
+    {
+      status_ = Status::Confirmed;
+      return status_;
+    }
+    if (now >= deadline_)
+      status_ = Status::Failed;
+    else if (sent_ && now - sent_time_ >= resend_interval_)
+      request();
+    return status_;
+  }
+
+  // Shorthand for `update() == Status::Confirmed`.
+  bool isConfirmed() { return update() == Status::Confirmed; }
+
+  /**
+   * True if the profile is waiting for a command to be submitted to the
+   * transmitter, e.g. to send empty commands when nothing else is being sent.
+   */
+  bool isSendPending() const { return status_ == Status::Pending && !sent_; }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  void request()
+  {
+    sequence_ = transmitter_.requestGains(selected_);
+    sent_ = false;
+  }
+
+  bool modulesReportSelected() const
+  {
+    for (size_t i = 0; i < num_modules_; ++i)
+    {
+      CachedModuleSettings cached = info_cache_.get(group_id_, i);
+      if (!cached.valid_ || cached.stale_ || !profiles_->matches(selected_, i, cached.settings_))
+        return false;
+    }
+    return true;
+  }
+
+  std::shared_ptr<const GainProfiles> profiles_;
+  CommandTransmitter& transmitter_;
+  InfoCache info_cache_;
+  const int group_id_;
+  const size_t num_modules_;
+  const clock::duration timeout_;
+  const clock::duration resend_interval_;
+
+  int selected_{-1};
+  Status status_{Status::None};
+  clock::time_point deadline_;
+  uint32_t sequence_{0};
+  bool sent_{false};
+  clock::time_point sent_time_;
+};
+
+} // namespace util
+} // namespace hebi
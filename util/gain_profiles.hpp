@@ -0,0 +1,179 @@
+#pragma once
+
+#include "group_command.hpp"
+#include "info_cache.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace hebi {
+namespace util {
+
+/**
+ * A set of named gain profiles (e.g. one for standing up and one for walking),
+ * each parsed once from a gains XML file into a GroupCommand, so that
+ * switching between them at runtime doesn't touch the file system.
+ *
+ * A profile is applied by merging its settings into an outgoing motion command
+ * (see `mergeGains` and util::CommandTransmitter), rather than by sending it
+ * on its own; the settings are then cleared again with `clearGains` so they
+ * aren't resent with every packet.
+ */
+class GainProfiles
+{
+public:
+  explicit GainProfiles(size_t num_modules) : num_modules_(num_modules) {}
+
+  GainProfiles(const GainProfiles&) = delete;
+  GainProfiles& operator=(const GainProfiles&) = delete;
+
+  /**
+   * Parses a gains file into a new profile, and returns its index; returns -1
+   * (and adds nothing) if the file could not be read.
+   */
+  int load(const std::string& name, const std::string& gains_file)
+  {
+    std::unique_ptr<GroupCommand> gains(new GroupCommand(num_modules_));
+    if (!gains->readGains(gains_file))
+      return -1;
+    names_.push_back(name);
+    profiles_.push_back(std::move(gains));
+    return static_cast<int>(profiles_.size()) - 1;
+  }
+
+  /**
+   * The index of the profile with the given name, or -1 if there is none.
+   */
+  int find(const std::string& name) const
+  {
+    for (size_t i = 0; i < names_.size(); ++i)
+      if (names_[i] == name)
+        return static_cast<int>(i);
+    return -1;
+  }
+
+  size_t size() const { return profiles_.size(); }
+  size_t getNumModules() const { return num_modules_; }
+  const std::string& getName(int profile) const { return names_[profile]; }
+  const GroupCommand& getGains(int profile) const { return *profiles_[profile]; }
+
+  /**
+   * Sets the gains and control strategy of every module in 'cmd' to those
+   * given in 'gains'; settings that 'gains' leaves unset are not changed.
+   */
+  static void mergeGains(const GroupCommand& gains, GroupCommand& cmd)
+  {
+    for (size_t i = 0; i < cmd.size(); ++i)
+    {
+      const auto& from = gains[i].settings().actuator();
+      auto& to = cmd[i].settings().actuator();
+      copyGains(from.positionGains(), to.positionGains());
+      copyGains(from.velocityGains(), to.velocityGains());
+      copyGains(from.effortGains(), to.effortGains());
+      copyField(from.controlStrategy(), to.controlStrategy());
+    }
+  }
+
+  /**
+   * Clears every setting that `mergeGains` may have set.
+   */
+  static void clearGains(GroupCommand& cmd)
+  {
+    for (size_t i = 0; i < cmd.size(); ++i)
+    {
+      auto& actuator = cmd[i].settings().actuator();
+      clearGains(actuator.positionGains());
+      clearGains(actuator.velocityGains());
+      clearGains(actuator.effortGains());
+      actuator.controlStrategy().clear();
+    }
+  }
+
+  /**
+   * True if the settings reported by one module (e.g. from util::InfoCache)
+   * agree with the profile's PID gains and control strategy.
+   */
+  bool matches(int profile, size_t module_index, const ModuleSettings& settings) const
+  {
+    const auto& expected = (*profiles_[profile])[module_index].settings().actuator();
+    if (expected.controlStrategy().has() &&
+        static_cast<int>(expected.controlStrategy().get()) != settings.control_strategy_)
+      return false;
+    return matchesPid(expected.positionGains(), settings.position_kp_, settings.position_ki_, settings.position_kd_) &&
+           matchesPid(expected.velocityGains(), settings.velocity_kp_, settings.velocity_ki_, settings.velocity_kd_) &&
+           matchesPid(expected.effortGains(), settings.effort_kp_, settings.effort_ki_, settings.effort_kd_);
+  }
+
+private:
+  template <typename Field>
+  static void copyField(const Field& from, Field& to)
+  {
+    if (from.has())
+      to.set(from.get());
+  }
+
+  template <typename Gains>
+  static void copyGains(const Gains& from, Gains& to)
+  {
+    copyField(from.kP(), to.kP());
+    copyField(from.kI(), to.kI());
+    copyField(from.kD(), to.kD());
+    copyField(from.feedForward(), to.feedForward());
+    copyField(from.deadZone(), to.deadZone());
+    copyField(from.iClamp(), to.iClamp());
+    copyField(from.punch(), to.punch());
+    copyField(from.minTarget(), to.minTarget());
+    copyField(from.maxTarget(), to.maxTarget());
+    copyField(from.targetLowpass(), to.targetLowpass());
+    copyField(from.minOutput(), to.minOutput());
+    copyField(from.maxOutput(), to.maxOutput());
+    copyField(from.outputLowpass(), to.outputLowpass());
+    copyField(from.dOnError(), to.dOnError());
+  }
+
+  template <typename Gains>
+  static void clearGains(Gains& gains)
+  {
+    gains.kP().clear();
+    gains.kI().clear();
+    gains.kD().clear();
+    gains.feedForward().clear();
+    gains.deadZone().clear();
+    gains.iClamp().clear();
+    gains.punch().clear();
+    gains.minTarget().clear();
+    gains.maxTarget().clear();
+    gains.targetLowpass().clear();
+    gains.minOutput().clear();
+    gains.maxOutput().clear();
+    gains.outputLowpass().clear();
+    gains.dOnError().clear();
+  }
+
+  // Modules report gains as floats, possibly rounded; unset expected values
+  // match anything.
+  template <typename Field>
+  static bool matchesValue(const Field& expected, float actual)
+  {
+    if (!expected.has())
+      return true;
+    float value = expected.get();
+    return std::abs(value - actual) <= 1e-4f * std::max(1.0f, std::abs(value));
+  }
+
+  template <typename Gains>
+  static bool matchesPid(const Gains& expected, float kp, float ki, float kd)
+  {
+    return matchesValue(expected.kP(), kp) && matchesValue(expected.kI(), ki) && matchesValue(expected.kD(), kd);
+  }
+
+  const size_t num_modules_;
+  std::vector<std::string> names_;
+  std::vector<std::unique_ptr<GroupCommand>> profiles_;
+};
+
+} // namespace util
+} // namespace hebi
@@ -24,6 +24,20 @@ public:
                      -base_accel.getY(),
                      -base_accel.getZ());
 
+    return getEfforts(model, masses, feedback.getPosition(), gravity);
+  }
+
+  /**
+   * As above, but from joint positions and a gravity vector (in the base
+   * frame; only its direction is used) that have already been read out of
+   * feedback.
+   */
+  static Eigen::VectorXd getEfforts(
+    const hebi::robot_model::RobotModel& model,
+    const Eigen::VectorXd& masses,
+    const Eigen::VectorXd& positions,
+    const Eigen::Vector3d& gravity)
+  {
     // Normalize gravity vector (to 1g, or 9.8 m/s^2)
     Eigen::Vector3d normed_gravity = gravity;
     normed_gravity /= normed_gravity.norm();
@@ -33,7 +47,7 @@ public:
     size_t num_frames = model.getFrameCount(HebiFrameTypeCenterOfMass);
 
     hebi::robot_model::MatrixXdVector jacobians;
-    model.getJ(HebiFrameTypeCenterOfMass, feedback.getPosition(), jacobians);
+    model.getJ(HebiFrameTypeCenterOfMass, positions, jacobians);
 
     // Get torque for each module
     // comp_torque = J' * wrench_vector
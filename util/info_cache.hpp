@@ -0,0 +1,334 @@
+#pragma once
+
+#include "group.hpp"
+#include "group_command.hpp"
+#include "group_info.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hebi {
+namespace util {
+
+/**
+ * The subset of module settings that the cache keeps for each module.  Float
+ * values that the module did not report are NaN, and a control strategy that
+ * was not reported is -1.
+ */
+struct ModuleSettings
+{
+  float spring_constant_;
+
+  float position_kp_;
+  float position_ki_;
+  float position_kd_;
+  float velocity_kp_;
+  float velocity_ki_;
+  float velocity_kd_;
+  float effort_kp_;
+  float effort_ki_;
+  float effort_kd_;
+
+  int control_strategy_;
+};
+
+/**
+ * The answer to a settings query, along with how fresh that answer is.
+ */
+struct CachedModuleSettings
+{
+  ModuleSettings settings_;
+  // False if no info has been received for this module yet; all other fields
+  // are meaningless in this case.
+  bool valid_;
+  // True if the info is older than the TTL for the group, or a settings
+  // command has been acknowledged since it was received.
+  bool stale_;
+  // Time since the info packet this answer came from was received [s].
+  double age_s_;
+};
+
+/**
+ * Keeps a copy of the settings of each registered group in memory, refreshing
+ * it from a single background thread, so that settings queries don't have to
+ * block on a `requestInfo` round trip.
+ *
+ * Each group is refreshed whenever its info is older than the TTL given when
+ * it was added.  Sending settings through `sendCommandWithAcknowledgement`
+ * invalidates the entry for that group and triggers an immediate refresh.
+ *
+ * Queries take the group id returned by `addGroup` and a module index, and are
+ * answered in constant time from the last received info packet.
+ */
+class InfoCache
+{
+public:
+  InfoCache()
+  {
+    refresh_thread_ = std::thread(&InfoCache::refreshProc, this);
+  }
+
+  ~InfoCache()
+  {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      quit_ = true;
+    }
+    refresh_cv_.notify_all();
+    refresh_thread_.join();
+  }
+
+  InfoCache(const InfoCache&) = delete;
+  InfoCache& operator=(const InfoCache&) = delete;
+
+  /**
+   * Registers a group with the cache, and returns the id that is used to query
+   * it.  The first refresh happens immediately in the background; use
+   * `waitForRefresh` to block until it has arrived.
+   *
+   * @param ttl How old the cached info for this group is allowed to get before
+   * it is refreshed.
+   * @param request_timeout_ms Timeout of each background `requestInfo` call.
+   */
+  int addGroup(std::shared_ptr<Group> group,
+    std::chrono::milliseconds ttl = std::chrono::milliseconds(1000),
+    long request_timeout_ms = 1000)
+  {
+    std::unique_ptr<Entry> entry(new Entry(group, ttl, request_timeout_ms));
+    int id;
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      id = static_cast<int>(entries_.size());
+      entries_.push_back(std::move(entry));
+    }
+    refresh_cv_.notify_all();
+    return id;
+  }
+
+  /**
+   * Returns the cached settings for one module of a group.  Never blocks on the
+   * network.
+   */
+  CachedModuleSettings get(int group_id, size_t module_index) const
+  {
+    CachedModuleSettings res;
+    const Entry& entry = getEntry(group_id);
+    std::lock_guard<std::mutex> lock(entry.data_lock_);
+    res.valid_ = entry.has_data_ && module_index < entry.settings_.size();
+    if (!res.valid_)
+    {
+      res.stale_ = true;
+      res.age_s_ = std::numeric_limits<double>::infinity();
+      return res;
+    }
+    res.settings_ = entry.settings_[module_index];
+    std::chrono::duration<double> age = std::chrono::steady_clock::now() - entry.received_;
+    res.age_s_ = age.count();
+    res.stale_ = entry.invalidated_ || age > entry.ttl_;
+    return res;
+  }
+
+  /**
+   * Convenience accessor for the spring constant of one module.  Returns NaN if
+   * it is not known; `age_s` is set to the age of the answer.
+   */
+  float getSpringConstant(int group_id, size_t module_index, double& age_s) const
+  {
+    CachedModuleSettings res = get(group_id, module_index);
+    age_s = res.age_s_;
+    return res.valid_ ? res.settings_.spring_constant_ : std::numeric_limits<float>::quiet_NaN();
+  }
+
+  /**
+   * Marks the cached info for a group as stale and requests an immediate
+   * refresh.
+   */
+  void invalidate(int group_id)
+  {
+    Entry& entry = getEntry(group_id);
+    {
+      std::lock_guard<std::mutex> lock(entry.data_lock_);
+      entry.invalidated_ = true;
+      ++entry.invalidate_count_;
+    }
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      entry.next_refresh_ = std::chrono::steady_clock::now();
+    }
+    refresh_cv_.notify_all();
+  }
+
+  /**
+   * Sends a (settings) command to a group with acknowledgement; if the command
+   * is acknowledged, the cached info for the group is invalidated.
+   */
+  bool sendCommandWithAcknowledgement(int group_id, const GroupCommand& cmd, long timeout_ms)
+  {
+    bool acked = getEntry(group_id).group_->sendCommandWithAcknowledgement(cmd, timeout_ms);
+    if (acked)
+      invalidate(group_id);
+    return acked;
+  }
+
+  /**
+   * Blocks until the cached info for the group is valid and not stale, or the
+   * timeout expires.  Returns true if fresh info is available.
+   */
+  bool waitForRefresh(int group_id, long timeout_ms)
+  {
+    Entry& entry = getEntry(group_id);
+    std::unique_lock<std::mutex> lock(entry.data_lock_);
+    return entry.refreshed_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+      [&entry]() { return entry.has_data_ && !entry.invalidated_; });
+  }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  struct Entry
+  {
+    Entry(std::shared_ptr<Group> group, std::chrono::milliseconds ttl, long request_timeout_ms)
+      : group_(group), ttl_(ttl), request_timeout_ms_(request_timeout_ms),
+        info_(group->size()), next_refresh_(clock::now())
+    {
+      settings_.resize(group->size());
+    }
+
+    std::shared_ptr<Group> group_;
+    const std::chrono::milliseconds ttl_;
+    const long request_timeout_ms_;
+    // Only touched by the refresh thread.
+    GroupInfo info_;
+    // Protected by the cache's 'lock_'.
+    clock::time_point next_refresh_;
+
+    // Protected by 'data_lock_'.
+    mutable std::mutex data_lock_;
+    std::condition_variable refreshed_cv_;
+    std::vector<ModuleSettings> settings_;
+    clock::time_point received_;
+    bool has_data_{false};
+    bool invalidated_{false};
+    unsigned int invalidate_count_{0};
+  };
+
+  Entry& getEntry(int group_id) const
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    return *entries_[group_id];
+  }
+
+  template <typename FieldType>
+  static float getOrNaN(const FieldType& field)
+  {
+    return field.has() ? field.get() : std::numeric_limits<float>::quiet_NaN();
+  }
+
+  static void parseInfo(const GroupInfo& info, std::vector<ModuleSettings>& settings)
+  {
+    for (size_t i = 0; i < settings.size(); ++i)
+    {
+      const auto& actuator = info[i].settings().actuator();
+      ModuleSettings& s = settings[i];
+      s.spring_constant_ = getOrNaN(actuator.springConstant());
+      s.position_kp_ = getOrNaN(actuator.positionGains().kP());
+      s.position_ki_ = getOrNaN(actuator.positionGains().kI());
+      s.position_kd_ = getOrNaN(actuator.positionGains().kD());
+      s.velocity_kp_ = getOrNaN(actuator.velocityGains().kP());
+      s.velocity_ki_ = getOrNaN(actuator.velocityGains().kI());
+      s.velocity_kd_ = getOrNaN(actuator.velocityGains().kD());
+      s.effort_kp_ = getOrNaN(actuator.effortGains().kP());
+      s.effort_ki_ = getOrNaN(actuator.effortGains().kI());
+      s.effort_kd_ = getOrNaN(actuator.effortGains().kD());
+      s.control_strategy_ = actuator.controlStrategy().has() ?
+        static_cast<int>(actuator.controlStrategy().get()) : -1;
+    }
+  }
+
+  void refreshEntry(Entry& entry)
+  {
+    // If a settings command is acknowledged while this request is in flight,
+    // the reply may not reflect it; remember how many invalidations we have
+    // seen so we can tell.
+    unsigned int invalidate_count;
+    {
+      std::lock_guard<std::mutex> lock(entry.data_lock_);
+      invalidate_count = entry.invalidate_count_;
+    }
+    bool success = entry.group_->requestInfo(entry.info_, entry.request_timeout_ms_);
+
+    std::vector<ModuleSettings> parsed(entry.settings_.size());
+    if (success)
+      parseInfo(entry.info_, parsed);
+
+    clock::time_point now = clock::now();
+    {
+      std::lock_guard<std::mutex> lock(entry.data_lock_);
+      if (success)
+      {
+        entry.settings_.swap(parsed);
+        entry.received_ = now;
+        entry.has_data_ = true;
+        if (entry.invalidate_count_ == invalidate_count)
+          entry.invalidated_ = false;
+      }
+    }
+    entry.refreshed_cv_.notify_all();
+
+    std::lock_guard<std::mutex> lock(lock_);
+    // 'next_refresh_' is only changed from "max" while the request is in flight
+    // if the entry was invalidated; in that case, refresh again right away.
+    if (entry.next_refresh_ == clock::time_point::max())
+      entry.next_refresh_ = now + (success ? entry.ttl_ : std::chrono::milliseconds(100));
+  }
+
+  void refreshProc()
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    while (!quit_)
+    {
+      // Find the entry that is due soonest
+      Entry* next = nullptr;
+      for (auto& entry : entries_)
+      {
+        if (!next || entry->next_refresh_ < next->next_refresh_)
+          next = entry.get();
+      }
+
+      if (!next)
+      {
+        refresh_cv_.wait(lock);
+        continue;
+      }
+      if (next->next_refresh_ > clock::now())
+      {
+        refresh_cv_.wait_until(lock, next->next_refresh_);
+        continue;
+      }
+
+      // Mark that we are handling this, so an invalidation during the request
+      // can move it back up.
+      next->next_refresh_ = clock::time_point::max();
+      lock.unlock();
+      refreshEntry(*next);
+      lock.lock();
+    }
+  }
+
+  // Protects 'entries_' (the vector itself) and each entry's 'next_refresh_'.
+  // Entries are never removed, so pointers to them remain valid for the life
+  // of the cache.
+  mutable std::mutex lock_;
+  std::condition_variable refresh_cv_;
+  std::vector<std::unique_ptr<Entry>> entries_;
+  bool quit_{false};
+  std::thread refresh_thread_;
+};
+
+} // namespace util
+} // namespace hebi
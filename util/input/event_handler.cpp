@@ -1,5 +1,6 @@
 #include "event_handler_internal.h"
 #include "joystick.h"
+#include "../trace.hpp"
 
 #include <cassert>
 #include <cmath>
@@ -34,6 +35,7 @@ void SDLEventHandler::dispatch_event(const SDL_Event& event) {
 }
 
 void SDLEventHandler::run(std::condition_variable& cv) {
+  HEBI_TRACE_THREAD_NAME("SDL events");
   // modify state to signal the event handler has begun running
   {
     std::unique_lock<std::mutex> lk(lock_);
@@ -48,7 +50,7 @@ void SDLEventHandler::run(std::condition_variable& cv) {
 
   SDL_Event events[10];
 
-  lock_.lock();
+  tracedLock(lock_, "wait event handler lock").release();
   while(keep_running_) {
     lock_.unlock();
     auto last_time = last_event_loop_time_;
@@ -62,6 +64,7 @@ void SDLEventHandler::run(std::condition_variable& cv) {
       last_event_loop_time_ = now_time;
     }
 
+    HEBI_TRACE_SCOPE("pump SDL events");
     SDL_PumpEvents();
 
     int readevents = 0;
@@ -71,11 +74,12 @@ void SDLEventHandler::run(std::condition_variable& cv) {
         break;
       }
       for (size_t i = 0; i < static_cast<size_t>(readevents); i++) {
+        HEBI_TRACE_SCOPE("dispatch SDL event");
         dispatch_event(events[i]);
       }
     }
 
-    lock_.lock();
+    tracedLock(lock_, "wait event handler lock").release();
   }
 
   lock_.unlock();
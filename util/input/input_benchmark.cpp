@@ -0,0 +1,424 @@
+// Synthetic load benchmark for the input event pipeline (SDLEventHandler ->
+// JoystickDispatcher -> JoystickElement callbacks), runnable on a headless
+// machine.
+//
+// Virtual game controllers are attached through SDL, and a single injector
+// thread pushes axis, hat and button events for them with SDL_PushEvent at a
+// controlled rate. This reports:
+//  - push to dispatch latency; an observer registered after the built-in
+//    dispatchers timestamps each event once all of its joystick callbacks
+//    have run,
+//  - sustained throughput, and events SDL refused because its queue was full,
+//  - contention on the singleton lifecycle lock, as the time other threads
+//    (e.g., a UI polling for joysticks) spend in Joystick::at_index while the
+//    dispatcher is busy, compared to an idle baseline,
+//  - CPU use of the process, and of the event pipeline alone.
+//
+// The pipeline dispatches events in the order they were pushed, so the n-th
+// event observed is the n-th event pushed. Unplug any real joysticks first,
+// as their events would be counted too.
+
+#include "event_handler.h"
+#include "joystick.h"
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+using namespace hebi::util;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// Must exceed the number of events that can be in flight (SDL's queue holds
+// at most 65535)
+const size_t push_time_ring_size = 1 << 17;
+const size_t max_latency_samples = 1 << 22;
+
+// Elements of each virtual controller
+const int num_axes = 6;
+const int num_buttons = 15;
+const int num_hats = 1;
+
+struct Options {
+  int joysticks{2};
+  double rate{2000.0}; // events/s over all joysticks; 0 pushes as fast as SDL accepts them
+  double duration{5.0};
+  int handlers{1};     // callbacks registered on each axis and button
+  int contenders{1};   // threads calling Joystick::at_index in a loop
+};
+
+void print_usage(const Options& defaults) {
+  std::cout << "Input pipeline benchmark usage:\n" <<
+  "    -j <count>\n" <<
+  "        Number of virtual controllers (default " << defaults.joysticks << ").\n\n" <<
+  "    -r <events/s>\n" <<
+  "        Total injection rate; 0 injects as fast as possible (default " << defaults.rate << ").\n\n" <<
+  "    -d <seconds>\n" <<
+  "        Injection time (default " << defaults.duration << ").\n\n" <<
+  "    -n <count>\n" <<
+  "        Callbacks registered on every axis and button (default " << defaults.handlers << ").\n\n" <<
+  "    -c <count>\n" <<
+  "        Threads contending for the lifecycle lock via Joystick::at_index\n" <<
+  "        (default " << defaults.contenders << ").\n\n" <<
+  "    -h\n" <<
+  "        Print this help and return." << std::endl;
+}
+
+int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now().time_since_epoch()).count();
+}
+
+// CPU time of the process or the calling thread, in seconds; NaN where
+// unavailable.
+double cpu_seconds(bool thread_only) {
+#if defined(_POSIX_CPUTIME) && defined(_POSIX_THREAD_CPUTIME)
+  timespec ts;
+  if (clock_gettime(thread_only ? CLOCK_THREAD_CPUTIME_ID : CLOCK_PROCESS_CPUTIME_ID, &ts) == 0) {
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+  }
+#else
+  (void)thread_only;
+#endif
+  return std::nan("");
+}
+
+// Latency percentiles, in microseconds
+struct Percentiles {
+  double mean{0.0}, p50{0.0}, p99{0.0}, max{0.0};
+};
+
+Percentiles percentiles(std::vector<float>& samples) {
+  Percentiles ret;
+  if (samples.empty()) {
+    return ret;
+  }
+  std::sort(samples.begin(), samples.end());
+  double sum = 0.0;
+  for (float sample : samples) {
+    sum += sample;
+  }
+  auto at = [&samples](double fraction) {
+    return static_cast<double>(samples[static_cast<size_t>(fraction * static_cast<double>(samples.size() - 1))]);
+  };
+  ret.mean = sum / static_cast<double>(samples.size());
+  ret.p50 = at(0.5);
+  ret.p99 = at(0.99);
+  ret.max = samples.back();
+  return ret;
+}
+
+std::ostream& operator<<(std::ostream& out, const Percentiles& p) {
+  return out << std::fixed << std::setprecision(1) << "mean " << p.mean << "  p50 " << p.p50
+             << "  p99 " << p.p99 << "  max " << p.max;
+}
+
+// Times `count` calls of Joystick::at_index, in microseconds each
+void time_at_index(size_t joysticks, size_t count, std::vector<float>& samples) {
+  for (size_t i = 0; i < count; ++i) {
+    auto start = clock_type::now();
+    auto joystick = Joystick::at_index(i % joysticks);
+    auto end = clock_type::now();
+    if (samples.size() < samples.capacity()) {
+      samples.push_back(std::chrono::duration<float, std::micro>(end - start).count());
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// Virtual controllers
+
+#if SDL_VERSION_ATLEAST(2, 0, 14)
+
+// Attaches a virtual controller, and gives it a mapping so that the pipeline
+// treats it as a game controller (adding a mapping for an attached joystick
+// makes SDL announce it with SDL_CONTROLLERDEVICEADDED).
+bool attach_virtual_controller() {
+  int device_index = SDL_JoystickAttachVirtual(SDL_JOYSTICK_TYPE_GAMECONTROLLER, num_axes, num_buttons, num_hats);
+  if (device_index < 0) {
+    std::cerr << "Could not attach a virtual joystick: " << SDL_GetError() << std::endl;
+    return false;
+  }
+  char guid[33];
+  SDL_JoystickGetGUIDString(SDL_JoystickGetDeviceGUID(device_index), guid, sizeof(guid));
+  std::string mapping = std::string(guid) + ",HEBI input benchmark,"
+    "a:b0,b:b1,x:b2,y:b3,back:b4,guide:b5,start:b6,leftstick:b7,rightstick:b8,"
+    "leftshoulder:b9,rightshoulder:b10,dpup:b11,dpdown:b12,dpleft:b13,dpright:b14,"
+    "leftx:a0,lefty:a1,rightx:a2,righty:a3,lefttrigger:a4,righttrigger:a5,";
+  if (SDL_GameControllerAddMapping(mapping.c_str()) < 0) {
+    std::cerr << "Could not map the virtual joystick: " << SDL_GetError() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool wait_for_joysticks(size_t count) {
+  auto deadline = clock_type::now() + std::chrono::seconds(2);
+  while (clock_type::now() < deadline) {
+    auto joysticks = Joystick::available_joysticks();
+    size_t ready = 0;
+    for (auto& joystick : joysticks) {
+      ready += joystick ? 1 : 0;
+    }
+    if (ready >= count) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return false;
+}
+
+#endif
+
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  Options options;
+  const Options defaults;
+  for (int idx = 1; idx < argc; ++idx) {
+    std::string arg(argv[idx]);
+    if (arg == "-j" && idx + 1 < argc) {
+      options.joysticks = std::atoi(argv[++idx]);
+    } else if (arg == "-r" && idx + 1 < argc) {
+      options.rate = std::atof(argv[++idx]);
+    } else if (arg == "-d" && idx + 1 < argc) {
+      options.duration = std::atof(argv[++idx]);
+    } else if (arg == "-n" && idx + 1 < argc) {
+      options.handlers = std::atoi(argv[++idx]);
+    } else if (arg == "-c" && idx + 1 < argc) {
+      options.contenders = std::atoi(argv[++idx]);
+    } else {
+      print_usage(defaults);
+      return arg == "-h" ? 0 : 1;
+    }
+  }
+  if (options.joysticks < 1 || options.rate < 0.0 || options.duration <= 0.0 ||
+      options.handlers < 1 || options.contenders < 0) {
+    print_usage(defaults);
+    return 1;
+  }
+
+#if !SDL_VERSION_ATLEAST(2, 0, 14)
+  std::cerr << "Virtual joysticks require SDL 2.0.14 or newer" << std::endl;
+  return 1;
+#else
+  initialize_event_handler();
+  for (int i = 0; i < options.joysticks; ++i) {
+    if (!attach_virtual_controller()) {
+      quit_event_handler();
+      return 1;
+    }
+  }
+  const size_t num_joysticks = static_cast<size_t>(options.joysticks);
+  if (!wait_for_joysticks(num_joysticks)) {
+    std::cerr << "The virtual joysticks were not recognized as game controllers" << std::endl;
+    quit_event_handler();
+    return 1;
+  }
+  // The dispatcher looks joysticks up by the event's `which`
+  std::vector<Uint32> targets;
+  for (auto& joystick : Joystick::available_joysticks()) {
+    if (joystick && targets.size() < num_joysticks) {
+      targets.push_back(static_cast<Uint32>(joystick->index()));
+    }
+  }
+
+  // Element callbacks (only the dispatch thread touches these counters, but
+  // the main thread reads them)
+  std::atomic<uint64_t> element_callbacks{0};
+  for (Uint32 target : targets) {
+    auto joystick = Joystick::at_index(target);
+    for (int handler = 0; handler < options.handlers; ++handler) {
+      for (int axis = 0; axis < num_axes; ++axis) {
+        joystick->add_axis_event_handler(static_cast<size_t>(axis), [&element_callbacks](uint32_t, float) {
+          element_callbacks.fetch_add(1, std::memory_order_relaxed);
+        });
+      }
+      for (int button = 0; button < num_buttons; ++button) {
+        joystick->add_button_event_handler(static_cast<size_t>(button), [&element_callbacks](uint32_t, bool) {
+          element_callbacks.fetch_add(1, std::memory_order_relaxed);
+        });
+      }
+    }
+  }
+
+  // Observers run after the built-in dispatchers for the same event type
+  std::unique_ptr<std::atomic<int64_t>[]> push_times(new std::atomic<int64_t>[push_time_ring_size]);
+  std::atomic<uint64_t> delivered{0};
+  std::atomic<uint64_t> delivered_by_type[3];
+  for (auto& count : delivered_by_type) {
+    count = 0;
+  }
+  std::vector<float> latencies;
+  latencies.reserve(max_latency_samples);
+  auto observer = [&](const SDL_Event& event) {
+    int64_t now = now_ns();
+    uint64_t sequence = delivered.load(std::memory_order_relaxed);
+    int64_t pushed = push_times[sequence % push_time_ring_size].load(std::memory_order_relaxed);
+    if (latencies.size() < latencies.capacity()) {
+      latencies.push_back(static_cast<float>(now - pushed) * 1e-3f);
+    }
+    size_t type = event.type == SDL_JOYAXISMOTION ? 0 : (event.type == SDL_JOYHATMOTION ? 1 : 2);
+    delivered_by_type[type].fetch_add(1, std::memory_order_relaxed);
+    delivered.store(sequence + 1, std::memory_order_release);
+  };
+  register_event(SDL_JOYAXISMOTION, observer);
+  register_event(SDL_JOYHATMOTION, observer);
+  register_event(SDL_JOYBUTTONDOWN, observer);
+  register_event(SDL_JOYBUTTONUP, observer);
+
+  // Idle baseline for the lifecycle lock
+  std::vector<float> idle_lock_times;
+  idle_lock_times.reserve(100000);
+  time_at_index(num_joysticks, idle_lock_times.capacity(), idle_lock_times);
+
+  double process_cpu_start = cpu_seconds(false);
+  std::atomic<bool> injecting{true};
+  std::vector<std::vector<float>> contender_lock_times(static_cast<size_t>(options.contenders));
+  std::vector<double> contender_cpu(contender_lock_times.size(), 0.0);
+  std::vector<std::thread> contenders;
+  for (size_t i = 0; i < contender_lock_times.size(); ++i) {
+    contender_lock_times[i].reserve(max_latency_samples / 4);
+    contenders.emplace_back([&, i] {
+      while (injecting.load(std::memory_order_relaxed)) {
+        time_at_index(num_joysticks, 100, contender_lock_times[i]);
+        // Leave room for the dispatcher, as a polling UI thread would
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+      contender_cpu[i] = cpu_seconds(true);
+    });
+  }
+
+  // Inject a mix of 7 axis, 1 hat and 2 button events in every 10, spread
+  // over the joysticks
+  uint64_t pushed = 0;
+  uint64_t refused = 0;
+  double injector_cpu = 0.0;
+  auto start = clock_type::now();
+  std::thread injector([&] {
+    auto end = start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(options.duration));
+    auto next = start;
+    double budget = 0.0;
+    const auto batch_period = std::chrono::milliseconds(1);
+    while (clock_type::now() < end) {
+      size_t batch = 64;
+      if (options.rate > 0.0) {
+        next += batch_period;
+        std::this_thread::sleep_until(next);
+        budget += options.rate * 1e-3;
+        batch = static_cast<size_t>(budget);
+        budget -= static_cast<double>(batch);
+      }
+      for (size_t i = 0; i < batch; ++i) {
+        SDL_Event event;
+        SDL_zero(event);
+        Uint32 which = targets[pushed % targets.size()];
+        uint64_t kind = (pushed / targets.size()) % 10;
+        if (kind < 7) {
+          event.type = SDL_JOYAXISMOTION;
+          event.jaxis.which = static_cast<SDL_JoystickID>(which);
+          event.jaxis.axis = static_cast<Uint8>(pushed % num_axes);
+          event.jaxis.value = static_cast<Sint16>(static_cast<int>((pushed * 1237) % 65536) - 32768);
+        } else if (kind == 7) {
+          event.type = SDL_JOYHATMOTION;
+          event.jhat.which = static_cast<SDL_JoystickID>(which);
+          event.jhat.hat = 0;
+          event.jhat.value = (pushed / 10) % 2 ? SDL_HAT_UP : SDL_HAT_CENTERED;
+        } else {
+          event.type = kind == 8 ? SDL_JOYBUTTONDOWN : SDL_JOYBUTTONUP;
+          event.jbutton.which = static_cast<SDL_JoystickID>(which);
+          event.jbutton.button = static_cast<Uint8>((pushed / 10) % num_buttons);
+          event.jbutton.state = kind == 8 ? SDL_PRESSED : SDL_RELEASED;
+        }
+        push_times[pushed % push_time_ring_size].store(now_ns(), std::memory_order_relaxed);
+        if (SDL_PushEvent(&event) == 1) {
+          ++pushed;
+        } else {
+          // Queue full; at an unlimited rate, wait for the dispatcher
+          ++refused;
+          if (options.rate == 0.0) {
+            std::this_thread::yield();
+          }
+        }
+      }
+    }
+    injector_cpu = cpu_seconds(true);
+  });
+  injector.join();
+  double inject_seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+
+  // Let the dispatcher drain the queue
+  auto drain_deadline = clock_type::now() + std::chrono::seconds(2);
+  while (delivered.load(std::memory_order_acquire) < pushed && clock_type::now() < drain_deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  double total_seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+  double process_cpu = cpu_seconds(false) - process_cpu_start;
+  injecting = false;
+  for (auto& contender : contenders) {
+    contender.join();
+  }
+  uint64_t received = delivered.load(std::memory_order_acquire);
+
+  double contenders_cpu = 0.0;
+  std::vector<float> loaded_lock_times;
+  for (size_t i = 0; i < contender_lock_times.size(); ++i) {
+    contenders_cpu += contender_cpu[i];
+    loaded_lock_times.insert(loaded_lock_times.end(), contender_lock_times[i].begin(), contender_lock_times[i].end());
+  }
+
+  std::cout << "Input pipeline benchmark: " << options.joysticks << " controllers (" << num_axes << " axes, "
+            << num_hats << " hat, " << num_buttons << " buttons), " << options.handlers
+            << " callback(s) per axis/button, ";
+  if (options.rate > 0.0) {
+    std::cout << options.rate << " events/s";
+  } else {
+    std::cout << "unlimited rate";
+  }
+  std::cout << " for " << options.duration << " s\n";
+  std::cout << "  pushed:     " << pushed << " events (" << refused << " refused by a full SDL queue)\n";
+  std::cout << "  dispatched: " << received << " (axis " << delivered_by_type[0] << ", hat " << delivered_by_type[1]
+            << ", button " << delivered_by_type[2] << "); " << element_callbacks << " element callbacks\n";
+  std::cout << "  throughput: " << std::fixed << std::setprecision(0) << received / total_seconds
+            << " events/s (pushed " << pushed / inject_seconds << " events/s)\n";
+  std::cout << "  push -> dispatch latency (us):       " << percentiles(latencies) << "\n";
+  std::cout << "  Joystick::at_index, idle (us):        " << percentiles(idle_lock_times) << "\n";
+  std::cout << "  Joystick::at_index, " << options.contenders << " thread(s) under load (us): "
+            << percentiles(loaded_lock_times) << "\n";
+  std::cout << std::setprecision(1);
+  if (std::isnan(process_cpu)) {
+    std::cout << "  CPU:        not available on this platform\n";
+  } else {
+    // Thread CPU times are totals; they are only used once the threads have
+    // finished, and the injector and contenders do nothing else
+    double pipeline_cpu = process_cpu - injector_cpu - contenders_cpu;
+    std::cout << "  CPU:        " << 100.0 * process_cpu / total_seconds << "% of a core for the process; "
+              << 100.0 * pipeline_cpu / total_seconds << "% for the event pipeline alone\n";
+  }
+  if (received != pushed) {
+    std::cout << "  WARNING: " << pushed - received << " events were not dispatched" << std::endl;
+  }
+
+  quit_event_handler();
+  return received == pushed ? 0 : 1;
+#endif
+}
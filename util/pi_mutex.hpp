@@ -0,0 +1,90 @@
+#pragma once
+
+#include <mutex>
+#include <system_error>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+namespace hebi {
+namespace util {
+
+/**
+ * A mutex that uses priority inheritance where the platform supports it (on
+ * Linux): while a real time thread waits for the mutex, the thread holding it
+ * runs at the waiter's priority, so that a lower priority thread (e.g. a UI
+ * thread editing shared state) can't hold up a control loop indefinitely by
+ * being preempted with the lock held.  Elsewhere this is a plain std::mutex.
+ *
+ * Meets the standard Lockable requirements, so it works with
+ * std::lock_guard, std::unique_lock and util::tracedLock; use
+ * std::condition_variable_any to wait on it.
+ *
+ * Priority inheritance only matters for threads with real time scheduling
+ * policies (SCHED_FIFO/SCHED_RR); it does not make the critical sections any
+ * shorter, so keep them bounded.
+ */
+class PiMutex
+{
+public:
+#ifdef __linux__
+  PiMutex()
+  {
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    priority_inheritance_ = pthread_mutexattr_setprotocol(&attributes, PTHREAD_PRIO_INHERIT) == 0;
+    int res = pthread_mutex_init(&mutex_, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+    if (res != 0)
+      throw std::system_error(res, std::system_category(), "pthread_mutex_init");
+  }
+
+  ~PiMutex()
+  {
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  void lock()
+  {
+    int res = pthread_mutex_lock(&mutex_);
+    if (res != 0)
+      throw std::system_error(res, std::system_category(), "pthread_mutex_lock");
+  }
+
+  bool try_lock()
+  {
+    return pthread_mutex_trylock(&mutex_) == 0;
+  }
+
+  void unlock()
+  {
+    pthread_mutex_unlock(&mutex_);
+  }
+#else
+  PiMutex() = default;
+
+  void lock() { mutex_.lock(); }
+  bool try_lock() { return mutex_.try_lock(); }
+  void unlock() { mutex_.unlock(); }
+#endif
+
+  PiMutex(const PiMutex&) = delete;
+  PiMutex& operator=(const PiMutex&) = delete;
+
+  /**
+   * True if waiting threads actually lend their priority to the owner.
+   */
+  bool hasPriorityInheritance() const { return priority_inheritance_; }
+
+private:
+#ifdef __linux__
+  pthread_mutex_t mutex_;
+#else
+  std::mutex mutex_;
+#endif
+  bool priority_inheritance_{false};
+};
+
+} // namespace util
+} // namespace hebi
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace hebi {
+namespace util {
+
+/**
+ * A multi-joint trajectory made of one quintic polynomial per joint and
+ * segment between waypoints.  Has the same `getState` interface as
+ * hebi::trajectory::Trajectory; create it with a QuinticSplineBuilder.
+ */
+class QuinticSpline
+{
+public:
+  /**
+   * @param times Waypoint times, strictly increasing.
+   * @param coefficients For each segment, a 6 x (number of joints) matrix of
+   * polynomial coefficients (constant term first) in the time since the start
+   * of the segment.
+   */
+  QuinticSpline(Eigen::VectorXd times, std::vector<Eigen::MatrixXd> coefficients)
+    : times_(std::move(times)), coefficients_(std::move(coefficients))
+  {
+  }
+
+  /**
+   * Evaluates the trajectory at the given time; times outside of the
+   * trajectory are clamped to its start or end.  Any of the outputs may be
+   * null.
+   */
+  bool getState(double time, Eigen::VectorXd* position, Eigen::VectorXd* velocity, Eigen::VectorXd* acceleration) const
+  {
+    time = std::min(std::max(time, getStartTime()), getEndTime());
+    size_t segment = static_cast<size_t>(std::upper_bound(times_.data() + 1, times_.data() + times_.size() - 1, time) - (times_.data() + 1));
+    const Eigen::MatrixXd& c = coefficients_[segment];
+    double t = time - times_[segment];
+    double t2 = t * t;
+    double t3 = t2 * t;
+    if (position)
+      *position = (c.row(0) + t * c.row(1) + t2 * c.row(2) + t3 * c.row(3) + t2 * t2 * c.row(4) + t3 * t2 * c.row(5)).transpose();
+    if (velocity)
+      *velocity = (c.row(1) + 2 * t * c.row(2) + 3 * t2 * c.row(3) + 4 * t3 * c.row(4) + 5 * t2 * t2 * c.row(5)).transpose();
+    if (acceleration)
+      *acceleration = (2 * c.row(2) + 6 * t * c.row(3) + 12 * t2 * c.row(4) + 20 * t3 * c.row(5)).transpose();
+    return true;
+  }
+
+  double getStartTime() const { return times_[0]; }
+  double getEndTime() const { return times_[times_.size() - 1]; }
+  double getDuration() const { return getEndTime() - getStartTime(); }
+  size_t getJointCount() const { return static_cast<size_t>(coefficients_[0].cols()); }
+
+private:
+  Eigen::VectorXd times_;
+  std::vector<Eigen::MatrixXd> coefficients_;
+};
+
+/**
+ * Builds minimum-jerk quintic splines through waypoints, like
+ * hebi::trajectory::Trajectory::createUnconstrainedQp: positions are always
+ * given, and velocities and accelerations are either given or (NaN) left free
+ * and chosen to minimize the integral of squared jerk, with continuous
+ * velocity and acceleration at every waypoint.
+ *
+ * The free values solve a small linear system that only depends on the
+ * segment durations and on which values are free.  The builder caches the
+ * solution of that system (as the matrix taking the given values to the free
+ * ones) for each distinct time grid and pattern, so creating a trajectory on a
+ * grid that has been seen before (e.g., every leg's step on the same phase
+ * grid) costs one small matrix product per joint instead of a factorization.
+ * Use `createUncached` for one-off grids, so they don't evict useful entries.
+ *
+ * The cache is bounded, and evicts its oldest entry when full.  A builder is
+ * not thread safe; give each thread its own (`createUncached` may be called
+ * from anywhere).
+ */
+class QuinticSplineBuilder
+{
+public:
+  struct Statistics
+  {
+    uint64_t hits_;
+    uint64_t misses_;
+    size_t cached_systems_;
+  };
+
+  explicit QuinticSplineBuilder(size_t max_cached_systems = 32)
+    : max_cached_systems_(std::max<size_t>(max_cached_systems, 1))
+  {
+  }
+
+  /**
+   * Creates a trajectory through the given waypoints (one column per
+   * waypoint, one row per joint).  NaN velocities or accelerations are free.
+   * If velocities or accelerations are null, they are zero at the ends and
+   * free in between.  Returns null if the input is invalid.
+   */
+  std::shared_ptr<QuinticSpline> create(const Eigen::VectorXd& times, const Eigen::MatrixXd& positions,
+    const Eigen::MatrixXd* velocities = nullptr, const Eigen::MatrixXd* accelerations = nullptr)
+  {
+    return build(times, positions, velocities, accelerations, this);
+  }
+
+  /**
+   * As `create`, but always solves the system from scratch, and does not
+   * touch any cache.
+   */
+  static std::shared_ptr<QuinticSpline> createUncached(const Eigen::VectorXd& times, const Eigen::MatrixXd& positions,
+    const Eigen::MatrixXd* velocities = nullptr, const Eigen::MatrixXd* accelerations = nullptr)
+  {
+    return build(times, positions, velocities, accelerations, nullptr);
+  }
+
+  Statistics getStatistics() const
+  {
+    return Statistics{ hits_, misses_, systems_.size() };
+  }
+
+private:
+  // Everything about a trajectory that only depends on the segment durations
+  // and the pattern of free values.
+  struct System
+  {
+    // Free values (in the order of `free_`) = solve_ * given values (in the
+    // order of `given_`)
+    Eigen::MatrixXd solve_;
+    // Indices into the per-waypoint [p v a] state vector
+    std::vector<int> free_;
+    std::vector<int> given_;
+    // For each segment, the map from its boundary states [p0 v0 a0 p1 v1 a1]
+    // to its polynomial coefficients
+    std::vector<Eigen::Matrix<double, 6, 6>> to_coefficients_;
+  };
+
+  // Segment durations, and which velocities/accelerations are free (two flags
+  // per waypoint)
+  using Key = std::pair<std::vector<double>, std::vector<bool>>;
+
+  static std::shared_ptr<const System> solveSystem(const Key& key)
+  {
+    const std::vector<double>& durations = key.first;
+    const std::vector<bool>& is_free = key.second;
+    int num_states = 3 * static_cast<int>(durations.size() + 1);
+    std::shared_ptr<System> system = std::make_shared<System>();
+
+    // Sum the jerk cost of each segment, as a quadratic form in its boundary
+    // states
+    Eigen::MatrixXd cost = Eigen::MatrixXd::Zero(num_states, num_states);
+    for (size_t k = 0; k < durations.size(); ++k)
+    {
+      double T = durations[k];
+      Eigen::Matrix<double, 6, 6> boundary;
+      boundary << 1, 0, 0, 0, 0, 0,
+                  0, 1, 0, 0, 0, 0,
+                  0, 0, 2, 0, 0, 0,
+                  1, T, T * T, T * T * T, T * T * T * T, T * T * T * T * T,
+                  0, 1, 2 * T, 3 * T * T, 4 * T * T * T, 5 * T * T * T * T,
+                  0, 0, 2, 6 * T, 12 * T * T, 20 * T * T * T;
+      Eigen::Matrix<double, 6, 6> to_coefficients = boundary.inverse();
+      system->to_coefficients_.push_back(to_coefficients);
+
+      // Integral of jerk^2 over [0, T], in terms of the coefficients
+      Eigen::Matrix<double, 6, 6> jerk = Eigen::Matrix<double, 6, 6>::Zero();
+      jerk.bottomRightCorner<3, 3>() << 36 * T, 72 * T * T, 120 * T * T * T,
+                                        72 * T * T, 192 * T * T * T, 360 * T * T * T * T,
+                                        120 * T * T * T, 360 * T * T * T * T, 720 * T * T * T * T * T;
+      cost.block<6, 6>(3 * k, 3 * k) += to_coefficients.transpose() * jerk * to_coefficients;
+    }
+
+    // Positions are always given
+    for (int i = 0; i < num_states; ++i)
+    {
+      if (i % 3 != 0 && is_free[(i / 3) * 2 + (i % 3) - 1])
+        system->free_.push_back(i);
+      else
+        system->given_.push_back(i);
+    }
+
+    // Minimize over the free values: H * free = -G * given
+    int num_free = static_cast<int>(system->free_.size());
+    int num_given = static_cast<int>(system->given_.size());
+    Eigen::MatrixXd H(num_free, num_free);
+    Eigen::MatrixXd G(num_free, num_given);
+    for (int i = 0; i < num_free; ++i)
+    {
+      for (int j = 0; j < num_free; ++j)
+        H(i, j) = cost(system->free_[i], system->free_[j]);
+      for (int j = 0; j < num_given; ++j)
+        G(i, j) = cost(system->free_[i], system->given_[j]);
+    }
+    if (num_free > 0)
+    {
+      Eigen::LDLT<Eigen::MatrixXd> ldlt(H);
+      if (ldlt.info() == Eigen::Success && ldlt.isPositive() && ldlt.rcond() > 1e-12)
+        system->solve_ = -ldlt.solve(G);
+      else // Not unique (e.g., everything free between two waypoints); take the smallest
+        system->solve_ = -H.completeOrthogonalDecomposition().solve(G);
+    }
+    else
+    {
+      system->solve_.resize(0, num_given);
+    }
+    return system;
+  }
+
+  std::shared_ptr<const System> getSystem(const Key& key)
+  {
+    auto found = systems_.find(key);
+    if (found != systems_.end())
+    {
+      ++hits_;
+      return found->second;
+    }
+    ++misses_;
+    std::shared_ptr<const System> system = solveSystem(key);
+    systems_.emplace(key, system);
+    insertion_order_.push_back(key);
+    if (insertion_order_.size() > max_cached_systems_)
+    {
+      systems_.erase(insertion_order_.front());
+      insertion_order_.pop_front();
+    }
+    return system;
+  }
+
+  static std::shared_ptr<QuinticSpline> build(const Eigen::VectorXd& times, const Eigen::MatrixXd& positions,
+    const Eigen::MatrixXd* velocities, const Eigen::MatrixXd* accelerations, QuinticSplineBuilder* cache)
+  {
+    int num_waypoints = static_cast<int>(times.size());
+    int num_joints = static_cast<int>(positions.rows());
+    if (num_waypoints < 2 || num_joints < 1 || positions.cols() != num_waypoints ||
+        (velocities && (velocities->rows() != num_joints || velocities->cols() != num_waypoints)) ||
+        (accelerations && (accelerations->rows() != num_joints || accelerations->cols() != num_waypoints)) ||
+        !positions.allFinite())
+      return nullptr;
+
+    std::vector<double> durations(num_waypoints - 1);
+    for (int i = 0; i + 1 < num_waypoints; ++i)
+    {
+      durations[i] = times[i + 1] - times[i];
+      if (!(durations[i] > 0))
+        return nullptr;
+    }
+
+    auto value = [num_waypoints](const Eigen::MatrixXd* values, int joint, int waypoint) {
+      if (values)
+        return (*values)(joint, waypoint);
+      return (waypoint == 0 || waypoint == num_waypoints - 1) ? 0.0 : std::nan("");
+    };
+
+    std::vector<Eigen::MatrixXd> coefficients(num_waypoints - 1, Eigen::MatrixXd(6, num_joints));
+    Key key(std::move(durations), std::vector<bool>(2 * num_waypoints));
+    Eigen::VectorXd states(3 * num_waypoints);
+    std::shared_ptr<const System> system;
+    for (int joint = 0; joint < num_joints; ++joint)
+    {
+      std::vector<bool> is_free(2 * num_waypoints);
+      for (int i = 0; i < num_waypoints; ++i)
+      {
+        states[3 * i] = positions(joint, i);
+        states[3 * i + 1] = value(velocities, joint, i);
+        states[3 * i + 2] = value(accelerations, joint, i);
+        is_free[2 * i] = std::isnan(states[3 * i + 1]);
+        is_free[2 * i + 1] = std::isnan(states[3 * i + 2]);
+      }
+      // Joints usually share a pattern; only look the system up again if not
+      if (!system || is_free != key.second)
+      {
+        key.second = std::move(is_free);
+        system = cache ? cache->getSystem(key) : solveSystem(key);
+      }
+
+      Eigen::VectorXd given(system->given_.size());
+      for (size_t i = 0; i < system->given_.size(); ++i)
+        given[i] = states[system->given_[i]];
+      if (!given.allFinite())
+        return nullptr;
+      Eigen::VectorXd free = system->solve_ * given;
+      for (size_t i = 0; i < system->free_.size(); ++i)
+        states[system->free_[i]] = free[i];
+
+      for (int k = 0; k + 1 < num_waypoints; ++k)
+        coefficients[k].col(joint) = system->to_coefficients_[k] * states.segment<6>(3 * k);
+    }
+    return std::make_shared<QuinticSpline>(times, std::move(coefficients));
+  }
+
+  const size_t max_cached_systems_;
+  std::map<Key, std::shared_ptr<const System>> systems_;
+  std::deque<Key> insertion_order_;
+  uint64_t hits_{0};
+  uint64_t misses_{0};
+};
+
+} // namespace util
+} // namespace hebi
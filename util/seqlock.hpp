@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace hebi {
+namespace util {
+
+/**
+ * A sequence lock, for sharing the latest value of a small, trivially copyable
+ * struct (a few scalars or fixed-size arrays) with any number of reader
+ * threads.
+ *
+ * Readers never block the writer and never see a partially written value:
+ * `load` copies the value, and retries if a write happened meanwhile
+ * (`tryLoad` makes a single attempt).  Writers only wait for each other, so
+ * this is meant for one writer thread, with at most occasional writes from
+ * elsewhere.  Neither side allocates.
+ *
+ * The value is stored as atomic words, so concurrent reads and writes are not
+ * data races.  Each word is written with release and read with acquire
+ * ordering (rather than using fences, which ThreadSanitizer doesn't
+ * understand): a reader that sees any word of a write also sees that write's
+ * odd sequence number when it checks the sequence again.
+ */
+template <typename T>
+class Seqlock
+{
+  static_assert(std::is_trivially_copyable<T>::value, "Seqlock values must be trivially copyable");
+
+public:
+  Seqlock() : Seqlock(T()) {}
+
+  explicit Seqlock(const T& initial)
+  {
+    storeWords(initial);
+  }
+
+  Seqlock(const Seqlock&) = delete;
+  Seqlock& operator=(const Seqlock&) = delete;
+
+  /**
+   * Replaces the value.  Only waits if another thread is writing.
+   */
+  void store(const T& value)
+  {
+    // Claim the write by making the sequence odd.
+    uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+    while ((sequence & 1) != 0 ||
+           !sequence_.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire, std::memory_order_relaxed))
+      sequence = sequence_.load(std::memory_order_relaxed);
+    storeWords(value);
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  /**
+   * Copies the value into 'value' if no write was in progress or happened
+   * during the copy; returns false (and leaves 'value' unspecified) otherwise.
+   */
+  bool tryLoad(T& value) const
+  {
+    uint64_t before = sequence_.load(std::memory_order_acquire);
+    if ((before & 1) != 0)
+      return false;
+    loadWords(value);
+    return sequence_.load(std::memory_order_relaxed) == before;
+  }
+
+  /**
+   * Returns a consistent copy of the value, retrying while it is being
+   * written.
+   */
+  T load() const
+  {
+    T value;
+    while (!tryLoad(value))
+      ;
+    return value;
+  }
+
+  /**
+   * The number of completed writes; can be used to tell if the value changed.
+   */
+  uint64_t getVersion() const
+  {
+    return sequence_.load(std::memory_order_acquire) / 2;
+  }
+
+private:
+  static constexpr size_t num_words_ = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  void storeWords(const T& value)
+  {
+    uint64_t words[num_words_] = {};
+    std::memcpy(words, &value, sizeof(T));
+    for (size_t i = 0; i < num_words_; ++i)
+      words_[i].store(words[i], std::memory_order_release);
+  }
+
+  void loadWords(T& value) const
+  {
+    uint64_t words[num_words_];
+    for (size_t i = 0; i < num_words_; ++i)
+      words[i] = words_[i].load(std::memory_order_acquire);
+    std::memcpy(&value, words, sizeof(T));
+  }
+
+  std::atomic<uint64_t> sequence_{0};
+  std::atomic<uint64_t> words_[num_words_];
+};
+
+template <typename T> constexpr size_t Seqlock<T>::num_words_;
+
+} // namespace util
+} // namespace hebi
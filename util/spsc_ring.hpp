@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace hebi {
+namespace util {
+
+/**
+ * A bounded, lock-free queue from a single producer thread to a single
+ * consumer thread, for handing off every item (e.g. log records or events) in
+ * order, rather than just the latest value (see util::TripleBuffer).
+ *
+ * `tryPush` fails rather than waits when the queue is full, and `tryPop` fails
+ * when it is empty; neither allocates.  Capacity must be a power of two.
+ */
+template <typename T, size_t Capacity>
+class SpscRing
+{
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+  SpscRing() = default;
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  static constexpr size_t capacity() { return Capacity; }
+
+  ////////////////////////////////////////////////////////////////////////////
+  // Producer side
+
+  /**
+   * Adds an item to the back of the queue; returns false if the queue is full.
+   */
+  bool tryPush(const T& item)
+  {
+    return emplace([&item] (T& slot) { slot = item; });
+  }
+
+  bool tryPush(T&& item)
+  {
+    return emplace([&item] (T& slot) { slot = std::move(item); });
+  }
+
+  ////////////////////////////////////////////////////////////////////////////
+  // Consumer side
+
+  /**
+   * Moves the item at the front of the queue into 'item'; returns false if the
+   * queue is empty.
+   */
+  bool tryPop(T& item)
+  {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_)
+    {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_)
+        return false;
+    }
+    item = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////
+  // Either side
+
+  /**
+   * The number of items in the queue; only a snapshot if the other side is
+   * active.
+   */
+  size_t size() const
+  {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+
+  bool empty() const { return size() == 0; }
+
+private:
+  static constexpr size_t mask_ = Capacity - 1;
+
+  template <typename Assign>
+  bool emplace(Assign assign)
+  {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == Capacity)
+    {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ == Capacity)
+        return false;
+    }
+    assign(slots_[tail & mask_]);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  T slots_[Capacity];
+
+  // Padded so the producer and consumer don't share cache lines.
+  char slots_padding_[64];
+
+  // Consumer side; 'cached_tail_' is its last look at 'tail_'.
+  std::atomic<size_t> head_{0};
+  size_t cached_tail_{0};
+  char head_padding_[64];
+
+  // Producer side; 'cached_head_' is its last look at 'head_'.
+  std::atomic<size_t> tail_{0};
+  size_t cached_head_{0};
+};
+
+template <typename T, size_t Capacity> constexpr size_t SpscRing<T, Capacity>::mask_;
+
+} // namespace util
+} // namespace hebi
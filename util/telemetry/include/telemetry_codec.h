@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hebi {
+namespace util {
+
+/**
+ * One telemetry signal. Values are quantized to a multiple of `resolution`
+ * before they are sent, so pick the coarsest resolution that is still useful;
+ * it directly determines how many bytes each change costs.
+ */
+struct TelemetryChannel {
+  std::string name;
+  double resolution;
+};
+
+/**
+ * A reconstructed telemetry frame. Channels that were invalid (NaN) when the
+ * frame was sampled are NaN here as well.
+ */
+struct TelemetryFrame {
+  // Sampling time, in seconds since the sender started
+  double time;
+  bool keyframe;
+  std::vector<double> values;
+};
+
+//------------------------------------------------------------------------------
+// Wire format
+//
+// Every packet starts with a fixed header:
+//   'H' 'T' version(u8) type(u8) session(u32) sequence(u32)
+// where multi-byte integers are little endian, `session` is chosen at random
+// by each sender, and `sequence` counts packets within a session.
+//
+// A schema packet (type 0) then holds varint(channel count), followed by
+// varint(name length) and the name bytes for each channel.
+//
+// A data packet (type 1) holds varint(frame count) frames, each:
+//   flags(u8)       bit 0: keyframe; bit 1: an invalid channel mask follows
+//   varint(time)    sampling time in ms since the sender started
+//   keyframes only: varint(channel count), then each resolution (f32)
+//   mask            if flagged: one bit per channel, set if the value is NaN
+//   values          zigzag varint per valid channel: the quantized value for
+//                   keyframes, else the change since the previous frame
+//
+// Deltas are taken between quantized values, so reconstruction is exact (to
+// the resolution) and does not drift. A lost packet breaks the delta chain,
+// so the receiver drops frames until the next keyframe.
+
+namespace telemetry {
+
+const uint8_t protocol_version = 1;
+const uint8_t packet_type_schema = 0;
+const uint8_t packet_type_data = 1;
+const size_t header_size = 12;
+
+// Maps signed integers to unsigned ones so that values near zero (of either
+// sign) have short varint encodings.
+inline uint64_t zigzag_encode(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// LEB128: 7 bits per byte, least significant first; high bit set on all
+// but the last byte.
+inline void append_varint(std::vector<uint8_t>& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+// Returns false (leaving `pos` unspecified) on truncated or overlong input.
+inline bool read_varint(const uint8_t* data, size_t size, size_t& pos, uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (pos >= size) {
+      return false;
+    }
+    uint8_t byte = data[pos++];
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace telemetry
+
+//------------------------------------------------------------------------------
+
+/**
+ * Turns a stream of sampled frames into packets (see the wire format above).
+ *
+ * Frames are batched `frames_per_packet` at a time, to amortize the packet
+ * and UDP/IP headers; keyframes are sent every `keyframe_interval` frames.
+ * Buffers are allocated up front, so encoding does not allocate.
+ */
+class TelemetryEncoder {
+
+public:
+
+  TelemetryEncoder(const std::vector<TelemetryChannel>& channels,
+    size_t keyframe_interval, size_t frames_per_packet, uint32_t session);
+
+  const std::vector<TelemetryChannel>& channels() const { return channels_; }
+
+  /**
+   * Adds a frame of `channels().size()` values, sampled at `time` seconds
+   * since the sender started. Returns true if a data packet is now ready (see
+   * `packet`); it must be used before the next call.
+   */
+  bool add_frame(double time, const double* values);
+
+  /**
+   * Ends the current packet early, e.g. on shutdown. Returns true if there
+   * was anything in it.
+   */
+  bool flush();
+
+  // The last completed packet
+  const std::vector<uint8_t>& packet() const { return packet_; }
+
+  /**
+   * Builds a schema packet (channel names) into `packet()`. Receivers can
+   * decode data without it, so it only needs to be sent occasionally.
+   */
+  void make_schema_packet();
+
+  // Requests that the next frame is a keyframe (e.g., after a send error).
+  void force_keyframe() { frames_since_keyframe_ = keyframe_interval_; }
+
+private:
+
+  void begin_packet(uint8_t type);
+  void finish_packet();
+
+  std::vector<TelemetryChannel> channels_;
+  size_t keyframe_interval_;
+  size_t frames_per_packet_;
+  uint32_t session_;
+  uint32_t sequence_{0};
+
+  size_t frames_since_keyframe_;
+  std::vector<int64_t> reference_;
+  std::vector<uint8_t> mask_;
+
+  // Frames of the packet being built
+  std::vector<uint8_t> body_;
+  size_t body_frames_{0};
+  std::vector<uint8_t> packet_;
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * Reconstructs frames from packets produced by a TelemetryEncoder.
+ */
+class TelemetryDecoder {
+
+public:
+
+  struct Statistics {
+    uint64_t packets;
+    uint64_t bytes;
+    // Packets missing from the sequence, or that could not be parsed
+    uint64_t lost_packets;
+    uint64_t bad_packets;
+    uint64_t frames;
+    // Delta frames that could not be used because of an earlier loss, or
+    // because no keyframe had been received yet (joining mid-stream)
+    uint64_t dropped_frames;
+    uint64_t sessions;
+  };
+
+  /**
+   * Decodes one packet, appending any reconstructed frames to `frames`.
+   * Returns false if the packet was malformed.
+   */
+  bool decode(const uint8_t* data, size_t size, std::vector<TelemetryFrame>& frames);
+
+  // Channel names, once a schema packet has been received (else empty)
+  const std::vector<std::string>& channel_names() const { return names_; }
+  // Channel resolutions, once a keyframe has been received (else empty)
+  const std::vector<double>& channel_resolutions() const { return resolutions_; }
+
+  const Statistics& statistics() const { return stats_; }
+
+private:
+
+  bool decode_schema(const uint8_t* data, size_t size, size_t pos);
+  bool decode_data(const uint8_t* data, size_t size, size_t pos, std::vector<TelemetryFrame>& frames);
+
+  bool have_session_{false};
+  uint32_t session_{0};
+  uint32_t next_sequence_{0};
+  // True if `reference_` holds the previous frame of the current session
+  bool synchronized_{false};
+  // True once a keyframe of the current session has given the channel count
+  bool have_keyframe_{false};
+  std::vector<int64_t> reference_;
+  std::vector<bool> valid_;
+  std::vector<double> resolutions_;
+  std::vector<std::string> names_;
+  Statistics stats_{};
+};
+
+}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "telemetry_codec.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace hebi {
+namespace util {
+
+// For internal use only.
+class UdpSocket;
+
+/**
+ * Receives a telemetry stream sent by a TelemetrySender, and reconstructs the
+ * frames.
+ */
+class TelemetryReceiver {
+
+public:
+
+  TelemetryReceiver();
+  ~TelemetryReceiver();
+
+  TelemetryReceiver(const TelemetryReceiver&) = delete;
+  TelemetryReceiver& operator=(const TelemetryReceiver&) = delete;
+
+  /**
+   * Listens on the given UDP port (on all interfaces).
+   */
+  bool open(uint16_t port);
+
+  /**
+   * Waits up to `timeout_ms` for a packet, and appends any frames it holds
+   * to `frames`. Returns false on timeout or a socket error; a malformed
+   * packet is counted in the statistics but still returns true.
+   */
+  bool receive(std::vector<TelemetryFrame>& frames, int timeout_ms);
+
+  // Channel names/resolutions, and loss statistics
+  const TelemetryDecoder& decoder() const { return decoder_; }
+
+private:
+
+  std::unique_ptr<UdpSocket> socket_;
+  std::vector<uint8_t> buffer_;
+  TelemetryDecoder decoder_;
+};
+
+}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "telemetry_codec.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace hebi {
+namespace util {
+
+struct TelemetrySenderOptions {
+  // How often the latest published values are sampled and encoded
+  double sample_rate_hz = 50.0;
+  // Time between keyframes, which bounds how long a lost packet affects the
+  // receiver
+  double keyframe_interval_s = 1.0;
+  // Frames batched into each packet (adds up to this many sample periods of
+  // latency, but saves the per-packet overhead of ~40 bytes)
+  size_t frames_per_packet = 5;
+  // Time between schema (channel name) packets
+  double schema_interval_s = 10.0;
+};
+
+// For internal use only.
+class TelemetrySenderImpl;
+
+/**
+ * Streams controller state to a base station over UDP.
+ *
+ * The control loop calls `publish` with its latest values (this only copies
+ * them into a lock-free slot); a background thread samples the most recent
+ * values at a fixed rate, delta-encodes and quantizes them (see
+ * telemetry_codec.h), and sends them. Use a TelemetryReceiver (or the
+ * `telemetry_monitor` tool) on the other end.
+ */
+class TelemetrySender {
+
+public:
+
+  struct Statistics {
+    uint64_t frames;
+    uint64_t packets;
+    // UDP payload bytes sent
+    uint64_t bytes;
+    uint64_t send_errors;
+  };
+
+  TelemetrySender(const std::vector<TelemetryChannel>& channels,
+    const TelemetrySenderOptions& options = TelemetrySenderOptions());
+  ~TelemetrySender();
+
+  TelemetrySender(const TelemetrySender&) = delete;
+  TelemetrySender& operator=(const TelemetrySender&) = delete;
+
+  /**
+   * Starts sending to the given host (a name or dotted address) and port.
+   * Returns false if the host could not be resolved or the socket opened.
+   */
+  bool start(const std::string& host, uint16_t port);
+
+  /**
+   * Sends any partially filled packet, and stops the background thread.
+   */
+  void stop();
+
+  size_t channel_count() const;
+
+  /**
+   * Hands off the latest `channel_count()` values; NaN marks a value as
+   * invalid. Call from one thread at a time; does not block or allocate.
+   */
+  void publish(const double* values);
+
+  Statistics statistics() const;
+
+private:
+
+  std::unique_ptr<TelemetrySenderImpl> impl_;
+};
+
+}
+}
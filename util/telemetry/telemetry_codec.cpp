@@ -0,0 +1,313 @@
+#include "telemetry_codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace hebi {
+namespace util {
+
+using namespace telemetry;
+
+static void append_u32(std::vector<uint8_t>& out, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+static uint32_t read_u32(const uint8_t* data) {
+  return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+         (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+static void append_f32(std::vector<uint8_t>& out, float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  append_u32(out, bits);
+}
+
+static float read_f32(const uint8_t* data) {
+  uint32_t bits = read_u32(data);
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// Quantized values are clamped well inside the int64 range, so that deltas
+// between them can't overflow.
+static int64_t quantize(double value, double resolution) {
+  const double limit = static_cast<double>(std::numeric_limits<int64_t>::max() / 4);
+  double scaled = std::round(value / resolution);
+  if (scaled > limit) {
+    scaled = limit;
+  } else if (scaled < -limit) {
+    scaled = -limit;
+  }
+  return static_cast<int64_t>(scaled);
+}
+
+//------------------------------------------------------------------------------
+// TelemetryEncoder
+
+TelemetryEncoder::TelemetryEncoder(const std::vector<TelemetryChannel>& channels,
+  size_t keyframe_interval, size_t frames_per_packet, uint32_t session)
+  : channels_(channels),
+    keyframe_interval_(keyframe_interval > 0 ? keyframe_interval : 1),
+    frames_per_packet_(frames_per_packet > 0 ? frames_per_packet : 1),
+    session_(session),
+    frames_since_keyframe_(keyframe_interval_),
+    reference_(channels.size(), 0),
+    mask_((channels.size() + 7) / 8) {
+  // Worst case per frame: flags, time, count, resolutions, mask, and 10 bytes
+  // per value; plus some slack for the frame count.
+  size_t max_frame = 1 + 10 + 10 + 4 * channels.size() + mask_.size() + 10 * channels.size();
+  body_.reserve(frames_per_packet_ * max_frame + 10);
+  packet_.reserve(header_size + body_.capacity());
+  size_t max_schema = header_size + 10;
+  for (auto& channel : channels_) {
+    max_schema += 10 + channel.name.size();
+  }
+  if (max_schema > packet_.capacity()) {
+    packet_.reserve(max_schema);
+  }
+}
+
+bool TelemetryEncoder::add_frame(double time, const double* values) {
+  bool keyframe = frames_since_keyframe_ >= keyframe_interval_;
+  frames_since_keyframe_ = keyframe ? 1 : frames_since_keyframe_ + 1;
+
+  bool any_invalid = false;
+  std::fill(mask_.begin(), mask_.end(), 0);
+  for (size_t i = 0; i < channels_.size(); ++i) {
+    if (std::isnan(values[i])) {
+      mask_[i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+      any_invalid = true;
+    }
+  }
+
+  body_.push_back(static_cast<uint8_t>((keyframe ? 1 : 0) | (any_invalid ? 2 : 0)));
+  append_varint(body_, static_cast<uint64_t>(std::max(0.0, std::round(time * 1000.0))));
+  if (keyframe) {
+    append_varint(body_, channels_.size());
+    for (auto& channel : channels_) {
+      append_f32(body_, static_cast<float>(channel.resolution));
+    }
+  }
+  if (any_invalid) {
+    body_.insert(body_.end(), mask_.begin(), mask_.end());
+  }
+  for (size_t i = 0; i < channels_.size(); ++i) {
+    if (std::isnan(values[i])) {
+      // The receiver can't know the reference of a channel that was invalid
+      // at a keyframe, so both sides restart it from zero.
+      if (keyframe) {
+        reference_[i] = 0;
+      }
+      continue;
+    }
+    // Quantize with the resolution as the receiver will see it
+    int64_t quantized = quantize(values[i], static_cast<float>(channels_[i].resolution));
+    append_varint(body_, zigzag_encode(keyframe ? quantized : quantized - reference_[i]));
+    reference_[i] = quantized;
+  }
+
+  if (++body_frames_ < frames_per_packet_) {
+    return false;
+  }
+  finish_packet();
+  return true;
+}
+
+bool TelemetryEncoder::flush() {
+  if (body_frames_ == 0) {
+    return false;
+  }
+  finish_packet();
+  return true;
+}
+
+void TelemetryEncoder::make_schema_packet() {
+  begin_packet(packet_type_schema);
+  append_varint(packet_, channels_.size());
+  for (auto& channel : channels_) {
+    append_varint(packet_, channel.name.size());
+    packet_.insert(packet_.end(), channel.name.begin(), channel.name.end());
+  }
+}
+
+void TelemetryEncoder::begin_packet(uint8_t type) {
+  packet_.clear();
+  packet_.push_back('H');
+  packet_.push_back('T');
+  packet_.push_back(protocol_version);
+  packet_.push_back(type);
+  append_u32(packet_, session_);
+  append_u32(packet_, sequence_++);
+}
+
+void TelemetryEncoder::finish_packet() {
+  begin_packet(packet_type_data);
+  append_varint(packet_, body_frames_);
+  packet_.insert(packet_.end(), body_.begin(), body_.end());
+  body_.clear();
+  body_frames_ = 0;
+}
+
+//------------------------------------------------------------------------------
+// TelemetryDecoder
+
+bool TelemetryDecoder::decode(const uint8_t* data, size_t size, std::vector<TelemetryFrame>& frames) {
+  ++stats_.packets;
+  stats_.bytes += size;
+  if (size < header_size || data[0] != 'H' || data[1] != 'T' || data[2] != protocol_version) {
+    ++stats_.bad_packets;
+    return false;
+  }
+  uint8_t type = data[3];
+  uint32_t session = read_u32(data + 4);
+  uint32_t sequence = read_u32(data + 8);
+
+  if (!have_session_ || session != session_) {
+    // A new sender (or a restarted one): start over.
+    have_session_ = true;
+    session_ = session;
+    synchronized_ = false;
+    have_keyframe_ = false;
+    names_.clear();
+    resolutions_.clear();
+    ++stats_.sessions;
+  } else if (sequence != next_sequence_) {
+    uint32_t gap = sequence - next_sequence_;
+    if (gap >= 0x80000000u) {
+      // Older than what we've already seen (duplicate or reordered); drop it.
+      ++stats_.bad_packets;
+      return false;
+    }
+    stats_.lost_packets += gap;
+    synchronized_ = false;
+  }
+  next_sequence_ = sequence + 1;
+
+  bool ok = false;
+  if (type == packet_type_schema) {
+    ok = decode_schema(data, size, header_size);
+  } else if (type == packet_type_data) {
+    ok = decode_data(data, size, header_size, frames);
+  }
+  if (!ok) {
+    ++stats_.bad_packets;
+    synchronized_ = false;
+  }
+  return ok;
+}
+
+bool TelemetryDecoder::decode_schema(const uint8_t* data, size_t size, size_t pos) {
+  uint64_t count;
+  if (!read_varint(data, size, pos, count) || count > size) {
+    return false;
+  }
+  std::vector<std::string> names;
+  names.reserve(static_cast<size_t>(count));
+  for (uint64_t i = 0; i < count; ++i) {
+    uint64_t length;
+    if (!read_varint(data, size, pos, length) || length > size - pos) {
+      return false;
+    }
+    names.emplace_back(reinterpret_cast<const char*>(data + pos), static_cast<size_t>(length));
+    pos += static_cast<size_t>(length);
+  }
+  names_.swap(names);
+  return true;
+}
+
+bool TelemetryDecoder::decode_data(const uint8_t* data, size_t size, size_t pos, std::vector<TelemetryFrame>& frames) {
+  uint64_t num_frames;
+  if (!read_varint(data, size, pos, num_frames)) {
+    return false;
+  }
+  for (uint64_t f = 0; f < num_frames; ++f) {
+    if (pos >= size) {
+      return false;
+    }
+    uint8_t flags = data[pos++];
+    bool keyframe = (flags & 1) != 0;
+    bool has_mask = (flags & 2) != 0;
+    if (!keyframe && !have_keyframe_) {
+      // Joined mid-stream: without a keyframe the channel count is unknown,
+      // so the rest of the packet can't be parsed (or used) either.
+      stats_.dropped_frames += num_frames - f;
+      return true;
+    }
+    uint64_t time_ms;
+    if (!read_varint(data, size, pos, time_ms)) {
+      return false;
+    }
+
+    if (keyframe) {
+      uint64_t count;
+      if (!read_varint(data, size, pos, count) || count > (size - pos) / 4) {
+        return false;
+      }
+      resolutions_.resize(static_cast<size_t>(count));
+      for (auto& resolution : resolutions_) {
+        resolution = read_f32(data + pos);
+        pos += 4;
+      }
+      reference_.assign(resolutions_.size(), 0);
+      synchronized_ = true;
+      have_keyframe_ = true;
+    }
+    size_t num_channels = resolutions_.size();
+
+    valid_.assign(num_channels, true);
+    if (has_mask) {
+      size_t mask_bytes = (num_channels + 7) / 8;
+      if (mask_bytes > size - pos) {
+        return false;
+      }
+      for (size_t i = 0; i < num_channels; ++i) {
+        valid_[i] = (data[pos + i / 8] & (1 << (i % 8))) == 0;
+      }
+      pos += mask_bytes;
+    }
+
+    // Values must be parsed even if the frame can't be used, to find the
+    // start of the next one.
+    bool usable = synchronized_;
+    TelemetryFrame frame;
+    if (usable) {
+      frame.time = time_ms * 1e-3;
+      frame.keyframe = keyframe;
+      frame.values.resize(num_channels);
+    }
+    for (size_t i = 0; i < num_channels; ++i) {
+      if (!valid_[i]) {
+        if (usable) {
+          frame.values[i] = std::numeric_limits<double>::quiet_NaN();
+        }
+        continue;
+      }
+      uint64_t encoded;
+      if (!read_varint(data, size, pos, encoded)) {
+        return false;
+      }
+      if (usable) {
+        int64_t value = zigzag_decode(encoded);
+        reference_[i] = keyframe ? value : reference_[i] + value;
+        frame.values[i] = reference_[i] * resolutions_[i];
+      }
+    }
+
+    if (usable) {
+      frames.push_back(std::move(frame));
+      ++stats_.frames;
+    } else {
+      ++stats_.dropped_frames;
+    }
+  }
+  return pos == size;
+}
+
+}
+}
@@ -0,0 +1,132 @@
+// Loopback checks of the telemetry codec, without sockets: packets from a
+// TelemetryEncoder are fed straight to a TelemetryDecoder, and every
+// reconstructed frame is compared with what was encoded.
+//
+// Covers a receiver that is there from the start, and receivers that start
+// mid-stream (with keyframes at the start of a packet, and within one); those
+// must count the frames before the first usable keyframe as dropped, not the
+// packets as bad.
+//
+// Returns 0 if every check passes.
+
+#include "telemetry_codec.h"
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace hebi::util;
+
+namespace {
+
+const size_t num_frames = 1000;
+const double sample_period = 0.01;
+
+int num_failures = 0;
+
+void check(bool condition, const std::string& what) {
+  if (!condition) {
+    std::cout << "FAILED: " << what << std::endl;
+    ++num_failures;
+  }
+}
+
+std::vector<TelemetryChannel> test_channels() {
+  std::vector<TelemetryChannel> channels;
+  channels.push_back({ "t", 1e-3 });
+  for (int i = 0; i < 6; ++i) {
+    channels.push_back({ "position_" + std::to_string(i), 1e-3 });
+  }
+  channels.push_back({ "effort", 1e-2 });
+  return channels;
+}
+
+double test_value(size_t channel, size_t frame) {
+  double t = frame * sample_period;
+  if (channel == 0) {
+    return t;
+  }
+  // NaN now and then, to exercise the invalid channel mask
+  if (channel == 7 && frame % 37 == 0) {
+    return std::nan("");
+  }
+  return 2.0 * std::sin(2.0 * M_PI * 0.5 * t + channel);
+}
+
+// Encodes `num_frames` frames, feeds the packets from `first_packet` on to a
+// new decoder, and checks the frames it reconstructs.  `first_usable_frame`
+// is the first keyframe at the start of a packet fed to the decoder.
+void run(const std::string& name, size_t keyframe_interval, size_t frames_per_packet,
+         size_t first_packet, size_t first_usable_frame) {
+  std::vector<TelemetryChannel> channels = test_channels();
+  TelemetryEncoder encoder(channels, keyframe_interval, frames_per_packet, 1234);
+  TelemetryDecoder decoder;
+
+  std::vector<TelemetryFrame> frames;
+  std::vector<double> values(channels.size());
+  size_t packets = 0;
+  bool all_decoded = true;
+  for (size_t f = 0; f < num_frames; ++f) {
+    for (size_t i = 0; i < channels.size(); ++i) {
+      values[i] = test_value(i, f);
+    }
+    if (!encoder.add_frame(f * sample_period, values.data())) {
+      continue;
+    }
+    if (packets++ >= first_packet) {
+      const auto& packet = encoder.packet();
+      all_decoded &= decoder.decode(packet.data(), packet.size(), frames);
+    }
+  }
+
+  const auto& stats = decoder.statistics();
+  size_t fed_frames = num_frames - first_packet * frames_per_packet;
+  size_t expected_dropped = first_usable_frame - first_packet * frames_per_packet;
+  check(all_decoded && stats.bad_packets == 0, name + ": no packet is reported as bad");
+  check(stats.lost_packets == 0, name + ": no packet is reported as lost");
+  check(stats.dropped_frames == expected_dropped,
+        name + ": " + std::to_string(expected_dropped) + " frames dropped before the first keyframe (got " +
+        std::to_string(stats.dropped_frames) + ")");
+  check(frames.size() == fed_frames - expected_dropped, name + ": every later frame is reconstructed");
+  check(!frames.empty() && frames.front().keyframe, name + ": the first frame is a keyframe");
+
+  // Each value to within half its resolution (as sent, in single precision)
+  double max_error_ratio = 0.0;
+  for (size_t k = 0; k < frames.size(); ++k) {
+    size_t f = first_usable_frame + k;
+    const TelemetryFrame& frame = frames[k];
+    if (frame.values.size() != channels.size() || std::fabs(frame.time - f * sample_period) > 1e-3) {
+      max_error_ratio = HUGE_VAL;
+      break;
+    }
+    for (size_t i = 0; i < channels.size(); ++i) {
+      double expected = test_value(i, f);
+      if (std::isnan(expected) != std::isnan(frame.values[i])) {
+        max_error_ratio = HUGE_VAL;
+      } else if (!std::isnan(expected)) {
+        double resolution = static_cast<float>(channels[i].resolution);
+        max_error_ratio = std::max(max_error_ratio, std::fabs(frame.values[i] - expected) / resolution);
+      }
+    }
+  }
+  check(max_error_ratio <= 0.5 + 1e-6, name + ": values are reconstructed to within half the resolution");
+}
+
+}
+
+int main() {
+  // 100 frames per keyframe, 5 frames per packet: keyframes start packets 0, 20, 40...
+  run("from the start", 100, 5, 0, 0);
+  run("mid-stream", 100, 5, 7, 100);
+  // 12 frames per keyframe: the keyframes at frames 12, 24, 36 and 48 fall
+  // within a packet, so the first one usable after packet 1 is frame 60.
+  run("mid-stream, keyframes within packets", 12, 5, 1, 60);
+
+  if (num_failures > 0) {
+    std::cout << num_failures << " check(s) failed." << std::endl;
+    return 1;
+  }
+  std::cout << "All checks passed." << std::endl;
+  return 0;
+}
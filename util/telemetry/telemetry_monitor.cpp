@@ -0,0 +1,209 @@
+// Base station side of the telemetry downlink: listens for a TelemetrySender,
+// and prints the link statistics once a second, or every frame as CSV.
+//
+// With "-l", it also runs a synthetic sender on this machine (41 channels at
+// 100 Hz, to localhost) and checks that every frame is reconstructed to within
+// the channel resolution, to test the whole pipeline without a robot.
+
+#include "telemetry_receiver.h"
+#include "telemetry_sender.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace hebi::util;
+
+namespace {
+
+const uint16_t default_port = 9870;
+
+void print_usage() {
+  std::cout << "Telemetry monitor usage:\n" <<
+  "    -p <port>\n" <<
+  "        UDP port to listen on (default " << default_port << ").\n\n" <<
+  "    -c\n" <<
+  "        Print every frame as CSV, instead of statistics.\n\n" <<
+  "    -l <seconds>\n" <<
+  "        Loopback test: also send synthetic telemetry to this port on localhost\n" <<
+  "        for the given time, and verify the reconstructed values.\n\n" <<
+  "    -h\n" <<
+  "        Print this help and return." << std::endl;
+}
+
+// Synthetic controller-like signals: joint angles, torques, and a few slower
+// or constant values; all are functions of the first channel, the time at
+// which they were computed.
+const double loopback_time_resolution = 1e-4;
+
+std::vector<TelemetryChannel> loopback_channels() {
+  std::vector<TelemetryChannel> channels;
+  channels.push_back({ "t", loopback_time_resolution });
+  for (int i = 0; i < 18; ++i) {
+    channels.push_back({ "position_" + std::to_string(i), 1e-3 });
+  }
+  for (int i = 0; i < 18; ++i) {
+    channels.push_back({ "effort_" + std::to_string(i), 1e-2 });
+  }
+  channels.push_back({ "gravity_x", 1e-3 });
+  channels.push_back({ "gravity_y", 1e-3 });
+  channels.push_back({ "gravity_z", 1e-3 });
+  channels.push_back({ "mode", 1.0 });
+  return channels;
+}
+
+double loopback_value(size_t channel, double t) {
+  if (channel == 0) {
+    return t;
+  } else if (channel < 19) {
+    return 0.5 * std::sin(2.0 * M_PI * 0.8 * t + channel);
+  } else if (channel < 37) {
+    return 4.0 * std::sin(2.0 * M_PI * 1.6 * t + channel) + 0.05 * std::sin(40.0 * t);
+  } else if (channel < 40) {
+    // NaN now and then, as if an IMU dropped out
+    return std::fmod(t, 3.0) < 0.1 ? std::nan("") : (channel == 39 ? -1.0 : 0.02 * std::sin(t));
+  }
+  return std::floor(std::fmod(t / 4.0, 2.0));
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint16_t port = default_port;
+  bool csv = false;
+  double loopback_seconds = 0.0;
+  for (int idx = 1; idx < argc; ++idx) {
+    std::string arg(argv[idx]);
+    if (arg == "-p" && idx + 1 < argc) {
+      port = static_cast<uint16_t>(std::atoi(argv[++idx]));
+    } else if (arg == "-c") {
+      csv = true;
+    } else if (arg == "-l" && idx + 1 < argc) {
+      loopback_seconds = std::atof(argv[++idx]);
+    } else {
+      print_usage();
+      return arg == "-h" ? 0 : 1;
+    }
+  }
+
+  TelemetryReceiver receiver;
+  if (!receiver.open(port)) {
+    std::cerr << "Could not listen on UDP port " << port << std::endl;
+    return 1;
+  }
+
+  std::unique_ptr<TelemetrySender> sender;
+  std::thread loopback_thread;
+  std::vector<TelemetryChannel> channels = loopback_channels();
+  if (loopback_seconds > 0.0) {
+    TelemetrySenderOptions options;
+    options.sample_rate_hz = 100.0;
+    sender.reset(new TelemetrySender(channels, options));
+    if (!sender->start("127.0.0.1", port)) {
+      std::cerr << "Could not start the loopback sender" << std::endl;
+      return 1;
+    }
+    // Publish at 200 Hz, like a control loop; the sender samples at 100 Hz.
+    loopback_thread = std::thread([&] {
+      std::vector<double> values(channels.size());
+      auto start = std::chrono::steady_clock::now();
+      auto next = start;
+      while (std::chrono::steady_clock::now() - start < std::chrono::duration<double>(loopback_seconds)) {
+        double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        for (size_t i = 0; i < values.size(); ++i) {
+          values[i] = loopback_value(i, t);
+        }
+        sender->publish(values.data());
+        next += std::chrono::milliseconds(5);
+        std::this_thread::sleep_until(next);
+      }
+      sender->stop();
+    });
+  }
+
+  std::vector<TelemetryFrame> frames;
+  bool printed_header = false;
+  double max_error_ratio = 0.0;
+  uint64_t checked_frames = 0;
+  auto start = std::chrono::steady_clock::now();
+  auto next_report = start + std::chrono::seconds(1);
+  TelemetryDecoder::Statistics last_stats = receiver.decoder().statistics();
+  while (true) {
+    auto now = std::chrono::steady_clock::now();
+    if (loopback_seconds > 0.0 && now - start > std::chrono::duration<double>(loopback_seconds + 0.5)) {
+      break;
+    }
+
+    frames.clear();
+    receiver.receive(frames, 100);
+    const auto& names = receiver.decoder().channel_names();
+    for (auto& frame : frames) {
+      if (csv) {
+        if (!printed_header && !names.empty()) {
+          std::cout << "time";
+          for (auto& name : names) {
+            std::cout << "," << name;
+          }
+          std::cout << "\n";
+          printed_header = true;
+        }
+        std::cout << frame.time;
+        for (double value : frame.values) {
+          std::cout << ",";
+          if (!std::isnan(value)) {
+            std::cout << value;
+          }
+        }
+        std::cout << "\n";
+      }
+      if (sender && frame.values.size() == channels.size()) {
+        // Recompute every value from the received time, allowing for that
+        // being quantized as well.
+        const auto& resolutions = receiver.decoder().channel_resolutions();
+        double t = frame.values[0];
+        double dt = 0.5 * loopback_time_resolution;
+        for (size_t i = 1; i < channels.size(); ++i) {
+          double expected = loopback_value(i, t);
+          if (std::isnan(frame.values[i]) || std::isnan(expected)) {
+            continue;
+          }
+          double slack = std::max(std::fabs(loopback_value(i, t + dt) - expected),
+            std::fabs(loopback_value(i, t - dt) - expected));
+          double error = std::max(0.0, std::fabs(frame.values[i] - expected) - slack);
+          max_error_ratio = std::max(max_error_ratio, error / resolutions[i]);
+        }
+        ++checked_frames;
+      }
+    }
+
+    if (!csv && now >= next_report) {
+      const auto& stats = receiver.decoder().statistics();
+      std::cout << "frames/s: " << stats.frames - last_stats.frames
+                << "  packets/s: " << stats.packets - last_stats.packets
+                << "  kB/s: " << (stats.bytes - last_stats.bytes) / 1000.0
+                << "  lost packets: " << stats.lost_packets
+                << "  dropped frames: " << stats.dropped_frames
+                << "  bad packets: " << stats.bad_packets
+                << "  channels: " << receiver.decoder().channel_resolutions().size() << std::endl;
+      last_stats = stats;
+      next_report += std::chrono::seconds(1);
+    }
+  }
+
+  loopback_thread.join();
+  auto sent = sender->statistics();
+  const auto& stats = receiver.decoder().statistics();
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "Loopback: sent " << sent.frames << " frames in " << sent.packets << " packets ("
+            << sent.bytes / elapsed / 1000.0 << " kB/s of UDP payload for " << channels.size()
+            << " channels); received " << stats.frames << " frames, lost " << stats.lost_packets
+            << " packets; max error " << max_error_ratio << " x resolution (quantization allows 0.5)" << std::endl;
+  // Quantization alone gives up to half the resolution
+  bool ok = checked_frames > 0 && max_error_ratio <= 0.5 + 1e-6;
+  std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,29 @@
+#include "telemetry_receiver.h"
+#include "udp_socket_internal.h"
+
+namespace hebi {
+namespace util {
+
+// Larger than any datagram that can arrive over UDP/IPv4
+static const size_t max_datagram_size = 65536;
+
+TelemetryReceiver::TelemetryReceiver()
+  : socket_(new UdpSocket()), buffer_(max_datagram_size) {}
+
+TelemetryReceiver::~TelemetryReceiver() = default;
+
+bool TelemetryReceiver::open(uint16_t port) {
+  return socket_->open_receiver(port);
+}
+
+bool TelemetryReceiver::receive(std::vector<TelemetryFrame>& frames, int timeout_ms) {
+  int size = socket_->receive(buffer_.data(), buffer_.size(), timeout_ms);
+  if (size <= 0) {
+    return false;
+  }
+  decoder_.decode(buffer_.data(), static_cast<size_t>(size), frames);
+  return true;
+}
+
+}
+}
@@ -0,0 +1,183 @@
+#include "telemetry_sender.h"
+#include "udp_socket_internal.h"
+#include "../triple_buffer.hpp"
+#include "../trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+
+namespace hebi {
+namespace util {
+
+using clock_type = std::chrono::steady_clock;
+
+//------------------------------------------------------------------------------
+// Internal implementation class
+
+class TelemetrySenderImpl {
+
+public:
+
+  struct Sample {
+    std::vector<double> values;
+    clock_type::time_point time;
+    uint64_t sequence;
+  };
+
+  TelemetrySenderImpl(const std::vector<TelemetryChannel>& channels, const TelemetrySenderOptions& options)
+    : options_(options),
+      encoder_(channels,
+        static_cast<size_t>(std::max(1.0, std::round(options.keyframe_interval_s * options.sample_rate_hz))),
+        options.frames_per_packet, random_session()),
+      samples_(Sample{std::vector<double>(channels.size(), std::nan("")), clock_type::time_point(), 0}) {}
+
+  ~TelemetrySenderImpl() {
+    stop();
+  }
+
+  bool start(const std::string& host, uint16_t port) {
+    stop();
+    if (!socket_.open_sender(host, port)) {
+      return false;
+    }
+    start_time_ = clock_type::now();
+    keep_running_ = true;
+    thread_ = std::thread(&TelemetrySenderImpl::run, this);
+    return true;
+  }
+
+  void stop() {
+    keep_running_ = false;
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  size_t channel_count() const {
+    return encoder_.channels().size();
+  }
+
+  void publish(const double* values) {
+    Sample& sample = samples_.getWriteBuffer();
+    std::copy(values, values + sample.values.size(), sample.values.begin());
+    sample.time = clock_type::now();
+    sample.sequence = ++publish_sequence_;
+    samples_.publish();
+  }
+
+  TelemetrySender::Statistics statistics() const {
+    return TelemetrySender::Statistics{ frames_.load(std::memory_order_relaxed),
+      packets_.load(std::memory_order_relaxed), bytes_.load(std::memory_order_relaxed),
+      send_errors_.load(std::memory_order_relaxed) };
+  }
+
+private:
+
+  static uint32_t random_session() {
+    std::random_device device;
+    return static_cast<uint32_t>(device());
+  }
+
+  void send_packet() {
+    const std::vector<uint8_t>& packet = encoder_.packet();
+    if (socket_.send(packet.data(), packet.size())) {
+      packets_.fetch_add(1, std::memory_order_relaxed);
+      bytes_.fetch_add(packet.size(), std::memory_order_relaxed);
+    } else {
+      send_errors_.fetch_add(1, std::memory_order_relaxed);
+      // The receiver can't use deltas after this; resynchronize it
+      encoder_.force_keyframe();
+    }
+  }
+
+  void run() {
+    HEBI_TRACE_THREAD_NAME("telemetry");
+    auto period = std::chrono::duration_cast<clock_type::duration>(
+      std::chrono::duration<double>(1.0 / options_.sample_rate_hz));
+    auto schema_period = std::chrono::duration_cast<clock_type::duration>(
+      std::chrono::duration<double>(options_.schema_interval_s));
+    auto next_sample = clock_type::now();
+    auto next_schema = next_sample;
+    uint64_t last_sequence = 0;
+
+    while (keep_running_) {
+      next_sample += period;
+      std::this_thread::sleep_until(next_sample);
+
+      auto now = clock_type::now();
+      if (now >= next_schema) {
+        encoder_.make_schema_packet();
+        send_packet();
+        next_schema = now + schema_period;
+      }
+
+      // Only send values that have changed since the last sample
+      samples_.update();
+      const Sample& sample = samples_.getReadBuffer();
+      if (sample.sequence == last_sequence) {
+        continue;
+      }
+      last_sequence = sample.sequence;
+
+      HEBI_TRACE_SCOPE("telemetry frame");
+      double time = std::chrono::duration<double>(sample.time - start_time_).count();
+      frames_.fetch_add(1, std::memory_order_relaxed);
+      if (encoder_.add_frame(time, sample.values.data())) {
+        send_packet();
+      }
+    }
+    if (encoder_.flush()) {
+      send_packet();
+    }
+  }
+
+  TelemetrySenderOptions options_;
+  UdpSocket socket_;
+  TelemetryEncoder encoder_;
+  TripleBuffer<Sample> samples_;
+  // Only touched by the publishing thread
+  uint64_t publish_sequence_{0};
+
+  clock_type::time_point start_time_;
+  std::atomic<bool> keep_running_{false};
+  std::thread thread_;
+
+  std::atomic<uint64_t> frames_{0};
+  std::atomic<uint64_t> packets_{0};
+  std::atomic<uint64_t> bytes_{0};
+  std::atomic<uint64_t> send_errors_{0};
+};
+
+//------------------------------------------------------------------------------
+// TelemetrySender
+
+TelemetrySender::TelemetrySender(const std::vector<TelemetryChannel>& channels, const TelemetrySenderOptions& options)
+  : impl_(new TelemetrySenderImpl(channels, options)) {}
+
+TelemetrySender::~TelemetrySender() = default;
+
+bool TelemetrySender::start(const std::string& host, uint16_t port) {
+  return impl_->start(host, port);
+}
+
+void TelemetrySender::stop() {
+  impl_->stop();
+}
+
+size_t TelemetrySender::channel_count() const {
+  return impl_->channel_count();
+}
+
+void TelemetrySender::publish(const double* values) {
+  impl_->publish(values);
+}
+
+TelemetrySender::Statistics TelemetrySender::statistics() const {
+  return impl_->statistics();
+}
+
+}
+}
@@ -0,0 +1,138 @@
+#include "udp_socket_internal.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace hebi {
+namespace util {
+
+#ifdef _WIN32
+static const SOCKET invalid_socket = INVALID_SOCKET;
+
+// Winsock must be initialized once per process before use
+static bool initialize_winsock() {
+  static bool initialized = [] {
+    WSADATA data;
+    return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+  }();
+  return initialized;
+}
+#else
+static const int invalid_socket = -1;
+#endif
+
+UdpSocket::UdpSocket()
+  : socket_(invalid_socket) {
+  std::memset(&destination_, 0, sizeof(destination_));
+}
+
+UdpSocket::~UdpSocket() {
+  close();
+}
+
+void UdpSocket::close() {
+  if (socket_ == invalid_socket) {
+    return;
+  }
+#ifdef _WIN32
+  closesocket(socket_);
+#else
+  ::close(socket_);
+#endif
+  socket_ = invalid_socket;
+}
+
+bool UdpSocket::is_open() const {
+  return socket_ != invalid_socket;
+}
+
+bool UdpSocket::open_sender(const std::string& host, uint16_t port) {
+#ifdef _WIN32
+  if (!initialize_winsock()) {
+    return false;
+  }
+#endif
+  close();
+
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo* result = nullptr;
+  if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 || result == nullptr) {
+    return false;
+  }
+  std::memcpy(&destination_, result->ai_addr, sizeof(destination_));
+  freeaddrinfo(result);
+  destination_.sin_port = htons(port);
+
+  socket_ = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  return is_open();
+}
+
+bool UdpSocket::open_receiver(uint16_t port) {
+#ifdef _WIN32
+  if (!initialize_winsock()) {
+    return false;
+  }
+#endif
+  close();
+
+  socket_ = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (!is_open()) {
+    return false;
+  }
+  sockaddr_in local;
+  std::memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  local.sin_port = htons(port);
+  if (::bind(socket_, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) != 0) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool UdpSocket::send(const uint8_t* data, size_t size) {
+  if (!is_open()) {
+    return false;
+  }
+  auto sent = ::sendto(socket_, reinterpret_cast<const char*>(data), static_cast<int>(size), 0,
+    reinterpret_cast<const sockaddr*>(&destination_), sizeof(destination_));
+  return sent == static_cast<decltype(sent)>(size);
+}
+
+int UdpSocket::receive(uint8_t* buffer, size_t capacity, int timeout_ms) {
+  if (!is_open()) {
+    return -1;
+  }
+#ifdef _WIN32
+  WSAPOLLFD fd;
+  fd.fd = socket_;
+  fd.events = POLLRDNORM;
+  int ready = WSAPoll(&fd, 1, timeout_ms);
+#else
+  pollfd fd;
+  fd.fd = socket_;
+  fd.events = POLLIN;
+  int ready = ::poll(&fd, 1, timeout_ms);
+#endif
+  if (ready <= 0) {
+    return ready;
+  }
+  auto received = ::recv(socket_, reinterpret_cast<char*>(buffer), static_cast<int>(capacity), 0);
+  return received < 0 ? -1 : static_cast<int>(received);
+}
+
+}
+}
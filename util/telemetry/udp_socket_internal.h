@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#endif
+
+namespace hebi {
+namespace util {
+
+// An internal class - you should not be using this directly.
+//
+// A minimal UDP socket: either "connected" to one destination for sending, or
+// bound to a local port for receiving.
+class UdpSocket {
+
+public:
+
+  UdpSocket();
+  ~UdpSocket();
+
+  UdpSocket(const UdpSocket&) = delete;
+  UdpSocket& operator=(const UdpSocket&) = delete;
+
+  // Resolves `host` (a name or dotted address) and sets it as the destination.
+  bool open_sender(const std::string& host, uint16_t port);
+
+  // Binds to `port` on all interfaces.
+  bool open_receiver(uint16_t port);
+
+  bool is_open() const;
+
+  // Returns false if the datagram could not be handed to the OS.
+  bool send(const uint8_t* data, size_t size);
+
+  // Waits up to `timeout_ms` for a datagram; returns its size, 0 on timeout,
+  // or -1 on error.
+  int receive(uint8_t* buffer, size_t capacity, int timeout_ms);
+
+private:
+
+  void close();
+
+#ifdef _WIN32
+  SOCKET socket_;
+#else
+  int socket_;
+#endif
+  sockaddr_in destination_;
+};
+
+}
+}
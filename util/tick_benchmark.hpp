@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <ostream>
+#include <vector>
+
+namespace hebi {
+namespace util {
+
+/**
+ * Collects per-tick statistics for a control loop that is run as fast as
+ * possible (e.g., against a dummy robot), to measure how much headroom there
+ * is compared to the control period.
+ *
+ * Call `beginTick` and `endTick` around each tick, and `report` at the end.
+ * Storage for `max_ticks` samples is allocated up front, so recording does not
+ * allocate; ticks past that are still counted in the totals, but not in the
+ * latency percentiles.
+ *
+ * Heap allocations are only counted if the program expands
+ * HEBI_BENCHMARK_COUNT_ALLOCATIONS() once at namespace scope, in one
+ * translation unit.
+ */
+class TickBenchmark
+{
+public:
+  explicit TickBenchmark(size_t max_ticks)
+  {
+    durations_ns_.reserve(max_ticks);
+    allocations_.reserve(max_ticks);
+  }
+
+  void beginTick()
+  {
+    tick_allocations_ = allocationCount().load(std::memory_order_relaxed);
+    tick_bytes_ = allocationBytes().load(std::memory_order_relaxed);
+    tick_start_ = clock::now();
+  }
+
+  void endTick()
+  {
+    auto end = clock::now();
+    uint64_t duration_ns = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - tick_start_).count());
+    uint64_t allocations = allocationCount().load(std::memory_order_relaxed) - tick_allocations_;
+    total_ns_ += duration_ns;
+    total_allocations_ += allocations;
+    total_bytes_ += allocationBytes().load(std::memory_order_relaxed) - tick_bytes_;
+    ++num_ticks_;
+    if (durations_ns_.size() < durations_ns_.capacity())
+    {
+      durations_ns_.push_back(duration_ns);
+      allocations_.push_back(allocations);
+    }
+  }
+
+  size_t getNumTicks() const { return num_ticks_; }
+
+  /**
+   * Writes a summary: sustained ticks per second (and how that compares to the
+   * given control period), tick latency percentiles, and allocations per tick.
+   */
+  void report(std::ostream& out, double control_period_s) const
+  {
+    if (num_ticks_ == 0)
+    {
+      out << "No ticks recorded." << std::endl;
+      return;
+    }
+    std::vector<uint64_t> sorted(durations_ns_);
+    std::sort(sorted.begin(), sorted.end());
+    double total_s = total_ns_ * 1e-9;
+    double ticks_per_s = num_ticks_ / total_s;
+    size_t ticks_with_allocations = std::count_if(allocations_.begin(), allocations_.end(),
+      [](uint64_t allocations) { return allocations > 0; });
+
+    auto flags = out.flags();
+    out << std::fixed << std::setprecision(1);
+    out << "Ticks:             " << num_ticks_ << " in " << std::setprecision(3) << total_s << " s of tick time\n";
+    out << std::setprecision(1);
+    out << "Sustained rate:    " << ticks_per_s << " ticks/s ("
+        << ticks_per_s * control_period_s << "x the " << 1.0 / control_period_s << " Hz control rate)\n";
+    out << "Tick latency (us): p50 " << percentileUs(sorted, 0.5)
+        << "  p90 " << percentileUs(sorted, 0.9)
+        << "  p99 " << percentileUs(sorted, 0.99)
+        << "  p99.9 " << percentileUs(sorted, 0.999)
+        << "  max " << sorted.back() * 1e-3 << "\n";
+    if (countingAllocations())
+    {
+      out << "Allocations:       " << static_cast<double>(total_allocations_) / num_ticks_ << " per tick ("
+          << static_cast<double>(total_bytes_) / num_ticks_ << " bytes); "
+          << ticks_with_allocations << " of " << allocations_.size() << " ticks allocated\n";
+    }
+    else
+    {
+      out << "Allocations:       not counted\n";
+    }
+    out.flags(flags);
+    out << std::flush;
+  }
+
+  // Allocation counters, updated by the functions that
+  // HEBI_BENCHMARK_COUNT_ALLOCATIONS() defines.
+  static std::atomic<uint64_t>& allocationCount()
+  {
+    static std::atomic<uint64_t> count{0};
+    return count;
+  }
+  static std::atomic<uint64_t>& allocationBytes()
+  {
+    static std::atomic<uint64_t> bytes{0};
+    return bytes;
+  }
+  static std::atomic<bool>& countingAllocations()
+  {
+    static std::atomic<bool> counting{false};
+    return counting;
+  }
+  static void countAllocation(size_t size)
+  {
+    allocationCount().fetch_add(1, std::memory_order_relaxed);
+    allocationBytes().fetch_add(size, std::memory_order_relaxed);
+  }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  static double percentileUs(const std::vector<uint64_t>& sorted, double fraction)
+  {
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+    return sorted[index] * 1e-3;
+  }
+
+  std::vector<uint64_t> durations_ns_;
+  std::vector<uint64_t> allocations_;
+  clock::time_point tick_start_;
+  uint64_t tick_allocations_ = 0;
+  uint64_t tick_bytes_ = 0;
+  size_t num_ticks_ = 0;
+  uint64_t total_ns_ = 0;
+  uint64_t total_allocations_ = 0;
+  uint64_t total_bytes_ = 0;
+};
+
+} // namespace util
+} // namespace hebi
+
+// Replaces the global allocation functions with ones that count into
+// TickBenchmark.  With glibc, malloc itself is interposed, so allocations made
+// directly with malloc (e.g., by Eigen, or the C API) are counted as well;
+// elsewhere, only operator new is.
+#if defined(__GLIBC__)
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t num, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+#define HEBI_BENCHMARK_COUNT_ALLOCATIONS()                                            \
+  extern "C" void* malloc(size_t size)                                                \
+  {                                                                                   \
+    ::hebi::util::TickBenchmark::countAllocation(size);                               \
+    return __libc_malloc(size);                                                       \
+  }                                                                                   \
+  extern "C" void* calloc(size_t num, size_t size)                                    \
+  {                                                                                   \
+    ::hebi::util::TickBenchmark::countAllocation(num * size);                         \
+    return __libc_calloc(num, size);                                                  \
+  }                                                                                   \
+  extern "C" void* realloc(void* ptr, size_t size)                                    \
+  {                                                                                   \
+    ::hebi::util::TickBenchmark::countAllocation(size);                               \
+    return __libc_realloc(ptr, size);                                                 \
+  }                                                                                   \
+  static const bool hebi_benchmark_counting_allocations =                             \
+    (::hebi::util::TickBenchmark::countingAllocations() = true)
+#else
+#define HEBI_BENCHMARK_COUNT_ALLOCATIONS()                                            \
+  void* operator new(std::size_t size)                                                \
+  {                                                                                   \
+    ::hebi::util::TickBenchmark::countAllocation(size);                               \
+    if (void* ptr = std::malloc(size ? size : 1))                                     \
+      return ptr;                                                                     \
+    throw std::bad_alloc();                                                           \
+  }                                                                                   \
+  void* operator new[](std::size_t size) { return ::operator new(size); }             \
+  void operator delete(void* ptr) noexcept { std::free(ptr); }                        \
+  void operator delete[](void* ptr) noexcept { std::free(ptr); }                      \
+  static const bool hebi_benchmark_counting_allocations =                             \
+    (::hebi::util::TickBenchmark::countingAllocations() = true)
+#endif
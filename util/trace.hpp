@@ -0,0 +1,379 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace hebi {
+namespace util {
+
+/**
+ * Lightweight timeline tracing across threads.
+ *
+ * Each thread that records an event gets its own fixed-size event buffer; the
+ * thread writes into it without locking (it is a single producer, single
+ * consumer ring, with the exporter as the consumer).  `writeChromeTrace` drains
+ * all of the buffers, merges them, and writes a Chrome trace-event JSON file
+ * that can be opened in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Tracing is disabled by default; while disabled, each trace point costs a
+ * single relaxed atomic load.  Define HEBI_DISABLE_TRACING to compile the
+ * macros out completely.
+ *
+ * Event and thread names are stored by pointer, so they must have static
+ * lifetime (e.g., string literals).
+ *
+ * Usage:
+ *   hebi::util::Tracer::get().setEnabled(true);
+ *   ...
+ *   {
+ *     HEBI_TRACE_SCOPE("control tick");
+ *     auto lock = hebi::util::tracedLock(my_mutex, "wait my_mutex");
+ *     ...
+ *   }
+ *   hebi::util::Tracer::get().writeChromeTrace("trace.json");
+ */
+class Tracer
+{
+public:
+  enum class Phase : char { Begin = 'B', End = 'E', Instant = 'i' };
+
+  struct Event
+  {
+    const char* name_;
+    uint64_t time_ns_;
+    int64_t value_;
+    Phase phase_;
+    bool has_value_;
+  };
+
+  /**
+   * The process-wide tracer.
+   */
+  static Tracer& get()
+  {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  Tracer(const Tracer&) = delete;
+  Tracer& operator=(const Tracer&) = delete;
+
+  void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+  bool isEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  /**
+   * Sets the number of events each thread's buffer can hold before events are
+   * dropped (rounded up to a power of two).  Only affects threads that have not
+   * recorded any events yet.
+   */
+  void setBufferCapacity(size_t events)
+  {
+    size_t capacity = 1;
+    while (capacity < events)
+      capacity <<= 1;
+    buffer_capacity_.store(capacity, std::memory_order_relaxed);
+  }
+
+  /**
+   * Names the calling thread on the timeline.  This does not allocate the
+   * thread's buffer, so it is cheap to call even when tracing is disabled.
+   */
+  void setThreadName(const char* name)
+  {
+    ThreadState& state = threadState();
+    state.name_ = name;
+    if (state.buffer_)
+      state.buffer_->name_.store(name, std::memory_order_relaxed);
+  }
+
+  void begin(const char* name) { record(name, Phase::Begin, 0, false); }
+  void end(const char* name) { record(name, Phase::End, 0, false); }
+  void instant(const char* name) { record(name, Phase::Instant, 0, false); }
+  void instant(const char* name, int64_t value) { record(name, Phase::Instant, value, true); }
+
+  /**
+   * Moves the events recorded so far out of the per-thread buffers into the
+   * tracer's own storage.  For long traces, call this periodically (from any
+   * thread) so the per-thread buffers don't fill up.
+   */
+  void collect()
+  {
+    std::lock_guard<std::mutex> lock(buffers_lock_);
+    collectLocked();
+  }
+
+  /**
+   * Discards all collected and buffered events.
+   */
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(buffers_lock_);
+    collectLocked();
+    collected_.clear();
+    dropped_ = 0;
+  }
+
+  /**
+   * Collects any outstanding events, and writes all events recorded since the
+   * start (or the last `clear`) as a Chrome trace-event JSON file.  Safe to
+   * call while other threads are recording.  Returns false if the file could
+   * not be written.
+   */
+  bool writeChromeTrace(const std::string& file)
+  {
+    std::vector<TaggedEvent> events;
+    std::vector<std::pair<int, const char*>> names;
+    uint64_t dropped;
+    {
+      std::lock_guard<std::mutex> lock(buffers_lock_);
+      collectLocked();
+      events = collected_;
+      for (auto& buffer : buffers_)
+        names.emplace_back(buffer->tid_, buffer->name_.load(std::memory_order_relaxed));
+      dropped = dropped_;
+    }
+
+    // Events are already ordered within each thread; a stable sort keeps
+    // begin/end pairs with equal timestamps in order.
+    std::stable_sort(events.begin(), events.end(),
+      [](const TaggedEvent& a, const TaggedEvent& b) { return a.event_.time_ns_ < b.event_.time_ns_; });
+
+    std::ofstream out(file);
+    if (!out)
+      return false;
+
+    out << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":" << dropped << "},\n";
+    out << "\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& name : names)
+    {
+      if (!first)
+        out << ",\n";
+      first = false;
+      out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << name.first
+          << ",\"args\":{\"name\":\"";
+      if (name.second)
+        writeEscaped(out, name.second);
+      else
+        out << "thread " << name.first;
+      out << "\"}}";
+    }
+    for (const auto& tagged : events)
+    {
+      const Event& e = tagged.event_;
+      if (!first)
+        out << ",\n";
+      first = false;
+      out << "{\"name\":\"";
+      writeEscaped(out, e.name_);
+      out << "\",\"ph\":\"" << static_cast<char>(e.phase_) << "\",\"pid\":1,\"tid\":" << tagged.tid_
+          << ",\"ts\":" << e.time_ns_ / 1000 << "." << digits3(e.time_ns_ % 1000);
+      if (e.phase_ == Phase::Instant)
+        out << ",\"s\":\"t\"";
+      if (e.has_value_)
+        out << ",\"args\":{\"value\":" << e.value_ << "}";
+      out << "}";
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+  }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  class ThreadBuffer
+  {
+  public:
+    ThreadBuffer(int tid, size_t capacity)
+      : tid_(tid), mask_(capacity - 1), events_(capacity)
+    {
+    }
+
+    // Called only by the owning thread.
+    void push(const Event& event)
+    {
+      uint64_t head = head_.load(std::memory_order_relaxed);
+      if (head - tail_.load(std::memory_order_acquire) > mask_)
+      {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      events_[head & mask_] = event;
+      head_.store(head + 1, std::memory_order_release);
+    }
+
+    // Called only by the exporter (with the tracer's buffer lock held).
+    bool pop(Event& event)
+    {
+      uint64_t tail = tail_.load(std::memory_order_relaxed);
+      if (tail == head_.load(std::memory_order_acquire))
+        return false;
+      event = events_[tail & mask_];
+      tail_.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    const int tid_;
+    std::atomic<const char*> name_{nullptr};
+    std::atomic<uint64_t> dropped_{0};
+
+  private:
+    const uint64_t mask_;
+    std::vector<Event> events_;
+    std::atomic<uint64_t> head_{0};
+    char padding_[64];
+    std::atomic<uint64_t> tail_{0};
+  };
+
+  struct TaggedEvent
+  {
+    Event event_;
+    int tid_;
+  };
+
+  Tracer() : epoch_(clock::now()) {}
+
+  void collectLocked()
+  {
+    for (auto& buffer : buffers_)
+    {
+      Event event;
+      while (buffer->pop(event))
+        collected_.push_back(TaggedEvent{event, buffer->tid_});
+      dropped_ += buffer->dropped_.exchange(0, std::memory_order_relaxed);
+    }
+  }
+
+  struct ThreadState
+  {
+    ThreadBuffer* buffer_;
+    const char* name_;
+  };
+
+  static ThreadState& threadState()
+  {
+    static thread_local ThreadState state{nullptr, nullptr};
+    return state;
+  }
+
+  // Buffers are owned by the tracer rather than the thread, so that events
+  // from threads which have exited can still be exported.
+  ThreadBuffer& threadBuffer()
+  {
+    ThreadState& state = threadState();
+    if (!state.buffer_)
+    {
+      std::lock_guard<std::mutex> lock(buffers_lock_);
+      buffers_.emplace_back(new ThreadBuffer(static_cast<int>(buffers_.size()) + 1,
+        buffer_capacity_.load(std::memory_order_relaxed)));
+      state.buffer_ = buffers_.back().get();
+      state.buffer_->name_.store(state.name_, std::memory_order_relaxed);
+    }
+    return *state.buffer_;
+  }
+
+  void record(const char* name, Phase phase, int64_t value, bool has_value)
+  {
+    if (!isEnabled())
+      return;
+    uint64_t time_ns = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - epoch_).count());
+    threadBuffer().push(Event{name, time_ns, value, phase, has_value});
+  }
+
+  static void writeEscaped(std::ostream& out, const char* str)
+  {
+    for (; *str; ++str)
+    {
+      if (*str == '"' || *str == '\\')
+        out << '\\';
+      if (static_cast<unsigned char>(*str) >= 0x20)
+        out << *str;
+    }
+  }
+
+  static std::string digits3(uint64_t value)
+  {
+    char buf[4] = { static_cast<char>('0' + value / 100), static_cast<char>('0' + (value / 10) % 10),
+                    static_cast<char>('0' + value % 10), '\0' };
+    return buf;
+  }
+
+  const clock::time_point epoch_;
+  std::atomic<bool> enabled_{false};
+  std::atomic<size_t> buffer_capacity_{1 << 16};
+
+  // Protects the list of buffers, and the collected events.
+  std::mutex buffers_lock_;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+  std::vector<TaggedEvent> collected_;
+  uint64_t dropped_{0};
+};
+
+/**
+ * Records a begin event on construction, and the matching end event on
+ * destruction.
+ */
+class TraceScope
+{
+public:
+  explicit TraceScope(const char* name) : name_(name), active_(Tracer::get().isEnabled())
+  {
+    if (active_)
+      Tracer::get().begin(name_);
+  }
+  ~TraceScope()
+  {
+    if (active_)
+      Tracer::get().end(name_);
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+  const char* name_;
+  const bool active_;
+};
+
+/**
+ * Locks a mutex, recording a trace scope for the time spent waiting if it was
+ * contended (uncontended acquisitions are not recorded).
+ */
+template <typename Mutex>
+std::unique_lock<Mutex> tracedLock(Mutex& mutex, const char* wait_name)
+{
+  if (!Tracer::get().isEnabled())
+    return std::unique_lock<Mutex>(mutex);
+  if (mutex.try_lock())
+    return std::unique_lock<Mutex>(mutex, std::adopt_lock);
+  TraceScope wait(wait_name);
+  return std::unique_lock<Mutex>(mutex);
+}
+
+} // namespace util
+} // namespace hebi
+
+#define HEBI_TRACE_CONCAT_INNER(a, b) a##b
+#define HEBI_TRACE_CONCAT(a, b) HEBI_TRACE_CONCAT_INNER(a, b)
+
+#ifndef HEBI_DISABLE_TRACING
+#define HEBI_TRACE_SCOPE(name) \
+  ::hebi::util::TraceScope HEBI_TRACE_CONCAT(hebi_trace_scope_, __LINE__)(name)
+#define HEBI_TRACE_INSTANT(name) ::hebi::util::Tracer::get().instant(name)
+#define HEBI_TRACE_VALUE(name, value) \
+  ::hebi::util::Tracer::get().instant(name, static_cast<int64_t>(value))
+#define HEBI_TRACE_THREAD_NAME(name) ::hebi::util::Tracer::get().setThreadName(name)
+#else
+#define HEBI_TRACE_SCOPE(name) do {} while (0)
+#define HEBI_TRACE_INSTANT(name) do {} while (0)
+#define HEBI_TRACE_VALUE(name, value) do {} while (0)
+#define HEBI_TRACE_THREAD_NAME(name) do {} while (0)
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "trajectory.hpp"
+#include "quintic_spline.hpp"
+
+#include <Eigen/Dense>
+
+#include <memory>
+
+namespace hebi {
+namespace util {
+
+/**
+ * Creates the minimum-jerk joint trajectories that the kits plan every step.
+ *
+ * By default, this is hebi::trajectory::Trajectory::createUnconstrainedQp.
+ * When built with HEBI_EXAMPLES_CACHED_SPLINES, it is a util::QuinticSplineBuilder
+ * instead, which reuses the solved system when a time grid repeats.  Only
+ * turn that on once advanced/trajectories/trajectory_builder_benchmark has
+ * shown that its trajectories match createUnconstrainedQp's for the HEBI
+ * library in use.
+ *
+ * Not thread safe: give each thread that plans trajectories its own builder.
+ */
+class TrajectoryBuilder
+{
+public:
+#ifdef HEBI_EXAMPLES_CACHED_SPLINES
+  using Trajectory = QuinticSpline;
+#else
+  using Trajectory = trajectory::Trajectory;
+#endif
+
+  /**
+   * As trajectory::Trajectory::createUnconstrainedQp; NaN velocities or
+   * accelerations are free.
+   */
+  std::shared_ptr<Trajectory> create(const Eigen::VectorXd& times, const Eigen::MatrixXd& positions,
+    const Eigen::MatrixXd* velocities = nullptr, const Eigen::MatrixXd* accelerations = nullptr)
+  {
+#ifdef HEBI_EXAMPLES_CACHED_SPLINES
+    return builder_.create(times, positions, velocities, accelerations);
+#else
+    return trajectory::Trajectory::createUnconstrainedQp(times, positions, velocities, accelerations);
+#endif
+  }
+
+  /**
+   * As `create`, for one-off time grids that aren't worth caching.
+   */
+  static std::shared_ptr<Trajectory> createUncached(const Eigen::VectorXd& times, const Eigen::MatrixXd& positions,
+    const Eigen::MatrixXd* velocities = nullptr, const Eigen::MatrixXd* accelerations = nullptr)
+  {
+#ifdef HEBI_EXAMPLES_CACHED_SPLINES
+    return QuinticSplineBuilder::createUncached(times, positions, velocities, accelerations);
+#else
+    return trajectory::Trajectory::createUnconstrainedQp(times, positions, velocities, accelerations);
+#endif
+  }
+
+#ifdef HEBI_EXAMPLES_CACHED_SPLINES
+private:
+  QuinticSplineBuilder builder_;
+#endif
+};
+
+} // namespace util
+} // namespace hebi
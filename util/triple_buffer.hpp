@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace hebi {
+namespace util {
+
+/**
+ * A lock-free triple buffer for handing the latest value of some state from a
+ * single writer thread to a single reader thread.
+ *
+ * The writer fills in the buffer from `getWriteBuffer` and calls `publish`;
+ * the reader calls `update` and then reads `getReadBuffer`.  Neither side ever
+ * blocks or allocates, and the reader always sees the most recently published
+ * value (intermediate values may be skipped).
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+  TripleBuffer() : TripleBuffer(T()) {}
+
+  explicit TripleBuffer(const T& initial)
+  {
+    for (auto& slot : slots_)
+      slot.value_ = initial;
+  }
+
+  TripleBuffer(const TripleBuffer&) = delete;
+  TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+  ////////////////////////////////////////////////////////////////////////////
+  // Writer side
+
+  /**
+   * The buffer the writer may fill in.  Note that this holds whatever value was
+   * in it when last swapped out, not necessarily the last published value.
+   */
+  T& getWriteBuffer() { return slots_[write_].value_; }
+
+  /**
+   * Makes the contents of the write buffer available to the reader.
+   */
+  void publish()
+  {
+    write_ = middle_.exchange(write_ | fresh_bit_, std::memory_order_acq_rel) & index_mask_;
+  }
+
+  /**
+   * Copies a value into the write buffer and publishes it.
+   */
+  void write(const T& value)
+  {
+    getWriteBuffer() = value;
+    publish();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////
+  // Reader side
+
+  /**
+   * Swaps in the most recently published value, if there is one that has not
+   * been read yet.  Returns true if the read buffer changed.
+   */
+  bool update()
+  {
+    if ((middle_.load(std::memory_order_relaxed) & fresh_bit_) == 0)
+      return false;
+    read_ = middle_.exchange(read_, std::memory_order_acq_rel) & index_mask_;
+    return true;
+  }
+
+  /**
+   * The value most recently swapped in by `update`.
+   */
+  const T& getReadBuffer() const { return slots_[read_].value_; }
+
+  /**
+   * Returns the latest published value.
+   */
+  const T& read()
+  {
+    update();
+    return getReadBuffer();
+  }
+
+private:
+  static constexpr uint8_t index_mask_ = 0x3;
+  static constexpr uint8_t fresh_bit_ = 0x4;
+
+  // Pad each slot so the reader and writer don't share cache lines.
+  struct Slot
+  {
+    T value_;
+    char padding_[64];
+  };
+  Slot slots_[3];
+
+  uint8_t write_{0};
+  char write_padding_[64];
+  std::atomic<uint8_t> middle_{1};
+  char middle_padding_[64];
+  uint8_t read_{2};
+};
+
+template <typename T> constexpr uint8_t TripleBuffer<T>::index_mask_;
+template <typename T> constexpr uint8_t TripleBuffer<T>::fresh_bit_;
+
+} // namespace util
+} // namespace hebi